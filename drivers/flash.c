@@ -3,8 +3,16 @@
  * @brief Flash Memory Driver Implementation
  *
  * RAM-based simulation for testing (can be overridden with platform-specific implementations)
+ *
+ * One operation runs at a time; queued operations form a FIFO list of
+ * requests. Internal requests live in the two page buffers (one open for
+ * writes while the other is programmed) and in a small erase pool.
+ *
+ * Injected errors and tears are placed with a seeded xorshift generator,
+ * so a failing run can be replayed with the same configuration.
  */
 
+#include "tinyos.h"
 #include "flash.h"
 #include <string.h>
 #include <stdio.h>
@@ -19,6 +27,48 @@ static bool write_protection_enabled = false;
 static uint32_t protected_start = 0;
 static uint32_t protected_size = 0;
 
+static flash_sim_config_t sim_config = {
+    .nor_semantics = FLASH_SIM_NOR,
+    .program_setup_us = FLASH_SIM_PROGRAM_SETUP_US,
+    .program_byte_ns = FLASH_SIM_PROGRAM_BYTE_NS,
+    .sector_erase_us = FLASH_SIM_SECTOR_ERASE_US,
+    .seed = 1
+};
+static flash_sim_stats_t sim_stats;
+static uint32_t erase_counts[FLASH_TOTAL_SIZE / FLASH_SECTOR_SIZE];
+static uint32_t sim_random_state = 1;
+static uint32_t program_error_countdown = 0;    /* Bits until the next injected error */
+static uint32_t read_error_countdown = 0;
+static uint32_t power_loss_countdown = 0;       /* Program/erase operations, 0 = off */
+static bool powered_off = false;
+
+/* ============================================================================
+ * Queue and Page Buffers
+ * ============================================================================ */
+
+typedef struct {
+    flash_request_t request;             /* Program of this page once queued */
+    uint32_t address;                    /* Page address */
+    uint32_t dirty_start;                /* Written range within the page */
+    uint32_t dirty_end;
+    uint8_t data[FLASH_PAGE_SIZE];       /* The page as it will be, outside the range too */
+} page_buffer_t;
+
+static page_buffer_t page_buffers[2];
+static page_buffer_t *open_page = NULL;  /* Accepting writes */
+
+static flash_request_t erase_pool[FLASH_ERASE_QUEUE_SIZE];
+
+static flash_request_t *queue_head = NULL;
+static flash_request_t *queue_tail = NULL;
+static flash_request_t *running = NULL;  /* Operation the device is busy with */
+static uint64_t busy_until_us = 0;       /* When the running operation completes */
+static bool processing = false;          /* flash_process() is running */
+static event_group_t flash_events;       /* FLASH_EV_DONE when an operation completes */
+
+#define FLASH_EV_DONE           0x01
+static flash_error_t deferred_error = FLASH_OK;     /* First failure of an internal request */
+
 /* ============================================================================
  * Error Strings
  * ============================================================================ */
@@ -44,10 +94,6 @@ static bool is_address_valid(uint32_t address, size_t size) {
     return size <= FLASH_TOTAL_SIZE && address <= FLASH_TOTAL_SIZE - size;
 }
 
-static bool is_sector_aligned(uint32_t address) {
-    return (address % FLASH_SECTOR_SIZE) == 0;
-}
-
 static bool is_write_protected_range(uint32_t address, size_t size) {
     if (!write_protection_enabled) {
         return false;
@@ -59,6 +105,370 @@ static bool is_write_protected_range(uint32_t address, size_t size) {
     return !((end <= protected_start) || (address >= protected_end));
 }
 
+static bool ranges_overlap(uint32_t a, size_t a_size, uint32_t b, size_t b_size) {
+    return a < b + b_size && b < a + a_size;
+}
+
+/**
+ * @brief Range an operation changes (erases cover whole sectors)
+ */
+static void request_extent(const flash_request_t *request, uint32_t *start, size_t *size) {
+    if (request->op == FLASH_OP_ERASE) {
+        *start = (request->address / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE;
+        *size = ((request->address + request->size + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE) *
+                FLASH_SECTOR_SIZE - *start;
+    } else {
+        *start = request->address;
+        *size = request->size;
+    }
+}
+
+static uint64_t now_us(void) {
+    return (uint64_t)os_get_uptime_ms() * 1000;
+}
+
+/**
+ * @brief Block until an operation completes or the running one is due
+ *
+ * flash_process() signals each completion, so a platform completing
+ * operations from its flash interrupt wakes the waiter early.
+ */
+static void wait_step(void) {
+    if (os_task_get_current() == NULL) {
+        /* No scheduler, so possibly no tick: complete the operation now */
+        busy_until_us = 0;
+        return;
+    }
+
+    uint32_t state = os_enter_critical();
+    uint64_t until = busy_until_us;
+    os_exit_critical(state);
+
+    uint64_t now = now_us();
+    uint32_t ticks = 1;
+    if (until > now) {
+        ticks = (uint32_t)(((until - now) * TICK_RATE_HZ + 999999) / 1000000);
+    }
+    os_event_group_wait_bits(&flash_events, FLASH_EV_DONE, EVENT_WAIT_ANY | EVENT_CLEAR_ON_EXIT,
+                             NULL, ticks);
+}
+
+/* ============================================================================
+ * Operation Execution
+ * ============================================================================ */
+
+static uint32_t sim_random(void) {
+    sim_random_state ^= sim_random_state << 13;
+    sim_random_state ^= sim_random_state >> 17;
+    sim_random_state ^= sim_random_state << 5;
+    return sim_random_state;
+}
+
+/**
+ * @brief Bits until the next injected error, interval bits apart on average
+ */
+static uint32_t sim_error_gap(uint32_t interval) {
+    return (interval == 0) ? 0 : 1 + sim_random() % (2 * interval);
+}
+
+/**
+ * @brief Inject errors into bytes as their bits go by
+ * @param set_bits true: the bit is left erased (program), false: flipped (read)
+ * @return Bits changed
+ */
+static uint32_t sim_inject(uint8_t *bytes, size_t size, uint32_t interval, uint32_t *countdown, bool set_bits) {
+    uint32_t changed = 0;
+
+    if (interval == 0) {
+        return 0;
+    }
+
+    uint64_t bits = (uint64_t)size * 8;
+    uint64_t position = 0;
+    while (*countdown <= bits - position) {
+        position += *countdown;
+        uint8_t *byte = &bytes[(position - 1) / 8];
+        uint8_t mask = (uint8_t)(1u << ((position - 1) % 8));
+
+        if (!set_bits || !(*byte & mask)) {
+            *byte ^= mask;
+            changed++;
+        }
+        *countdown = sim_error_gap(interval);
+    }
+    *countdown -= (uint32_t)(bits - position);
+
+    return changed;
+}
+
+/**
+ * @brief Count down to an injected power loss
+ * @return true if power fails during this operation
+ */
+static bool sim_power_fails(void) {
+    return power_loss_countdown != 0 && --power_loss_countdown == 0;
+}
+
+/**
+ * @brief Drop power: the queue, page buffers and running operation are gone
+ */
+static void sim_power_off(void) {
+    uint32_t state = os_enter_critical();
+
+    while (queue_head != NULL) {
+        flash_request_t *request = queue_head;
+        queue_head = request->next;
+        request->result = FLASH_ERROR_TIMEOUT;
+        request->pending = false;
+    }
+    queue_tail = NULL;
+
+    if (running != NULL) {
+        running->result = FLASH_ERROR_TIMEOUT;
+        running->pending = false;
+        running = NULL;
+    }
+
+    open_page = NULL;
+    busy_until_us = 0;
+    powered_off = true;
+    sim_stats.power_losses++;
+
+    os_exit_critical(state);
+}
+
+static flash_error_t program_now(uint32_t address, const void *buffer, size_t size) {
+    /* Call platform-specific write if available */
+    if (platform_flash_write(address, buffer, size) == FLASH_OK) {
+        return FLASH_OK;
+    }
+
+    /* Use simulated flash; a power loss stops it part way through a byte */
+    const uint8_t *data = (const uint8_t *)buffer;
+    bool torn = sim_power_fails();
+    size_t length = torn ? sim_random() % size : size;
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t old = simulated_flash[address + i];
+        for (uint8_t raised = data[i] & (uint8_t)~old; raised; raised &= raised - 1) {
+            sim_stats.overwrite_bits++;
+        }
+        simulated_flash[address + i] = sim_config.nor_semantics ? (old & data[i]) : data[i];
+    }
+    sim_stats.program_bit_errors += sim_inject(&simulated_flash[address], length,
+                                               sim_config.program_error_interval,
+                                               &program_error_countdown, true);
+
+    uint64_t time_us = sim_config.program_setup_us + ((uint64_t)length * sim_config.program_byte_ns) / 1000;
+    busy_until_us += time_us;
+    sim_stats.busy_us += time_us;
+    sim_stats.programs++;
+    sim_stats.bytes_programmed += length;
+
+    if (torn) {
+        simulated_flash[address + length] &= data[length] | (uint8_t)sim_random();
+        sim_power_off();
+        return FLASH_ERROR_WRITE_FAILED;
+    }
+    return FLASH_OK;
+}
+
+static flash_error_t erase_now(uint32_t sector_address) {
+    /* Call platform-specific erase if available */
+    if (platform_flash_erase_sector(sector_address) == FLASH_OK) {
+        return FLASH_OK;
+    }
+
+    /* Erase sector (set to 0xFF); a power loss leaves part of it as it was */
+    bool torn = sim_power_fails();
+    memset(&simulated_flash[sector_address], 0xFF, torn ? sim_random() % FLASH_SECTOR_SIZE : FLASH_SECTOR_SIZE);
+
+    busy_until_us += sim_config.sector_erase_us;
+    sim_stats.busy_us += sim_config.sector_erase_us;
+    sim_stats.erases++;
+    erase_counts[sector_address / FLASH_SECTOR_SIZE]++;
+
+    if (torn) {
+        sim_power_off();
+        return FLASH_ERROR_ERASE_FAILED;
+    }
+    return FLASH_OK;
+}
+
+/**
+ * @brief Start the operation at the head of the queue
+ *
+ * The simulation applies the data at once and stays busy for the modelled
+ * time. A queued operation starts when the one before it completes, as it
+ * would from the flash interrupt, even if nobody called flash_process().
+ */
+static void start_next(void) {
+    uint32_t state = os_enter_critical();
+    flash_request_t *request = queue_head;
+    queue_head = request->next;
+    if (queue_head == NULL) {
+        queue_tail = NULL;
+    }
+    os_exit_critical(state);
+
+    if (busy_until_us < request->submit_us) {
+        busy_until_us = request->submit_us;
+    }
+
+    flash_error_t err = FLASH_OK;
+    if (request->op == FLASH_OP_PROGRAM) {
+        err = program_now(request->address, request->buffer, request->size);
+    } else {
+        uint32_t start;
+        size_t size;
+        request_extent(request, &start, &size);
+        for (uint32_t address = start; err == FLASH_OK && address < start + size;
+             address += FLASH_SECTOR_SIZE) {
+            err = erase_now(address);
+        }
+    }
+
+    request->result = err;
+    if (powered_off) {
+        request->pending = false;
+        return;
+    }
+    running = request;
+}
+
+static void complete(flash_request_t *request) {
+    bool internal = (request >= erase_pool && request < erase_pool + FLASH_ERASE_QUEUE_SIZE) ||
+                    request == &page_buffers[0].request || request == &page_buffers[1].request;
+
+    if (internal && request->result != FLASH_OK && deferred_error == FLASH_OK) {
+        deferred_error = request->result;
+    }
+
+    request->pending = false;
+    if (request->callback != NULL) {
+        request->callback(request, request->user_data);
+    }
+}
+
+void flash_process(void) {
+    uint64_t now = now_us();
+    bool completed = false;
+
+    /* An interrupt arriving while a task is in here leaves the work to it */
+    uint32_t state = os_enter_critical();
+    if (processing || powered_off) {
+        os_exit_critical(state);
+        return;
+    }
+    processing = true;
+    os_exit_critical(state);
+
+    for (;;) {
+        if (running != NULL) {
+            if (now < busy_until_us) {
+                break;
+            }
+            flash_request_t *done = running;
+            running = NULL;
+            complete(done);
+            completed = true;
+        }
+
+        if (queue_head == NULL || powered_off) {
+            break;
+        }
+        start_next();
+    }
+
+    processing = false;
+    if (completed) {
+        os_event_group_set_bits(&flash_events, FLASH_EV_DONE);
+    }
+}
+
+static void enqueue(flash_request_t *request) {
+    request->pending = true;
+    request->result = FLASH_OK;
+    request->next = NULL;
+    request->submit_us = now_us();
+
+    /* Power failed earlier in the same call */
+    if (powered_off) {
+        request->result = FLASH_ERROR_TIMEOUT;
+        request->pending = false;
+        return;
+    }
+
+    uint32_t state = os_enter_critical();
+    if (queue_tail != NULL) {
+        queue_tail->next = request;
+    } else {
+        queue_head = request;
+    }
+    queue_tail = request;
+    os_exit_critical(state);
+
+    flash_process();
+}
+
+/**
+ * @brief Queue the open page's program and close it for writes
+ */
+static void submit_open_page(void) {
+    page_buffer_t *page = open_page;
+    open_page = NULL;
+
+    page->request.op = FLASH_OP_PROGRAM;
+    page->request.address = page->address + page->dirty_start;
+    page->request.buffer = &page->data[page->dirty_start];
+    page->request.size = page->dirty_end - page->dirty_start;
+    page->request.callback = NULL;
+    enqueue(&page->request);
+}
+
+/**
+ * @brief Wait until no queued (not yet started) operation changes the range
+ */
+static void wait_for_range(uint32_t address, size_t size) {
+    for (;;) {
+        bool overlap = false;
+        uint32_t state = os_enter_critical();
+        for (flash_request_t *request = queue_head; request != NULL && !overlap; request = request->next) {
+            uint32_t start;
+            size_t length;
+            request_extent(request, &start, &length);
+            overlap = ranges_overlap(address, size, start, length);
+        }
+        os_exit_critical(state);
+        if (!overlap) {
+            return;
+        }
+        wait_step();
+        flash_process();
+    }
+}
+
+static void wait_idle(void) {
+    while (flash_is_busy()) {
+        wait_step();
+    }
+}
+
+/**
+ * @brief Read without waiting or overlaying the page buffer
+ * @return true if the simulation served the read
+ */
+static bool read_now(uint32_t address, void *buffer, size_t size) {
+    /* Call platform-specific read if available */
+    if (platform_flash_read(address, buffer, size) == FLASH_OK) {
+        return false;
+    }
+
+    /* Use simulated flash */
+    memcpy(buffer, &simulated_flash[address], size);
+    return true;
+}
+
 /* ============================================================================
  * Initialization
  * ============================================================================ */
@@ -71,6 +481,10 @@ flash_error_t flash_init(void) {
     /* Initialize simulated flash to 0xFF (erased state) */
     memset(simulated_flash, 0xFF, FLASH_TOTAL_SIZE);
 
+    /* Nothing queued or buffered */
+    os_event_group_init(&flash_events);
+    flash_sim_power_cycle();
+
     /* Call platform-specific initialization if available */
     flash_error_t err = platform_flash_init();
     if (err != FLASH_OK) {
@@ -108,18 +522,41 @@ flash_error_t flash_read(uint32_t address, void *buffer, size_t size) {
         return FLASH_ERROR_INVALID_PARAM;
     }
 
+    if (powered_off) {
+        return FLASH_ERROR_TIMEOUT;
+    }
+
     if (!is_address_valid(address, size)) {
         return FLASH_ERROR_OUT_OF_RANGE;
     }
 
-    /* Call platform-specific read if available */
-    flash_error_t err = platform_flash_read(address, buffer, size);
-    if (err == FLASH_OK) {
-        return FLASH_OK;
+    /* Coherent with queued operations and the page buffer */
+    wait_for_range(address, size);
+    if (powered_off) {
+        return FLASH_ERROR_TIMEOUT;
+    }
+    if (read_now(address, buffer, size)) {
+        sim_stats.reads++;
+        sim_stats.bytes_read += size;
+        sim_stats.read_bit_errors += sim_inject(buffer, size, sim_config.read_error_interval,
+                                                &read_error_countdown, false);
+    }
+
+    if (open_page != NULL) {
+        uint32_t start = open_page->address + open_page->dirty_start;
+        uint32_t end = open_page->address + open_page->dirty_end;
+        if (start < address) {
+            start = address;
+        }
+        if (end > address + size) {
+            end = address + size;
+        }
+        if (start < end) {
+            memcpy((uint8_t *)buffer + (start - address), &open_page->data[start - open_page->address],
+                   end - start);
+        }
     }
 
-    /* Use simulated flash */
-    memcpy(buffer, &simulated_flash[address], size);
     return FLASH_OK;
 }
 
@@ -147,6 +584,10 @@ flash_error_t flash_write(uint32_t address, const void *buffer, size_t size) {
         return FLASH_ERROR_INVALID_PARAM;
     }
 
+    if (powered_off) {
+        return FLASH_ERROR_TIMEOUT;
+    }
+
     if (!is_address_valid(address, size)) {
         return FLASH_ERROR_OUT_OF_RANGE;
     }
@@ -155,14 +596,65 @@ flash_error_t flash_write(uint32_t address, const void *buffer, size_t size) {
         return FLASH_ERROR_WRITE_PROTECTED;
     }
 
-    /* Call platform-specific write if available */
-    flash_error_t err = platform_flash_write(address, buffer, size);
-    if (err == FLASH_OK) {
-        return FLASH_OK;
+    const uint8_t *data = (const uint8_t *)buffer;
+    while (size > 0) {
+        uint32_t page_address = (address / FLASH_PAGE_SIZE) * FLASH_PAGE_SIZE;
+        uint32_t offset = address - page_address;
+        uint32_t length = FLASH_PAGE_SIZE - offset;
+        if (length > size) {
+            length = size;
+        }
+
+        if (open_page != NULL && open_page->address != page_address) {
+            submit_open_page();
+        }
+
+        if (open_page == NULL) {
+            /* A free buffer: the one not being programmed, or wait for it */
+            page_buffer_t *page = page_buffers[0].request.pending ? &page_buffers[1] : &page_buffers[0];
+            while (page->request.pending) {
+                wait_step();
+                flash_process();
+            }
+
+            /* Current contents, so coalesced writes with gaps program the gaps unchanged */
+            if (length < FLASH_PAGE_SIZE) {
+                wait_for_range(page_address, FLASH_PAGE_SIZE);
+                if (powered_off) {
+                    return FLASH_ERROR_TIMEOUT;
+                }
+                read_now(page_address, page->data, FLASH_PAGE_SIZE);
+            }
+
+            page->address = page_address;
+            page->dirty_start = offset;
+            page->dirty_end = offset + length;
+            open_page = page;
+        } else {
+            if (offset < open_page->dirty_start) {
+                open_page->dirty_start = offset;
+            }
+            if (offset + length > open_page->dirty_end) {
+                open_page->dirty_end = offset + length;
+            }
+        }
+
+        memcpy(&open_page->data[offset], data, length);
+
+        /* Sequential writes have finished the page */
+        if (open_page->dirty_end == FLASH_PAGE_SIZE) {
+            submit_open_page();
+        }
+
+        if (powered_off) {
+            return FLASH_ERROR_TIMEOUT;
+        }
+
+        address += length;
+        data += length;
+        size -= length;
     }
 
-    /* Use simulated flash */
-    memcpy(&simulated_flash[address], buffer, size);
     return FLASH_OK;
 }
 
@@ -187,6 +679,12 @@ flash_error_t flash_write_verify(uint32_t address, const void *buffer, size_t si
         return err;
     }
 
+    /* Program now: a read would be served from the page buffer */
+    err = flash_flush();
+    if (err != FLASH_OK) {
+        return err;
+    }
+
     /* Allocate verify buffer */
     verify_buffer = (uint8_t *)os_malloc(size);
     if (verify_buffer == NULL) {
@@ -214,65 +712,137 @@ flash_error_t flash_write_verify(uint32_t address, const void *buffer, size_t si
  * ============================================================================ */
 
 flash_error_t flash_erase_sector(uint32_t address) {
+    return flash_erase_range(address, 1);
+}
+
+flash_error_t flash_erase_range(uint32_t start_address, size_t size) {
     if (!flash_initialized) {
         return FLASH_ERROR_INVALID_PARAM;
     }
 
-    /* Align to sector boundary */
-    uint32_t sector_address = (address / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE;
+    if (powered_off) {
+        return FLASH_ERROR_TIMEOUT;
+    }
+
+    if (size == 0) {
+        return FLASH_OK;
+    }
 
-    if (!is_address_valid(sector_address, FLASH_SECTOR_SIZE)) {
+    if (!is_address_valid(start_address, size)) {
         return FLASH_ERROR_OUT_OF_RANGE;
     }
 
-    if (is_write_protected_range(sector_address, FLASH_SECTOR_SIZE)) {
+    /* Calculate the sectors to erase */
+    uint32_t start_sector = (start_address / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE;
+    uint32_t end_sector = ((start_address + size + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE;
+
+    if (is_write_protected_range(start_sector, end_sector - start_sector)) {
         return FLASH_ERROR_WRITE_PROTECTED;
     }
 
-    /* Call platform-specific erase if available */
-    flash_error_t err = platform_flash_erase_sector(sector_address);
-    if (err == FLASH_OK) {
-        return FLASH_OK;
+    /* Writes still buffered for an erased page are superseded */
+    if (open_page != NULL && open_page->address >= start_sector && open_page->address < end_sector) {
+        open_page = NULL;
     }
 
-    /* Erase sector (set to 0xFF) */
-    memset(&simulated_flash[sector_address], 0xFF, FLASH_SECTOR_SIZE);
-    return FLASH_OK;
+    /* Queue the erase behind what is already queued */
+    flash_request_t *request = NULL;
+    while (request == NULL) {
+        for (int i = 0; i < FLASH_ERASE_QUEUE_SIZE && request == NULL; i++) {
+            if (!erase_pool[i].pending) {
+                request = &erase_pool[i];
+            }
+        }
+        if (request == NULL) {
+            wait_step();
+            flash_process();
+        }
+    }
+
+    request->op = FLASH_OP_ERASE;
+    request->address = start_sector;
+    request->size = end_sector - start_sector;
+    request->callback = NULL;
+    enqueue(request);
+
+    return powered_off ? FLASH_ERROR_TIMEOUT : FLASH_OK;
 }
 
-flash_error_t flash_erase_range(uint32_t start_address, size_t size) {
+flash_error_t flash_erase_chip(void) {
     if (!flash_initialized) {
         return FLASH_ERROR_INVALID_PARAM;
     }
 
-    /* Calculate number of sectors to erase */
-    uint32_t start_sector = (start_address / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE;
-    uint32_t end_address = start_address + size;
-    uint32_t end_sector = ((end_address + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE;
-
-    /* Erase all sectors in range */
-    for (uint32_t addr = start_sector; addr < end_sector; addr += FLASH_SECTOR_SIZE) {
-        flash_error_t err = flash_erase_sector(addr);
-        if (err != FLASH_OK) {
-            return err;
-        }
+    if (write_protection_enabled) {
+        return FLASH_ERROR_WRITE_PROTECTED;
     }
 
-    return FLASH_OK;
+    /* Erase entire flash */
+    return flash_erase_range(0, FLASH_TOTAL_SIZE);
 }
 
-flash_error_t flash_erase_chip(void) {
+/* ============================================================================
+ * Asynchronous Operations
+ * ============================================================================ */
+
+flash_error_t flash_submit(flash_request_t *request) {
+    if (request == NULL || request->pending || request->size == 0 ||
+        (request->op == FLASH_OP_PROGRAM && request->buffer == NULL)) {
+        return FLASH_ERROR_INVALID_PARAM;
+    }
+
     if (!flash_initialized) {
         return FLASH_ERROR_INVALID_PARAM;
     }
 
-    if (write_protection_enabled) {
+    if (powered_off) {
+        return FLASH_ERROR_TIMEOUT;
+    }
+
+    if (!is_address_valid(request->address, request->size)) {
+        return FLASH_ERROR_OUT_OF_RANGE;
+    }
+
+    uint32_t start;
+    size_t size;
+    request_extent(request, &start, &size);
+    if (is_write_protected_range(start, size)) {
         return FLASH_ERROR_WRITE_PROTECTED;
     }
 
-    /* Erase entire flash */
-    memset(simulated_flash, 0xFF, FLASH_TOTAL_SIZE);
-    return FLASH_OK;
+    /* Keep the order with writes still in the page buffer */
+    if (open_page != NULL && ranges_overlap(open_page->address, FLASH_PAGE_SIZE, start, size)) {
+        if (request->op == FLASH_OP_ERASE) {
+            open_page = NULL;
+        } else {
+            submit_open_page();
+        }
+    }
+
+    enqueue(request);
+    return powered_off ? FLASH_ERROR_TIMEOUT : FLASH_OK;
+}
+
+flash_error_t flash_flush(void) {
+    if (!flash_initialized) {
+        return FLASH_ERROR_INVALID_PARAM;
+    }
+
+    if (powered_off) {
+        return FLASH_ERROR_TIMEOUT;
+    }
+
+    if (open_page != NULL) {
+        submit_open_page();
+    }
+    wait_idle();
+    if (powered_off) {
+        return FLASH_ERROR_TIMEOUT;
+    }
+
+    flash_error_t err = deferred_error;
+    deferred_error = FLASH_OK;
+    return err;
 }
 
 /* ============================================================================
@@ -312,13 +882,23 @@ bool flash_is_write_protected(uint32_t address) {
  * ============================================================================ */
 
 bool flash_is_busy(void) {
-    /* Simulated flash is never busy */
-    return false;
+    flash_process();
+
+    uint32_t state = os_enter_critical();
+    bool busy = running != NULL || queue_head != NULL;
+    os_exit_critical(state);
+    return busy;
 }
 
 flash_error_t flash_wait_ready(uint32_t timeout_ms) {
-    /* Simulated flash is always ready */
-    (void)timeout_ms;
+    uint32_t start = os_get_uptime_ms();
+
+    while (flash_is_busy()) {
+        if (os_get_uptime_ms() - start >= timeout_ms) {
+            return FLASH_ERROR_TIMEOUT;
+        }
+        wait_step();
+    }
     return FLASH_OK;
 }
 
@@ -329,6 +909,98 @@ const char *flash_error_to_string(flash_error_t error) {
     return "Unknown error";
 }
 
+/* ============================================================================
+ * Simulation
+ * ============================================================================ */
+
+void flash_sim_get_config(flash_sim_config_t *config) {
+    if (config != NULL) {
+        *config = sim_config;
+    }
+}
+
+flash_error_t flash_sim_set_config(const flash_sim_config_t *config) {
+    if (config == NULL) {
+        return FLASH_ERROR_INVALID_PARAM;
+    }
+
+    sim_config = *config;
+    sim_random_state = (config->seed != 0) ? config->seed : 1;
+    program_error_countdown = sim_error_gap(config->program_error_interval);
+    read_error_countdown = sim_error_gap(config->read_error_interval);
+    power_loss_countdown = config->power_loss_after;
+    return FLASH_OK;
+}
+
+void flash_sim_get_stats(flash_sim_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+
+    *stats = sim_stats;
+    stats->erase_count_min = erase_counts[0];
+    stats->erase_count_max = erase_counts[0];
+    for (uint32_t i = 1; i < sizeof(erase_counts) / sizeof(erase_counts[0]); i++) {
+        if (erase_counts[i] < stats->erase_count_min) {
+            stats->erase_count_min = erase_counts[i];
+        }
+        if (erase_counts[i] > stats->erase_count_max) {
+            stats->erase_count_max = erase_counts[i];
+        }
+    }
+}
+
+void flash_sim_reset_stats(void) {
+    memset(&sim_stats, 0, sizeof(sim_stats));
+}
+
+uint32_t flash_sim_erase_count(uint32_t address) {
+    if (address >= FLASH_TOTAL_SIZE) {
+        return 0;
+    }
+    return erase_counts[address / FLASH_SECTOR_SIZE];
+}
+
+void flash_sim_print_stats(void) {
+    flash_sim_stats_t stats;
+    flash_sim_get_stats(&stats);
+
+    printf("\n=== Flash Simulation ===\n");
+    printf("Semantics: %s\n", sim_config.nor_semantics ? "NOR" : "overwrite");
+    printf("Timing: program %lu us + %lu ns/byte, sector erase %lu us\n",
+           (unsigned long)sim_config.program_setup_us, (unsigned long)sim_config.program_byte_ns,
+           (unsigned long)sim_config.sector_erase_us);
+    printf("Reads: %lu (%lu bytes)\n", (unsigned long)stats.reads, (unsigned long)stats.bytes_read);
+    printf("Programs: %lu (%lu bytes)\n", (unsigned long)stats.programs, (unsigned long)stats.bytes_programmed);
+    printf("Erases: %lu (per sector %lu..%lu)\n", (unsigned long)stats.erases,
+           (unsigned long)stats.erase_count_min, (unsigned long)stats.erase_count_max);
+    printf("Busy: %lu ms\n", (unsigned long)(stats.busy_us / 1000));
+    printf("Overwritten Bits: %lu\n", (unsigned long)stats.overwrite_bits);
+    printf("Bit Errors: %lu program, %lu read\n",
+           (unsigned long)stats.program_bit_errors, (unsigned long)stats.read_bit_errors);
+    printf("Power Losses: %lu%s\n", (unsigned long)stats.power_losses, powered_off ? " (powered off)" : "");
+    printf("========================\n\n");
+}
+
+void flash_sim_power_loss(void) {
+    if (!powered_off) {
+        sim_power_off();
+    }
+}
+
+void flash_sim_power_cycle(void) {
+    uint32_t state = os_enter_critical();
+    memset(page_buffers, 0, sizeof(page_buffers));
+    memset(erase_pool, 0, sizeof(erase_pool));
+    open_page = NULL;
+    queue_head = queue_tail = running = NULL;
+    busy_until_us = 0;
+    deferred_error = FLASH_OK;
+    processing = false;
+    powered_off = false;
+    os_exit_critical(state);
+}
+
 /* ============================================================================
  * Weak Platform-Specific Functions (can be overridden)
  * ============================================================================ */
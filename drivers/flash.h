@@ -3,6 +3,37 @@
  * @brief Flash Memory Driver Interface
  *
  * Provides flash memory operations for firmware storage
+ *
+ * Writes go through a page buffer: small writes to the same page are
+ * coalesced into one program operation, which is queued when the page is
+ * complete, when a write moves to another page, or on flash_flush().
+ * Erases are queued too, so an erase ahead of the pages about to be
+ * written runs while the caller produces them. Operations run in the
+ * order they were queued, one at a time; reads wait only for queued
+ * operations they overlap and see data still in the page buffer. Call
+ * flash_flush() where data must be in flash, e.g. before a reset.
+ *
+ * flash_submit() queues a caller-owned request and returns at once; the
+ * driver completes it from flash_process(), which the waiting functions
+ * call and which a platform can also call from a timer or its flash
+ * interrupt: the queue is updated in critical sections, and a call that
+ * interrupts another one returns at once. The other functions are for
+ * task context, from one task at a time. Waiting tasks block on an event
+ * that flash_process() sets when an operation completes, with a timeout
+ * at the running operation's modelled end.
+ *
+ * The RAM simulation models program and erase times (FLASH_SIM_*) so
+ * storage throughput can be measured. Waits have tick resolution. While
+ * the scheduler is not running the tick may not advance, so waits then
+ * finish an operation at once.
+ *
+ * It also behaves like NOR flash: programming can only clear bits, so
+ * rewriting without an erase ANDs the data in (and is counted). Erases
+ * are counted per sector. flash_sim_set_config() changes the timings and
+ * injects bit errors and power losses: a power loss tears the program or
+ * erase it interrupts, drops everything queued or buffered and fails
+ * every call with FLASH_ERROR_TIMEOUT until flash_sim_power_cycle(). None of this
+ * applies to operations a platform implementation takes over.
  */
 
 #ifndef TINYOS_FLASH_H
@@ -37,6 +68,25 @@ extern "C" {
 #define FLASH_DATA_START        0x0007C000
 #define FLASH_DATA_SIZE         (16 * 1024)   /* 16KB */
 
+/* Driver queue */
+#define FLASH_ERASE_QUEUE_SIZE  4       /* Erases queued by flash_erase_range() at once */
+
+/* Simulation defaults (see flash_sim_config_t) */
+#ifndef FLASH_SIM_NOR
+#define FLASH_SIM_NOR               1       /* Programming ANDs data into flash */
+#endif
+
+/* Simulated timings (typical SPI NOR values; 0 makes an operation instantaneous) */
+#ifndef FLASH_SIM_PROGRAM_SETUP_US
+#define FLASH_SIM_PROGRAM_SETUP_US  100     /* Per program operation */
+#endif
+#ifndef FLASH_SIM_PROGRAM_BYTE_NS
+#define FLASH_SIM_PROGRAM_BYTE_NS   1200    /* Per byte programmed */
+#endif
+#ifndef FLASH_SIM_SECTOR_ERASE_US
+#define FLASH_SIM_SECTOR_ERASE_US   45000   /* Per sector erased */
+#endif
+
 /* ============================================================================
  * Types
  * ============================================================================ */
@@ -57,6 +107,75 @@ typedef enum {
     FLASH_ERROR_TIMEOUT
 } flash_error_t;
 
+/**
+ * @brief Queued operation types
+ */
+typedef enum {
+    FLASH_OP_PROGRAM = 0,
+    FLASH_OP_ERASE                       /* Every sector overlapping address..address+size */
+} flash_op_t;
+
+struct flash_request;
+
+/**
+ * @brief Completion callback, called from flash_process()
+ */
+typedef void (*flash_callback_t)(struct flash_request *request, void *user_data);
+
+/**
+ * @brief Asynchronous operation, owned by the caller until it completes
+ */
+typedef struct flash_request {
+    flash_op_t op;
+    uint32_t address;
+    const void *buffer;                  /* Program data, read when the operation runs */
+    size_t size;
+    flash_callback_t callback;           /* Optional */
+    void *user_data;
+    volatile flash_error_t result;
+    volatile bool pending;               /* Set by flash_submit(), cleared on completion */
+
+    /* Driver use */
+    struct flash_request *next;
+    uint64_t submit_us;
+} flash_request_t;
+
+/**
+ * @brief Simulation settings
+ *
+ * Error intervals are the mean number of bits between injected errors
+ * (0 = none). A program error leaves a bit erased, a read error flips a
+ * bit in the returned data only.
+ */
+typedef struct {
+    bool nor_semantics;                  /* false: programming overwrites */
+    uint32_t program_setup_us;
+    uint32_t program_byte_ns;
+    uint32_t sector_erase_us;
+    uint32_t program_error_interval;     /* Bits programmed per injected error */
+    uint32_t read_error_interval;        /* Bits read per injected error */
+    uint32_t power_loss_after;           /* Lose power during this program/erase (1 = next), 0 = never */
+    uint32_t seed;                       /* For error and tear positions */
+} flash_sim_config_t;
+
+/**
+ * @brief Simulation statistics
+ */
+typedef struct {
+    uint32_t reads;
+    uint32_t programs;
+    uint32_t erases;
+    uint64_t bytes_read;
+    uint64_t bytes_programmed;
+    uint32_t overwrite_bits;             /* Bits programmed from 0 to 1 without an erase */
+    uint32_t program_bit_errors;
+    uint32_t read_bit_errors;
+    uint32_t power_losses;
+    uint32_t erase_count_min;            /* Per sector */
+    uint32_t erase_count_max;
+    uint64_t busy_us;                    /* Modelled device time */
+} flash_sim_stats_t;
+
 /**
  * @brief Flash info structure
  */
@@ -120,6 +239,11 @@ flash_error_t flash_read_word(uint32_t address, uint32_t *value);
 
 /**
  * @brief Write data to flash
+ *
+ * Data is copied into the page buffer and programmed later (see the file
+ * comment); flash_read() sees it at once. Program failures are reported
+ * by flash_flush().
+ *
  * @param address Start address
  * @param buffer Data to write
  * @param size Number of bytes to write
@@ -144,7 +268,7 @@ flash_error_t flash_write_byte(uint32_t address, uint8_t value);
 flash_error_t flash_write_word(uint32_t address, uint32_t value);
 
 /**
- * @brief Write with verification
+ * @brief Write, program and read back for verification
  * @param address Start address
  * @param buffer Data to write
  * @param size Number of bytes to write
@@ -157,17 +281,20 @@ flash_error_t flash_write_verify(uint32_t address, const void *buffer, size_t si
  * ============================================================================ */
 
 /**
- * @brief Erase flash sector
+ * @brief Queue a flash sector erase
  * @param address Address within sector to erase
- * @return FLASH_OK on success, error code otherwise
+ * @return FLASH_OK if queued, error code otherwise
  */
 flash_error_t flash_erase_sector(uint32_t address);
 
 /**
- * @brief Erase multiple sectors
+ * @brief Queue an erase of multiple sectors
+ *
+ * Waits only when FLASH_ERASE_QUEUE_SIZE erases are already queued.
+ *
  * @param start_address Start address
  * @param size Size to erase (rounded up to sector boundary)
- * @return FLASH_OK on success, error code otherwise
+ * @return FLASH_OK if queued, error code otherwise
  */
 flash_error_t flash_erase_range(uint32_t start_address, size_t size);
 
@@ -177,6 +304,33 @@ flash_error_t flash_erase_range(uint32_t start_address, size_t size);
  */
 flash_error_t flash_erase_chip(void);
 
+/* ============================================================================
+ * Asynchronous Operations
+ * ============================================================================ */
+
+/**
+ * @brief Queue a program or erase and return without waiting
+ *
+ * The request and its buffer must stay valid until request->pending is
+ * cleared; request->result then holds the outcome. Programs bypass the
+ * page buffer (a page it holds for the same range is queued first).
+ *
+ * @param request Operation to queue
+ * @return FLASH_OK if queued, error code otherwise (nothing queued)
+ */
+flash_error_t flash_submit(flash_request_t *request);
+
+/**
+ * @brief Complete the running operation if it is done and start the next
+ */
+void flash_process(void);
+
+/**
+ * @brief Program the page buffer and wait until every queued operation is done
+ * @return FLASH_OK, or the first error of an operation queued by this driver
+ */
+flash_error_t flash_flush(void);
+
 /* ============================================================================
  * Protection
  * ============================================================================ */
@@ -208,12 +362,12 @@ bool flash_is_write_protected(uint32_t address);
 
 /**
  * @brief Check if flash is busy
- * @return true if busy, false otherwise
+ * @return true while an operation is running or queued
  */
 bool flash_is_busy(void);
 
 /**
- * @brief Wait for flash operation to complete
+ * @brief Wait for queued operations to complete (the page buffer stays as it is)
  * @param timeout_ms Timeout in milliseconds
  * @return FLASH_OK if ready, FLASH_ERROR_TIMEOUT if timeout
  */
@@ -226,6 +380,59 @@ flash_error_t flash_wait_ready(uint32_t timeout_ms);
  */
 const char *flash_error_to_string(flash_error_t error);
 
+/* ============================================================================
+ * Simulation
+ * ============================================================================ */
+
+/**
+ * @brief Get the simulation settings
+ * @param config Pointer to store the settings
+ */
+void flash_sim_get_config(flash_sim_config_t *config);
+
+/**
+ * @brief Change the simulation settings (power_loss_after counts from now)
+ * @param config New settings
+ * @return FLASH_OK on success, error code otherwise
+ */
+flash_error_t flash_sim_set_config(const flash_sim_config_t *config);
+
+/**
+ * @brief Get the simulation statistics
+ * @param stats Pointer to store the statistics
+ */
+void flash_sim_get_stats(flash_sim_stats_t *stats);
+
+/**
+ * @brief Clear the statistics (erase counts are wear and stay)
+ */
+void flash_sim_reset_stats(void);
+
+/**
+ * @brief Times a sector has been erased
+ * @param address Address within the sector
+ * @return Erase count, 0 if the address is out of range
+ */
+uint32_t flash_sim_erase_count(uint32_t address);
+
+/**
+ * @brief Print the statistics and settings
+ */
+void flash_sim_print_stats(void);
+
+/**
+ * @brief Lose power now
+ *
+ * Whatever is queued or buffered is lost. The simulation applies an
+ * operation when it starts, so use power_loss_after to tear one.
+ */
+void flash_sim_power_loss(void);
+
+/**
+ * @brief Restore power: the driver restarts empty, flash contents are kept
+ */
+void flash_sim_power_cycle(void);
+
 /* ============================================================================
  * Platform-Specific Functions (weak symbols)
  * ============================================================================ */
@@ -0,0 +1,215 @@
+/**
+ * @file cbor_bench.c
+ * @brief CBOR/SenML vs JSON Payload Benchmark for TinyOS-RTOS
+ *
+ * This example demonstrates:
+ * - Encoding the same sensor pack as JSON (snprintf) and as SenML CBOR
+ * - Comparing payload size, encode time and decode time
+ * - Decoding a SenML pack with senml_decode() and checking the round trip
+ *
+ * Payload size matters most on constrained links: every byte saved is
+ * airtime and energy, and smaller payloads keep CoAP responses inside a
+ * single datagram. In a CoAP handler the encoder writes straight into the
+ * response buffer:
+ *
+ *     uint16_t capacity;
+ *     uint8_t *payload = coap_pdu_payload_buffer(response, &capacity);
+ *     cbor_encoder_init(&encoder, payload, capacity);
+ *     if (senml_encode(&encoder, records, count) == CBOR_OK) {
+ *         coap_pdu_set_payload(response, payload, encoder.length);
+ *     }
+ *
+ * with Content-Format COAP_CONTENT_FORMAT_SENML_CBOR.
+ */
+
+#include "tinyos.h"
+#include "tinyos/cbor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Benchmark Configuration */
+#define BENCH_ITERATIONS    2000
+#define BENCH_BUFFER_SIZE   256
+#define BENCH_BASE_NAME     "urn:dev:mac:0200000001:"
+#define BENCH_BASE_TIME     1700000000
+
+static senml_record_t records[] = {
+    { .base_name = BENCH_BASE_NAME, .base_time = BENCH_BASE_TIME,
+      .name = "temp", .unit = "Cel", .value_type = SENML_VALUE_NUMBER, .value.number = 23.5f },
+    { .name = "humidity", .unit = "%RH", .value_type = SENML_VALUE_NUMBER, .value.number = 45.0f },
+    { .name = "pressure", .unit = "Pa", .value_type = SENML_VALUE_NUMBER, .value.number = 101325.0f },
+    { .name = "battery", .unit = "V", .time = -10, .value_type = SENML_VALUE_NUMBER, .value.number = 3.3f },
+    { .name = "door", .value_type = SENML_VALUE_BOOL, .value.boolean = true }
+};
+
+#define RECORD_COUNT    (sizeof(records) / sizeof(records[0]))
+
+static uint8_t json_buffer[BENCH_BUFFER_SIZE];
+static uint8_t cbor_buffer[BENCH_BUFFER_SIZE];
+
+/* ========== JSON ========== */
+
+/**
+ * @brief Encode the pack as SenML JSON, the way the demos render payloads
+ */
+static int json_encode(char *buffer, size_t size) {
+    int length = snprintf(buffer, size, "[");
+
+    for (size_t i = 0; i < RECORD_COUNT && length > 0 && (size_t)length < size; i++) {
+        const senml_record_t *record = &records[i];
+        char *out = buffer + length;
+        size_t left = size - length;
+        int n = snprintf(out, left, "%s{", i ? "," : "");
+
+        if (i == 0) {
+            n += snprintf(out + n, left > (size_t)n ? left - n : 0, "\"bn\":\"%s\",\"bt\":%ld,",
+                          record->base_name, (long)record->base_time);
+        }
+        n += snprintf(out + n, left > (size_t)n ? left - n : 0, "\"n\":\"%s\"", record->name);
+        if (record->unit) {
+            n += snprintf(out + n, left > (size_t)n ? left - n : 0, ",\"u\":\"%s\"", record->unit);
+        }
+        if (record->time) {
+            n += snprintf(out + n, left > (size_t)n ? left - n : 0, ",\"t\":%ld", (long)record->time);
+        }
+        if (record->value_type == SENML_VALUE_NUMBER) {
+            n += snprintf(out + n, left > (size_t)n ? left - n : 0, ",\"v\":%g", (double)record->value.number);
+        } else if (record->value_type == SENML_VALUE_BOOL) {
+            n += snprintf(out + n, left > (size_t)n ? left - n : 0, ",\"vb\":%s",
+                          record->value.boolean ? "true" : "false");
+        }
+        n += snprintf(out + n, left > (size_t)n ? left - n : 0, "}");
+        length += n;
+    }
+
+    if (length > 0 && (size_t)length < size) {
+        length += snprintf(buffer + length, size - length, "]");
+    }
+    return (length > 0 && (size_t)length < size) ? length : -1;
+}
+
+/**
+ * @brief Pull the "v" values out of the JSON pack (minimal scanner)
+ */
+static int json_decode(const char *json, float *values, int max_values) {
+    int count = 0;
+    const char *p = json;
+
+    while (count < max_values && (p = strstr(p, "\"v\":")) != NULL) {
+        p += 4;
+        values[count++] = strtof(p, NULL);
+    }
+    return count;
+}
+
+/* ========== CBOR ========== */
+
+static int cbor_pack_encode(uint8_t *buffer, size_t size) {
+    cbor_encoder_t encoder;
+    cbor_encoder_init(&encoder, buffer, size);
+    return (senml_encode(&encoder, records, RECORD_COUNT) == CBOR_OK) ? (int)encoder.length : -1;
+}
+
+typedef struct {
+    int count;
+    int matched;
+} decode_result_t;
+
+static void record_callback(const senml_record_t *record, void *user_data) {
+    decode_result_t *result = user_data;
+    const senml_record_t *expected = &records[result->count];
+
+    if (record->name_length == strlen(expected->name) &&
+        memcmp(record->name, expected->name, record->name_length) == 0 &&
+        record->value_type == expected->value_type &&
+        record->base_time == BENCH_BASE_TIME &&
+        record->time == expected->time &&
+        (record->value_type != SENML_VALUE_NUMBER || record->value.number == expected->value.number)) {
+        result->matched++;
+    }
+    result->count++;
+}
+
+/* ========== Benchmark ========== */
+
+static void bench_task(void *param) {
+    (void)param;
+    uint32_t start;
+
+    int json_length = json_encode((char *)json_buffer, sizeof(json_buffer));
+    int cbor_length = cbor_pack_encode(cbor_buffer, sizeof(cbor_buffer));
+    if (json_length < 0 || cbor_length < 0) {
+        printf("[Bench] Encode failed\n");
+        return;
+    }
+
+    printf("[Bench] %u SenML records, %u iterations\n\n", (unsigned)RECORD_COUNT, BENCH_ITERATIONS);
+    printf("  JSON: %s\n\n", (char *)json_buffer);
+    printf("  CBOR:");
+    for (int i = 0; i < cbor_length; i++) {
+        printf(" %02x", cbor_buffer[i]);
+    }
+    printf("\n\n");
+
+    start = os_get_uptime_ms();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        json_encode((char *)json_buffer, sizeof(json_buffer));
+    }
+    uint32_t json_encode_ms = os_get_uptime_ms() - start;
+
+    start = os_get_uptime_ms();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        cbor_pack_encode(cbor_buffer, sizeof(cbor_buffer));
+    }
+    uint32_t cbor_encode_ms = os_get_uptime_ms() - start;
+
+    float values[RECORD_COUNT];
+    start = os_get_uptime_ms();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        json_decode((const char *)json_buffer, values, RECORD_COUNT);
+    }
+    uint32_t json_decode_ms = os_get_uptime_ms() - start;
+
+    decode_result_t result;
+    start = os_get_uptime_ms();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        result.count = 0;
+        result.matched = 0;
+        senml_decode(cbor_buffer, cbor_length, record_callback, &result);
+    }
+    uint32_t cbor_decode_ms = os_get_uptime_ms() - start;
+
+    printf("  %-6s %5s %10s %10s\n", "", "bytes", "encode ms", "decode ms");
+    printf("  %-6s %5d %10lu %10lu\n", "JSON", json_length,
+           (unsigned long)json_encode_ms, (unsigned long)json_decode_ms);
+    printf("  %-6s %5d %10lu %10lu\n", "CBOR", cbor_length,
+           (unsigned long)cbor_encode_ms, (unsigned long)cbor_decode_ms);
+
+    printf("\n[Bench] CBOR is %d%% of the JSON size, round trip %s (%d/%u records)\n",
+           cbor_length * 100 / json_length,
+           (result.count == (int)RECORD_COUNT && result.matched == (int)RECORD_COUNT) ? "ok" : "FAILED",
+           result.matched, (unsigned)RECORD_COUNT);
+
+    while (1) {
+        os_task_delay(1000);
+    }
+}
+
+/**
+ * @brief Main function
+ */
+int main(void) {
+    printf("\n");
+    printf("========================================\n");
+    printf("  TinyOS-RTOS CBOR/SenML Benchmark\n");
+    printf("========================================\n\n");
+
+    os_init();
+
+    static tcb_t bench_tcb;
+    os_task_create(&bench_tcb, "bench", bench_task, NULL, PRIORITY_NORMAL);
+
+    os_start();
+    return 0;
+}
@@ -5,8 +5,11 @@
  * Demonstrates:
  * - CoAP server with multiple resources
  * - CoAP client making GET/POST/PUT/DELETE requests
+ * - Concurrent asynchronous requests with retransmission
+ * - Block-wise transfer of a body larger than one datagram
  * - RESTful sensor data access
- * - CoAP observe pattern (optional)
+ * - CoAP observe pattern: /sensor/temperature pushes changes to observers
+ * - Group discovery: a multicast GET answered after a random leisure
  */
 
 #include "tinyos.h"
@@ -19,6 +22,7 @@
 #define SERVER_IP       IPV4(192, 168, 1, 100)
 #define CLIENT_IP       IPV4(192, 168, 1, 101)
 #define SERVER_PORT     COAP_DEFAULT_PORT
+#define CLIENT_PORT     (COAP_DEFAULT_PORT + 100)
 
 /* Simulated sensor data */
 static float temperature = 25.5f;
@@ -159,6 +163,64 @@ void data_handler(
     }
 }
 
+/* GET /sensor/slow - slow conversion answered later (separate response) */
+static coap_context_t *slow_context;
+static coap_exchange_t *volatile slow_exchange;
+static semaphore_t slow_sem;
+
+void slow_handler(
+    coap_context_t *context,
+    coap_resource_t *resource,
+    const coap_pdu_t *request,
+    coap_pdu_t *response,
+    void *user_data
+) {
+    printf("[Server] GET /sensor/slow (deferred)\n");
+
+    /* One conversion at a time; the server keeps serving other requests meanwhile */
+    coap_exchange_t *exchange = slow_exchange ? NULL : coap_response_defer(context, request);
+    if (!exchange) {
+        response->code = COAP_RESPONSE_503_SERVICE_UNAVAILABLE;
+        return;
+    }
+    slow_context = context;
+    slow_exchange = exchange;
+    os_semaphore_post(&slow_sem);
+}
+
+/* Completes deferred /sensor/slow requests after a 500 ms "conversion" */
+void slow_sensor_task(void *param) {
+    while (1) {
+        os_semaphore_wait(&slow_sem, OS_WAIT_FOREVER);
+        os_task_delay(500);
+
+        char payload[32];
+        int len = snprintf(payload, sizeof(payload), "{\"pressure\":%d}", 1000 + (rand() % 30));
+        coap_exchange_t *exchange = slow_exchange;
+        slow_exchange = NULL;
+        coap_response_complete(slow_context, exchange, COAP_RESPONSE_205_CONTENT,
+                               COAP_CONTENT_FORMAT_JSON, (const uint8_t *)payload, len);
+    }
+}
+
+/* GET /log - 3000-byte synthetic log, served block-wise */
+#define LOG_SIZE        3000
+
+static int32_t log_read(void *user_data, uint32_t offset, uint8_t *buffer, uint16_t length,
+                        uint32_t *total_size) {
+    *total_size = LOG_SIZE;
+    if (offset >= LOG_SIZE) {
+        return 0;
+    }
+    if (length > LOG_SIZE - offset) {
+        length = LOG_SIZE - offset;
+    }
+    for (uint16_t i = 0; i < length; i++) {
+        buffer[i] = 'a' + (offset + i) % 26;
+    }
+    return length;
+}
+
 /* ====================
  * CoAP Server Task
  * ==================== */
@@ -171,7 +233,7 @@ void coap_server_task(void *param) {
     coap_config_t config = {
         .bind_address = 0,  /* 0.0.0.0 - bind to all interfaces */
         .port = SERVER_PORT,
-        .enable_observe = false,
+        .enable_observe = true,
         .ack_timeout_ms = COAP_ACK_TIMEOUT_MS,
         .max_retransmit = COAP_MAX_RETRANSMIT
     };
@@ -188,20 +250,39 @@ void coap_server_task(void *param) {
 
     printf("[Server] CoAP server listening on port %d\n", SERVER_PORT);
 
+    /* Also answer group requests sent to All CoAP Nodes */
+    if (coap_join_group(&server, COAP_MULTICAST_IPV4) == COAP_OK) {
+        printf("[Server] Joined group 224.0.1.187\n");
+    }
+
     /* Register resources */
-    coap_resource_create(&server, "/sensor/temperature", temperature_handler, NULL);
-    coap_resource_create(&server, "/sensor/humidity", humidity_handler, NULL);
+    coap_resource_t *temperature_resource =
+        coap_resource_create(&server, "/sensor/temperature", temperature_handler, NULL);
+    coap_resource_set_observable(temperature_resource, 60);
+    coap_resource_set_link_attributes(temperature_resource, "rt=\"temperature\";if=\"sensor\"");
+    coap_resource_t *humidity_resource =
+        coap_resource_create(&server, "/sensor/humidity", humidity_handler, NULL);
+    coap_resource_set_cache(humidity_resource, true);
+    humidity_resource->max_age = 5;     /* Served from cache for 5 s */
     coap_resource_create(&server, "/actuator/led", led_handler, NULL);
     coap_resource_create(&server, "/data", data_handler, NULL);
+    coap_resource_t *log_resource = coap_resource_create(&server, "/log", data_handler, NULL);
+    coap_resource_set_block_handlers(log_resource, log_read, NULL, NULL);
+    coap_resource_create(&server, "/sensor/slow", slow_handler, NULL);
 
     printf("[Server] Registered resources:\n");
-    printf("  - GET  /sensor/temperature\n");
-    printf("  - GET  /sensor/humidity\n");
+    printf("  - GET  /sensor/temperature (observable)\n");
+    printf("  - GET  /sensor/humidity (cached, max-age 5 s)\n");
     printf("  - GET  /actuator/led\n");
     printf("  - PUT  /actuator/led\n");
     printf("  - POST /data\n");
+    printf("  - GET  /log (block-wise, %d bytes)\n", LOG_SIZE);
+    printf("  - GET  /sensor/slow (separate response)\n");
+    printf("  - GET  /.well-known/core (resource discovery)\n");
     printf("\n");
 
+    float notified_temperature = temperature;
+
     /* Process incoming requests */
     while (1) {
         coap_error_t err = coap_process(&server, 1000);
@@ -216,11 +297,16 @@ void coap_server_task(void *param) {
         if (temperature < 20.0f) temperature = 20.0f;
         if (temperature > 30.0f) temperature = 30.0f;
 
+        /* Push significant changes to observers instead of being polled */
+        if (temperature - notified_temperature >= 0.5f || notified_temperature - temperature >= 0.5f) {
+            coap_resource_notify(&server, temperature_resource);
+            notified_temperature = temperature;
+        }
+
         humidity += (rand() % 10 - 5) / 10.0f;
         if (humidity < 40.0f) humidity = 40.0f;
         if (humidity > 80.0f) humidity = 80.0f;
 
-        os_task_delay(100);
     }
 
     coap_stop(&server);
@@ -230,6 +316,61 @@ void coap_server_task(void *param) {
  * CoAP Client Task
  * ==================== */
 
+static volatile int concurrent_pending;
+
+static uint32_t log_received;
+
+/* Block sink for Test 7: blocks may arrive out of order */
+static coap_error_t log_sink(void *user_data, uint32_t offset, const uint8_t *data, uint16_t length,
+                             bool complete) {
+    if (!data) {
+        log_received = 0;
+        return COAP_OK;
+    }
+    log_received += length;
+    if (complete) {
+        printf("[Client] /log complete: %lu bytes\n", (unsigned long)log_received);
+    }
+    return COAP_OK;
+}
+
+/* Completion callback for the asynchronous requests in Test 6 */
+static void concurrent_response_handler(
+    coap_context_t *context,
+    const coap_response_t *response,
+    void *user_data
+) {
+    const char *path = user_data;
+
+    if (response->error != COAP_OK) {
+        printf("[Client] %s: %s\n", path, coap_error_to_string(response->error));
+    } else {
+        printf("[Client] %s: %s %.*s\n", path, coap_response_code_to_string(response->code),
+               response->payload_length, response->payload);
+    }
+    concurrent_pending--;
+}
+
+/* Called per group member response in Test 9, then once with a timeout */
+static void group_response_handler(
+    coap_context_t *context,
+    const coap_response_t *response,
+    void *user_data
+) {
+    (void)context;
+    volatile bool *done = user_data;
+
+    if (response->error == COAP_ERROR_TIMEOUT) {
+        *done = true;
+        return;
+    }
+
+    uint32_t ip = response->source.ip_address;     /* COAP_IPV4 byte order */
+    printf("[Client] %u.%u.%u.%u: %s %.*s\n",
+           (unsigned)(ip & 0xFF), (unsigned)((ip >> 8) & 0xFF), (unsigned)((ip >> 16) & 0xFF), (unsigned)(ip >> 24),
+           coap_response_code_to_string(response->code), response->payload_length, response->payload);
+}
+
 void coap_client_task(void *param) {
     printf("\n=== CoAP Client Task Started ===\n");
 
@@ -239,11 +380,12 @@ void coap_client_task(void *param) {
     /* Initialize CoAP client */
     coap_context_t client;
     coap_config_t config = {
-        .bind_address = CLIENT_IP,
-        .port = 0,  /* Random port */
+        .bind_address = COAP_IPV4(CLIENT_IP),
+        .port = CLIENT_PORT,
         .enable_observe = false,
         .ack_timeout_ms = COAP_ACK_TIMEOUT_MS,
-        .max_retransmit = COAP_MAX_RETRANSMIT
+        .max_retransmit = COAP_MAX_RETRANSMIT,
+        .nstart = 3  /* Allow Test 6 to have three requests in flight */
     };
 
     if (coap_init(&client, &config, false) != COAP_OK) {
@@ -265,7 +407,7 @@ void coap_client_task(void *param) {
         /* Test 1: GET temperature */
         printf("\n[Client] --- Test 1: GET /sensor/temperature ---\n");
         memset(&response, 0, sizeof(response));
-        err = coap_get(&client, SERVER_IP, SERVER_PORT, "/sensor/temperature", &response, 5000);
+        err = coap_get(&client, COAP_IPV4(SERVER_IP), SERVER_PORT, "/sensor/temperature", &response, 5000);
 
         if (err == COAP_OK) {
             printf("[Client] Response code: %s\n", coap_response_code_to_string(response.code));
@@ -282,7 +424,7 @@ void coap_client_task(void *param) {
         /* Test 2: GET humidity */
         printf("\n[Client] --- Test 2: GET /sensor/humidity ---\n");
         memset(&response, 0, sizeof(response));
-        err = coap_get(&client, SERVER_IP, SERVER_PORT, "/sensor/humidity", &response, 5000);
+        err = coap_get(&client, COAP_IPV4(SERVER_IP), SERVER_PORT, "/sensor/humidity", &response, 5000);
 
         if (err == COAP_OK) {
             printf("[Client] Response code: %s\n", coap_response_code_to_string(response.code));
@@ -300,7 +442,7 @@ void coap_client_task(void *param) {
         printf("\n[Client] --- Test 3: PUT /actuator/led (turn on) ---\n");
         const char *led_on = "{\"state\":\"on\"}";
         memset(&response, 0, sizeof(response));
-        err = coap_put(&client, SERVER_IP, SERVER_PORT, "/actuator/led",
+        err = coap_put(&client, COAP_IPV4(SERVER_IP), SERVER_PORT, "/actuator/led",
                       COAP_CONTENT_FORMAT_JSON,
                       (const uint8_t *)led_on, strlen(led_on),
                       &response, 5000);
@@ -317,7 +459,7 @@ void coap_client_task(void *param) {
         /* Test 4: GET LED state */
         printf("\n[Client] --- Test 4: GET /actuator/led ---\n");
         memset(&response, 0, sizeof(response));
-        err = coap_get(&client, SERVER_IP, SERVER_PORT, "/actuator/led", &response, 5000);
+        err = coap_get(&client, COAP_IPV4(SERVER_IP), SERVER_PORT, "/actuator/led", &response, 5000);
 
         if (err == COAP_OK) {
             printf("[Client] Response code: %s\n", coap_response_code_to_string(response.code));
@@ -335,7 +477,7 @@ void coap_client_task(void *param) {
         printf("\n[Client] --- Test 5: POST /data ---\n");
         const char *post_data = "{\"sensor\":\"test\",\"value\":42}";
         memset(&response, 0, sizeof(response));
-        err = coap_post(&client, SERVER_IP, SERVER_PORT, "/data",
+        err = coap_post(&client, COAP_IPV4(SERVER_IP), SERVER_PORT, "/data",
                        COAP_CONTENT_FORMAT_JSON,
                        (const uint8_t *)post_data, strlen(post_data),
                        &response, 5000);
@@ -350,6 +492,76 @@ void coap_client_task(void *param) {
             printf("[Client] Error: %s\n", coap_error_to_string(err));
         }
 
+        os_task_delay(2000);
+
+        /* Test 6: concurrent GETs completed through the response handler */
+        printf("\n[Client] --- Test 6: 3 concurrent GETs ---\n");
+        static const char *paths[] = { "/sensor/temperature", "/sensor/humidity", "/actuator/led" };
+        concurrent_pending = 0;
+        for (int i = 0; i < 3; i++) {
+            coap_request_t request = {
+                .method = COAP_METHOD_GET,
+                .uri_path = paths[i],
+                .timeout_ms = 5000
+            };
+            err = coap_request_async(&client, COAP_IPV4(SERVER_IP), SERVER_PORT, &request,
+                                     concurrent_response_handler, (void *)paths[i]);
+            if (err == COAP_OK) {
+                concurrent_pending++;
+            } else {
+                printf("[Client] %s: %s\n", paths[i], coap_error_to_string(err));
+            }
+        }
+        while (concurrent_pending > 0) {
+            coap_process(&client, 1000);
+        }
+
+        os_task_delay(2000);
+
+        /* Test 7: block-wise download, up to nstart blocks in flight */
+        printf("\n[Client] --- Test 7: GET /log (block-wise) ---\n");
+        err = coap_block_download(&client, COAP_IPV4(SERVER_IP), SERVER_PORT, "/log",
+                                  log_sink, NULL, 5000);
+        if (err != COAP_OK) {
+            printf("[Client] Error: %s\n", coap_error_to_string(err));
+        }
+
+        os_task_delay(2000);
+
+        /* Test 8: empty ACK first, response later as a separate CON */
+        printf("\n[Client] --- Test 8: GET /sensor/slow (separate response) ---\n");
+        memset(&response, 0, sizeof(response));
+        err = coap_get(&client, COAP_IPV4(SERVER_IP), SERVER_PORT, "/sensor/slow", &response, 5000);
+
+        if (err == COAP_OK) {
+            printf("[Client] Response code: %s\n", coap_response_code_to_string(response.code));
+            if (response.payload && response.payload_length > 0) {
+                printf("[Client] Payload: %.*s\n", response.payload_length, response.payload);
+                coap_response_free(&response);
+            }
+        } else {
+            printf("[Client] Error: %s\n", coap_error_to_string(err));
+        }
+
+        os_task_delay(2000);
+
+        /* Test 9: one multicast GET reaches every node in the group */
+        printf("\n[Client] --- Test 9: GET /.well-known/core to 224.0.1.187 (group) ---\n");
+        coap_request_t group_request = {
+            .method = COAP_METHOD_GET,
+            .uri_path = "/.well-known/core"
+        };
+        volatile bool group_done = false;
+        err = coap_group_request(&client, COAP_IPV4(COAP_MULTICAST_IPV4), SERVER_PORT, &group_request,
+                                 group_response_handler, (void *)&group_done);
+        if (err == COAP_OK) {
+            while (!group_done) {
+                coap_process(&client, 1000);
+            }
+        } else {
+            printf("[Client] Error: %s\n", coap_error_to_string(err));
+        }
+
         os_task_delay(5000);
     }
 
@@ -396,9 +608,11 @@ int main(void) {
     printf("Network started successfully\n");
 
     /* Create tasks */
-    static tcb_t server_task, client_task;
+    static tcb_t server_task, client_task, sensor_task;
 
+    os_semaphore_init(&slow_sem, 0);
     os_task_create(&server_task, "coap_server", coap_server_task, NULL, PRIORITY_NORMAL);
+    os_task_create(&sensor_task, "slow_sensor", slow_sensor_task, NULL, PRIORITY_LOW);
     os_task_create(&client_task, "coap_client", coap_client_task, NULL, PRIORITY_NORMAL);
 
     printf("Tasks created\n");
@@ -0,0 +1,241 @@
+/**
+ * @file coap_stack_bench.c
+ * @brief CoAP Stack Usage Benchmark for TinyOS-RTOS
+ *
+ * This example demonstrates:
+ * - Running a CoAP server task and a CoAP client task over the loopback driver
+ * - Exercising a plain GET, a Block1 upload and a Block2 download
+ * - Measuring the peak stack of both tasks after each phase
+ *
+ * Stack use is read with os_task_get_stats(), which finds the deepest
+ * non-zero word of the task stack, so figures are high-water marks that
+ * include the task's own locals. Build with `make example-coap-stack`,
+ * which raises STACK_SIZE so an overrun cannot corrupt the measurement.
+ */
+
+#include "tinyos.h"
+#include "tinyos/net.h"
+#include "tinyos/coap.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Benchmark Configuration */
+#define BENCH_IP            IPV4(192, 168, 1, 150)  /* Our own address */
+#define BENCH_SERVER_PORT   COAP_DEFAULT_PORT
+#define BENCH_CLIENT_PORT   (COAP_DEFAULT_PORT + 100)
+#define BENCH_BODY_SIZE     4096                    /* Block transfer body */
+#define BENCH_REQUESTS      20
+#define BENCH_TARGET_BYTES  1536                    /* Peak stack goal per CoAP task */
+
+static coap_context_t server;
+static coap_context_t client;
+static tcb_t server_tcb;
+static tcb_t client_tcb;
+
+static uint8_t upload_body[BENCH_BODY_SIZE];
+static uint32_t upload_received;
+static volatile bool server_ready;
+
+/* ========== Server Resources ========== */
+
+static void value_handler(coap_context_t *context, coap_resource_t *resource,
+                          const coap_pdu_t *request, coap_pdu_t *response, void *user_data) {
+    (void)context;
+    (void)resource;
+    (void)request;
+    (void)user_data;
+
+    /* Render straight into the response buffer */
+    uint16_t capacity;
+    uint8_t *payload = coap_pdu_payload_buffer(response, &capacity);
+    if (payload) {
+        int length = snprintf((char *)payload, capacity, "{\"value\":%lu}", (unsigned long)os_get_uptime_ms());
+        coap_pdu_set_payload(response, payload, (length > 0 && length < capacity) ? length : 0);
+    }
+}
+
+static int32_t body_read(void *user_data, uint32_t offset, uint8_t *buffer, uint16_t length,
+                         uint32_t *total_size) {
+    (void)user_data;
+
+    *total_size = BENCH_BODY_SIZE;
+    if (offset >= BENCH_BODY_SIZE) {
+        return 0;
+    }
+    if (length > BENCH_BODY_SIZE - offset) {
+        length = BENCH_BODY_SIZE - offset;
+    }
+    for (uint16_t i = 0; i < length; i++) {
+        buffer[i] = (uint8_t)(offset + i);
+    }
+    return length;
+}
+
+static coap_error_t body_write(void *user_data, uint32_t offset, const uint8_t *data, uint16_t length,
+                               bool complete) {
+    (void)user_data;
+    (void)complete;
+
+    if (!data) {
+        upload_received = 0;
+        return COAP_OK;
+    }
+    upload_received += length;
+    return (offset + length <= BENCH_BODY_SIZE) ? COAP_OK : COAP_ERROR_NO_MEMORY;
+}
+
+static coap_error_t download_sink(void *user_data, uint32_t offset, const uint8_t *data, uint16_t length,
+                                  bool complete) {
+    (void)complete;
+    uint32_t *received = user_data;
+
+    if (data) {
+        for (uint16_t i = 0; i < length; i++) {
+            if (data[i] != (uint8_t)(offset + i)) {
+                return COAP_ERROR_INVALID_MESSAGE;
+            }
+        }
+        *received += length;
+    }
+    return COAP_OK;
+}
+
+static int32_t upload_source(void *user_data, uint32_t offset, uint8_t *buffer, uint16_t length,
+                             uint32_t *total_size) {
+    (void)user_data;
+
+    *total_size = BENCH_BODY_SIZE;
+    if (offset >= BENCH_BODY_SIZE) {
+        return 0;
+    }
+    if (length > BENCH_BODY_SIZE - offset) {
+        length = BENCH_BODY_SIZE - offset;
+    }
+    memcpy(buffer, upload_body + offset, length);
+    return length;
+}
+
+/* ========== Measurements ========== */
+
+static void report(const char *phase, bool ok) {
+    task_stats_t server_stats, client_stats;
+    os_task_get_stats(&server_tcb, &server_stats);
+    os_task_get_stats(&client_tcb, &client_stats);
+
+    printf("  %-16s %-4s  server %5lu B  client %5lu B\n", phase, ok ? "ok" : "FAIL",
+           (unsigned long)server_stats.stack_used, (unsigned long)client_stats.stack_used);
+}
+
+static void server_task(void *param) {
+    (void)param;
+
+    /* Sockets need the scheduler running, so contexts start in their tasks */
+    coap_config_t config = { .port = BENCH_SERVER_PORT };
+    if (coap_init(&server, &config, true) != COAP_OK || coap_start(&server) != COAP_OK) {
+        printf("[Bench] Server start failed\n");
+        return;
+    }
+
+    coap_resource_create(&server, "/bench/value", value_handler, NULL);
+    coap_resource_t *body = coap_resource_create(&server, "/bench/body", value_handler, NULL);
+    coap_resource_set_block_handlers(body, body_read, body_write, NULL);
+    server_ready = true;
+
+    while (1) {
+        coap_process(&server, 100);
+    }
+}
+
+static void client_task(void *param) {
+    (void)param;
+    coap_response_t response;
+    bool ok;
+
+    coap_config_t config = { .port = BENCH_CLIENT_PORT, .nstart = 2 };
+    if (coap_init(&client, &config, false) != COAP_OK || coap_start(&client) != COAP_OK) {
+        printf("[Bench] Client start failed\n");
+        return;
+    }
+    while (!server_ready) {
+        os_task_delay(10);
+    }
+
+    printf("[Bench] Peak stack (high-water) after each phase, goal < %u B per task\n\n",
+           BENCH_TARGET_BYTES);
+    report("idle", true);
+
+    ok = true;
+    for (int i = 0; i < BENCH_REQUESTS; i++) {
+        ok &= coap_get(&client, COAP_IPV4(BENCH_IP), BENCH_SERVER_PORT, "/bench/value", &response, 5000) == COAP_OK &&
+              response.code == COAP_RESPONSE_205_CONTENT;
+        coap_response_free(&response);
+    }
+    report("GET", ok);
+
+    coap_request_t request = {
+        .method = COAP_METHOD_PUT,
+        .uri_path = "/bench/body",
+        .content_format = COAP_CONTENT_FORMAT_OCTET_STREAM,
+        .timeout_ms = 5000
+    };
+    ok = coap_block_upload(&client, COAP_IPV4(BENCH_IP), BENCH_SERVER_PORT, &request,
+                           upload_source, NULL, &response) == COAP_OK &&
+         response.code == COAP_RESPONSE_204_CHANGED && upload_received == BENCH_BODY_SIZE;
+    coap_response_free(&response);
+    report("Block1 upload", ok);
+
+    uint32_t received = 0;
+    ok = coap_block_download(&client, COAP_IPV4(BENCH_IP), BENCH_SERVER_PORT, "/bench/body",
+                             download_sink, &received, 5000) == COAP_OK && received == BENCH_BODY_SIZE;
+    report("Block2 download", ok);
+
+    task_stats_t server_stats, client_stats;
+    os_task_get_stats(&server_tcb, &server_stats);
+    os_task_get_stats(&client_tcb, &client_stats);
+    printf("\n[Bench] %s: peak %lu B of %lu B stack\n",
+           (server_stats.stack_used < BENCH_TARGET_BYTES && client_stats.stack_used < BENCH_TARGET_BYTES)
+               ? "PASS" : "OVER GOAL",
+           (unsigned long)(server_stats.stack_used > client_stats.stack_used ?
+                           server_stats.stack_used : client_stats.stack_used),
+           (unsigned long)server_stats.stack_size);
+
+    while (1) {
+        os_task_delay(1000);
+    }
+}
+
+/**
+ * @brief Main function
+ */
+int main(void) {
+    printf("\n");
+    printf("========================================\n");
+    printf("  TinyOS-RTOS CoAP Stack Usage Benchmark\n");
+    printf("========================================\n\n");
+
+    os_init();
+
+    net_config_t net_config = {
+        .mac = {{0x02, 0x00, 0x00, 0x00, 0x00, 0x01}},
+        .ip = BENCH_IP,
+        .netmask = {{255, 255, 255, 0}},
+        .gateway = {{192, 168, 1, 1}},
+        .dns = {{8, 8, 8, 8}}
+    };
+
+    extern net_driver_t *loopback_get_driver(void);
+    if (net_init(loopback_get_driver(), &net_config) != OS_OK || net_start() != OS_OK) {
+        printf("ERROR: Network initialization failed\n");
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < BENCH_BODY_SIZE; i++) {
+        upload_body[i] = (uint8_t)(i * 7);
+    }
+
+    os_task_create(&server_tcb, "coap_srv", server_task, NULL, PRIORITY_NORMAL);
+    os_task_create(&client_tcb, "coap_cli", client_task, NULL, PRIORITY_LOW);
+
+    os_start();
+    return 0;
+}
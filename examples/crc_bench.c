@@ -0,0 +1,180 @@
+/**
+ * @file crc_bench.c
+ * @brief CRC32 Throughput and Image Verification Benchmark for TinyOS-RTOS
+ *
+ * This example demonstrates:
+ * - CRC32 throughput of the compiled-in table mode against a bitwise loop
+ * - Verification time of a downloaded image (ota_end_update(), which
+ *   reads the image back and checks its CRC32)
+ * - Verification time at boot (ota_verify_partition(), as the bootloader
+ *   does before jumping to an image)
+ *
+ * Build once per table mode to compare them:
+ *
+ *     make example-crc
+ *     make example-crc EXTRA_CFLAGS=-DCRC32_MODE=CRC32_MODE_BYTE
+ *     make example-crc EXTRA_CFLAGS=-DCRC32_MODE=CRC32_MODE_NIBBLE
+ */
+
+#include "tinyos.h"
+#include "tinyos/ota.h"
+#include "tinyos/crc.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Benchmark Configuration */
+#define BENCH_BUFFER_SIZE   4096
+#define BENCH_ITERATIONS    256                 /* 1 MB through each CRC */
+#define BENCH_CHUNK_SIZE    OTA_CHUNK_SIZE      /* Download chunk size */
+
+static uint8_t buffer[BENCH_BUFFER_SIZE];
+
+static const uint32_t image_sizes[] = { 16 * 1024, 64 * 1024, 236 * 1024 };
+
+/**
+ * @brief Bitwise CRC32, the loop the examples used before crc.h
+ */
+static uint32_t bitwise_crc32(uint32_t crc, const uint8_t *data, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * @brief Payload byte at offset in the test image
+ */
+static uint8_t image_byte(uint32_t offset) {
+    return (uint8_t)((offset * 31) ^ (offset >> 8));
+}
+
+/**
+ * @brief Fill buffer with the test image payload starting at offset
+ */
+static void image_fill(uint8_t *data, uint32_t offset, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        data[i] = image_byte(offset + i);
+    }
+}
+
+/**
+ * @brief Stream a test image into the update partition
+ * @param end_ms Time spent in ota_end_update() (output)
+ */
+static ota_error_t install_image(uint32_t image_size, uint32_t *end_ms) {
+    ota_image_header_t header;
+    uint32_t payload_size = image_size - sizeof(ota_image_header_t);
+    uint32_t crc = CRC32_INIT;
+
+    for (uint32_t offset = 0; offset < payload_size; offset += BENCH_CHUNK_SIZE) {
+        uint32_t length = (payload_size - offset < BENCH_CHUNK_SIZE) ? payload_size - offset : BENCH_CHUNK_SIZE;
+        image_fill(buffer, offset, length);
+        crc = crc32_update(crc, buffer, length);
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = 0x544F5346;  /* "TOSF" */
+    header.version = 0x00010001;
+    snprintf(header.version_string, OTA_VERSION_STRING_MAX, "1.0.1");
+    header.image_size = image_size;
+    header.crc32 = crc32_final(crc);
+
+    ota_error_t err = ota_begin_update(NULL, NULL);
+    if (err == OTA_OK) {
+        err = ota_write_chunk((const uint8_t *)&header, sizeof(header), 0);
+    }
+    for (uint32_t offset = 0; err == OTA_OK && offset < payload_size; offset += BENCH_CHUNK_SIZE) {
+        uint32_t length = (payload_size - offset < BENCH_CHUNK_SIZE) ? payload_size - offset : BENCH_CHUNK_SIZE;
+        image_fill(buffer, offset, length);
+        err = ota_write_chunk(buffer, length, sizeof(header) + offset);
+    }
+    if (err != OTA_OK) {
+        return err;
+    }
+
+    uint32_t start = os_get_uptime_ms();
+    err = ota_end_update();
+    *end_ms = os_get_uptime_ms() - start;
+
+    return err;
+}
+
+static void bench_task(void *param) {
+    (void)param;
+
+    /* Throughput over RAM */
+    image_fill(buffer, 0, BENCH_BUFFER_SIZE);
+
+    uint32_t start = os_get_uptime_ms();
+    uint32_t table_crc = CRC32_INIT;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        table_crc = crc32_update(table_crc, buffer, BENCH_BUFFER_SIZE);
+    }
+    uint32_t table_ms = os_get_uptime_ms() - start;
+
+    start = os_get_uptime_ms();
+    uint32_t bitwise_crc = CRC32_INIT;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        bitwise_crc = bitwise_crc32(bitwise_crc, buffer, BENCH_BUFFER_SIZE);
+    }
+    uint32_t bitwise_ms = os_get_uptime_ms() - start;
+
+    printf("[Bench] CRC32 over %lu KB of RAM, check value %08lX (expect CBF43926)\n\n",
+           (unsigned long)(BENCH_BUFFER_SIZE * BENCH_ITERATIONS / 1024),
+           (unsigned long)crc32_calculate("123456789", 9));
+    printf("  %-8s %8s\n", "mode", "ms");
+    printf("  %-8s %8lu\n", crc32_mode_name(), (unsigned long)table_ms);
+    printf("  %-8s %8lu   %s\n", "bitwise", (unsigned long)bitwise_ms,
+           (table_crc == bitwise_crc) ? "results match" : "RESULTS DIFFER");
+
+    /* Image verification from flash */
+    printf("\n[Bench] Image verification with %s tables\n\n", crc32_mode_name());
+    printf("  %-8s %14s %12s\n", "image", "download ms", "boot ms");
+
+    for (uint32_t i = 0; i < sizeof(image_sizes) / sizeof(image_sizes[0]); i++) {
+        uint32_t end_ms = 0;
+        ota_error_t err = install_image(image_sizes[i], &end_ms);
+
+        start = os_get_uptime_ms();
+        if (err == OTA_OK) {
+            err = ota_verify_partition(ota_get_update_partition());
+        }
+        uint32_t boot_ms = os_get_uptime_ms() - start;
+
+        printf("  %5lu KB %14lu %12lu   %s\n", (unsigned long)(image_sizes[i] / 1024),
+               (unsigned long)end_ms, (unsigned long)boot_ms, ota_error_to_string(err));
+    }
+
+    printf("\n[Bench] download = ota_end_update(), boot = ota_verify_partition()\n");
+
+    while (1) {
+        os_task_delay(1000);
+    }
+}
+
+/**
+ * @brief Main function
+ */
+int main(void) {
+    printf("\n");
+    printf("========================================\n");
+    printf("  TinyOS-RTOS CRC32 Benchmark\n");
+    printf("========================================\n\n");
+
+    os_init();
+
+    if (ota_init(NULL) != OTA_OK) {
+        printf("ERROR: OTA initialization failed\n");
+        return 1;
+    }
+
+    static tcb_t bench_tcb;
+    os_task_create(&bench_tcb, "bench", bench_task, NULL, PRIORITY_NORMAL);
+
+    os_start();
+    return 0;
+}
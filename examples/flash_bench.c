@@ -0,0 +1,178 @@
+/**
+ * @file flash_bench.c
+ * @brief Flash Write Path Benchmark for TinyOS-RTOS
+ *
+ * This example demonstrates:
+ * - Small record writes coalesced in the page buffer, against programming
+ *   each record on its own (flash_flush() after every write)
+ * - Writing an image with flash_write(), where the task blocks once both
+ *   page buffers wait behind the queued erases
+ * - Queueing the same image with flash_submit() and working meanwhile
+ * - The simulation's operation counts, wear and modelled busy time
+ *
+ * Times come from the simulation's program and erase model (FLASH_SIM_*
+ * in drivers/flash.h); build with other values to model another part.
+ * They have tick resolution, so a flush that waits for one short program
+ * costs a whole tick.
+ */
+
+#include "tinyos.h"
+#include "drivers/flash.h"
+#include "tinyos/crc.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Benchmark Configuration */
+#define BENCH_AREA          FLASH_APP_B_START   /* Scratch area */
+#define BENCH_RECORD_SIZE   32
+#define BENCH_RECORDS       128                 /* 4 KB of records, one sector */
+#define BENCH_IMAGE_SIZE    (64 * 1024)
+
+static uint8_t image[BENCH_IMAGE_SIZE];
+
+static void bench_fill(void) {
+    uint32_t state = 0x1234567;
+    for (uint32_t i = 0; i < sizeof(image); i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        image[i] = (uint8_t)state;
+    }
+}
+
+static bool bench_check(uint32_t address, const uint8_t *data, uint32_t size) {
+    uint8_t buffer[256];
+    for (uint32_t offset = 0; offset < size; offset += sizeof(buffer)) {
+        uint32_t length = (size - offset < sizeof(buffer)) ? size - offset : sizeof(buffer);
+        if (flash_read(address + offset, buffer, length) != FLASH_OK ||
+            memcmp(buffer, data + offset, length) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void bench_records(bool coalesce) {
+    flash_erase_range(BENCH_AREA, BENCH_RECORDS * BENCH_RECORD_SIZE);
+    flash_flush();
+
+    uint32_t start = os_get_uptime_ms();
+    for (uint32_t i = 0; i < BENCH_RECORDS; i++) {
+        flash_write(BENCH_AREA + i * BENCH_RECORD_SIZE, image + i * BENCH_RECORD_SIZE, BENCH_RECORD_SIZE);
+        if (!coalesce) {
+            flash_flush();
+        }
+    }
+    flash_error_t err = flash_flush();
+    uint32_t elapsed = os_get_uptime_ms() - start;
+
+    printf("  %-26s %6lu ms   %s\n", coalesce ? "records, coalesced" : "records, one program each",
+           (unsigned long)elapsed,
+           (err == FLASH_OK && bench_check(BENCH_AREA, image, BENCH_RECORDS * BENCH_RECORD_SIZE)) ? "ok" : "FAILED");
+}
+
+static void bench_image(void) {
+    uint32_t start = os_get_uptime_ms();
+
+    /* Erases and pages go into the queue; only full page buffers wait */
+    flash_error_t err = flash_erase_range(BENCH_AREA, sizeof(image));
+    if (err == FLASH_OK) {
+        err = flash_write(BENCH_AREA, image, sizeof(image));
+    }
+    uint32_t submitted = os_get_uptime_ms() - start;
+    if (err == FLASH_OK) {
+        err = flash_flush();
+    }
+    uint32_t elapsed = os_get_uptime_ms() - start;
+
+    printf("  %-26s %6lu ms   %s (blocked in flash_write() %lu ms)\n",
+           "64 KB image, flash_write", (unsigned long)elapsed,
+           (err == FLASH_OK && bench_check(BENCH_AREA, image, sizeof(image))) ? "ok" : "FAILED",
+           (unsigned long)submitted);
+}
+
+static void bench_async(void) {
+    static flash_request_t requests[BENCH_IMAGE_SIZE / FLASH_PAGE_SIZE];
+    flash_request_t erase = {
+        .op = FLASH_OP_ERASE,
+        .address = BENCH_AREA,
+        .size = sizeof(image)
+    };
+
+    uint32_t start = os_get_uptime_ms();
+    flash_error_t err = flash_submit(&erase);
+    for (uint32_t i = 0; err == FLASH_OK && i < BENCH_IMAGE_SIZE / FLASH_PAGE_SIZE; i++) {
+        requests[i] = (flash_request_t){
+            .op = FLASH_OP_PROGRAM,
+            .address = BENCH_AREA + i * FLASH_PAGE_SIZE,
+            .buffer = image + i * FLASH_PAGE_SIZE,
+            .size = FLASH_PAGE_SIZE
+        };
+        err = flash_submit(&requests[i]);
+    }
+    uint32_t submitted = os_get_uptime_ms() - start;
+
+    /* Work while the device programs: CRC passes over the image */
+    uint32_t passes = 0;
+    uint32_t crc = 0;
+    while (err == FLASH_OK && flash_is_busy()) {
+        crc ^= crc32_calculate(image, 4096);
+        passes++;
+        os_task_yield();
+    }
+    uint32_t elapsed = os_get_uptime_ms() - start;
+
+    for (uint32_t i = 0; err == FLASH_OK && i < BENCH_IMAGE_SIZE / FLASH_PAGE_SIZE; i++) {
+        err = requests[i].result;
+    }
+
+    printf("  %-26s %6lu ms   %s (submitted in %lu ms, %lu CRC passes meanwhile)\n",
+           "64 KB image, flash_submit", (unsigned long)elapsed,
+           (err == FLASH_OK && erase.result == FLASH_OK && bench_check(BENCH_AREA, image, sizeof(image))) ?
+           "ok" : "FAILED", (unsigned long)submitted, (unsigned long)passes);
+    (void)crc;
+}
+
+static void bench_task(void *param) {
+    (void)param;
+
+    bench_fill();
+
+    printf("[Bench] program %u us + %u ns/byte, sector erase %u us\n\n",
+           FLASH_SIM_PROGRAM_SETUP_US, FLASH_SIM_PROGRAM_BYTE_NS, FLASH_SIM_SECTOR_ERASE_US);
+
+    bench_records(false);
+    bench_records(true);
+    bench_image();
+    bench_async();
+
+    printf("\n[Bench] times include waiting for the last operation (flash_flush)\n");
+    flash_sim_print_stats();
+
+    while (1) {
+        os_task_delay(1000);
+    }
+}
+
+/**
+ * @brief Main function
+ */
+int main(void) {
+    printf("\n");
+    printf("========================================\n");
+    printf("  TinyOS-RTOS Flash Write Benchmark\n");
+    printf("========================================\n\n");
+
+    os_init();
+
+    if (flash_init() != FLASH_OK) {
+        printf("ERROR: Flash initialization failed\n");
+        return 1;
+    }
+
+    static tcb_t bench_tcb;
+    os_task_create(&bench_tcb, "bench", bench_task, NULL, PRIORITY_NORMAL);
+
+    os_start();
+    return 0;
+}
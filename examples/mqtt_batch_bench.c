@@ -0,0 +1,253 @@
+/**
+ * @file mqtt_batch_bench.c
+ * @brief MQTT Publish Batching Benchmark for TinyOS-RTOS
+ *
+ * This example demonstrates:
+ * - Publishing high-rate 20-byte sensor samples one message at a time
+ * - Publishing the same samples through the mqtt_batch layer
+ * - Counting frames and bytes on the wire with a wrapping network driver
+ * - Reporting samples per second, MQTT messages and wire overhead
+ */
+
+#include "tinyos.h"
+#include "tinyos/net.h"
+#include "tinyos/mqtt.h"
+#include "tinyos/mqtt_batch.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Benchmark Configuration */
+#define MQTT_BROKER_HOST    "192.168.1.100"  /* Change to your MQTT broker */
+#define MQTT_BROKER_PORT    1883
+#define MQTT_CLIENT_ID      "tinyos_bench"
+#define BENCH_TOPIC         "bench/samples"
+#define BENCH_SAMPLES       1000
+#define BENCH_BATCH_BYTES   480
+#define BENCH_LATENCY_MS    200
+
+/* One sensor sample: 20 bytes on the wire */
+typedef struct {
+    uint32_t sequence;
+    int16_t accel[3];
+    int16_t gyro[3];
+    uint16_t temperature;
+    uint16_t flags;
+} __attribute__((packed)) bench_sample_t;
+
+/* Wire accounting */
+static struct {
+    uint32_t frames;
+    uint32_t bytes;
+} wire_stats;
+
+static net_driver_t *lower_driver;
+static net_driver_t counting_driver;
+
+static mqtt_client_t mqtt_client;
+static mqtt_batch_t mqtt_batcher;
+
+/* ========== Counting Driver ========== */
+
+static os_error_t counting_init(void) {
+    return lower_driver->init();
+}
+
+static os_error_t counting_send(const uint8_t *data, uint16_t length) {
+    os_error_t err = lower_driver->send(data, length);
+    if (err == OS_OK) {
+        wire_stats.frames++;
+        wire_stats.bytes += length;
+    }
+    return err;
+}
+
+static int32_t counting_receive(uint8_t *buffer, uint16_t max_length) {
+    return lower_driver->receive(buffer, max_length);
+}
+
+static void counting_get_mac(mac_addr_t *mac) {
+    lower_driver->get_mac(mac);
+}
+
+static bool counting_is_link_up(void) {
+    return lower_driver->is_link_up();
+}
+
+/* ========== Benchmark ========== */
+
+typedef struct {
+    const char *name;
+    uint32_t elapsed_ms;
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t messages;
+} bench_result_t;
+
+static void fill_sample(bench_sample_t *sample, uint32_t sequence) {
+    memset(sample, 0, sizeof(*sample));
+    sample->sequence = sequence;
+    sample->accel[0] = (int16_t)(sequence * 3);
+    sample->accel[1] = (int16_t)(sequence * 5);
+    sample->accel[2] = 1000;
+    sample->temperature = 2500;
+}
+
+static void wire_reset(void) {
+    uint32_t state = os_enter_critical();
+    wire_stats.frames = 0;
+    wire_stats.bytes = 0;
+    os_exit_critical(state);
+}
+
+static void run_unbatched(bench_result_t *result) {
+    bench_sample_t sample;
+
+    wire_reset();
+    uint32_t start = os_get_uptime_ms();
+
+    for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+        fill_sample(&sample, i);
+        while (mqtt_publish(&mqtt_client, BENCH_TOPIC, &sample, sizeof(sample),
+                            MQTT_QOS_0, false) != MQTT_OK) {
+            os_task_yield();  /* Driver queue full: let the stack drain */
+        }
+    }
+
+    result->name = "per-sample";
+    result->elapsed_ms = os_get_uptime_ms() - start;
+    result->frames = wire_stats.frames;
+    result->bytes = wire_stats.bytes;
+    result->messages = BENCH_SAMPLES;
+}
+
+static void run_batched(bench_result_t *result) {
+    bench_sample_t sample;
+    mqtt_batch_stats_t stats;
+
+    mqtt_batch_config_t config = {
+        .max_batch_bytes = BENCH_BATCH_BYTES,
+        .max_latency_ms = BENCH_LATENCY_MS,
+        .qos = MQTT_QOS_0,
+        .retained = false
+    };
+    mqtt_batch_init(&mqtt_batcher, &mqtt_client, &config);
+
+    wire_reset();
+    uint32_t start = os_get_uptime_ms();
+
+    for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+        fill_sample(&sample, i);
+        while (mqtt_batch_add(&mqtt_batcher, BENCH_TOPIC, &sample, sizeof(sample)) != MQTT_OK) {
+            os_task_yield();
+        }
+    }
+    mqtt_batch_flush(&mqtt_batcher);
+
+    mqtt_batch_get_stats(&mqtt_batcher, &stats);
+    mqtt_batch_deinit(&mqtt_batcher);
+
+    result->name = "batched";
+    result->elapsed_ms = os_get_uptime_ms() - start;
+    result->frames = wire_stats.frames;
+    result->bytes = wire_stats.bytes;
+    result->messages = stats.batches;
+}
+
+static void print_result(const bench_result_t *r) {
+    uint32_t elapsed = (r->elapsed_ms > 0) ? r->elapsed_ms : 1;
+    uint32_t payload = BENCH_SAMPLES * sizeof(bench_sample_t);
+
+    printf("  %-10s  %6lu samples/s  %5lu msgs  %5lu frames  %7lu bytes  %3lu%% payload\n",
+           r->name,
+           (unsigned long)(BENCH_SAMPLES * 1000UL / elapsed),
+           (unsigned long)r->messages,
+           (unsigned long)r->frames,
+           (unsigned long)r->bytes,
+           (unsigned long)(r->bytes ? payload * 100UL / r->bytes : 0));
+}
+
+static void bench_task(void *param) {
+    (void)param;
+    bench_result_t unbatched, batched;
+
+    printf("[Bench] Connecting to %s:%u...\n", MQTT_BROKER_HOST, MQTT_BROKER_PORT);
+    mqtt_error_t err = mqtt_connect(&mqtt_client);
+    if (err != MQTT_OK) {
+        printf("[Bench] Connection failed: %s\n", mqtt_error_to_string(err));
+        return;
+    }
+
+    printf("[Bench] %u samples of %u bytes, batch <= %u bytes / %u ms\n",
+           BENCH_SAMPLES, (unsigned)sizeof(bench_sample_t),
+           BENCH_BATCH_BYTES, BENCH_LATENCY_MS);
+
+    run_unbatched(&unbatched);
+    os_task_delay(500);
+    run_batched(&batched);
+
+    printf("\n[Bench] Results:\n");
+    print_result(&unbatched);
+    print_result(&batched);
+
+    if (batched.bytes > 0) {
+        printf("[Bench] Wire bytes reduced %lu.%lux\n",
+               (unsigned long)(unbatched.bytes / batched.bytes),
+               (unsigned long)((unbatched.bytes * 10UL / batched.bytes) % 10));
+    }
+
+    mqtt_disconnect(&mqtt_client);
+}
+
+/**
+ * @brief Main function
+ */
+int main(void) {
+    printf("\n");
+    printf("========================================\n");
+    printf("  TinyOS-RTOS MQTT Batching Benchmark\n");
+    printf("========================================\n\n");
+
+    os_init();
+
+    /* Wrap the platform driver to count frames and bytes sent */
+    extern net_driver_t *loopback_get_driver(void);
+    lower_driver = loopback_get_driver();
+    counting_driver.init = counting_init;
+    counting_driver.send = counting_send;
+    counting_driver.receive = counting_receive;
+    counting_driver.get_mac = counting_get_mac;
+    counting_driver.is_link_up = counting_is_link_up;
+
+    net_config_t net_config = {
+        .mac = {{0x02, 0x00, 0x00, 0x00, 0x00, 0x01}},
+        .ip = {{192, 168, 1, 150}},
+        .netmask = {{255, 255, 255, 0}},
+        .gateway = {{192, 168, 1, 1}},
+        .dns = {{8, 8, 8, 8}}
+    };
+
+    if (net_init(&counting_driver, &net_config) != OS_OK || net_start() != OS_OK) {
+        printf("ERROR: Network initialization failed\n");
+        return 1;
+    }
+
+    mqtt_config_t config = {
+        .broker_host = MQTT_BROKER_HOST,
+        .broker_port = MQTT_BROKER_PORT,
+        .client_id = MQTT_CLIENT_ID,
+        .keepalive_sec = 60,
+        .clean_session = true,
+        .timeout_ms = 5000
+    };
+
+    if (mqtt_client_init(&mqtt_client, &config) != MQTT_OK) {
+        printf("ERROR: MQTT initialization failed\n");
+        return 1;
+    }
+
+    tcb_t bench_tcb;
+    os_task_create(&bench_tcb, "bench", bench_task, NULL, PRIORITY_NORMAL);
+
+    os_start();
+    return 0;
+}
@@ -0,0 +1,264 @@
+/**
+ * @file mqtt_bench.c
+ * @brief End-to-End MQTT Benchmark for TinyOS-RTOS
+ *
+ * This example demonstrates:
+ * - Running the in-process MQTT broker over the loopback driver
+ * - Measuring publish rate at QoS 0, 1 and 2
+ * - Measuring publish-to-delivery latency percentiles
+ * - Measuring reconnect time after a simulated broker restart
+ *
+ * Needs no network: client and broker talk through drivers/loopback_net.c.
+ * Latency resolution is one system tick.
+ */
+
+#include "tinyos.h"
+#include "tinyos/net.h"
+#include "tinyos/mqtt.h"
+#include "tinyos/mqtt_broker.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Benchmark Configuration */
+#define BENCH_BROKER_HOST   "192.168.1.150"  /* Our own address */
+#define BENCH_TOPIC         "bench/data"
+#define BENCH_MESSAGES      500
+#define BENCH_PAYLOAD       32
+#define BENCH_WINDOW        MQTT_MAX_PENDING  /* Unacknowledged QoS>0 publishes */
+#define BENCH_RECONNECTS    5
+#define BENCH_LATENCY_BINS  256              /* 1 ms bins; last bin is overflow */
+
+static mqtt_client_t pub_client;
+static mqtt_client_t sub_client;
+
+static semaphore_t window_sem;
+
+static struct {
+    volatile uint32_t received;
+    uint32_t histogram[BENCH_LATENCY_BINS];
+} rx_stats;
+
+static volatile bool pub_connected;
+
+/* ========== Callbacks ========== */
+
+static void bench_message_received(mqtt_client_t *client, const mqtt_message_t *message, void *user_data) {
+    (void)client;
+    (void)user_data;
+
+    if (message->payload_length < 8) {
+        return;
+    }
+
+    uint32_t sent_ms;
+    memcpy(&sent_ms, message->payload + 4, sizeof(sent_ms));
+
+    uint32_t latency = os_get_uptime_ms() - sent_ms;
+    if (latency >= BENCH_LATENCY_BINS) {
+        latency = BENCH_LATENCY_BINS - 1;
+    }
+    rx_stats.histogram[latency]++;
+    rx_stats.received++;
+}
+
+static void bench_publish_done(mqtt_client_t *client, mqtt_error_t result, void *user_data) {
+    (void)client;
+    (void)result;
+    (void)user_data;
+    os_semaphore_post(&window_sem);
+}
+
+static void bench_pub_connection(mqtt_client_t *client, bool connected, void *user_data) {
+    (void)client;
+    (void)user_data;
+    pub_connected = connected;
+}
+
+/* ========== Measurements ========== */
+
+static uint32_t latency_percentile(uint32_t percent) {
+    uint32_t target = (rx_stats.received * percent + 99) / 100;
+    uint32_t seen = 0;
+
+    for (uint32_t i = 0; i < BENCH_LATENCY_BINS; i++) {
+        seen += rx_stats.histogram[i];
+        if (seen >= target && target > 0) {
+            return i;
+        }
+    }
+    return BENCH_LATENCY_BINS - 1;
+}
+
+static void run_qos(mqtt_qos_t qos) {
+    uint8_t payload[BENCH_PAYLOAD];
+    uint32_t published = 0;
+
+    memset(&rx_stats, 0, sizeof(rx_stats));
+    memset(payload, 0xA5, sizeof(payload));
+    os_semaphore_init(&window_sem, BENCH_WINDOW);
+
+    uint32_t start = os_get_uptime_ms();
+
+    while (published < BENCH_MESSAGES) {
+        os_semaphore_wait(&window_sem, OS_WAIT_FOREVER);
+
+        uint32_t now = os_get_uptime_ms();
+        memcpy(payload, &published, 4);
+        memcpy(payload + 4, &now, 4);
+
+        mqtt_error_t err = mqtt_publish_async(&pub_client, BENCH_TOPIC, payload, sizeof(payload),
+                                              qos, false, bench_publish_done, NULL);
+        if (err != MQTT_OK) {
+            os_semaphore_post(&window_sem);
+            os_task_delay(1);
+            continue;
+        }
+        published++;
+    }
+
+    /* Wait for deliveries to drain (bounded) */
+    uint32_t deadline = os_get_uptime_ms() + MQTT_DEFAULT_TIMEOUT_MS;
+    while (rx_stats.received < BENCH_MESSAGES && (int32_t)(deadline - os_get_uptime_ms()) > 0) {
+        os_task_delay(1);
+    }
+
+    uint32_t elapsed = os_get_uptime_ms() - start;
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+
+    printf("  QoS %d  %6lu msg/s  delivered %lu/%u  latency p50 %lu ms  p90 %lu ms  p99 %lu ms\n",
+           qos,
+           (unsigned long)(rx_stats.received * 1000UL / elapsed),
+           (unsigned long)rx_stats.received, BENCH_MESSAGES,
+           (unsigned long)latency_percentile(50),
+           (unsigned long)latency_percentile(90),
+           (unsigned long)latency_percentile(99));
+}
+
+static void run_reconnect(void) {
+    uint32_t min_ms = UINT32_MAX, max_ms = 0, total_ms = 0, count = 0;
+
+    for (int i = 0; i < BENCH_RECONNECTS; i++) {
+        uint32_t start = os_get_uptime_ms();
+        mqtt_broker_drop_clients();
+
+        /* Wait for the drop to be noticed, then for CONNACK */
+        while (pub_connected && (os_get_uptime_ms() - start) < MQTT_DEFAULT_TIMEOUT_MS) {
+            os_task_delay(1);
+        }
+        while (!pub_connected && (os_get_uptime_ms() - start) < MQTT_DEFAULT_TIMEOUT_MS) {
+            os_task_delay(1);
+        }
+        if (!pub_connected) {
+            printf("  Reconnect %d timed out\n", i);
+            continue;
+        }
+
+        uint32_t elapsed = os_get_uptime_ms() - start;
+        min_ms = (elapsed < min_ms) ? elapsed : min_ms;
+        max_ms = (elapsed > max_ms) ? elapsed : max_ms;
+        total_ms += elapsed;
+        count++;
+
+        os_task_delay(100);
+    }
+
+    if (count > 0) {
+        printf("  Reconnect  min %lu ms  avg %lu ms  max %lu ms  (%lu/%d)\n",
+               (unsigned long)min_ms, (unsigned long)(total_ms / count),
+               (unsigned long)max_ms, (unsigned long)count, BENCH_RECONNECTS);
+    }
+}
+
+static void bench_task(void *param) {
+    (void)param;
+
+    /* Sockets need the scheduler running, so the broker starts here */
+    mqtt_broker_config_t broker_config = {
+        .port = MQTT_DEFAULT_PORT,
+        .priority = PRIORITY_NORMAL
+    };
+    if (mqtt_broker_start(&broker_config) != MQTT_OK) {
+        printf("[Bench] Broker start failed\n");
+        return;
+    }
+
+    if (mqtt_connect(&sub_client) != MQTT_OK || mqtt_connect(&pub_client) != MQTT_OK) {
+        printf("[Bench] Could not connect to local broker\n");
+        return;
+    }
+
+    /* Wait for SUBACK before publishing */
+    os_semaphore_init(&window_sem, 0);
+    if (mqtt_subscribe_async(&sub_client, BENCH_TOPIC, MQTT_QOS_2, bench_publish_done, NULL) != MQTT_OK ||
+        os_semaphore_wait(&window_sem, MQTT_DEFAULT_TIMEOUT_MS) != OS_OK) {
+        printf("[Bench] Subscribe failed\n");
+        return;
+    }
+
+    printf("[Bench] %u messages of %u bytes, window %u\n\n",
+           BENCH_MESSAGES, BENCH_PAYLOAD, BENCH_WINDOW);
+
+    run_qos(MQTT_QOS_0);
+    run_qos(MQTT_QOS_1);
+    run_qos(MQTT_QOS_2);
+    run_reconnect();
+
+    mqtt_broker_stats_t stats;
+    mqtt_broker_get_stats(&stats);
+    printf("\n[Bench] Broker: %lu connections, %lu in, %lu out, %lu send errors\n",
+           (unsigned long)stats.connections, (unsigned long)stats.publishes_in,
+           (unsigned long)stats.publishes_out, (unsigned long)stats.send_errors);
+}
+
+/**
+ * @brief Main function
+ */
+int main(void) {
+    printf("\n");
+    printf("========================================\n");
+    printf("  TinyOS-RTOS MQTT End-to-End Benchmark\n");
+    printf("========================================\n\n");
+
+    os_init();
+
+    net_config_t net_config = {
+        .mac = {{0x02, 0x00, 0x00, 0x00, 0x00, 0x01}},
+        .ip = {{192, 168, 1, 150}},
+        .netmask = {{255, 255, 255, 0}},
+        .gateway = {{192, 168, 1, 1}},
+        .dns = {{8, 8, 8, 8}}
+    };
+
+    extern net_driver_t *loopback_get_driver(void);
+    if (net_init(loopback_get_driver(), &net_config) != OS_OK || net_start() != OS_OK) {
+        printf("ERROR: Network initialization failed\n");
+        return 1;
+    }
+
+    mqtt_config_t config = {
+        .broker_host = BENCH_BROKER_HOST,
+        .broker_port = MQTT_DEFAULT_PORT,
+        .keepalive_sec = 30,
+        .clean_session = true,
+        .timeout_ms = MQTT_DEFAULT_TIMEOUT_MS,
+        .auto_reconnect = true,
+        .reconnect_interval_ms = 50,
+        .reconnect_max_interval_ms = 1000
+    };
+
+    config.client_id = "bench_sub";
+    mqtt_client_init(&sub_client, &config);
+    mqtt_set_message_callback(&sub_client, bench_message_received, NULL);
+
+    config.client_id = "bench_pub";
+    mqtt_client_init(&pub_client, &config);
+    mqtt_set_connection_callback(&pub_client, bench_pub_connection, NULL);
+
+    tcb_t bench_tcb;
+    os_task_create(&bench_tcb, "bench", bench_task, NULL, PRIORITY_LOW);
+
+    os_start();
+    return 0;
+}
@@ -125,6 +125,21 @@ static void mqtt_connection_changed(mqtt_client_t *client,
     }
 }
 
+/**
+ * @brief Connect completion callback (runs in the MQTT service task)
+ */
+static void mqtt_connect_done(mqtt_client_t *client, mqtt_error_t result, void *user_data) {
+    (void)client;
+    (void)user_data;
+    if (result != MQTT_OK) {
+        printf("[MQTT] Connection failed: %s\n", mqtt_error_to_string(result));
+        printf("[MQTT] Please check:\n");
+        printf("  1. Broker is running at %s:%u\n", MQTT_BROKER_HOST, MQTT_BROKER_PORT);
+        printf("  2. Network connectivity\n");
+        printf("  3. Firewall settings\n");
+    }
+}
+
 /**
  * @brief Sensor publishing task
  */
@@ -277,14 +292,11 @@ int main(void) {
     printf("[MQTT] Connecting to broker at %s:%u...\n",
            MQTT_BROKER_HOST, MQTT_BROKER_PORT);
 
-    mqtt_error_t err = mqtt_connect(&mqtt_client);
+    /* Non-blocking: the MQTT service task completes the handshake once the
+     * scheduler is running and reports through mqtt_connect_done() */
+    mqtt_error_t err = mqtt_connect_async(&mqtt_client, mqtt_connect_done, NULL);
     if (err != MQTT_OK) {
-        printf("[MQTT] Connection failed: %s\n", mqtt_error_to_string(err));
-        printf("[MQTT] Please check:\n");
-        printf("  1. Broker is running at %s:%u\n", MQTT_BROKER_HOST, MQTT_BROKER_PORT);
-        printf("  2. Network connectivity\n");
-        printf("  3. Firewall settings\n");
-        /* Continue anyway - auto-reconnect will retry */
+        printf("[MQTT] Connect request failed: %s\n", mqtt_error_to_string(err));
     }
 
     /* Create sensor task */
@@ -0,0 +1,184 @@
+/**
+ * @file ota_delta_bench.c
+ * @brief Delta OTA Patch Size and Apply Time Benchmark for TinyOS-RTOS
+ *
+ * This example demonstrates:
+ * - Generating patches between synthetic firmware versions with the
+ *   host generator (tools/ota_diff.c, compiled in for the benchmark)
+ * - Applying each patch from the running partition into the update
+ *   partition with ota_patch_write(), in download-sized chunks
+ * - Comparing patch size and apply time with installing the full image
+ *
+ * The synthetic firmware is made of 32-bit words, a fifth of them
+ * absolute addresses into the image, like literal pools in Thumb code.
+ * Inserting code shifts every later address, which is the case delta
+ * formats have to handle well.
+ *
+ * On a device the patch comes from the update server; the generator
+ * needs the old and new images in RAM and only runs here because the
+ * benchmark is self-contained.
+ */
+
+#include "tinyos.h"
+#include "tinyos/ota.h"
+#include "tinyos/ota_delta.h"
+#include "tinyos/crc.h"
+#include "drivers/flash.h"
+#include <stdio.h>
+#include <string.h>
+
+#define OTA_DIFF_NO_MAIN
+#include "../tools/ota_diff.c"
+
+/* Benchmark Configuration */
+#define BENCH_IMAGE_SIZE    (48 * 1024)         /* Payload of the base image */
+#define BENCH_CHUNK_SIZE    OTA_CHUNK_SIZE      /* Patch bytes per ota_patch_write() */
+#define BENCH_CODE_BASE     0x08004000          /* Address the image runs at */
+#define BENCH_IMAGE_MAX     (BENCH_IMAGE_SIZE + 8192)   /* Room for inserted code and the header */
+
+static uint8_t old_image[BENCH_IMAGE_MAX];
+static uint8_t new_image[BENCH_IMAGE_MAX];
+static uint8_t patch_data[BENCH_IMAGE_MAX + 4096];
+static int32_t work[(1 << OTA_DIFF_HASH_BITS) + BENCH_IMAGE_MAX];
+
+static uint32_t rng_state;
+
+static uint32_t bench_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/**
+ * @brief Build an image from a word generator
+ *
+ * Word i is an address (into the image, moved by shift past shift_at) or
+ * an instruction-like value; the sequence is the same for every version
+ * except where inserted or changed, so versions share most of their code.
+ */
+static uint32_t build_image(uint8_t *image, uint32_t version, uint32_t insert_at, uint32_t insert_words,
+                            uint32_t changes, bool unrelated) {
+    uint32_t words = BENCH_IMAGE_SIZE / 4;
+    uint32_t shift = insert_words * 4;
+    uint32_t *payload = (uint32_t *)(image + sizeof(ota_image_header_t));
+    uint32_t count = 0;
+
+    rng_state = unrelated ? 0xC0FFEE : 0x1234567;
+    for (uint32_t i = 0; i < words; i++) {
+        if (i == insert_at) {
+            uint32_t saved = rng_state;
+            rng_state = 0xBADF00D;
+            for (uint32_t j = 0; j < insert_words; j++) {
+                payload[count++] = bench_random();
+            }
+            rng_state = saved;
+        }
+
+        uint32_t r = bench_random();
+        if (r % 5 == 0) {
+            uint32_t target = (bench_random() % words) * 4;
+            payload[count++] = BENCH_CODE_BASE + target + ((target >= insert_at * 4) ? shift : 0);
+        } else {
+            payload[count++] = r & 0xFFFF00FF;
+        }
+    }
+
+    /* Scattered edits, e.g. changed constants */
+    rng_state = 0x5EED;
+    for (uint32_t i = 0; i < changes; i++) {
+        payload[bench_random() % count] = bench_random();
+    }
+
+    ota_image_header_t *header = (ota_image_header_t *)image;
+    memset(header, 0, sizeof(ota_image_header_t));
+    header->magic = 0x544F5346;  /* "TOSF" */
+    header->version = version;
+    snprintf(header->version_string, OTA_VERSION_STRING_MAX, "1.0.%lu", (unsigned long)(version & 0xFF));
+    header->image_size = sizeof(ota_image_header_t) + count * 4;
+    header->crc32 = crc32_calculate(payload, count * 4);
+
+    return header->image_size;
+}
+
+static void run_case(const char *label, uint32_t old_size, uint32_t new_size) {
+    size_t ops = 0;
+    size_t patch_size = ota_diff_generate(old_image, old_size, new_image, new_size,
+                                          patch_data, sizeof(patch_data), work, &ops);
+    if (patch_size == 0) {
+        printf("  %-14s patch generation failed\n", label);
+        return;
+    }
+
+    /* Apply the patch as it would stream in */
+    uint32_t start = os_get_uptime_ms();
+    ota_error_t err = ota_patch_begin(NULL, NULL);
+    for (size_t offset = 0; err == OTA_OK && offset < patch_size; offset += BENCH_CHUNK_SIZE) {
+        size_t length = (patch_size - offset < BENCH_CHUNK_SIZE) ? patch_size - offset : BENCH_CHUNK_SIZE;
+        err = ota_patch_write(patch_data + offset, length);
+    }
+    if (err == OTA_OK) {
+        err = ota_patch_end();
+    }
+    uint32_t apply_ms = os_get_uptime_ms() - start;
+
+    /* The same image installed in full, for comparison */
+    start = os_get_uptime_ms();
+    ota_error_t full_err = ota_start_update_from_buffer(new_image, new_size, NULL, NULL);
+    uint32_t full_ms = os_get_uptime_ms() - start;
+
+    printf("  %-14s %6lu %6lu %5lu%% %4lu %8lu %8lu   %s\n", label,
+           (unsigned long)new_size, (unsigned long)patch_size,
+           (unsigned long)(patch_size * 100 / new_size), (unsigned long)ops,
+           (unsigned long)apply_ms, (unsigned long)full_ms,
+           (err == OTA_OK && full_err == OTA_OK) ? "ok" : ota_error_to_string(err));
+}
+
+static void bench_task(void *param) {
+    (void)param;
+
+    /* Version 1.0.0 is the running image */
+    uint32_t old_size = build_image(old_image, 0x00010000, 0, 0, 0, false);
+    ota_partition_info_t running;
+    ota_get_partition_info(ota_get_running_partition(), &running);
+    flash_erase_range(running.start_address, old_size);
+    flash_write(running.start_address, old_image, old_size);
+
+    printf("[Bench] Base image %lu bytes, patch fed in %u-byte chunks\n\n",
+           (unsigned long)old_size, BENCH_CHUNK_SIZE);
+    printf("  %-14s %6s %6s %6s %4s %8s %8s\n", "case", "image", "patch", "size", "ops", "apply ms", "full ms");
+
+    run_case("constants", old_size, build_image(new_image, 0x00010001, 0, 0, 16, false));
+    run_case("insert 256 B", old_size, build_image(new_image, 0x00010002, BENCH_IMAGE_SIZE / 12, 64, 16, false));
+    run_case("insert 4 KB", old_size, build_image(new_image, 0x00010003, BENCH_IMAGE_SIZE / 8, 1024, 64, false));
+    run_case("unrelated", old_size, build_image(new_image, 0x00020000, 0, 0, 0, true));
+
+    printf("\n[Bench] size = patch / image; apply and full include erase, program and CRC check\n");
+
+    while (1) {
+        os_task_delay(1000);
+    }
+}
+
+/**
+ * @brief Main function
+ */
+int main(void) {
+    printf("\n");
+    printf("========================================\n");
+    printf("  TinyOS-RTOS Delta OTA Benchmark\n");
+    printf("========================================\n\n");
+
+    os_init();
+
+    if (ota_init(NULL) != OTA_OK) {
+        printf("ERROR: OTA initialization failed\n");
+        return 1;
+    }
+
+    static tcb_t bench_tcb;
+    os_task_create(&bench_tcb, "bench", bench_task, NULL, PRIORITY_NORMAL);
+
+    os_start();
+    return 0;
+}
@@ -13,6 +13,7 @@
 #include "tinyos.h"
 #include "tinyos/ota.h"
 #include "tinyos/net.h"
+#include "tinyos/crc.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -32,41 +33,86 @@
  * Test Firmware Image Generation
  * ============================================================================ */
 
+#define TEST_FIRMWARE_SIZE      (1024 * 64)  /* 64KB test firmware */
+
+static void ota_progress_callback(const ota_progress_t *progress, void *user_data);
+
 /**
- * @brief Create a test firmware image for demonstration
+ * @brief Test pattern byte at offset in the test firmware payload
  */
-static uint8_t *create_test_firmware(uint32_t *size) {
-    const uint32_t test_firmware_size = 1024 * 64;  /* 64KB test firmware */
+static uint8_t test_firmware_byte(uint32_t offset) {
+    return (uint8_t)(offset & 0xFF);
+}
 
-    uint8_t *firmware = (uint8_t *)os_malloc(test_firmware_size);
-    if (firmware == NULL) {
-        return NULL;
+/**
+ * @brief CRC32 of the test firmware payload (bytes after the header)
+ */
+static uint32_t test_firmware_crc32(void) {
+    uint8_t chunk[64];
+    uint32_t crc = CRC32_INIT;
+
+    for (uint32_t offset = sizeof(ota_image_header_t); offset < TEST_FIRMWARE_SIZE; offset += sizeof(chunk)) {
+        uint32_t length = TEST_FIRMWARE_SIZE - offset;
+        if (length > sizeof(chunk)) {
+            length = sizeof(chunk);
+        }
+        for (uint32_t i = 0; i < length; i++) {
+            chunk[i] = test_firmware_byte(offset + i);
+        }
+        crc = crc32_update(crc, chunk, length);
     }
 
+    return crc32_final(crc);
+}
+
+/**
+ * @brief Stream a test firmware image into the update partition
+ *
+ * The image is generated a chunk at a time, the way a download delivers
+ * it, so the 64KB image never has to fit in RAM.
+ */
+static ota_error_t install_test_firmware(void) {
     /* Create firmware header */
-    ota_image_header_t *header = (ota_image_header_t *)firmware;
-    memset(header, 0, sizeof(ota_image_header_t));
-
-    header->magic = 0x544F5346;  /* "TOSF" */
-    header->version = 0x00010001;  /* Version 1.0.1 (newer than current) */
-    snprintf(header->version_string, OTA_VERSION_STRING_MAX, "1.0.1");
-    header->image_size = test_firmware_size;
-    header->timestamp = 1234567890;
-    header->flags = 0;
-
-    /* Fill rest with test pattern */
-    for (uint32_t i = sizeof(ota_image_header_t); i < test_firmware_size; i++) {
-        firmware[i] = (uint8_t)(i & 0xFF);
+    ota_image_header_t header;
+    memset(&header, 0, sizeof(ota_image_header_t));
+
+    header.magic = 0x544F5346;  /* "TOSF" */
+    header.version = 0x00010001;  /* Version 1.0.1 (newer than current) */
+    snprintf(header.version_string, OTA_VERSION_STRING_MAX, "1.0.1");
+    header.image_size = TEST_FIRMWARE_SIZE;
+    header.timestamp = 1234567890;
+    header.flags = 0;
+    header.crc32 = test_firmware_crc32();
+
+    /*
+     * Left unsigned: no signature_key is configured here. Real images are
+     * signed on the build host with tools/ota_sign.py.
+     */
+
+    ota_error_t err = ota_begin_update(ota_progress_callback, NULL);
+    if (err != OTA_OK) {
+        return err;
     }
 
-    /* Calculate CRC32 (simplified - would use actual CRC) */
-    header->crc32 = 0xDEADBEEF;
+    err = ota_write_chunk((const uint8_t *)&header, sizeof(header), 0);
 
-    /* Calculate signature (would use actual crypto) */
-    memset(header->signature, 0xAA, OTA_SIGNATURE_SIZE);
+    uint8_t chunk[OTA_CHUNK_SIZE];
+    uint32_t offset = sizeof(header);
+    while (err == OTA_OK && offset < TEST_FIRMWARE_SIZE) {
+        uint32_t chunk_size = TEST_FIRMWARE_SIZE - offset;
+        if (chunk_size > sizeof(chunk)) {
+            chunk_size = sizeof(chunk);
+        }
 
-    *size = test_firmware_size;
-    return firmware;
+        for (uint32_t i = 0; i < chunk_size; i++) {
+            chunk[i] = test_firmware_byte(offset + i);
+        }
+
+        err = ota_write_chunk(chunk, chunk_size, offset);
+        offset += chunk_size;
+    }
+
+    return (err == OTA_OK) ? ota_end_update() : err;
 }
 
 /* ============================================================================
@@ -111,49 +157,34 @@ static void ota_update_task(void *param) {
     while (1) {
         printf("\n--- Checking for firmware updates ---\n");
 
-        /* For demo purposes, create a test firmware image */
-        uint32_t firmware_size;
-        uint8_t *test_firmware = create_test_firmware(&firmware_size);
+        /* For demo purposes, stream a generated test firmware image */
+        printf("Test firmware: %lu bytes\n", (unsigned long)TEST_FIRMWARE_SIZE);
 
-        if (test_firmware != NULL) {
-            printf("Test firmware generated: %lu bytes\n", (unsigned long)firmware_size);
+        ota_error_t err = install_test_firmware();
 
-            /* Start update from buffer */
-            ota_error_t err = ota_start_update_from_buffer(
-                test_firmware,
-                firmware_size,
-                ota_progress_callback,
-                NULL
-            );
+        if (err == OTA_OK) {
+            printf("✓ Firmware update completed successfully!\n");
 
+            /* Finalize update */
+            err = ota_finalize_update();
             if (err == OTA_OK) {
-                printf("✓ Firmware update completed successfully!\n");
-
-                /* Finalize update */
-                err = ota_finalize_update();
-                if (err == OTA_OK) {
-                    printf("✓ Update finalized, ready to reboot\n");
+                printf("✓ Update finalized, ready to reboot\n");
 
-                    /* Wait a moment before rebooting */
-                    os_task_delay(2000);
+                /* Wait a moment before rebooting */
+                os_task_delay(2000);
 
-                    printf("\nRebooting to apply update...\n");
-                    printf("========================================\n\n");
+                printf("\nRebooting to apply update...\n");
+                printf("========================================\n\n");
 
-                    /* Reboot to new firmware */
-                    ota_reboot();
+                /* Reboot to new firmware */
+                ota_reboot();
 
-                    /* Should not reach here */
-                } else {
-                    printf("✗ Failed to finalize update: %s\n", ota_error_to_string(err));
-                }
+                /* Should not reach here */
             } else {
-                printf("✗ Firmware update failed: %s\n", ota_error_to_string(err));
+                printf("✗ Failed to finalize update: %s\n", ota_error_to_string(err));
             }
-
-            os_free(test_firmware);
         } else {
-            printf("✗ Failed to create test firmware\n");
+            printf("✗ Firmware update failed: %s\n", ota_error_to_string(err));
         }
 
         /* Wait before next check */
@@ -277,7 +308,7 @@ int main(void) {
         .firmware_path = "/firmware.bin",
         .timeout_ms = 30000,
         .retry_count = 3,
-        .verify_signature = true,
+        .verify_signature = false,  /* Unsigned test image; set a key to require signatures */
         .auto_rollback = true,
         .signature_key = NULL,
         .signature_key_len = 0
@@ -334,7 +365,7 @@ int main(void) {
     printf("Demo Features:\n");
     printf("  ✓ Firmware version management\n");
     printf("  ✓ A/B partition swapping\n");
-    printf("  ✓ Download and install updates\n");
+    printf("  ✓ Streamed download and install (one flash page of RAM)\n");
     printf("  ✓ Firmware verification (CRC32)\n");
     printf("  ✓ Automatic rollback on failure\n");
     printf("  ✓ Boot confirmation mechanism\n");
@@ -370,6 +401,7 @@ static void download_firmware_example(void) {
 
     printf("Downloading firmware from: %s\n", firmware_url);
 
+    /* The body is written to flash as it arrives; progress is reported per chunk */
     ota_error_t err = ota_start_update(
         firmware_url,
         ota_progress_callback,
@@ -397,6 +429,8 @@ static void manual_chunk_update_example(void) {
 
     ota_progress_t progress;
 
+    ota_begin_update(ota_progress_callback, NULL);
+
     for (uint32_t offset = 0; offset < total_size; offset += chunk_size) {
         uint8_t chunk[512];
 
@@ -416,12 +450,35 @@ static void manual_chunk_update_example(void) {
         printf("Progress: %d%%\n", progress.progress_percent);
     }
 
-    /* Verify and finalize */
-    ota_verify_partition(ota_get_update_partition());
-    ota_finalize_update();
+    /* Verify (size and CRC) and finalize */
+    if (ota_finalize_update() != OTA_OK) {
+        printf("Firmware verification failed\n");
+        return;
+    }
 
     printf("Update complete! Rebooting...\n");
     ota_reboot();
 }
 
+/**
+ * @brief Example: Background update that leaves room for telemetry
+ */
+static void background_update_example(void) {
+    ota_config_t config;
+    ota_get_config(&config);
+    config.rate_limit = 8 * 1024;           /* 8 KB/s, the rest of the link stays free */
+    config.rate_burst = 2 * 1024;
+    config.progress_interval_ms = 5000;     /* One progress report every 5 seconds */
+    ota_set_config(&config);
+
+    /* Below the application tasks: the update uses CPU and flash they leave idle */
+    ota_error_t err = ota_start_update_background("http://firmware.example.com/update.bin",
+                                                  PRIORITY_LOW, ota_progress_callback, NULL);
+    if (err != OTA_OK) {
+        printf("Background update not started: %s\n", ota_error_to_string(err));
+    }
+
+    /* ota_progress_callback() sees Complete; ota_finalize_update() then reboot when convenient */
+}
+
 #endif /* Network examples */
@@ -0,0 +1,304 @@
+/**
+ * @file secure_boot_bench.c
+ * @brief Signed Image Verification Benchmark for TinyOS-RTOS
+ *
+ * This example demonstrates:
+ * - SHA-256 throughput and the cost of one Ed25519 verification
+ * - Installing signed images with a public key configured, so
+ *   ota_end_update() checks the digest built during the download
+ * - The boot-time check (ota_verify_image(), as the bootloader does
+ *   before jumping to an image) against a 100 ms budget
+ * - Rejecting an unsigned image, and a tampered image whose CRC32 was
+ *   fixed up to match
+ *
+ * The signatures below were made offline with tools/ota_sign.py over the
+ * images this benchmark generates, using a test key derived from
+ * SHA-256("TinyOS-RTOS secure boot bench"). Never ship that key.
+ *
+ * Ed25519 needs a larger task stack than the default:
+ *
+ *     make example-secure-boot
+ */
+
+#include "tinyos.h"
+#include "tinyos/ota.h"
+#include "tinyos/crc.h"
+#include "tinyos/sha256.h"
+#include "tinyos/ed25519.h"
+#include "drivers/flash.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Benchmark Configuration */
+#define BENCH_BUFFER_SIZE   4096
+#define BENCH_ITERATIONS    256                 /* 1 MB through SHA-256 */
+#define BENCH_VERIFY_COUNT  8
+#define BENCH_CHUNK_SIZE    OTA_CHUNK_SIZE      /* Download chunk size */
+#define BENCH_BOOT_BUDGET_MS 100
+
+static uint8_t buffer[BENCH_BUFFER_SIZE];
+
+/* Public key of the test signing key */
+static uint8_t test_public_key[OTA_PUBLIC_KEY_SIZE] = {
+    0xDA, 0xC2, 0x79, 0x89, 0x49, 0xE1, 0x6F, 0x05,
+    0x26, 0x86, 0x7B, 0x40, 0x66, 0xF4, 0x06, 0x62,
+    0x93, 0xB1, 0x6F, 0x02, 0x35, 0x23, 0x90, 0xB6,
+    0x7D, 0x25, 0x03, 0xAF, 0xAE, 0x31, 0x79, 0x60
+};
+
+typedef struct {
+    uint32_t image_size;
+    uint8_t signature[OTA_SIGNATURE_SIZE];
+} signed_image_t;
+
+static const signed_image_t signed_images[] = {
+    { 16 * 1024, {
+        0x97, 0x96, 0x7D, 0xE0, 0x54, 0xE6, 0x18, 0x86,
+        0x76, 0xF7, 0xE7, 0x03, 0x02, 0x91, 0x5E, 0xB6,
+        0x74, 0xCF, 0x5C, 0xAE, 0x0D, 0x17, 0xB0, 0x97,
+        0x02, 0xEA, 0x99, 0xA9, 0x77, 0xD7, 0xBB, 0x02,
+        0x7B, 0x9E, 0x78, 0x56, 0x78, 0xD3, 0xB9, 0x3B,
+        0x80, 0x86, 0x36, 0x63, 0x63, 0xBA, 0x01, 0xF0,
+        0xCC, 0x1E, 0xA8, 0x9A, 0x9C, 0xEF, 0x3A, 0x33,
+        0x1B, 0x1B, 0x55, 0xE1, 0x4B, 0x45, 0xCC, 0x05 } },
+    { 64 * 1024, {
+        0x01, 0x20, 0xF4, 0x69, 0xB1, 0x95, 0x16, 0xE6,
+        0x3B, 0x31, 0x99, 0x20, 0xD1, 0xCB, 0xAB, 0xBF,
+        0x2C, 0x89, 0x0D, 0x32, 0x1E, 0x57, 0x86, 0x54,
+        0xEB, 0x4E, 0x81, 0x24, 0x20, 0x98, 0xC8, 0xFC,
+        0x27, 0x04, 0xF5, 0x45, 0x19, 0xAB, 0x3B, 0x07,
+        0x3A, 0x9C, 0x9B, 0x50, 0x1F, 0x2D, 0xE7, 0xA5,
+        0x83, 0x7E, 0x20, 0x16, 0xFF, 0x7E, 0xB6, 0x94,
+        0xF2, 0x77, 0x6E, 0xBE, 0x0D, 0xA4, 0x57, 0x07 } },
+    { 236 * 1024, {
+        0xFF, 0x3D, 0x6D, 0x94, 0x67, 0xB0, 0x0F, 0xC7,
+        0xFF, 0x5E, 0xE3, 0x55, 0x6C, 0x67, 0x6E, 0xE1,
+        0x35, 0xAD, 0x66, 0xF7, 0xD4, 0xDF, 0xF6, 0x0C,
+        0x83, 0x5F, 0x01, 0x7C, 0xDE, 0xCD, 0x85, 0xDB,
+        0xBF, 0xDE, 0xCF, 0xD4, 0x80, 0xC0, 0xDA, 0x14,
+        0xF9, 0xE6, 0x10, 0xC8, 0x64, 0x28, 0x1C, 0x07,
+        0xA8, 0x4F, 0xED, 0x41, 0x0B, 0x8C, 0x73, 0xD5,
+        0x48, 0x23, 0xBF, 0x5E, 0x62, 0x1D, 0xB4, 0x06 } }
+};
+
+#define SIGNED_IMAGE_COUNT  (sizeof(signed_images) / sizeof(signed_images[0]))
+
+/**
+ * @brief Payload byte at offset in the test image
+ */
+static uint8_t image_byte(uint32_t offset) {
+    return (uint8_t)((offset * 31) ^ (offset >> 8));
+}
+
+/**
+ * @brief Fill buffer with the test image payload starting at offset
+ */
+static void image_fill(uint8_t *data, uint32_t offset, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        data[i] = image_byte(offset + i);
+    }
+}
+
+/**
+ * @brief Stream a test image into the update partition
+ * @param signature Header signature, NULL for an unsigned image
+ * @param end_ms Time spent in ota_end_update() (output)
+ */
+static ota_error_t install_image(uint32_t image_size, const uint8_t *signature, uint32_t *end_ms) {
+    ota_image_header_t header;
+    uint32_t payload_size = image_size - sizeof(ota_image_header_t);
+    uint32_t crc = CRC32_INIT;
+
+    for (uint32_t offset = 0; offset < payload_size; offset += BENCH_CHUNK_SIZE) {
+        uint32_t length = (payload_size - offset < BENCH_CHUNK_SIZE) ? payload_size - offset : BENCH_CHUNK_SIZE;
+        image_fill(buffer, offset, length);
+        crc = crc32_update(crc, buffer, length);
+    }
+
+    /* Must match the header the signatures were made over */
+    memset(&header, 0, sizeof(header));
+    header.magic = 0x544F5346;  /* "TOSF" */
+    header.version = 0x00010001;
+    snprintf(header.version_string, OTA_VERSION_STRING_MAX, "1.0.1");
+    header.image_size = image_size;
+    header.crc32 = crc32_final(crc);
+    if (signature != NULL) {
+        memcpy(header.signature, signature, OTA_SIGNATURE_SIZE);
+    }
+
+    ota_error_t err = ota_begin_update(NULL, NULL);
+    if (err == OTA_OK) {
+        err = ota_write_chunk((const uint8_t *)&header, sizeof(header), 0);
+    }
+    for (uint32_t offset = 0; err == OTA_OK && offset < payload_size; offset += BENCH_CHUNK_SIZE) {
+        uint32_t length = (payload_size - offset < BENCH_CHUNK_SIZE) ? payload_size - offset : BENCH_CHUNK_SIZE;
+        image_fill(buffer, offset, length);
+        err = ota_write_chunk(buffer, length, sizeof(header) + offset);
+    }
+    if (err != OTA_OK) {
+        ota_abort_update();
+        return err;
+    }
+
+    uint32_t start = os_get_uptime_ms();
+    err = ota_end_update();
+    *end_ms = os_get_uptime_ms() - start;
+
+    return err;
+}
+
+/**
+ * @brief Rewrite bytes in place: flash programming only clears bits, so
+ * the sector holding them is read, erased and programmed again
+ */
+static ota_error_t rewrite_flash(uint32_t address, const void *data, size_t size) {
+    static uint8_t sector[FLASH_SECTOR_SIZE];
+    uint32_t sector_address = address - address % FLASH_SECTOR_SIZE;
+
+    if (flash_read(sector_address, sector, sizeof(sector)) != FLASH_OK) {
+        return OTA_ERROR_FLASH_ERROR;
+    }
+    memcpy(&sector[address - sector_address], data, size);
+    if (flash_erase_sector(sector_address) != FLASH_OK ||
+        flash_write(sector_address, sector, sizeof(sector)) != FLASH_OK ||
+        flash_flush() != FLASH_OK) {
+        return OTA_ERROR_FLASH_ERROR;
+    }
+    return OTA_OK;
+}
+
+/**
+ * @brief Flip a payload bit and rewrite the header CRC32 to match
+ *
+ * What an attacker with flash access would do; only the signature can
+ * catch it.
+ */
+static ota_error_t tamper_image(ota_partition_type_t type) {
+    ota_partition_info_t info;
+    uint32_t crc;
+    uint8_t byte;
+
+    if (ota_get_partition_info(type, &info) != OTA_OK) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
+    uint32_t address = info.start_address + sizeof(ota_image_header_t) + 1000;
+    flash_read(address, &byte, 1);
+    byte ^= 0x01;
+    ota_error_t err = rewrite_flash(address, &byte, 1);
+    if (err != OTA_OK) {
+        return err;
+    }
+
+    err = ota_compute_crc32(type, &crc);
+    if (err != OTA_OK) {
+        return err;
+    }
+    return rewrite_flash(info.start_address + offsetof(ota_image_header_t, crc32), &crc, sizeof(crc));
+}
+
+static void bench_task(void *param) {
+    (void)param;
+
+    /* Primitives over RAM */
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256_ctx_t sha;
+
+    image_fill(buffer, 0, BENCH_BUFFER_SIZE);
+
+    uint32_t start = os_get_uptime_ms();
+    sha256_init(&sha);
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        sha256_update(&sha, buffer, BENCH_BUFFER_SIZE);
+    }
+    sha256_final(&sha, digest);
+    uint32_t sha_ms = os_get_uptime_ms() - start;
+
+    uint32_t valid = 0;
+    start = os_get_uptime_ms();
+    for (int i = 0; i < BENCH_VERIFY_COUNT; i++) {
+        /* The signature is for another message: each call runs in full and must fail */
+        valid += ed25519_verify(signed_images[0].signature, digest, sizeof(digest), test_public_key) ? 1 : 0;
+    }
+    uint32_t verify_ms = os_get_uptime_ms() - start;
+
+    printf("[Bench] Primitives\n\n");
+    printf("  SHA-256 over %lu KB of RAM: %lu ms\n",
+           (unsigned long)(BENCH_BUFFER_SIZE * BENCH_ITERATIONS / 1024), (unsigned long)sha_ms);
+    printf("  Ed25519 verify: %lu.%lu ms average, %lu/%d accepted a wrong message (expect 0)\n",
+           (unsigned long)(verify_ms / BENCH_VERIFY_COUNT),
+           (unsigned long)((verify_ms % BENCH_VERIFY_COUNT) * 10 / BENCH_VERIFY_COUNT),
+           (unsigned long)valid, BENCH_VERIFY_COUNT);
+
+    /* Signed images from flash */
+    printf("\n[Bench] Signed images, boot budget %d ms\n\n", BENCH_BOOT_BUDGET_MS);
+    printf("  %-8s %14s %12s\n", "image", "download ms", "boot ms");
+
+    ota_partition_type_t update = ota_get_update_partition();
+
+    for (uint32_t i = 0; i < SIGNED_IMAGE_COUNT; i++) {
+        uint32_t end_ms = 0;
+        ota_error_t err = install_image(signed_images[i].image_size, signed_images[i].signature, &end_ms);
+
+        start = os_get_uptime_ms();
+        if (err == OTA_OK) {
+            err = ota_verify_image(update, test_public_key, NULL);
+        }
+        uint32_t boot_ms = os_get_uptime_ms() - start;
+
+        printf("  %5lu KB %14lu %12lu   %s%s\n", (unsigned long)(signed_images[i].image_size / 1024),
+               (unsigned long)end_ms, (unsigned long)boot_ms, ota_error_to_string(err),
+               (boot_ms > BENCH_BOOT_BUDGET_MS) ? " (over budget)" : "");
+    }
+
+    /* Rejections */
+    uint32_t end_ms = 0;
+    ota_error_t err = install_image(signed_images[0].image_size, NULL, &end_ms);
+    printf("\n[Bench] Unsigned image: %s (expect verification failure)\n", ota_error_to_string(err));
+
+    err = tamper_image(update);
+    if (err == OTA_OK) {
+        printf("[Bench] Tampered image, CRC32 fixed up: ota_verify_partition() %s, ota_verify_image() %s\n",
+               ota_error_to_string(ota_verify_partition(update)),
+               ota_error_to_string(ota_verify_image(update, test_public_key, NULL)));
+    }
+
+    printf("\n[Bench] download = ota_end_update(), boot = ota_verify_image()\n");
+
+    while (1) {
+        os_task_delay(1000);
+    }
+}
+
+/**
+ * @brief Main function
+ */
+int main(void) {
+    printf("\n");
+    printf("========================================\n");
+    printf("  TinyOS-RTOS Secure Boot Benchmark\n");
+    printf("========================================\n\n");
+
+    os_init();
+
+    ota_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.timeout_ms = 30000;
+    config.retry_count = 3;
+    config.verify_signature = true;
+    config.auto_rollback = true;
+    config.signature_key = test_public_key;
+    config.signature_key_len = sizeof(test_public_key);
+
+    if (ota_init(&config) != OTA_OK) {
+        printf("ERROR: OTA initialization failed\n");
+        return 1;
+    }
+
+    static tcb_t bench_tcb;
+    os_task_create(&bench_tcb, "bench", bench_task, NULL, PRIORITY_NORMAL);
+
+    os_start();
+    return 0;
+}
@@ -24,7 +24,9 @@
 
 /* Configuration */
 #define MAX_TASKS               8
-#define STACK_SIZE              256
+#ifndef STACK_SIZE
+#define STACK_SIZE              256     /* Words; override with -DSTACK_SIZE */
+#endif
 #define TICK_RATE_HZ            1000
 #define TIME_SLICE_MS           10
 
@@ -0,0 +1,284 @@
+/**
+ * @file cbor.h
+ * @brief CBOR (RFC 8949) Encoder/Decoder and SenML Helper for TinyOS-RTOS
+ *
+ * Allocation-free CBOR for sensor payloads. The encoder writes straight
+ * into a caller buffer (a CoAP payload buffer, an MQTT publish buffer),
+ * and the decoder is a pull parser that returns one item at a time, with
+ * strings returned as views into the input.
+ *
+ * Encoder errors are sticky: after the first failure every call returns
+ * the same error, so a whole message can be encoded and checked once.
+ *
+ * Floats are single precision, as on the FPU of the target: the encoder
+ * emits half precision when that is exact, and the decoder narrows
+ * double-precision input to float. Indefinite-length strings are not
+ * supported; indefinite arrays and maps are decoded.
+ *
+ * The SenML helper encodes and decodes RFC 8428 packs using the CBOR
+ * integer labels (Content-Format application/senml+cbor, 112).
+ */
+
+#ifndef TINYOS_CBOR_H
+#define TINYOS_CBOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup CBOR CBOR Encoder/Decoder
+ * @{
+ */
+
+/* CBOR Constants */
+#define CBOR_INDEFINITE         UINT64_MAX  /* Count of an indefinite array or map */
+#define CBOR_MAX_NESTING        8           /* Depth cbor_decode_skip() can follow */
+
+/* SenML (RFC 8428) */
+#define SENML_CONTENT_FORMAT    112         /* application/senml+cbor */
+#define SENML_LABEL_BASE_NAME   (-2)
+#define SENML_LABEL_BASE_TIME   (-3)
+#define SENML_LABEL_NAME        0
+#define SENML_LABEL_UNIT        1
+#define SENML_LABEL_VALUE       2
+#define SENML_LABEL_STRING      3
+#define SENML_LABEL_BOOL        4
+#define SENML_LABEL_TIME        6
+
+/**
+ * @brief CBOR error codes
+ */
+typedef enum {
+    CBOR_OK = 0,
+    CBOR_ERROR_NO_SPACE = -1,       /* Output buffer full */
+    CBOR_ERROR_TRUNCATED = -2,      /* Input ended inside an item */
+    CBOR_ERROR_INVALID = -3,        /* Malformed input */
+    CBOR_ERROR_UNSUPPORTED = -4,    /* Valid CBOR this decoder does not handle */
+    CBOR_ERROR_TYPE = -5,           /* Item is not of the expected type */
+    CBOR_ERROR_END = -6             /* No more items */
+} cbor_error_t;
+
+/**
+ * @brief CBOR item types
+ */
+typedef enum {
+    CBOR_TYPE_UINT,
+    CBOR_TYPE_NEGINT,               /* value.integer holds the (negative) value */
+    CBOR_TYPE_BYTES,
+    CBOR_TYPE_TEXT,
+    CBOR_TYPE_ARRAY,                /* value.count items follow */
+    CBOR_TYPE_MAP,                  /* value.count key/value pairs follow */
+    CBOR_TYPE_TAG,                  /* value.tag applies to the next item */
+    CBOR_TYPE_BOOL,
+    CBOR_TYPE_NULL,
+    CBOR_TYPE_UNDEFINED,
+    CBOR_TYPE_FLOAT,
+    CBOR_TYPE_BREAK                 /* End of an indefinite array or map */
+} cbor_type_t;
+
+/**
+ * @brief Decoded item
+ */
+typedef struct {
+    cbor_type_t type;
+    union {
+        uint64_t uint;
+        int64_t integer;            /* UINT up to INT64_MAX and NEGINT */
+        struct {
+            const uint8_t *data;    /* Points into the input */
+            size_t length;
+        } string;
+        uint64_t count;
+        uint64_t tag;
+        bool boolean;
+        float number;
+    } value;
+} cbor_item_t;
+
+/**
+ * @brief Encoder over a caller buffer
+ */
+typedef struct {
+    uint8_t *buffer;
+    size_t size;
+    size_t length;                  /* Bytes written */
+    cbor_error_t error;             /* First error, sticky */
+} cbor_encoder_t;
+
+/**
+ * @brief Pull decoder over an input buffer
+ */
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;                  /* Next unread byte */
+} cbor_decoder_t;
+
+/* ====================
+ * Encoder
+ * ==================== */
+
+/**
+ * @brief Start encoding into buffer
+ * @param encoder Encoder
+ * @param buffer Output buffer
+ * @param size Output buffer size
+ */
+void cbor_encoder_init(cbor_encoder_t *encoder, uint8_t *buffer, size_t size);
+
+cbor_error_t cbor_encode_uint(cbor_encoder_t *encoder, uint64_t value);
+cbor_error_t cbor_encode_int(cbor_encoder_t *encoder, int64_t value);
+cbor_error_t cbor_encode_bytes(cbor_encoder_t *encoder, const uint8_t *data, size_t length);
+cbor_error_t cbor_encode_text(cbor_encoder_t *encoder, const char *text, size_t length);
+
+/**
+ * @brief Encode a NUL-terminated string as text
+ */
+cbor_error_t cbor_encode_string(cbor_encoder_t *encoder, const char *text);
+
+/**
+ * @brief Start an array of count items (encode the items next)
+ */
+cbor_error_t cbor_encode_array(cbor_encoder_t *encoder, size_t count);
+
+/**
+ * @brief Start a map of count pairs (encode key, value, key, value... next)
+ */
+cbor_error_t cbor_encode_map(cbor_encoder_t *encoder, size_t count);
+
+cbor_error_t cbor_encode_tag(cbor_encoder_t *encoder, uint64_t tag);
+cbor_error_t cbor_encode_bool(cbor_encoder_t *encoder, bool value);
+cbor_error_t cbor_encode_null(cbor_encoder_t *encoder);
+
+/**
+ * @brief Encode a float, as half precision when that is exact
+ */
+cbor_error_t cbor_encode_float(cbor_encoder_t *encoder, float value);
+
+/* ====================
+ * Decoder
+ * ==================== */
+
+/**
+ * @brief Start decoding data
+ * @param decoder Decoder
+ * @param data Input (must outlive the decoded string views)
+ * @param size Input size
+ */
+void cbor_decoder_init(cbor_decoder_t *decoder, const uint8_t *data, size_t size);
+
+/**
+ * @brief Decode the next item
+ *
+ * Arrays, maps and tags return only their head; their contents are the
+ * following items. Strings are returned whole, as views into the input.
+ *
+ * @param decoder Decoder
+ * @param item Output item
+ * @return CBOR_OK, CBOR_ERROR_END at the end of input, or an error
+ */
+cbor_error_t cbor_decode_next(cbor_decoder_t *decoder, cbor_item_t *item);
+
+/**
+ * @brief Skip the next item including everything nested in it
+ * @param decoder Decoder
+ * @return CBOR_OK on success, error code otherwise
+ */
+cbor_error_t cbor_decode_skip(cbor_decoder_t *decoder);
+
+/**
+ * @brief Decode the next item as an integer (UINT or NEGINT)
+ */
+cbor_error_t cbor_decode_int(cbor_decoder_t *decoder, int64_t *value);
+
+/**
+ * @brief Decode the next item as a number (integer or float)
+ */
+cbor_error_t cbor_decode_number(cbor_decoder_t *decoder, float *value);
+
+/* ====================
+ * SenML
+ * ==================== */
+
+/**
+ * @brief SenML value kinds
+ */
+typedef enum {
+    SENML_VALUE_NONE,
+    SENML_VALUE_NUMBER,
+    SENML_VALUE_BOOL,
+    SENML_VALUE_STRING
+} senml_value_type_t;
+
+/**
+ * @brief One SenML record
+ *
+ * Strings are NUL-terminated when encoding. When decoding they are views
+ * into the input and not terminated; name_length and string_length give
+ * their lengths.
+ */
+typedef struct {
+    const char *base_name;          /* bn, NULL to omit (decode: in effect) */
+    uint16_t base_name_length;      /* Decode only */
+    int32_t base_time;              /* bt, 0 to omit (decode: in effect) */
+    const char *name;               /* n, appended to the base name */
+    uint16_t name_length;           /* Decode only */
+    const char *unit;               /* u, NULL to omit */
+    uint16_t unit_length;           /* Decode only */
+    int32_t time;                   /* t relative to base time, 0 to omit */
+    senml_value_type_t value_type;
+    union {
+        float number;               /* v */
+        bool boolean;               /* vb */
+        struct {
+            const char *data;       /* vs */
+            uint16_t length;        /* Decode only */
+        } string;
+    } value;
+} senml_record_t;
+
+/**
+ * @brief Callback for senml_decode()
+ *
+ * @param record Record with base name and base time in effect
+ * @param user_data User data passed to senml_decode()
+ */
+typedef void (*senml_record_callback_t)(const senml_record_t *record, void *user_data);
+
+/**
+ * @brief Encode a SenML pack
+ *
+ * Base name and base time are taken from the first record only.
+ *
+ * @param encoder Encoder (may already hold other items)
+ * @param records Records
+ * @param count Number of records
+ * @return CBOR_OK on success, error code otherwise
+ */
+cbor_error_t senml_encode(cbor_encoder_t *encoder, const senml_record_t *records, size_t count);
+
+/**
+ * @brief Decode a SenML pack, calling callback once per record
+ *
+ * Unknown labels are skipped.
+ *
+ * @param data Encoded pack
+ * @param size Size of data
+ * @param callback Record callback
+ * @param user_data User data passed to callback
+ * @return CBOR_OK on success, error code otherwise
+ */
+cbor_error_t senml_decode(const uint8_t *data, size_t size, senml_record_callback_t callback, void *user_data);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TINYOS_CBOR_H */
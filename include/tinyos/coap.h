@@ -12,6 +12,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include "tinyos.h"
+#include "tinyos/net.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,11 +31,44 @@ extern "C" {
 #define COAP_MAX_TOKEN_LEN          8
 #define COAP_MAX_OPTION_COUNT       16
 #define COAP_MAX_PAYLOAD_SIZE       1024
+#define COAP_PDU_HEADROOM           (4 + COAP_MAX_TOKEN_LEN)    /* Header and token, written last */
 
 /* CoAP timeout and retry */
 #define COAP_ACK_TIMEOUT_MS         2000
 #define COAP_MAX_RETRANSMIT         4
 #define COAP_ACK_RANDOM_FACTOR      1.5
+#define COAP_NSTART                 1       /* Outstanding requests per server */
+#define COAP_MAX_TRANSACTIONS       8       /* Outstanding requests per context */
+#define COAP_MAX_LATENCY_MS         100000  /* RFC 7252 MAX_LATENCY */
+#define COAP_DEDUP_ENTRIES          8       /* Recent CON requests whose response is kept */
+#define COAP_MAX_EXCHANGES          4       /* Deferred (separate) responses outstanding */
+
+/* CoAP observe (RFC 7641) */
+#define COAP_MAX_OBSERVERS          4       /* Observers per resource */
+#define COAP_OBSERVE_CON_INTERVAL   8       /* Every Nth notification is CON */
+
+/* CoAP block-wise transfer (RFC 7959) */
+#define COAP_BLOCK_SZX_DEFAULT      5       /* 512-byte blocks: fits the socket receive buffer */
+#define COAP_BLOCK_SZX_MAX          5       /* Larger blocks overflow the socket receive buffer */
+#define COAP_BLOCK_SIZE(szx)        (16u << (szx))
+#define COAP_BLOCK_WINDOW           32      /* Blocks tracked ahead of the next expected one */
+
+/* CoAP group communication (RFC 7390) */
+#define COAP_MULTICAST_IPV4         IPV4(224, 0, 1, 187)    /* All CoAP Nodes */
+#define COAP_DEFAULT_LEISURE_MS     5000    /* RFC 7252 DEFAULT_LEISURE */
+#define COAP_MAX_LEISURE            4       /* Group responses waiting out their leisure */
+#define COAP_MAX_GROUPS             2       /* Multicast groups joined per context */
+
+/* CoAP forward proxy */
+#define COAP_PROXY_MAX_PENDING      4       /* Distinct upstream requests in flight */
+#define COAP_PROXY_MAX_WAITERS      4       /* Clients sharing one upstream request */
+#define COAP_PROXY_CACHE_ENTRIES    4       /* Cached upstream responses */
+#define COAP_PROXY_PATH_LEN         48
+#define COAP_PROXY_QUERY_LEN        32
+
+/* IPv4 addresses in this API: ipv4_addr_t bytes packed low byte first */
+#define COAP_IPV4(ip) ((uint32_t)(ip).addr[0] | ((uint32_t)(ip).addr[1] << 8) | \
+                       ((uint32_t)(ip).addr[2] << 16) | ((uint32_t)(ip).addr[3] << 24))
 
 /* CoAP Message Types */
 typedef enum {
@@ -59,6 +94,7 @@ typedef enum {
     COAP_RESPONSE_203_VALID                = 67,   /* 2.03 */
     COAP_RESPONSE_204_CHANGED              = 68,   /* 2.04 */
     COAP_RESPONSE_205_CONTENT              = 69,   /* 2.05 */
+    COAP_RESPONSE_231_CONTINUE             = 95,   /* 2.31 */
 
     /* Client Error 4.xx */
     COAP_RESPONSE_400_BAD_REQUEST          = 128,  /* 4.00 */
@@ -68,6 +104,7 @@ typedef enum {
     COAP_RESPONSE_404_NOT_FOUND            = 132,  /* 4.04 */
     COAP_RESPONSE_405_METHOD_NOT_ALLOWED   = 133,  /* 4.05 */
     COAP_RESPONSE_406_NOT_ACCEPTABLE       = 134,  /* 4.06 */
+    COAP_RESPONSE_408_REQUEST_INCOMPLETE   = 136,  /* 4.08 */
     COAP_RESPONSE_412_PRECONDITION_FAILED  = 140,  /* 4.12 */
     COAP_RESPONSE_413_REQUEST_TOO_LARGE    = 141,  /* 4.13 */
     COAP_RESPONSE_415_UNSUPPORTED_FORMAT   = 143,  /* 4.15 */
@@ -112,7 +149,8 @@ typedef enum {
     COAP_CONTENT_FORMAT_OCTET_STREAM        = 42,
     COAP_CONTENT_FORMAT_EXI                 = 47,
     COAP_CONTENT_FORMAT_JSON                = 50,
-    COAP_CONTENT_FORMAT_CBOR                = 60
+    COAP_CONTENT_FORMAT_CBOR                = 60,
+    COAP_CONTENT_FORMAT_SENML_CBOR          = 112
 } coap_content_format_t;
 
 /* CoAP Error Codes */
@@ -126,7 +164,8 @@ typedef enum {
     COAP_ERROR_INVALID_MESSAGE,
     COAP_ERROR_NOT_FOUND,
     COAP_ERROR_OBSERVE_FAILED,
-    COAP_ERROR_MAX_RETRANSMIT
+    COAP_ERROR_MAX_RETRANSMIT,
+    COAP_ERROR_BUSY                         /* NSTART or transaction table limit */
 } coap_error_t;
 
 /* Forward declarations */
@@ -143,7 +182,16 @@ struct coap_option {
     const uint8_t *value;
 };
 
-/* CoAP PDU (Protocol Data Unit) */
+/*
+ * CoAP PDU (Protocol Data Unit)
+ *
+ * A PDU is a small view over one encoded message and owns no storage.
+ * A received PDU (coap_pdu_decode) points into the datagram: options are
+ * parsed on lookup and the payload is not copied. A PDU being built
+ * (coap_pdu_init_buffer) encodes options and payload straight into the
+ * caller's buffer, normally a transmit net_buffer_t; the header and token
+ * are written last by coap_pdu_finalize, so they may change until then.
+ */
 struct coap_pdu {
     uint8_t version;                        /* CoAP version (always 1) */
     coap_msg_type_t type;                   /* Message type */
@@ -151,12 +199,27 @@ struct coap_pdu {
     uint8_t code;                           /* Method or response code */
     uint16_t message_id;                    /* Message ID for deduplication */
     uint8_t token[COAP_MAX_TOKEN_LEN];      /* Token */
-    coap_option_t options[COAP_MAX_OPTION_COUNT];
-    uint8_t option_count;
-    uint8_t *payload;                       /* Payload data */
+    uint8_t option_count;                   /* Options in the message */
+    uint8_t *payload;                       /* Payload data, inside data */
     uint16_t payload_length;                /* Payload length */
-    uint8_t buffer[COAP_MAX_PDU_SIZE];      /* Internal buffer */
-    uint16_t buffer_length;                 /* Used buffer length */
+    uint8_t *data;                          /* Encoded message (NULL if none) */
+    uint16_t size;                          /* Capacity of data; 0 for a received (read-only) PDU */
+    uint16_t length;                        /* Encoded bytes in data */
+    uint16_t options_offset;                /* First option byte */
+    uint16_t options_end;                   /* End of options (payload marker or end of data) */
+    uint16_t last_option;                   /* Highest option number present */
+};
+
+/* Option iterator over an encoded PDU (see coap_option_next) */
+typedef struct {
+    uint16_t offset;                        /* Next option byte */
+    uint16_t number;                        /* Number of the option last returned */
+} coap_option_iter_t;
+
+/* CoAP Endpoint (Client or Server) */
+struct coap_endpoint {
+    uint32_t ip_address;                    /* IPv4 address */
+    uint16_t port;                          /* UDP port */
 };
 
 /* CoAP Request/Response structure */
@@ -168,6 +231,7 @@ typedef struct {
     const uint8_t *payload;
     uint16_t payload_length;
     uint32_t timeout_ms;
+    const char *proxy_uri;                  /* Sent as Proxy-Uri to a forward proxy, or NULL */
 } coap_request_t;
 
 typedef struct {
@@ -176,6 +240,9 @@ typedef struct {
     uint8_t *payload;
     uint16_t payload_length;
     bool success;
+    coap_error_t error;                     /* Transport result (COAP_OK if a response arrived) */
+    const coap_pdu_t *pdu;                  /* Full response, valid during async callbacks only */
+    coap_endpoint_t source;                 /* Server that answered (async callbacks) */
 } coap_response_t;
 
 /* CoAP resource handler callback */
@@ -194,6 +261,33 @@ typedef void (*coap_response_handler_t)(
     void *user_data
 );
 
+/**
+ * Block-wise body source: copy up to length bytes starting at offset into
+ * buffer. Returns the number of bytes copied (fewer than length only at
+ * the end of the body) or -1 on error. Sets *total_size if the body size
+ * is known (sent as Size1/Size2); it may be left untouched.
+ */
+typedef int32_t (*coap_block_read_t)(
+    void *user_data,
+    uint32_t offset,
+    uint8_t *buffer,
+    uint16_t length,
+    uint32_t *total_size
+);
+
+/**
+ * Block-wise body sink: store length bytes at offset. Blocks may arrive
+ * out of order. complete is true on the call that makes the body whole.
+ * A call with data == NULL means a new body begins: discard any old one.
+ */
+typedef coap_error_t (*coap_block_write_t)(
+    void *user_data,
+    uint32_t offset,
+    const uint8_t *data,
+    uint16_t length,
+    bool complete
+);
+
 /* CoAP observe notification callback */
 typedef void (*coap_observe_handler_t)(
     coap_context_t *context,
@@ -202,6 +296,109 @@ typedef void (*coap_observe_handler_t)(
     void *user_data
 );
 
+/* Registered observer of a resource */
+typedef struct {
+    bool in_use;
+    bool con_pending;                       /* CON notification awaiting ACK */
+    coap_endpoint_t peer;
+    uint8_t token[COAP_MAX_TOKEN_LEN];
+    uint8_t token_length;
+    uint8_t since_con;                      /* NON notifications since the last CON */
+    uint16_t last_message_id;               /* To match an RST to a NON notification */
+} coap_observer_t;
+
+/* Block-wise reassembly state: blocks below next are done, window bit i is block next + i */
+typedef struct {
+    bool active;
+    coap_endpoint_t peer;
+    uint8_t szx;
+    uint32_t next;
+    uint32_t window;
+    int32_t last_num;                       /* Block with M=0, -1 until seen */
+} coap_block_state_t;
+
+/* Response to a recent CON request, replayed for duplicates */
+typedef struct {
+    bool in_use;
+    uint16_t message_id;
+    coap_endpoint_t peer;
+    uint32_t expires_ms;                    /* Uptime after which the entry is stale */
+    uint8_t *response;                      /* Encoded response (heap) */
+    uint16_t response_length;
+} coap_dedup_entry_t;
+
+/* Deferred exchange states */
+typedef enum {
+    COAP_EXCHANGE_FREE = 0,
+    COAP_EXCHANGE_WAITING,                  /* Deferred by the handler, not yet completed */
+    COAP_EXCHANGE_COMPLETING,               /* Claimed by coap_response_complete() */
+    COAP_EXCHANGE_READY                     /* Completed, to be sent by coap_process() */
+} coap_exchange_state_t;
+
+/* Request whose response is sent later as a separate response */
+typedef struct {
+    volatile coap_exchange_state_t state;
+    bool confirmable;                       /* Request was CON: response is CON too */
+    coap_endpoint_t peer;
+    uint8_t token[COAP_MAX_TOKEN_LEN];
+    uint8_t token_length;
+    uint8_t code;                           /* Set by coap_response_complete() */
+    coap_content_format_t content_format;
+    uint8_t *payload;                       /* Heap copy of the response payload */
+    uint16_t payload_length;
+} coap_exchange_t;
+
+/* Response to a group request, held back for a random leisure */
+typedef struct {
+    bool in_use;
+    uint32_t send_at;                       /* Uptime at which it is sent */
+    coap_endpoint_t peer;
+    uint8_t *message;                       /* Encoded response (heap) */
+    uint16_t length;
+} coap_leisure_t;
+
+/* Client waiting for a proxied response */
+typedef struct {
+    coap_endpoint_t peer;
+    uint8_t token[COAP_MAX_TOKEN_LEN];
+    uint8_t token_length;
+    bool confirmable;                       /* Answer with a CON separate response */
+} coap_proxy_waiter_t;
+
+/* Upstream target of a proxied request */
+typedef struct {
+    coap_endpoint_t server;
+    char path[COAP_PROXY_PATH_LEN];         /* Segments joined with '/' */
+    char query[COAP_PROXY_QUERY_LEN];       /* Arguments joined with '&' */
+} coap_proxy_target_t;
+
+/* Upstream request in flight; identical GETs join it as extra waiters */
+typedef struct {
+    bool in_use;
+    bool coalescable;                       /* GET: later identical requests may join */
+    coap_proxy_target_t target;
+    coap_proxy_waiter_t waiters[COAP_PROXY_MAX_WAITERS];
+    uint8_t waiter_count;
+} coap_proxy_pending_t;
+
+/* Cached upstream 2.05 response */
+typedef struct {
+    coap_proxy_target_t target;
+    struct coap_cache_entry *entry;         /* NULL if the slot is free */
+} coap_proxy_cached_t;
+
+/* Forward proxy state (see coap_proxy_start) */
+typedef struct {
+    uint32_t timeout_ms;                    /* Upstream exchange timeout (0 = ACK timeout) */
+    coap_proxy_pending_t pending[COAP_PROXY_MAX_PENDING];
+    coap_proxy_cached_t cache[COAP_PROXY_CACHE_ENTRIES];
+    /* Statistics */
+    uint32_t requests;                      /* Proxy requests received */
+    uint32_t cache_hits;                    /* Answered from the cache */
+    uint32_t coalesced;                     /* Joined an upstream request in flight */
+    uint32_t upstream;                      /* Upstream requests sent */
+} coap_proxy_t;
+
 /* CoAP Resource */
 struct coap_resource {
     char uri_path[64];
@@ -209,14 +406,41 @@ struct coap_resource {
     void *user_data;
     bool observable;
     uint32_t max_age;
+    uint32_t observe_seq;                   /* 24-bit Observe sequence number */
+    coap_observer_t observers[COAP_MAX_OBSERVERS];
+    coap_block_read_t block_read;           /* Serves GET bodies with Block2 */
+    coap_block_write_t block_write;         /* Receives PUT/POST bodies with Block1 */
+    void *block_user_data;
+    char *file_path;                        /* Set by coap_resource_set_file() */
+    coap_block_state_t block_rx;            /* Block1 upload in progress */
+    bool cacheable;                         /* GET responses are cached (coap_resource_set_cache) */
+    struct coap_cache_entry *cache;         /* Cached 2.05 response, NULL if none */
+    uint16_t content_format;                /* Content-Format of Block2 bodies */
+    const char *link_attributes;            /* Extra .well-known/core attributes, or NULL */
     struct coap_resource *next;
 };
 
-/* CoAP Endpoint (Client or Server) */
-struct coap_endpoint {
-    uint32_t ip_address;                    /* IPv4 address */
-    uint16_t port;                          /* UDP port */
-};
+/* Outstanding client request (retransmission state) */
+typedef struct {
+    bool in_use;
+    bool acked;                             /* Empty ACK seen: separate response pending */
+    bool notification;                      /* CON notification: an empty ACK completes it */
+    bool group;                             /* Multicast request: responses collected until timeout */
+    volatile bool expired;                  /* Set by the timer (tick context) */
+    uint16_t message_id;
+    uint8_t token[COAP_MAX_TOKEN_LEN];
+    uint8_t token_length;
+    uint8_t retransmit_count;
+    coap_endpoint_t peer;
+    uint8_t *pdu;                           /* Encoded request, kept for retransmission */
+    uint16_t pdu_length;
+    uint32_t timeout_ms;                    /* Current retransmission timeout */
+    uint32_t exchange_timeout_ms;           /* Wait for a separate response (0 = ack timeout) */
+    timer_t timer;
+    coap_response_handler_t handler;
+    void *user_data;
+    coap_context_t *context;
+} coap_transaction_t;
 
 /* CoAP Context (Client/Server state) */
 struct coap_context {
@@ -224,10 +448,29 @@ struct coap_context {
     int socket_fd;                          /* UDP socket */
     uint16_t next_message_id;
     coap_resource_t *resources;             /* Linked list of resources */
-    coap_response_handler_t response_handler;
+    struct coap_path_node *routes;          /* Path-segment trie used for dispatch */
+    coap_response_handler_t response_handler;  /* Default for async requests */
     coap_observe_handler_t observe_handler;
     void *user_data;
     bool is_server;
+    bool enable_observe;                    /* Honour Observe registrations */
+    event_group_t events;                   /* Socket and retransmission wakeups */
+    uint32_t ack_timeout_ms;
+    uint8_t max_retransmit;
+    uint8_t nstart;
+    uint8_t block_szx;                      /* Preferred block size exponent */
+    uint32_t rng_state;                     /* Token and backoff jitter */
+    uint32_t exchange_lifetime_ms;          /* EXCHANGE_LIFETIME for duplicate detection */
+    coap_transaction_t transactions[COAP_MAX_TRANSACTIONS];
+    coap_dedup_entry_t dedup[COAP_DEDUP_ENTRIES];
+    coap_proxy_t *proxy;                    /* Forward proxy, NULL if disabled */
+    coap_exchange_t exchanges[COAP_MAX_EXCHANGES];
+    const sockaddr_in_t *request_from;      /* Peer of the request being dispatched */
+    coap_exchange_t *deferred;              /* Set by coap_response_defer() during dispatch */
+    uint32_t leisure_ms;                    /* Upper bound of the group response delay */
+    coap_leisure_t leisure[COAP_MAX_LEISURE];
+    timer_t leisure_timer;                  /* Wakes coap_process() for the next leisure */
+    uint32_t groups[COAP_MAX_GROUPS];       /* Joined multicast groups, 0 = free */
 };
 
 /* CoAP Configuration */
@@ -237,6 +480,9 @@ typedef struct {
     bool enable_observe;                    /* Enable observe pattern */
     uint32_t ack_timeout_ms;                /* ACK timeout */
     uint8_t max_retransmit;                 /* Max retransmissions */
+    uint8_t nstart;                         /* Concurrent requests per server (0 = COAP_NSTART) */
+    uint8_t block_szx;                      /* Block size 16 << szx (0 = COAP_BLOCK_SZX_DEFAULT) */
+    uint32_t leisure_ms;                    /* Group response delay bound (0 = COAP_DEFAULT_LEISURE_MS) */
 } coap_config_t;
 
 /* ====================
@@ -267,9 +513,14 @@ void coap_stop(coap_context_t *context);
 
 /**
  * @brief Process incoming CoAP messages (call periodically in task)
+ *
+ * Handles at most one received datagram plus any due retransmissions, and
+ * completes asynchronous requests by calling their response handlers. A
+ * context must be driven by a single task.
+ *
  * @param context CoAP context
- * @param timeout_ms Timeout for receiving messages
- * @return COAP_OK on success, error code otherwise
+ * @param timeout_ms Maximum time to wait for activity (0 = forever)
+ * @return COAP_OK if something was handled, COAP_ERROR_TIMEOUT if idle
  */
 coap_error_t coap_process(coap_context_t *context, uint32_t timeout_ms);
 
@@ -382,17 +633,52 @@ coap_error_t coap_request(
     coap_response_t *response
 );
 
+/**
+ * @brief Send a CoAP request without blocking
+ *
+ * The request is sent as CON and retransmitted with exponential backoff
+ * (ACK_TIMEOUT x random factor, doubling, up to max_retransmit) from
+ * coap_process(). The handler is called exactly once from coap_process():
+ * with the response, or with response->error set on failure. The response
+ * payload is only valid during the callback.
+ *
+ * @param context CoAP context
+ * @param server_ip Server IP address
+ * @param server_port Server port
+ * @param request Request parameters (copied; timeout_ms bounds the wait
+ *                for a separate response after an empty ACK)
+ * @param handler Completion callback (NULL = context->response_handler)
+ * @param user_data User data passed to handler
+ * @return COAP_OK if sent, COAP_ERROR_BUSY if NSTART requests to this
+ *         server (or COAP_MAX_TRANSACTIONS overall) are outstanding
+ */
+coap_error_t coap_request_async(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const coap_request_t *request,
+    coap_response_handler_t handler,
+    void *user_data
+);
+
 /* ====================
  * CoAP Server API
  * ==================== */
 
 /**
  * @brief Register a CoAP resource handler
+ *
+ * Requests are dispatched by matching their Uri-Path options segment by
+ * segment against a trie of registered paths. A "*" segment matches any
+ * single segment; exact segments take precedence over it. Servers also
+ * answer GET /.well-known/core with an RFC 6690 listing of all resources
+ * that have no wildcard in their path.
+ *
  * @param context CoAP context (server)
- * @param uri_path URI path (e.g., "/sensor/temperature")
+ * @param uri_path URI path (e.g., "/sensor/temperature"); segments may be "*"
  * @param handler Resource handler callback
  * @param user_data User data passed to handler
- * @return Resource pointer on success, NULL on error
+ * @return Resource pointer on success, NULL on error or if the path is taken
  */
 coap_resource_t *coap_resource_create(
     coap_context_t *context,
@@ -410,7 +696,63 @@ coap_resource_t *coap_resource_create(
 coap_error_t coap_resource_set_observable(coap_resource_t *resource, uint32_t max_age);
 
 /**
- * @brief Notify observers of a resource
+ * @brief Set extra link attributes listed in /.well-known/core
+ *
+ * ";obs" is added automatically for observable resources.
+ *
+ * @param resource Resource
+ * @param attributes Attributes without a leading ';' (e.g. "rt=\"temperature\";if=\"sensor\""),
+ *        not copied, or NULL for none
+ * @return COAP_OK on success, error code otherwise
+ */
+coap_error_t coap_resource_set_link_attributes(coap_resource_t *resource, const char *attributes);
+
+/**
+ * @brief Enable or disable the response cache of a resource
+ *
+ * A cached resource answers GETs from its last 2.05 response until
+ * Max-Age (the response's option, else resource->max_age) expires,
+ * without calling the handler. Responses without an ETag get one, and a
+ * GET carrying the current ETag is answered 2.03 Valid with no payload.
+ * GETs with Uri-Query, Accept or Observe bypass the cache; PUT, POST,
+ * DELETE and coap_resource_notify invalidate it.
+ *
+ * @param resource Resource
+ * @param enable true to cache
+ * @return COAP_OK on success, error code otherwise
+ */
+coap_error_t coap_resource_set_cache(coap_resource_t *resource, bool enable);
+
+/**
+ * @brief Drop a resource's cached response
+ *
+ * Call when the representation changes outside of a request.
+ *
+ * @param resource Resource
+ */
+void coap_resource_invalidate(coap_resource_t *resource);
+
+/**
+ * @brief Notify observers of a resource with its current representation
+ *
+ * Calls the resource handler once for a GET, encodes the result once with
+ * the next Observe sequence number and Max-Age, and sends it to every
+ * observer patching only the token and message ID. Notifications are NON,
+ * with every COAP_OBSERVE_CON_INTERVAL-th sent CON to confirm the observer
+ * is still there; observers that reset or never ACK are removed.
+ *
+ * @param context CoAP context (server, enable_observe set)
+ * @param resource Observable resource
+ * @return COAP_OK on success (also with no observers), error code otherwise
+ */
+coap_error_t coap_resource_notify(coap_context_t *context, coap_resource_t *resource);
+
+/**
+ * @brief Notify observers of a resource with a given payload
+ *
+ * Same fan-out as coap_resource_notify() without calling the handler;
+ * the notification is 2.05 Content with no Content-Format.
+ *
  * @param context CoAP context
  * @param resource Resource to notify
  * @param payload Notification payload
@@ -424,6 +766,171 @@ coap_error_t coap_notify_observers(
     uint16_t payload_length
 );
 
+/**
+ * @brief Defer the response to the request being handled
+ *
+ * Call from a resource handler that cannot answer right away (a slow
+ * sensor read, a request to another device). The server acknowledges a
+ * CON request with an empty ACK and the handler's response PDU is
+ * discarded. Any task then finishes the exchange with
+ * coap_response_complete(). The response is sent from coap_process() as
+ * CON with retransmission, or NON if the request was NON. Every deferred
+ * exchange must be completed, if need be with an error code.
+ *
+ * @param context CoAP context passed to the handler
+ * @param request Request passed to the handler
+ * @return Exchange handle, or NULL if called outside a handler or all
+ *         COAP_MAX_EXCHANGES are in use (then answer synchronously)
+ */
+coap_exchange_t *coap_response_defer(coap_context_t *context, const coap_pdu_t *request);
+
+/**
+ * @brief Complete a deferred exchange
+ *
+ * Safe to call from any task; of two calls for one exchange only the
+ * first succeeds. The payload is copied.
+ *
+ * @param context CoAP context the exchange belongs to
+ * @param exchange Handle from coap_response_defer()
+ * @param code Response code
+ * @param content_format Content-Format of the payload
+ * @param payload Payload (NULL if none)
+ * @param payload_length Payload length (up to COAP_MAX_PAYLOAD_SIZE)
+ * @return COAP_OK on success, COAP_ERROR_NO_MEMORY if the payload could
+ *         not be copied (the exchange stays open)
+ */
+coap_error_t coap_response_complete(
+    coap_context_t *context,
+    coap_exchange_t *exchange,
+    uint8_t code,
+    coap_content_format_t content_format,
+    const uint8_t *payload,
+    uint16_t payload_length
+);
+
+/* ====================
+ * CoAP Block-Wise Transfer
+ * ==================== */
+
+/**
+ * @brief Download a resource of any size with Block2
+ *
+ * Blocks go straight to the sink, so the body is never buffered. Once the
+ * first response gives the size (Size2), up to nstart blocks are requested
+ * concurrently and written in whatever order they arrive.
+ *
+ * @param context CoAP context
+ * @param server_ip Server IP address
+ * @param server_port Server port
+ * @param uri_path URI path
+ * @param sink Body sink
+ * @param user_data User data passed to sink
+ * @param timeout_ms Per-block timeout for separate responses
+ * @return COAP_OK when the whole body was received, error code otherwise
+ */
+coap_error_t coap_block_download(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const char *uri_path,
+    coap_block_write_t sink,
+    void *user_data,
+    uint32_t timeout_ms
+);
+
+/**
+ * @brief Upload a body of any size with Block1
+ *
+ * Blocks are sent one at a time. The block size starts at the context's
+ * block_szx and follows a smaller size requested by the server.
+ *
+ * @param context CoAP context
+ * @param server_ip Server IP address
+ * @param server_port Server port
+ * @param request Method (PUT or POST), path, format and timeout; payload is ignored
+ * @param source Body source
+ * @param user_data User data passed to source
+ * @param response Final response (free with coap_response_free)
+ * @return COAP_OK on success, error code otherwise
+ */
+coap_error_t coap_block_upload(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const coap_request_t *request,
+    coap_block_read_t source,
+    void *user_data,
+    coap_response_t *response
+);
+
+/**
+ * @brief Download a resource into a file
+ * @param context CoAP context
+ * @param server_ip Server IP address
+ * @param server_port Server port
+ * @param uri_path URI path
+ * @param file_path Destination file (created or truncated)
+ * @param timeout_ms Per-block timeout
+ * @return COAP_OK on success, error code otherwise
+ */
+coap_error_t coap_get_file(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const char *uri_path,
+    const char *file_path,
+    uint32_t timeout_ms
+);
+
+/**
+ * @brief Upload a file with PUT
+ * @param context CoAP context
+ * @param server_ip Server IP address
+ * @param server_port Server port
+ * @param uri_path URI path
+ * @param file_path Source file
+ * @param response Final response (free with coap_response_free)
+ * @param timeout_ms Per-block timeout
+ * @return COAP_OK on success, error code otherwise
+ */
+coap_error_t coap_put_file(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const char *uri_path,
+    const char *file_path,
+    coap_response_t *response,
+    uint32_t timeout_ms
+);
+
+/**
+ * @brief Serve a resource body block-wise
+ *
+ * GET is answered from read with Block2 (application/octet-stream);
+ * PUT/POST bodies are passed to write with Block1. Either may be NULL,
+ * in which case that method goes to the resource handler as usual.
+ *
+ * @param resource Resource
+ * @param read Body source for GET
+ * @param write Body sink for PUT/POST
+ * @param user_data User data passed to read and write
+ * @return COAP_OK on success, error code otherwise
+ */
+coap_error_t coap_resource_set_block_handlers(
+    coap_resource_t *resource,
+    coap_block_read_t read,
+    coap_block_write_t write,
+    void *user_data
+);
+
+/**
+ * @brief Back a resource with a file: GET reads it, PUT/POST replace it
+ * @param resource Resource
+ * @param file_path File path (copied)
+ * @return COAP_OK on success, error code otherwise
+ */
+coap_error_t coap_resource_set_file(coap_resource_t *resource, const char *file_path);
+
 /* ====================
  * CoAP Observe Pattern (Client)
  * ==================== */
@@ -455,12 +962,105 @@ coap_error_t coap_observe_start(
  */
 coap_error_t coap_observe_stop(coap_context_t *context, const char *uri_path);
 
+/* ====================
+ * CoAP Forward Proxy
+ * ==================== */
+
+/**
+ * @brief Act as a forward proxy for coap:// targets
+ *
+ * Requests carrying Proxy-Uri, or Proxy-Scheme with Uri-Host/Port/Path/
+ * Query, are forwarded from the same context instead of being dispatched
+ * locally. The client is answered with an empty ACK and later gets a
+ * separate response (CON if it asked with CON).
+ *
+ * GETs share one upstream request while it is in flight: identical GETs
+ * from other clients become extra waiters rather than new upstream
+ * requests. 2.05 responses are cached until their Max-Age (default 60 s)
+ * expires, and other methods invalidate the cached target. Only IPv4
+ * literal hosts are accepted; anything else is answered 5.05.
+ *
+ * @param context CoAP context (server)
+ * @param proxy Proxy state, zero-initialized except timeout_ms, kept by
+ *        the caller until coap_proxy_stop()
+ * @return COAP_OK on success, error code otherwise
+ */
+coap_error_t coap_proxy_start(coap_context_t *context, coap_proxy_t *proxy);
+
+/**
+ * @brief Stop proxying and free the proxy's cache
+ *
+ * Upstream requests still in flight are cancelled; their clients get no
+ * response.
+ *
+ * @param context CoAP context
+ */
+void coap_proxy_stop(coap_context_t *context);
+
+/* ====================
+ * CoAP Group Communication
+ * ==================== */
+
+/**
+ * @brief Receive group requests sent to a multicast address
+ *
+ * Joins the IPv4 group (IGMPv2) so NON requests sent to it on the
+ * context's port are dispatched like unicast ones, with the RFC 7252
+ * section 8 rules: CON and proxy requests are ignored, error responses
+ * (4.xx, 5.xx) are not sent, and each success response is delayed by a
+ * random time below the context's leisure, so one datagram reaching many
+ * nodes does not make them all answer at once.
+ *
+ * @param context CoAP context (server, started)
+ * @param group Multicast address, e.g. COAP_MULTICAST_IPV4
+ * @return COAP_OK on success, COAP_ERROR_BUSY if COAP_MAX_GROUPS are
+ *         joined, error code otherwise
+ */
+coap_error_t coap_join_group(coap_context_t *context, ipv4_addr_t group);
+
+/**
+ * @brief Stop receiving a group's requests (also done by coap_stop)
+ * @param context CoAP context
+ * @param group Multicast address
+ * @return COAP_OK on success, COAP_ERROR_INVALID_PARAM if not joined
+ */
+coap_error_t coap_leave_group(coap_context_t *context, ipv4_addr_t group);
+
+/**
+ * @brief Send a NON request to a multicast group and collect the responses
+ *
+ * handler is called once per response, with response->source telling
+ * the servers apart, and a last time with COAP_ERROR_TIMEOUT when
+ * request->timeout_ms (default: the context's leisure plus one ACK
+ * timeout) has passed. The request is not retransmitted.
+ *
+ * @param context CoAP context
+ * @param group_ip Multicast address (use COAP_IPV4(COAP_MULTICAST_IPV4))
+ * @param port Server port
+ * @param request Request parameters
+ * @param handler Response handler
+ * @param user_data User data passed to handler
+ * @return COAP_OK if sent, error code otherwise
+ */
+coap_error_t coap_group_request(
+    coap_context_t *context,
+    uint32_t group_ip,
+    uint16_t port,
+    const coap_request_t *request,
+    coap_response_handler_t handler,
+    void *user_data
+);
+
 /* ====================
  * CoAP PDU Manipulation
  * ==================== */
 
 /**
- * @brief Create a new CoAP PDU
+ * @brief Create a new CoAP PDU with no message buffer
+ *
+ * Suitable for header-only messages; options and payload need
+ * coap_pdu_init_buffer.
+ *
  * @param pdu PDU structure to initialize
  * @param type Message type
  * @param code Method or response code
@@ -469,6 +1069,24 @@ coap_error_t coap_observe_stop(coap_context_t *context, const char *uri_path);
  */
 coap_error_t coap_pdu_init(coap_pdu_t *pdu, coap_msg_type_t type, uint8_t code, uint16_t message_id);
 
+/**
+ * @brief Create a new CoAP PDU that encodes into buffer
+ *
+ * The first COAP_PDU_HEADROOM bytes of buffer are kept for the header and
+ * token. Option values and the payload are copied into buffer as they
+ * are added, so they may come from short-lived storage.
+ *
+ * @param pdu PDU structure to initialize
+ * @param type Message type
+ * @param code Method or response code
+ * @param message_id Message ID
+ * @param buffer Message buffer
+ * @param size Buffer size (at least COAP_PDU_HEADROOM)
+ * @return COAP_OK on success, error code otherwise
+ */
+coap_error_t coap_pdu_init_buffer(coap_pdu_t *pdu, coap_msg_type_t type, uint8_t code, uint16_t message_id,
+                                  uint8_t *buffer, uint16_t size);
+
 /**
  * @brief Set PDU token
  * @param pdu PDU structure
@@ -480,9 +1098,13 @@ coap_error_t coap_pdu_set_token(coap_pdu_t *pdu, const uint8_t *token, uint8_t t
 
 /**
  * @brief Add option to PDU
+ *
+ * Options are kept sorted by number (stable for repeated options), so
+ * they may be added in any order; adding in order is cheapest.
+ *
  * @param pdu PDU structure
  * @param option_num Option number
- * @param value Option value
+ * @param value Option value (must not point into the PDU's own buffer)
  * @param length Option value length
  * @return COAP_OK on success, error code otherwise
  */
@@ -491,22 +1113,67 @@ coap_error_t coap_pdu_add_option(coap_pdu_t *pdu, uint16_t option_num, const uin
 /**
  * @brief Set PDU payload
  * @param pdu PDU structure
- * @param payload Payload data
+ * @param payload Payload data (may be the area from coap_pdu_payload_buffer)
  * @param length Payload length
  * @return COAP_OK on success, error code otherwise
  */
 coap_error_t coap_pdu_set_payload(coap_pdu_t *pdu, const uint8_t *payload, uint16_t length);
 
 /**
- * @brief Get option from PDU
+ * @brief Get the area where the payload will be encoded
+ *
+ * Lets a handler render its payload in place and then call
+ * coap_pdu_set_payload with the same pointer, instead of formatting into
+ * a stack buffer first. Adding options afterwards moves the area.
+ *
+ * @param pdu PDU structure
+ * @param capacity Output: bytes available
+ * @return Payload area or NULL if the PDU has no buffer
+ */
+uint8_t *coap_pdu_payload_buffer(coap_pdu_t *pdu, uint16_t *capacity);
+
+/**
+ * @brief Find the first option with a given number
  * @param pdu PDU structure
  * @param option_num Option number to find
- * @return Option pointer or NULL if not found
+ * @param option Output option (may be NULL to test for presence)
+ * @return true if found
  */
-const coap_option_t *coap_pdu_get_option(const coap_pdu_t *pdu, uint16_t option_num);
+bool coap_pdu_get_option(const coap_pdu_t *pdu, uint16_t option_num, coap_option_t *option);
 
 /**
- * @brief Encode PDU to wire format
+ * @brief Start iterating over a PDU's options
+ * @param pdu PDU structure
+ * @param iter Iterator to initialize
+ */
+void coap_option_iter_init(const coap_pdu_t *pdu, coap_option_iter_t *iter);
+
+/**
+ * @brief Decode the next option, in number order
+ *
+ * Values point into the PDU's message buffer.
+ *
+ * @param pdu PDU structure
+ * @param iter Iterator
+ * @param option Output option
+ * @return true if an option was returned, false at the end
+ */
+bool coap_option_next(const coap_pdu_t *pdu, coap_option_iter_t *iter, coap_option_t *option);
+
+/**
+ * @brief Write the header and token of a built PDU in place
+ *
+ * The message is then contiguous in the PDU's buffer, just in front of
+ * the options. For a received PDU this returns the datagram unchanged.
+ *
+ * @param pdu PDU structure
+ * @param length Output: message length
+ * @return Start of the encoded message, or NULL on error
+ */
+uint8_t *coap_pdu_finalize(coap_pdu_t *pdu, uint16_t *length);
+
+/**
+ * @brief Copy PDU to wire format
  * @param pdu PDU structure
  * @param buffer Output buffer
  * @param buffer_size Buffer size
@@ -516,6 +1183,10 @@ int coap_pdu_encode(const coap_pdu_t *pdu, uint8_t *buffer, size_t buffer_size);
 
 /**
  * @brief Decode PDU from wire format
+ *
+ * The message is validated once; the PDU then refers to buffer, which
+ * must stay unchanged while the PDU is used.
+ *
  * @param pdu PDU structure to fill
  * @param buffer Input buffer
  * @param length Buffer length
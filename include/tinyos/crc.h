@@ -0,0 +1,104 @@
+/**
+ * @file crc.h
+ * @brief CRC32 (IEEE 802.3) for TinyOS-RTOS
+ *
+ * The reflected CRC32 used by zlib, Ethernet and the OTA image header
+ * (polynomial 0xEDB88320, initial value and final XOR 0xFFFFFFFF).
+ *
+ * The software implementation is selected at build time with CRC32_MODE,
+ * trading flash for speed; all tables are const and live in flash:
+ *
+ *   CRC32_MODE_SLICE8  8 KB of tables, 8 bytes per step (default)
+ *   CRC32_MODE_BYTE    1 KB table, 1 byte per step
+ *   CRC32_MODE_NIBBLE  64 B table, 4 bits per step, for small flash
+ *
+ * e.g. make EXTRA_CFLAGS=-DCRC32_MODE=CRC32_MODE_NIBBLE
+ *
+ * A platform with a CRC unit overrides platform_crc32_update(); the
+ * software path is then only used for data the hook declines.
+ *
+ * Data can be fed in pieces, so a CRC can be kept while an image streams
+ * in or a file is written:
+ *
+ *   uint32_t crc = CRC32_INIT;
+ *   crc = crc32_update(crc, part1, len1);
+ *   crc = crc32_update(crc, part2, len2);
+ *   crc = crc32_final(crc);
+ */
+
+#ifndef TINYOS_CRC_H
+#define TINYOS_CRC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup CRC CRC32
+ * @{
+ */
+
+#define CRC32_MODE_SLICE8       0
+#define CRC32_MODE_BYTE         1
+#define CRC32_MODE_NIBBLE       2
+
+#ifndef CRC32_MODE
+#define CRC32_MODE              CRC32_MODE_SLICE8
+#endif
+
+#define CRC32_INIT              0xFFFFFFFF  /* Running value before any data */
+
+/**
+ * @brief Continue a CRC32 over more data
+ * @param crc Running value (CRC32_INIT for the first call)
+ * @param data Data
+ * @param length Number of bytes
+ * @return New running value
+ */
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length);
+
+/**
+ * @brief Turn a running value into the CRC32
+ */
+static inline uint32_t crc32_final(uint32_t crc) {
+    return ~crc;
+}
+
+/**
+ * @brief CRC32 of a buffer in one call
+ * @param data Data
+ * @param length Number of bytes
+ * @return CRC32
+ */
+uint32_t crc32_calculate(const void *data, size_t length);
+
+/**
+ * @brief Name of the compiled-in software implementation ("slice8", "byte", "nibble")
+ */
+const char *crc32_mode_name(void);
+
+/**
+ * @brief Hardware CRC hook (weak, returns false by default)
+ *
+ * Must produce the same running value as the software path (reflected
+ * input and output, no final XOR). May decline data it cannot handle,
+ * e.g. short or unaligned buffers.
+ *
+ * @param crc Running value, updated when the hook handles the data
+ * @param data Data
+ * @param length Number of bytes
+ * @return true if the data was processed in hardware
+ */
+bool platform_crc32_update(uint32_t *crc, const uint8_t *data, size_t length);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TINYOS_CRC_H */
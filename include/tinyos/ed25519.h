@@ -0,0 +1,50 @@
+/**
+ * @file ed25519.h
+ * @brief Ed25519 Signature Verification (RFC 8032) for TinyOS-RTOS
+ *
+ * Verification only: devices check signatures made on the build host
+ * (see tools/ota_sign.py) and never hold a private key.
+ *
+ * The implementation is allocation-free and needs about 1.5 KB of stack;
+ * run it from a task created with STACK_SIZE of at least 512 words, or
+ * from the bootloader's main stack. It is not constant-time, which is
+ * fine for verification since every input is public.
+ */
+
+#ifndef TINYOS_ED25519_H
+#define TINYOS_ED25519_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup Ed25519 Ed25519
+ * @{
+ */
+
+#define ED25519_PUBLIC_KEY_SIZE 32
+#define ED25519_SIGNATURE_SIZE  64
+
+/**
+ * @brief Verify an Ed25519 signature
+ * @param signature Signature, ED25519_SIGNATURE_SIZE bytes (R || S)
+ * @param message Signed message
+ * @param length Message length
+ * @param public_key Public key, ED25519_PUBLIC_KEY_SIZE bytes
+ * @return true if the signature is valid for message and key
+ */
+bool ed25519_verify(const uint8_t *signature, const uint8_t *message, size_t length,
+                    const uint8_t *public_key);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TINYOS_ED25519_H */
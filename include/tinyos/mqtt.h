@@ -2,8 +2,13 @@
  * @file mqtt.h
  * @brief MQTT Client for TinyOS-RTOS
  *
- * Lightweight MQTT 3.1.1 client implementation for IoT devices.
- * Supports QoS 0, 1, 2 and automatic reconnection.
+ * Lightweight MQTT 3.1.1 / 5.0 client implementation for IoT devices.
+ * Supports QoS 0, 1, 2 and automatic reconnection. MQTT 5 adds topic
+ * aliases, Receive Maximum flow control and Maximum Packet Size.
+ *
+ * Clients are event driven: socket readiness and a software keepalive
+ * timer wake one shared service task, so any number of clients (up to
+ * MQTT_SERVICE_MAX_CLIENTS) cost no extra TCB or stack.
  */
 
 #ifndef TINYOS_MQTT_H
@@ -33,9 +38,18 @@ extern "C" {
 #define MQTT_DEFAULT_KEEPALIVE      60
 #define MQTT_DEFAULT_PORT           1883
 #define MQTT_DEFAULT_TIMEOUT_MS     5000
+#define MQTT_MAX_TOPIC_ALIASES      8     /* Alias table size per direction (MQTT 5) */
+#define MQTT_MAX_PENDING            8     /* Outstanding acks with completion callbacks */
+#define MQTT_MAX_INFLIGHT           8     /* QoS>0 publishes in flight per direction */
+#define MQTT_SERVICE_MAX_CLIENTS    4     /* Clients sharing the service task (max 8) */
+#define MQTT_SERVICE_TICK_MS        1000  /* Keepalive / ack timeout check period */
+#define MQTT_DEFAULT_RECONNECT_MS   1000  /* First reconnect delay */
+#define MQTT_DEFAULT_RECONNECT_MAX_MS 60000 /* Reconnect backoff ceiling */
+#define MQTT_OFFLINE_QUEUE_SIZE     512   /* Bytes of publishes queued while reconnecting */
 
 /* MQTT Protocol Version */
 #define MQTT_PROTOCOL_VERSION_3_1_1 4
+#define MQTT_PROTOCOL_VERSION_5     5
 
 /* MQTT QoS Levels */
 typedef enum {
@@ -57,7 +71,8 @@ typedef enum {
     MQTT_ERROR_BROKER_REFUSED,
     MQTT_ERROR_SUBSCRIBE_FAILED,
     MQTT_ERROR_PUBLISH_FAILED,
-    MQTT_ERROR_NO_MEMORY
+    MQTT_ERROR_NO_MEMORY,
+    MQTT_ERROR_FLOW_CONTROL      /* Broker Receive Maximum or MQTT_MAX_INFLIGHT reached */
 } mqtt_error_t;
 
 /* MQTT Connection States */
@@ -78,6 +93,77 @@ typedef enum {
     MQTT_CONNACK_REFUSED_NOT_AUTHORIZED
 } mqtt_connack_t;
 
+/* MQTT 5 Reason Codes (CONNACK, PUBACK, SUBACK, DISCONNECT, ...) */
+typedef enum {
+    MQTT_RC_SUCCESS = 0x00,                     /* Also Normal disconnection / Granted QoS 0 */
+    MQTT_RC_GRANTED_QOS_1 = 0x01,
+    MQTT_RC_GRANTED_QOS_2 = 0x02,
+    MQTT_RC_DISCONNECT_WITH_WILL = 0x04,
+    MQTT_RC_NO_MATCHING_SUBSCRIBERS = 0x10,
+    MQTT_RC_NO_SUBSCRIPTION_EXISTED = 0x11,
+    MQTT_RC_UNSPECIFIED_ERROR = 0x80,
+    MQTT_RC_MALFORMED_PACKET = 0x81,
+    MQTT_RC_PROTOCOL_ERROR = 0x82,
+    MQTT_RC_IMPLEMENTATION_SPECIFIC = 0x83,
+    MQTT_RC_UNSUPPORTED_PROTOCOL_VERSION = 0x84,
+    MQTT_RC_CLIENT_ID_NOT_VALID = 0x85,
+    MQTT_RC_BAD_USERNAME_OR_PASSWORD = 0x86,
+    MQTT_RC_NOT_AUTHORIZED = 0x87,
+    MQTT_RC_SERVER_UNAVAILABLE = 0x88,
+    MQTT_RC_SERVER_BUSY = 0x89,
+    MQTT_RC_BANNED = 0x8A,
+    MQTT_RC_SERVER_SHUTTING_DOWN = 0x8B,
+    MQTT_RC_KEEPALIVE_TIMEOUT = 0x8D,
+    MQTT_RC_SESSION_TAKEN_OVER = 0x8E,
+    MQTT_RC_TOPIC_FILTER_INVALID = 0x8F,
+    MQTT_RC_TOPIC_NAME_INVALID = 0x90,
+    MQTT_RC_PACKET_ID_IN_USE = 0x91,
+    MQTT_RC_PACKET_ID_NOT_FOUND = 0x92,
+    MQTT_RC_RECEIVE_MAXIMUM_EXCEEDED = 0x93,
+    MQTT_RC_TOPIC_ALIAS_INVALID = 0x94,
+    MQTT_RC_PACKET_TOO_LARGE = 0x95,
+    MQTT_RC_MESSAGE_RATE_TOO_HIGH = 0x96,
+    MQTT_RC_QUOTA_EXCEEDED = 0x97,
+    MQTT_RC_ADMINISTRATIVE_ACTION = 0x98,
+    MQTT_RC_PAYLOAD_FORMAT_INVALID = 0x99,
+    MQTT_RC_RETAIN_NOT_SUPPORTED = 0x9A,
+    MQTT_RC_QOS_NOT_SUPPORTED = 0x9B,
+    MQTT_RC_USE_ANOTHER_SERVER = 0x9C,
+    MQTT_RC_SERVER_MOVED = 0x9D,
+    MQTT_RC_CONNECTION_RATE_EXCEEDED = 0x9F
+} mqtt_reason_code_t;
+
+/* MQTT 5 Property Identifiers */
+typedef enum {
+    MQTT_PROP_PAYLOAD_FORMAT_INDICATOR = 0x01,  /* Byte */
+    MQTT_PROP_MESSAGE_EXPIRY_INTERVAL = 0x02,   /* Four byte integer */
+    MQTT_PROP_CONTENT_TYPE = 0x03,              /* UTF-8 string */
+    MQTT_PROP_RESPONSE_TOPIC = 0x08,            /* UTF-8 string */
+    MQTT_PROP_CORRELATION_DATA = 0x09,          /* Binary data */
+    MQTT_PROP_SUBSCRIPTION_IDENTIFIER = 0x0B,   /* Variable byte integer */
+    MQTT_PROP_SESSION_EXPIRY_INTERVAL = 0x11,   /* Four byte integer */
+    MQTT_PROP_ASSIGNED_CLIENT_ID = 0x12,        /* UTF-8 string */
+    MQTT_PROP_SERVER_KEEP_ALIVE = 0x13,         /* Two byte integer */
+    MQTT_PROP_AUTHENTICATION_METHOD = 0x15,     /* UTF-8 string */
+    MQTT_PROP_AUTHENTICATION_DATA = 0x16,       /* Binary data */
+    MQTT_PROP_REQUEST_PROBLEM_INFO = 0x17,      /* Byte */
+    MQTT_PROP_WILL_DELAY_INTERVAL = 0x18,       /* Four byte integer */
+    MQTT_PROP_REQUEST_RESPONSE_INFO = 0x19,     /* Byte */
+    MQTT_PROP_RESPONSE_INFO = 0x1A,             /* UTF-8 string */
+    MQTT_PROP_SERVER_REFERENCE = 0x1C,          /* UTF-8 string */
+    MQTT_PROP_REASON_STRING = 0x1F,             /* UTF-8 string */
+    MQTT_PROP_RECEIVE_MAXIMUM = 0x21,           /* Two byte integer */
+    MQTT_PROP_TOPIC_ALIAS_MAXIMUM = 0x22,       /* Two byte integer */
+    MQTT_PROP_TOPIC_ALIAS = 0x23,               /* Two byte integer */
+    MQTT_PROP_MAXIMUM_QOS = 0x24,               /* Byte */
+    MQTT_PROP_RETAIN_AVAILABLE = 0x25,          /* Byte */
+    MQTT_PROP_USER_PROPERTY = 0x26,             /* UTF-8 string pair */
+    MQTT_PROP_MAXIMUM_PACKET_SIZE = 0x27,       /* Four byte integer */
+    MQTT_PROP_WILDCARD_SUB_AVAILABLE = 0x28,    /* Byte */
+    MQTT_PROP_SUB_ID_AVAILABLE = 0x29,          /* Byte */
+    MQTT_PROP_SHARED_SUB_AVAILABLE = 0x2A       /* Byte */
+} mqtt_property_id_t;
+
 /* MQTT Message Types */
 typedef enum {
     MQTT_MSG_TYPE_CONNECT = 1,
@@ -142,6 +228,39 @@ typedef void (*mqtt_connection_callback_t)(
     void *user_data
 );
 
+/**
+ * @brief Asynchronous operation completion callback
+ *
+ * Called from the MQTT service task when a connect, publish or subscribe
+ * started with the *_async API completes (CONNACK, PUBACK/PUBCOMP, SUBACK),
+ * fails, or times out. QoS 0 publishes complete as soon as they are sent.
+ *
+ * @param client MQTT client instance
+ * @param result MQTT_OK on success, error code otherwise
+ * @param user_data User data passed to the *_async call
+ */
+typedef void (*mqtt_complete_callback_t)(
+    mqtt_client_t *client,
+    mqtt_error_t result,
+    void *user_data
+);
+
+/**
+ * @brief Service hook function
+ *
+ * Called from the MQTT service task each time a connected client is
+ * serviced (socket data, keepalive tick or mqtt_service_wake()). Lets
+ * layers built on the client do deferred work, such as flushing queued
+ * data, in task context.
+ *
+ * @param client MQTT client instance
+ * @param user_data User data passed to mqtt_set_service_hook()
+ */
+typedef void (*mqtt_service_hook_t)(
+    mqtt_client_t *client,
+    void *user_data
+);
+
 /**
  * @brief MQTT client configuration
  */
@@ -152,7 +271,7 @@ typedef struct {
     const char *username;        /* Username (NULL if not used) */
     const char *password;        /* Password (NULL if not used) */
     uint16_t keepalive_sec;      /* Keep-alive interval in seconds */
-    bool clean_session;          /* Clean session flag */
+    bool clean_session;          /* Clean session flag (false + session_expiry_sec for MQTT 5 resume) */
     const char *will_topic;      /* Last Will topic (NULL if not used) */
     const char *will_message;    /* Last Will message */
     uint16_t will_message_len;   /* Last Will message length */
@@ -160,7 +279,14 @@ typedef struct {
     bool will_retained;          /* Last Will retained flag */
     uint32_t timeout_ms;         /* Command timeout in milliseconds */
     bool auto_reconnect;         /* Enable automatic reconnection */
-    uint32_t reconnect_interval_ms; /* Reconnect interval */
+    uint32_t reconnect_interval_ms; /* First reconnect delay, doubled per failure */
+    uint32_t reconnect_max_interval_ms; /* Backoff ceiling */
+
+    /* MQTT 5 (ignored for 3.1.1) */
+    uint8_t protocol_version;    /* MQTT_PROTOCOL_VERSION_xxx (0 = 3.1.1) */
+    uint32_t session_expiry_sec; /* Session Expiry Interval (0 = end with connection) */
+    uint16_t receive_maximum;    /* Inbound QoS>0 publishes in flight (0 or above MQTT_MAX_INFLIGHT = MQTT_MAX_INFLIGHT) */
+    uint16_t topic_alias_maximum;/* Inbound topic aliases accepted (max MQTT_MAX_TOPIC_ALIASES) */
 } mqtt_config_t;
 
 /**
@@ -172,6 +298,25 @@ typedef struct {
     bool active;
 } mqtt_subscription_t;
 
+/**
+ * @brief Outstanding operation awaiting acknowledgement (internal)
+ */
+typedef struct {
+    uint8_t ack_type;                    /* Expected ack (MQTT_MSG_TYPE_xxx), 0 = free */
+    uint16_t message_id;
+    uint32_t sent_ms;
+    mqtt_complete_callback_t callback;
+    void *user_data;
+} mqtt_pending_t;
+
+/**
+ * @brief Topic alias table entry (internal, MQTT 5)
+ */
+typedef struct {
+    char topic[MQTT_MAX_TOPIC_LENGTH];
+    bool active;
+} mqtt_topic_alias_t;
+
 /**
  * @brief MQTT client structure
  */
@@ -195,14 +340,50 @@ struct mqtt_client {
     /* Subscriptions */
     mqtt_subscription_t subscriptions[MQTT_MAX_SUBSCRIPTIONS];
 
+    /* MQTT 5 session limits announced by the broker in CONNACK */
+    uint16_t server_receive_maximum;     /* Outbound QoS>0 publishes in flight */
+    uint16_t server_topic_alias_maximum; /* Outbound aliases the broker accepts */
+    uint32_t server_maximum_packet_size; /* Largest packet the broker accepts */
+    uint16_t inflight_count;             /* Unacknowledged outbound QoS>0 publishes */
+    uint16_t inflight_ids[MQTT_MAX_INFLIGHT];    /* Their packet ids, 0 = free */
+    uint16_t rx_inflight_count;          /* Inbound QoS 2 publishes awaiting PUBREL */
+    uint16_t rx_inflight_ids[MQTT_MAX_INFLIGHT]; /* Their packet ids, 0 = free */
+    mqtt_reason_code_t last_reason_code; /* Reason code of last ack/disconnect */
+
+    /* MQTT 5 topic aliases (alias N lives at index N-1) */
+    mqtt_topic_alias_t tx_aliases[MQTT_MAX_TOPIC_ALIASES];
+    mqtt_topic_alias_t rx_aliases[MQTT_MAX_TOPIC_ALIASES];
+
     /* Buffers */
     uint8_t tx_buffer[MQTT_MAX_PACKET_SIZE];
     uint8_t rx_buffer[MQTT_MAX_PACKET_SIZE];
     uint16_t rx_buffer_pos;
-
-    /* Task handle */
-    tcb_t task;
-    bool task_running;
+    uint8_t rx_header;                   /* Fixed header byte of last packet */
+
+    /* Incremental receive parser */
+    uint8_t rx_state;
+    uint8_t rx_length_bytes;
+    uint32_t rx_packet_length;           /* Remaining length of packet being read */
+
+    /* Event-driven service (shared task, no per-client TCB) */
+    int8_t service_slot;                 /* Slot in the shared service, -1 if none */
+    timer_t keepalive_timer;             /* Periodic tick for keepalive and timeouts */
+    uint32_t connect_start_ms;
+    bool ping_outstanding;
+    mqtt_complete_callback_t connect_callback;
+    void *connect_callback_data;
+    mqtt_pending_t pending[MQTT_MAX_PENDING];
+    mqtt_service_hook_t service_hook;
+    void *service_hook_data;
+
+    /* Automatic reconnection */
+    bool reconnect_pending;              /* Waiting for backoff to expire */
+    bool session_present;                /* Broker resumed the session (CONNACK) */
+    uint16_t reconnect_attempts;         /* Consecutive failed attempts */
+    uint32_t reconnect_at_ms;            /* Time of next attempt */
+    uint32_t rng_state;                  /* Backoff jitter PRNG */
+    uint8_t offline_queue[MQTT_OFFLINE_QUEUE_SIZE];
+    uint16_t offline_queue_length;
 
     /* Synchronization */
     mutex_t mutex;
@@ -220,13 +401,39 @@ mqtt_error_t mqtt_client_init(mqtt_client_t *client, const mqtt_config_t *config
 /**
  * @brief Connect to MQTT broker
  *
- * Establishes TCP connection and performs MQTT handshake.
+ * Establishes TCP connection and performs MQTT handshake. Blocks until
+ * CONNACK arrives or the attempt fails; must not be called from MQTT
+ * callbacks (use mqtt_connect_async() there).
+ *
+ * With auto_reconnect, a lost connection (or failed first attempt) is
+ * retried with jittered exponential backoff between reconnect_interval_ms
+ * and reconnect_max_interval_ms. If clean_session is false and the broker
+ * reports session-present, subscriptions are not re-sent; otherwise all
+ * active subscriptions are restored after CONNACK.
  *
  * @param client MQTT client instance
  * @return MQTT_OK on success, error code otherwise
  */
 mqtt_error_t mqtt_connect(mqtt_client_t *client);
 
+/**
+ * @brief Start connecting to MQTT broker without blocking
+ *
+ * Registers the client with the shared service task, which resolves the
+ * broker, opens the TCP connection and sends CONNECT. @p callback fires
+ * with the CONNACK result.
+ *
+ * @param client MQTT client instance
+ * @param callback Completion callback (may be NULL)
+ * @param user_data User data to pass to callback
+ * @return MQTT_OK if the attempt was started, error code otherwise
+ */
+mqtt_error_t mqtt_connect_async(
+    mqtt_client_t *client,
+    mqtt_complete_callback_t callback,
+    void *user_data
+);
+
 /**
  * @brief Disconnect from MQTT broker
  *
@@ -240,6 +447,10 @@ mqtt_error_t mqtt_disconnect(mqtt_client_t *client);
 /**
  * @brief Publish message to topic
  *
+ * While an auto_reconnect client is waiting to reconnect, the message is
+ * queued (up to MQTT_OFFLINE_QUEUE_SIZE bytes) and sent right after the
+ * next CONNACK.
+ *
  * @param client MQTT client instance
  * @param topic Topic name
  * @param payload Message payload
@@ -257,6 +468,34 @@ mqtt_error_t mqtt_publish(
     bool retained
 );
 
+/**
+ * @brief Publish message with completion callback
+ *
+ * Returns as soon as the PUBLISH is sent. @p callback fires on PUBACK
+ * (QoS 1), PUBCOMP (QoS 2), immediately for QoS 0, or with
+ * MQTT_ERROR_TIMEOUT if no acknowledgement arrives within timeout_ms.
+ *
+ * @param client MQTT client instance
+ * @param topic Topic name
+ * @param payload Message payload
+ * @param payload_length Payload length in bytes
+ * @param qos Quality of Service level (0, 1, or 2)
+ * @param retained Retained message flag
+ * @param callback Completion callback (may be NULL)
+ * @param user_data User data to pass to callback
+ * @return MQTT_OK if sent, error code otherwise (callback not called)
+ */
+mqtt_error_t mqtt_publish_async(
+    mqtt_client_t *client,
+    const char *topic,
+    const void *payload,
+    uint16_t payload_length,
+    mqtt_qos_t qos,
+    bool retained,
+    mqtt_complete_callback_t callback,
+    void *user_data
+);
+
 /**
  * @brief Subscribe to topic
  *
@@ -271,6 +510,24 @@ mqtt_error_t mqtt_subscribe(
     mqtt_qos_t qos
 );
 
+/**
+ * @brief Subscribe to topic with completion callback
+ *
+ * @param client MQTT client instance
+ * @param topic Topic name (supports wildcards: + and #)
+ * @param qos Maximum QoS level for messages on this topic
+ * @param callback Completion callback fired on SUBACK (may be NULL)
+ * @param user_data User data to pass to callback
+ * @return MQTT_OK if sent, error code otherwise (callback not called)
+ */
+mqtt_error_t mqtt_subscribe_async(
+    mqtt_client_t *client,
+    const char *topic,
+    mqtt_qos_t qos,
+    mqtt_complete_callback_t callback,
+    void *user_data
+);
+
 /**
  * @brief Unsubscribe from topic
  *
@@ -322,17 +579,75 @@ bool mqtt_is_connected(const mqtt_client_t *client);
  */
 mqtt_state_t mqtt_get_state(const mqtt_client_t *client);
 
+/**
+ * @brief Get reason code of the last acknowledgement or disconnect
+ *
+ * Only meaningful for MQTT 5 clients; 3.1.1 clients report the
+ * CONNACK return code mapped onto the MQTT 5 equivalents.
+ *
+ * @param client MQTT client instance
+ * @return Last reason code received from the broker
+ */
+mqtt_reason_code_t mqtt_get_last_reason_code(const mqtt_client_t *client);
+
+/**
+ * @brief Start the shared MQTT service task
+ *
+ * Started implicitly by the first connect; call beforehand to choose the
+ * task priority. One task services every registered client.
+ *
+ * @param priority Service task priority
+ * @return MQTT_OK on success, error code otherwise
+ */
+mqtt_error_t mqtt_service_start(task_priority_t priority);
+
+/**
+ * @brief Install a hook run by the service task for this client
+ *
+ * @param client MQTT client instance
+ * @param hook Hook function (NULL to remove)
+ * @param user_data User data passed to hook
+ */
+void mqtt_set_service_hook(
+    mqtt_client_t *client,
+    mqtt_service_hook_t hook,
+    void *user_data
+);
+
+/**
+ * @brief Ask the service task to process a client soon
+ *
+ * Safe to call from timer callbacks and interrupt context. Has no effect
+ * while the client is not registered with the service.
+ *
+ * @param client MQTT client instance
+ */
+void mqtt_service_wake(mqtt_client_t *client);
+
 /**
  * @brief Process MQTT client (internal loop)
  *
- * This is called automatically by the background task.
- * Do not call manually unless using custom task management.
+ * Never blocks on the network: drains whatever the socket has buffered,
+ * dispatches complete packets and checks keepalive and ack timeouts.
+ * Called automatically by the service task on socket readiness and timer
+ * ticks. Do not call manually unless using custom task management.
  *
  * @param client MQTT client instance
  * @return MQTT_OK on success, error code otherwise
  */
 mqtt_error_t mqtt_loop(mqtt_client_t *client);
 
+/**
+ * @brief Check if a topic matches a subscription filter
+ *
+ * Supports the single-level (+) and multi-level (#) wildcards.
+ *
+ * @param subscription Topic filter
+ * @param topic Topic name
+ * @return true if the topic matches the filter
+ */
+bool mqtt_topic_matches(const char *subscription, const char *topic);
+
 /**
  * @brief Convert error code to string
  *
@@ -349,6 +664,14 @@ const char *mqtt_error_to_string(mqtt_error_t error);
  */
 const char *mqtt_state_to_string(mqtt_state_t state);
 
+/**
+ * @brief Convert MQTT 5 reason code to string
+ *
+ * @param code Reason code
+ * @return Reason code description string
+ */
+const char *mqtt_reason_code_to_string(mqtt_reason_code_t code);
+
 /** @} */
 
 #ifdef __cplusplus
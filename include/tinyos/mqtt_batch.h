@@ -0,0 +1,195 @@
+/**
+ * @file mqtt_batch.h
+ * @brief MQTT Publish Batching for TinyOS-RTOS
+ *
+ * Aggregates small, high-rate samples into one MQTT publish per topic.
+ * A batch is flushed when it reaches max_batch_bytes or when its oldest
+ * sample is max_latency_ms old, whichever comes first. Time-based flushes
+ * run in the MQTT service task, so no extra task is needed.
+ *
+ * Batch payload format (all multi-byte fields big-endian):
+ *
+ *   +---------+-------+-----------+----------------------------+
+ *   | version | count | base_ms   | record[0] ... record[n-1]  |
+ *   | 1 byte  | 1 byte| 4 bytes   |                            |
+ *   +---------+-------+-----------+----------------------------+
+ *
+ *   record = delta_ms (varint) | length (varint) | data
+ *
+ * delta_ms is relative to the previous sample (the first to base_ms);
+ * varints use the MQTT remaining-length encoding (7 bits per byte, LSB
+ * group first). A 20-byte sample costs 22 bytes instead of a full
+ * MQTT/TCP/IP packet.
+ */
+
+#ifndef TINYOS_MQTT_BATCH_H
+#define TINYOS_MQTT_BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tinyos.h"
+#include "tinyos/mqtt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup MQTT_Batch MQTT Publish Batching
+ * @{
+ */
+
+/* Batching Constants */
+#define MQTT_BATCH_MAX_TOPICS           4     /* Topics batched concurrently */
+#define MQTT_BATCH_BUFFER_SIZE          512   /* Upper bound for max_batch_bytes */
+#define MQTT_BATCH_MAX_SAMPLES          255   /* Samples per batch (count is 1 byte) */
+#define MQTT_BATCH_DEFAULT_LATENCY_MS   500
+#define MQTT_BATCH_VERSION              0xB1
+#define MQTT_BATCH_HEADER_SIZE          6
+
+/**
+ * @brief Batching configuration
+ */
+typedef struct {
+    uint16_t max_batch_bytes;    /* Flush once a batch reaches this size (0 = buffer size) */
+    uint32_t max_latency_ms;     /* Flush once the oldest sample is this old (0 = default) */
+    mqtt_qos_t qos;              /* QoS used for batch publishes */
+    bool retained;               /* Retain flag used for batch publishes */
+} mqtt_batch_config_t;
+
+/**
+ * @brief Per-topic batch (internal)
+ */
+typedef struct {
+    char topic[MQTT_MAX_TOPIC_LENGTH];
+    uint8_t buffer[MQTT_BATCH_BUFFER_SIZE];
+    uint16_t length;             /* Bytes used including header */
+    uint8_t count;               /* Samples in batch */
+    uint32_t base_ms;            /* Timestamp of first sample */
+    uint32_t last_ms;            /* Timestamp of latest sample */
+    bool active;                 /* Slot bound to topic */
+} mqtt_batch_topic_t;
+
+/**
+ * @brief Batching statistics
+ */
+typedef struct {
+    uint32_t samples;            /* Samples accepted */
+    uint32_t sample_bytes;       /* Sample payload bytes accepted */
+    uint32_t batches;            /* Batches published */
+    uint32_t batch_bytes;        /* Batch payload bytes published */
+    uint32_t size_flushes;       /* Flushes triggered by max_batch_bytes */
+    uint32_t time_flushes;       /* Flushes triggered by max_latency_ms */
+    uint32_t dropped;            /* Samples rejected because a flush failed */
+} mqtt_batch_stats_t;
+
+/**
+ * @brief Batcher instance
+ */
+typedef struct {
+    mqtt_client_t *client;
+    mqtt_batch_config_t config;
+    mqtt_batch_topic_t topics[MQTT_BATCH_MAX_TOPICS];
+    timer_t flush_timer;         /* One-shot, armed for the oldest open batch */
+    mqtt_batch_stats_t stats;
+    mutex_t mutex;
+} mqtt_batch_t;
+
+/**
+ * @brief Sample callback for mqtt_batch_decode()
+ *
+ * @param timestamp_ms Sample timestamp (sender uptime)
+ * @param data Sample data
+ * @param length Sample length
+ * @param user_data User data passed to mqtt_batch_decode()
+ */
+typedef void (*mqtt_batch_sample_callback_t)(
+    uint32_t timestamp_ms,
+    const uint8_t *data,
+    uint16_t length,
+    void *user_data
+);
+
+/**
+ * @brief Initialize batcher on top of an MQTT client
+ *
+ * Installs the client's service hook; a client carries one batcher.
+ *
+ * @param batch Batcher instance
+ * @param client Initialized MQTT client
+ * @param config Batching configuration (NULL for defaults)
+ * @return MQTT_OK on success, error code otherwise
+ */
+mqtt_error_t mqtt_batch_init(
+    mqtt_batch_t *batch,
+    mqtt_client_t *client,
+    const mqtt_batch_config_t *config
+);
+
+/**
+ * @brief Stop batching and release the client hook
+ *
+ * Pending samples are discarded; call mqtt_batch_flush() first to keep them.
+ *
+ * @param batch Batcher instance
+ */
+void mqtt_batch_deinit(mqtt_batch_t *batch);
+
+/**
+ * @brief Queue a sample for a topic
+ *
+ * Publishes the topic's batch first if the sample would not fit, and
+ * again if the batch reaches max_batch_bytes afterwards.
+ *
+ * @param batch Batcher instance
+ * @param topic Topic to publish to
+ * @param data Sample data
+ * @param length Sample length
+ * @return MQTT_OK on success, error code otherwise
+ */
+mqtt_error_t mqtt_batch_add(
+    mqtt_batch_t *batch,
+    const char *topic,
+    const void *data,
+    uint16_t length
+);
+
+/**
+ * @brief Publish all non-empty batches now
+ *
+ * @param batch Batcher instance
+ * @return MQTT_OK on success, first error otherwise (failed batches are kept)
+ */
+mqtt_error_t mqtt_batch_flush(mqtt_batch_t *batch);
+
+/**
+ * @brief Get batching statistics
+ *
+ * @param batch Batcher instance
+ * @param stats Output statistics
+ */
+void mqtt_batch_get_stats(mqtt_batch_t *batch, mqtt_batch_stats_t *stats);
+
+/**
+ * @brief Split a received batch payload into samples
+ *
+ * @param payload Batch payload (mqtt_message_t payload)
+ * @param length Payload length
+ * @param callback Called once per sample
+ * @param user_data User data passed to callback
+ * @return Number of samples, or -1 if the payload is malformed
+ */
+int32_t mqtt_batch_decode(
+    const uint8_t *payload,
+    uint16_t length,
+    mqtt_batch_sample_callback_t callback,
+    void *user_data
+);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TINYOS_MQTT_BATCH_H */
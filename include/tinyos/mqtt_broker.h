@@ -0,0 +1,89 @@
+/**
+ * @file mqtt_broker.h
+ * @brief Minimal In-Process MQTT Broker for TinyOS-RTOS
+ *
+ * A small MQTT 3.1.1 broker that runs as one task on the local network
+ * stack. With drivers/loopback_net.c it lets the MQTT client be exercised
+ * and benchmarked end to end on a host build without any network.
+ *
+ * Supported: CONNECT/CONNACK, PUBLISH at QoS 0/1/2 (with PUBACK, PUBREC,
+ * PUBREL, PUBCOMP), SUBSCRIBE/UNSUBSCRIBE with + and # wildcards,
+ * PINGREQ and DISCONNECT. Not supported: retained messages, persistent
+ * sessions (CONNACK never reports session-present), wills and
+ * authentication. QoS 2 messages are routed on the first PUBLISH of a
+ * packet id; a retransmission before PUBREL is acknowledged, not routed.
+ */
+
+#ifndef TINYOS_MQTT_BROKER_H
+#define TINYOS_MQTT_BROKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tinyos.h"
+#include "tinyos/mqtt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup MQTT_Broker MQTT Broker
+ * @{
+ */
+
+/* Broker Constants */
+#define MQTT_BROKER_MAX_CLIENTS         3     /* Each uses one socket, plus one listener */
+#define MQTT_BROKER_MAX_SUBSCRIPTIONS   8     /* Topic filters per client */
+#define MQTT_BROKER_MAX_QOS2            8     /* Inbound QoS 2 publishes awaiting PUBREL per client */
+#define MQTT_BROKER_POLL_MS             1000  /* Keepalive check period */
+
+/**
+ * @brief Broker configuration
+ */
+typedef struct {
+    uint16_t port;               /* Listen port (0 = MQTT_DEFAULT_PORT) */
+    task_priority_t priority;    /* Broker task priority */
+} mqtt_broker_config_t;
+
+/**
+ * @brief Broker statistics
+ */
+typedef struct {
+    uint32_t connections;        /* CONNECTs accepted */
+    uint32_t publishes_in;       /* PUBLISH packets received */
+    uint32_t publishes_out;      /* PUBLISH packets delivered to subscribers */
+    uint32_t send_errors;        /* Packets dropped because a send failed */
+} mqtt_broker_stats_t;
+
+/**
+ * @brief Start the broker task
+ *
+ * Requires an initialized and started network stack.
+ *
+ * @param config Broker configuration (NULL for defaults)
+ * @return MQTT_OK on success, error code otherwise
+ */
+mqtt_error_t mqtt_broker_start(const mqtt_broker_config_t *config);
+
+/**
+ * @brief Close every client connection
+ *
+ * Simulates a broker restart: clients see the TCP connection close and
+ * must reconnect. The listener stays open.
+ */
+void mqtt_broker_drop_clients(void);
+
+/**
+ * @brief Get broker statistics
+ *
+ * @param stats Output statistics
+ */
+void mqtt_broker_get_stats(mqtt_broker_stats_t *stats);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TINYOS_MQTT_BROKER_H */
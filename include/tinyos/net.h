@@ -3,7 +3,7 @@
  * @brief TinyOS Network Stack - Lightweight TCP/IP Implementation
  *
  * Ultra-lightweight network stack for embedded systems
- * Features: Ethernet, IPv4, ICMP, UDP, TCP, HTTP, DNS
+ * Features: Ethernet, IPv4, ICMP, IGMPv2, UDP, TCP, HTTP, DNS
  */
 
 #ifndef TINYOS_NET_H
@@ -20,8 +20,12 @@
 #define NET_MAX_SOCKETS         8       /* Maximum number of sockets */
 #define NET_BUFFER_SIZE         1500    /* MTU size */
 #define NET_MAX_BUFFERS         8       /* Number of network buffers */
+#define NET_TX_HEADROOM         42      /* Ethernet + IPv4 + UDP headers, prepended in place */
+#define NET_SOCKET_RX_SIZE      1024    /* Per-socket receive buffer; larger datagrams are truncated */
 #define NET_TCP_MAX_CONNECTIONS 4       /* Maximum TCP connections */
 #define NET_UDP_MAX_SOCKETS     4       /* Maximum UDP sockets */
+#define NET_MAX_MULTICAST_GROUPS 4      /* Joined IPv4 multicast groups */
+#define HTTP_STREAM_CHUNK_SIZE  512     /* Receive size of net_http_get_stream() */
 
 /*===========================================================================
  * MAC Address (6 bytes)
@@ -42,6 +46,7 @@ typedef struct {
 /* Helper macros for IPv4 addresses */
 #define IPV4(a,b,c,d) ((ipv4_addr_t){{a,b,c,d}})
 #define IPV4_ADDR(ip) ((ip).addr[0]), ((ip).addr[1]), ((ip).addr[2]), ((ip).addr[3])
+#define IPV4_IS_MULTICAST(ip) (((ip).addr[0] & 0xF0) == 0xE0)  /* 224.0.0.0/4 */
 
 /*===========================================================================
  * Network Buffer Management
@@ -55,6 +60,18 @@ typedef struct net_buffer {
     bool in_use;
 } net_buffer_t;
 
+/**
+ * @brief Allocate a buffer from the network pool
+ * @return Buffer (length and offset 0) or NULL if none is free
+ */
+net_buffer_t *net_buffer_alloc(void);
+
+/**
+ * @brief Return a buffer to the network pool
+ * @param buf Buffer to free (NULL is ignored)
+ */
+void net_buffer_free(net_buffer_t *buf);
+
 /*===========================================================================
  * Network Interface Configuration
  *===========================================================================*/
@@ -224,6 +241,10 @@ os_error_t net_listen(net_socket_t sock, int backlog);
 
 /**
  * @brief Accept incoming connection (TCP only)
+ *
+ * Blocks until a connection is pending. Use net_socket_available() or
+ * net_socket_set_notify() on the listening socket to avoid blocking.
+ *
  * @param sock Listening socket
  * @param addr Remote address (output)
  * @return New socket descriptor or INVALID_SOCKET on error
@@ -244,7 +265,7 @@ os_error_t net_connect(net_socket_t sock, const sockaddr_in_t *addr, uint32_t ti
  * @param sock Socket descriptor
  * @param data Data buffer
  * @param length Data length
- * @param timeout_ms Timeout in milliseconds
+ * @param timeout_ms Max time to wait for room in the driver TX queue
  * @return Number of bytes sent or negative on error
  */
 int32_t net_send(net_socket_t sock, const void *data, uint16_t length, uint32_t timeout_ms);
@@ -269,6 +290,21 @@ int32_t net_recv(net_socket_t sock, void *buffer, uint16_t max_length, uint32_t
  */
 int32_t net_sendto(net_socket_t sock, const void *data, uint16_t length, const sockaddr_in_t *addr);
 
+/**
+ * @brief Send datagram held in a network buffer (UDP only)
+ *
+ * Sends buf->data[offset, offset + length). The UDP, IP and Ethernet
+ * headers are written into the NET_TX_HEADROOM bytes before offset, so
+ * the payload is never copied. The buffer stays owned by the caller and
+ * may be sent again.
+ *
+ * @param sock Socket descriptor
+ * @param buf Buffer with offset >= NET_TX_HEADROOM
+ * @param addr Destination address
+ * @return Number of bytes sent or negative on error
+ */
+int32_t net_sendto_buffer(net_socket_t sock, net_buffer_t *buf, const sockaddr_in_t *addr);
+
 /**
  * @brief Receive datagram (UDP only)
  * @param sock Socket descriptor
@@ -279,6 +315,22 @@ int32_t net_sendto(net_socket_t sock, const void *data, uint16_t length, const s
  */
 int32_t net_recvfrom(net_socket_t sock, void *buffer, uint16_t max_length, sockaddr_in_t *addr);
 
+/**
+ * @brief Receive datagram and the address it was sent to (UDP only)
+ *
+ * Like net_recvfrom(); @p dest tells a datagram sent to a multicast
+ * group apart from one sent to our own address.
+ *
+ * @param sock Socket descriptor
+ * @param buffer Receive buffer
+ * @param max_length Buffer size
+ * @param addr Source address (output, can be NULL)
+ * @param dest Destination address (output, can be NULL)
+ * @return Number of bytes received or negative on error
+ */
+int32_t net_recvfrom_to(net_socket_t sock, void *buffer, uint16_t max_length, sockaddr_in_t *addr,
+                        ipv4_addr_t *dest);
+
 /**
  * @brief Close socket
  * @param sock Socket descriptor
@@ -286,6 +338,32 @@ int32_t net_recvfrom(net_socket_t sock, void *buffer, uint16_t max_length, socka
  */
 os_error_t net_close(net_socket_t sock);
 
+/**
+ * @brief Register socket readiness notification
+ *
+ * Sets @p bits in @p group whenever data arrives on the socket, the
+ * connection is closed by the peer, or (listening sockets) a new
+ * connection is waiting to be accepted. Pass NULL to unregister. Lets one task
+ * service many sockets without blocking in net_recv().
+ *
+ * @param sock Socket descriptor
+ * @param group Event group to signal (NULL to disable)
+ * @param bits Event bits to set
+ * @return OS_OK on success
+ */
+os_error_t net_socket_set_notify(net_socket_t sock, event_group_t *group, uint32_t bits);
+
+/**
+ * @brief Get number of bytes that can be read without blocking
+ *
+ * For a listening socket, returns the number of connections waiting in
+ * the accept backlog instead.
+ *
+ * @param sock Socket descriptor
+ * @return Bytes available, or negative if the socket is invalid or closed
+ */
+int32_t net_socket_available(net_socket_t sock);
+
 /*===========================================================================
  * ICMP (Ping)
  *===========================================================================*/
@@ -299,6 +377,42 @@ os_error_t net_close(net_socket_t sock);
  */
 os_error_t net_ping(ipv4_addr_t dest_ip, uint32_t timeout_ms, uint32_t *rtt);
 
+/*===========================================================================
+ * IPv4 Multicast (IGMPv2)
+ *===========================================================================*/
+
+/**
+ * @brief Join an IPv4 multicast group
+ *
+ * Datagrams sent to the group are delivered to UDP sockets bound to their
+ * port. Membership is announced with an IGMPv2 report, repeated once,
+ * and renewed when a router queries. Joins are counted, so each join
+ * needs its own leave. The driver must pass multicast frames up
+ * (all-multicast mode); the IP layer filters by group.
+ *
+ * @param group Multicast address (224.0.0.0/4)
+ * @return OS_OK on success, OS_ERR_NO_RESOURCE if all
+ *         NET_MAX_MULTICAST_GROUPS are in use
+ */
+os_error_t net_multicast_join(ipv4_addr_t group);
+
+/**
+ * @brief Leave an IPv4 multicast group
+ *
+ * The last leave sends an IGMPv2 Leave Group message.
+ *
+ * @param group Multicast address
+ * @return OS_OK on success, OS_ERR_INVALID_PARAM if not joined
+ */
+os_error_t net_multicast_leave(ipv4_addr_t group);
+
+/**
+ * @brief Check multicast group membership
+ * @param group Multicast address
+ * @return true if joined (always true for 224.0.0.1, all systems)
+ */
+bool net_multicast_is_member(ipv4_addr_t group);
+
 /*===========================================================================
  * DNS Client
  *===========================================================================*/
@@ -385,6 +499,44 @@ os_error_t net_http_post(
     uint32_t timeout_ms
 );
 
+/**
+ * @brief Body callback for net_http_get_stream()
+ * @param data Next body bytes
+ * @param length Number of bytes
+ * @param status_code HTTP status code (200, or 206 for a Range request)
+ * @param content_length Content-Length of the response (0 if absent)
+ * @param user_data User data passed to net_http_get_stream()
+ * @return OS_OK to continue, any other code aborts the transfer
+ */
+typedef os_error_t (*http_body_callback_t)(const uint8_t *data, uint32_t length, uint16_t status_code,
+                                           uint32_t content_length, void *user_data);
+
+/**
+ * @brief HTTP GET delivering the body in chunks as it is received
+ *
+ * Nothing is buffered beyond one receive of HTTP_STREAM_CHUNK_SIZE bytes,
+ * so bodies of any size can be consumed (e.g. written straight to flash).
+ * Pass a "Range: bytes=N-" header to continue an interrupted transfer;
+ * servers that ignore it answer 200 with the whole body.
+ *
+ * @param url URL
+ * @param headers Additional headers (NULL-terminated array, can be NULL)
+ * @param callback Called for each body chunk
+ * @param user_data User data for callback
+ * @param status_code HTTP status code (output, can be NULL)
+ * @param timeout_ms Connect timeout and per-receive timeout in milliseconds
+ * @return OS_OK once the whole body was delivered, OS_ERROR on a non-2xx
+ *         status, OS_ERR_TIMEOUT if the body ended early, or the callback's error
+ */
+os_error_t net_http_get_stream(
+    const char *url,
+    const char **headers,
+    http_body_callback_t callback,
+    void *user_data,
+    uint16_t *status_code,
+    uint32_t timeout_ms
+);
+
 /*===========================================================================
  * HTTP Server (Simple)
  *===========================================================================*/
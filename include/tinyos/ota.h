@@ -7,6 +7,35 @@
  * - Signature verification
  * - Automatic rollback on failure
  * - Progress monitoring
+ *
+ * Updates are streamed: the image (header first, then payload) is
+ * parsed, checksummed and programmed page by page as it arrives, so RAM
+ * use is one flash page regardless of image size. Checkpoints in the data
+ * partition let an interrupted update continue where it stopped.
+ *
+ * Signed images carry an Ed25519 signature of the image digest: SHA-256
+ * over the header (with the signature field zeroed) followed by the
+ * payload. The digest is computed while the image streams in, so the
+ * signature check after a download needs no extra pass over flash, and
+ * a check at boot is one pass that also covers the CRC32. Images are
+ * signed on the host with tools/ota_sign.py.
+ *
+ * An image can be sent compressed (tools/ota_compress.c): the header is
+ * sent as is but with OTA_IMAGE_FLAG_COMPRESSED set, and the payload as
+ * one LZ4 block (the LZ4 block format, offsets up to 64 KB). The payload
+ * is decompressed as it streams in, and the header is programmed with
+ * the flag cleared, so flash holds exactly the image that was signed:
+ * image_size, crc32 and the digest all describe the decompressed image,
+ * and the bootloader never sees compressed data. Matches are copied
+ * from the image already written, so the decompressor needs no window
+ * buffer of its own.
+ *
+ * ota_start_update_background() runs the download in its own task, at a
+ * priority below the application's traffic, so a fleet rollout does not
+ * hold up telemetry. rate_limit caps the download with a token bucket
+ * (the HTTP receive stalls and TCP flow control slows the server), the
+ * update yields between flash operations, and progress_interval_ms
+ * limits how often the progress callback runs.
  */
 
 #ifndef TINYOS_OTA_H
@@ -25,9 +54,14 @@ extern "C" {
  * ============================================================================ */
 
 #define OTA_VERSION_STRING_MAX  32
-#define OTA_SIGNATURE_SIZE      32   /* SHA-256 signature size */
+#define OTA_SIGNATURE_SIZE      64   /* Ed25519 signature size */
+#define OTA_PUBLIC_KEY_SIZE     32   /* Ed25519 public key size */
+#define OTA_DIGEST_SIZE         32   /* SHA-256 image digest size */
 #define OTA_CHUNK_SIZE          512  /* Firmware chunk size for download */
 
+/* Image header flags */
+#define OTA_IMAGE_FLAG_COMPRESSED   0x00000001  /* Payload sent as an LZ4 block (transport only) */
+
 /* ============================================================================
  * Enums and Types
  * ============================================================================ */
@@ -92,9 +126,9 @@ typedef struct {
     uint32_t magic;                             /* Magic number: 0x544F5346 "TOSF" */
     uint32_t version;                           /* Firmware version */
     char version_string[OTA_VERSION_STRING_MAX]; /* Version string (e.g., "1.2.3") */
-    uint32_t image_size;                        /* Firmware image size */
-    uint32_t crc32;                             /* CRC32 checksum */
-    uint8_t signature[OTA_SIGNATURE_SIZE];      /* SHA-256 signature */
+    uint32_t image_size;                        /* Image size including this header */
+    uint32_t crc32;                             /* CRC32 of the bytes after this header */
+    uint8_t signature[OTA_SIGNATURE_SIZE];      /* Ed25519 signature of the image digest */
     uint32_t timestamp;                         /* Build timestamp */
     uint32_t flags;                             /* Feature flags */
     uint32_t reserved[4];                       /* Reserved for future use */
@@ -120,11 +154,14 @@ typedef struct {
     const char *server_url;           /* Update server URL */
     const char *firmware_path;        /* Path to firmware on server */
     uint32_t timeout_ms;              /* Download timeout */
-    uint32_t retry_count;             /* Number of retries */
-    bool verify_signature;            /* Enable signature verification */
+    uint32_t retry_count;             /* Resumed attempts after a dropped download */
+    bool verify_signature;            /* Require a valid signature (needs signature_key) */
     bool auto_rollback;               /* Enable automatic rollback */
-    uint8_t *signature_key;           /* Public key for signature verification */
-    uint16_t signature_key_len;       /* Key length */
+    uint8_t *signature_key;           /* Ed25519 public key */
+    uint16_t signature_key_len;       /* Key length (OTA_PUBLIC_KEY_SIZE) */
+    uint32_t rate_limit;              /* Download bytes per second, 0 = unlimited */
+    uint32_t rate_burst;              /* Bytes let through at once (token bucket size), 0 = one chunk */
+    uint32_t progress_interval_ms;    /* Minimum time between download progress callbacks, 0 = every chunk */
 } ota_config_t;
 
 /**
@@ -153,7 +190,8 @@ typedef void (*ota_progress_callback_t)(const ota_progress_t *progress, void *us
 /**
  * @brief Initialize OTA subsystem
  * @param config OTA configuration
- * @return OTA_OK on success, error code otherwise
+ * @return OTA_OK on success, OTA_ERROR_INVALID_PARAM if verify_signature
+ *         is set without a signature_key, error code otherwise
  */
 ota_error_t ota_init(const ota_config_t *config);
 
@@ -167,7 +205,8 @@ ota_error_t ota_get_config(ota_config_t *config);
 /**
  * @brief Update OTA configuration
  * @param config New configuration
- * @return OTA_OK on success, error code otherwise
+ * @return OTA_OK on success, OTA_ERROR_INVALID_PARAM if verify_signature
+ *         is set without a signature_key, error code otherwise
  */
 ota_error_t ota_set_config(const ota_config_t *config);
 
@@ -213,8 +252,44 @@ ota_error_t ota_mark_partition_invalid(ota_partition_type_t type);
  * Firmware Update Operations
  * ============================================================================ */
 
+/**
+ * @brief Start a streamed firmware update
+ *
+ * Follow with ota_write_chunk() for each piece of the image in order and
+ * ota_end_update() (or ota_finalize_update()) after the last one.
+ * Discards any checkpoint left by an interrupted update.
+ *
+ * @param callback Progress callback (optional), called once per chunk
+ *                 (at most once per progress_interval_ms when set)
+ * @param user_data User data for callback
+ * @return OTA_OK on success, OTA_ERROR_BUSY if an update is in progress
+ */
+ota_error_t ota_begin_update(ota_progress_callback_t callback, void *user_data);
+
+/**
+ * @brief Continue an update interrupted by a reset or a lost connection
+ *
+ * Progress is checkpointed in the data partition each time a flash sector
+ * of the image has been programmed. This restores the stream at the last
+ * checkpoint without erasing the sectors already written; continue with
+ * ota_write_chunk() from the returned offset (e.g. an HTTP Range request
+ * or the matching CoAP Block2 block number).
+ *
+ * @param callback Progress callback (optional)
+ * @param user_data User data for callback
+ * @param offset Stream offset to continue from (output; sector aligned
+ *               unless the image is sent compressed)
+ * @return OTA_OK on success, OTA_ERROR_INVALID_IMAGE if there is nothing to resume
+ */
+ota_error_t ota_resume_update(ota_progress_callback_t callback, void *user_data, uint32_t *offset);
+
 /**
  * @brief Start firmware update from URL
+ *
+ * The HTTP body is streamed into the update partition as it is received.
+ * An interrupted update is resumed with an HTTP Range request, both after
+ * a dropped connection (up to retry_count times) and after a reset.
+ *
  * @param url Firmware download URL
  * @param callback Progress callback (optional)
  * @param user_data User data for callback
@@ -222,6 +297,30 @@ ota_error_t ota_mark_partition_invalid(ota_partition_type_t type);
  */
 ota_error_t ota_start_update(const char *url, ota_progress_callback_t callback, void *user_data);
 
+/**
+ * @brief Start firmware update from URL in a background task
+ *
+ * Runs ota_start_update() in a task of its own and returns at once. The
+ * callback sees OTA_STATE_COMPLETE or OTA_STATE_FAILED at the end; call
+ * ota_finalize_update() from the application to switch partitions. Use
+ * a priority below the tasks that carry production traffic, and set
+ * rate_limit to leave them bandwidth. The task needs a stack large
+ * enough for Ed25519 when a signature key is set (see example-secure-boot).
+ *
+ * While the task runs, calls from other tasks that change the update or
+ * the boot info (ota_set_config(), ota_write_chunk(), ota_abort_update(),
+ * ota_confirm_boot(), ota_set_boot_partition(), ...) return
+ * OTA_ERROR_BUSY; ota_get_progress() and the verify calls still work.
+ *
+ * @param url Firmware download URL (must stay valid until the update ends)
+ * @param priority Update task priority (e.g. PRIORITY_LOW)
+ * @param callback Progress callback (optional), called from the update task
+ * @param user_data User data for callback
+ * @return OTA_OK if the task was started, OTA_ERROR_BUSY if an update is in progress
+ */
+ota_error_t ota_start_update_background(const char *url, task_priority_t priority,
+                                        ota_progress_callback_t callback, void *user_data);
+
 /**
  * @brief Start firmware update from buffer
  * @param firmware_data Pointer to firmware data
@@ -235,15 +334,31 @@ ota_error_t ota_start_update_from_buffer(const uint8_t *firmware_data, uint32_t
 
 /**
  * @brief Write firmware chunk (for custom download implementations)
+ *
+ * Chunks may have any size but must be contiguous. The header is checked
+ * as soon as it is complete, the payload CRC is accumulated, and sectors
+ * are erased just ahead of the pages being programmed. A compressed
+ * payload is decompressed on the way. A chunk at offset 0 starts a new
+ * update if none is in progress.
+ *
  * @param data Chunk data
  * @param size Chunk size
- * @param offset Offset in firmware image
+ * @param offset Offset in the stream as sent (must equal the bytes passed so far)
  * @return OTA_OK on success, error code otherwise
  */
 ota_error_t ota_write_chunk(const uint8_t *data, uint32_t size, uint32_t offset);
 
+/**
+ * @brief Complete a streamed update: flush, check size, CRC and signature, mark pending
+ * @return OTA_OK on success, error code otherwise
+ */
+ota_error_t ota_end_update(void);
+
 /**
  * @brief Finalize firmware update and prepare for reboot
+ *
+ * Calls ota_end_update() first if a streamed update is still open.
+ *
  * @return OTA_OK on success, error code otherwise
  */
 ota_error_t ota_finalize_update(void);
@@ -266,7 +381,7 @@ ota_error_t ota_get_progress(ota_progress_t *progress);
  * ============================================================================ */
 
 /**
- * @brief Verify firmware image in partition
+ * @brief Verify firmware image in partition (header, then CRC32 of the payload read back)
  * @param type Partition type to verify
  * @return OTA_OK if valid, error code otherwise
  */
@@ -280,7 +395,10 @@ ota_error_t ota_verify_partition(ota_partition_type_t type);
 ota_error_t ota_verify_image_header(const ota_image_header_t *header);
 
 /**
- * @brief Compute CRC32 of firmware image
+ * @brief Compute CRC32 of the firmware image payload (image_size from its header)
+ *
+ * The result is comparable with the header's crc32 field.
+ *
  * @param type Partition type
  * @param crc32 Pointer to store CRC32 value
  * @return OTA_OK on success, error code otherwise
@@ -288,10 +406,22 @@ ota_error_t ota_verify_image_header(const ota_image_header_t *header);
 ota_error_t ota_compute_crc32(ota_partition_type_t type, uint32_t *crc32);
 
 /**
- * @brief Verify firmware signature
+ * @brief Verify an image in one pass over flash: header, CRC32 and signature
+ *
+ * With a key this needs about 2 KB of stack (see ed25519.h).
+ *
+ * @param type Partition type
+ * @param public_key Ed25519 public key, or NULL to skip the signature check
+ * @param digest Receives the image digest (optional, OTA_DIGEST_SIZE bytes)
+ * @return OTA_OK if valid, error code otherwise
+ */
+ota_error_t ota_verify_image(ota_partition_type_t type, const uint8_t *public_key, uint8_t *digest);
+
+/**
+ * @brief Verify firmware signature (see ota_verify_image())
  * @param type Partition type
- * @param public_key Public key for verification
- * @param key_len Key length
+ * @param public_key Ed25519 public key
+ * @param key_len Key length (OTA_PUBLIC_KEY_SIZE)
  * @return OTA_OK if signature valid, error code otherwise
  */
 ota_error_t ota_verify_signature(ota_partition_type_t type,
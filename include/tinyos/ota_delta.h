@@ -0,0 +1,107 @@
+/**
+ * @file ota_delta.h
+ * @brief Delta (Binary Patch) Firmware Updates for TinyOS-RTOS
+ *
+ * A delta update carries only the difference between the running image
+ * and the new one. The patch is applied as it streams in: old bytes are
+ * read from the running partition, combined with the patch and fed to
+ * the normal OTA stream (ota_write_chunk()), so the reconstructed image
+ * is erased, programmed, checkpointed and CRC-checked exactly like a
+ * full download. RAM use is one OTA_PATCH_BUFFER_SIZE output buffer.
+ *
+ * Patches are produced on the host by tools/ota_diff.c.
+ *
+ * Patch format (all fixed fields little-endian, as in the image header):
+ *
+ *   +-------+----------+-----------+----------+-----------------------+
+ *   | magic | old_size | old_crc32 | new_size | op[0] ... op[n-1]     |
+ *   | "TOSD"| 4 bytes  | 4 bytes   | 4 bytes  |                       |
+ *   +-------+----------+-----------+----------+-----------------------+
+ *
+ *   op    = diff_len (varint) | extra_len (varint) | seek (zigzag varint)
+ *           | diff data | extra_len literal bytes
+ *   diff  = token (varint) [ literal bytes ] ... covering diff_len bytes
+ *   token = run << 1 | 1: run bytes follow, each added to the old byte
+ *           run << 1 | 0: run old bytes copied unchanged
+ *
+ * Each op is bsdiff's control triple: diff_len bytes are taken from the
+ * old image at the current old position (with small byte differences
+ * added, which keeps shifted code cheap), extra_len bytes are new, and
+ * the old position then moves by seek. old_size and old_crc32 are the
+ * image_size and crc32 fields of the image the patch was made against;
+ * a patch for any other running image is rejected before anything is
+ * written. Varints are LEB128 (7 bits per byte, LSB group first).
+ */
+
+#ifndef TINYOS_OTA_DELTA_H
+#define TINYOS_OTA_DELTA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tinyos.h"
+#include "tinyos/ota.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup OTA_Delta Delta Firmware Updates
+ * @{
+ */
+
+#define OTA_PATCH_MAGIC         0x44534F54  /* "TOSD" */
+#define OTA_PATCH_BUFFER_SIZE   256         /* Reconstructed bytes buffered per ota_write_chunk() */
+
+/**
+ * @brief Patch header
+ */
+typedef struct {
+    uint32_t magic;                 /* OTA_PATCH_MAGIC */
+    uint32_t old_size;              /* image_size of the base image */
+    uint32_t old_crc32;             /* crc32 of the base image */
+    uint32_t new_size;              /* image_size of the reconstructed image */
+} ota_patch_header_t;
+
+/**
+ * @brief Start applying a patch to the running image
+ * @param callback Progress callback (optional), reports the reconstructed image
+ * @param user_data User data for callback
+ * @return OTA_OK on success, error code otherwise
+ */
+ota_error_t ota_patch_begin(ota_progress_callback_t callback, void *user_data);
+
+/**
+ * @brief Feed the next patch bytes (any size, in order)
+ *
+ * On a malformed patch, or one made against a different base image, the
+ * update is aborted.
+ *
+ * @param data Patch bytes
+ * @param size Number of bytes
+ * @return OTA_OK on success, error code otherwise
+ */
+ota_error_t ota_patch_write(const uint8_t *data, uint32_t size);
+
+/**
+ * @brief Finish the patch and verify the reconstructed image (see ota_end_update())
+ * @return OTA_OK on success, error code otherwise
+ */
+ota_error_t ota_patch_end(void);
+
+/**
+ * @brief Download a patch over HTTP and apply it while it streams in
+ * @param url Patch download URL
+ * @param callback Progress callback (optional)
+ * @param user_data User data for callback
+ * @return OTA_OK on success, error code otherwise
+ */
+ota_error_t ota_start_patch_update(const char *url, ota_progress_callback_t callback, void *user_data);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TINYOS_OTA_DELTA_H */
@@ -0,0 +1,73 @@
+/**
+ * @file sha256.h
+ * @brief SHA-256 (FIPS 180-4) for TinyOS-RTOS
+ *
+ * Streaming interface: a context holds the running state and one partial
+ * 64-byte block, so data can be hashed as it arrives:
+ *
+ *   sha256_ctx_t ctx;
+ *   sha256_init(&ctx);
+ *   sha256_update(&ctx, part1, len1);
+ *   sha256_update(&ctx, part2, len2);
+ *   sha256_final(&ctx, digest);
+ */
+
+#ifndef TINYOS_SHA256_H
+#define TINYOS_SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup SHA256 SHA-256
+ * @{
+ */
+
+#define SHA256_DIGEST_SIZE      32
+#define SHA256_BLOCK_SIZE       64
+
+/**
+ * @brief SHA-256 context
+ */
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;                /* Bytes hashed so far */
+    uint8_t block[SHA256_BLOCK_SIZE];
+} sha256_ctx_t;
+
+/**
+ * @brief Start a new hash
+ */
+void sha256_init(sha256_ctx_t *ctx);
+
+/**
+ * @brief Hash more data
+ * @param ctx Context
+ * @param data Data
+ * @param length Number of bytes
+ */
+void sha256_update(sha256_ctx_t *ctx, const void *data, size_t length);
+
+/**
+ * @brief Finish the hash
+ * @param ctx Context (must be re-initialized before reuse)
+ * @param digest Output, SHA256_DIGEST_SIZE bytes
+ */
+void sha256_final(sha256_ctx_t *ctx, uint8_t *digest);
+
+/**
+ * @brief SHA-256 of a buffer in one call
+ */
+void sha256(const void *data, size_t length, uint8_t *digest);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TINYOS_SHA256_H */
@@ -7,6 +7,7 @@
  */
 
 #include "tinyos/ota.h"
+#include "tinyos/crc.h"
 #include "drivers/flash.h"
 #include <stdint.h>
 #include <stdbool.h>
@@ -20,11 +21,20 @@
 #define BOOTLOADER_VERSION      0x00010000  /* Version 1.0.0 */
 #define MAX_BOOT_ATTEMPTS       3
 #define WATCHDOG_TIMEOUT_MS     30000
+#define FULL_VERIFY_INTERVAL    64          /* Boots between scheduled full checks */
 
 /* ============================================================================
  * Boot Information (stored in Data Partition)
  * ============================================================================ */
 
+/*
+ * The verified_* fields cache the last full image check. A boot may skip
+ * rehashing the image when the cache names the partition being booted,
+ * flash_generation has not moved since (ota.c bumps it before rewriting
+ * a partition), and the image header still has the CRC32 recorded then.
+ *
+ * The layout must match boot_info_t in ota.c, which writes the same block.
+ */
 typedef struct {
     uint32_t magic;                      /* Magic: 0x424F4F54 "BOOT" */
     ota_partition_type_t active_partition;
@@ -35,13 +45,74 @@ typedef struct {
     bool boot_confirmed;
     uint32_t boot_attempts;
     uint32_t last_boot_timestamp;
+    uint32_t flash_generation;           /* Bumped before an update rewrites a partition */
+    ota_partition_type_t verified_partition;  /* OTA_PARTITION_MAX = nothing cached */
+    uint32_t verified_generation;        /* flash_generation at the check */
+    uint32_t verified_header_crc32;      /* CRC32 of the image header at the check */
     uint32_t crc32;
 } bootloader_boot_info_t;
 
+/* ============================================================================
+ * Platform Hooks
+ * ============================================================================ */
+
+/**
+ * @brief Ed25519 public key images must be signed with (weak, NULL = no secure boot)
+ *
+ * A board enabling secure boot overrides this to return its key, e.g. the
+ * array printed by "tools/ota_sign.py pubkey".
+ */
+__attribute__((weak)) const uint8_t *bootloader_public_key(void) {
+    return NULL;
+}
+
+/**
+ * @brief Whether the last reset looks like a fault (weak, default: no)
+ *
+ * A board overrides this to check its reset cause register, e.g. watchdog,
+ * lockup or brown-out resets. A suspected fault forces a full image check.
+ */
+__attribute__((weak)) bool bootloader_fault_suspected(void) {
+    return false;
+}
+
 /* ============================================================================
  * Static Functions
  * ============================================================================ */
 
+/**
+ * @brief Adopt a boot info block that has the magic but no valid CRC
+ *
+ * Older application firmware wrote a shorter block, and earlier
+ * bootloaders wrote this one without a CRC. All of them share the fields
+ * up to boot_confirmed; keep those if they make sense and reset the rest,
+ * dropping the verification cache. Mirrors boot_info_adopt() in ota.c.
+ */
+static bool bootloader_adopt_boot_info(bootloader_boot_info_t *boot_info) {
+    uint8_t rollback_enabled;
+    uint8_t boot_confirmed;
+
+    memcpy(&rollback_enabled, &boot_info->rollback_enabled, 1);
+    memcpy(&boot_confirmed, &boot_info->boot_confirmed, 1);
+
+    if ((boot_info->active_partition != OTA_PARTITION_APP_A &&
+         boot_info->active_partition != OTA_PARTITION_APP_B) ||
+        (boot_info->pending_partition != OTA_PARTITION_APP_A &&
+         boot_info->pending_partition != OTA_PARTITION_APP_B) ||
+        rollback_enabled > 1 || boot_confirmed > 1) {
+        return false;
+    }
+
+    printf("Bootloader: Boot info in an older layout, keeping partition choice\n");
+    boot_info->boot_attempts = 0;
+    boot_info->last_boot_timestamp = 0;
+    boot_info->flash_generation = 0;
+    boot_info->verified_partition = OTA_PARTITION_MAX;
+    boot_info->verified_generation = 0;
+    boot_info->verified_header_crc32 = 0;
+    return true;
+}
+
 /**
  * @brief Read boot information from flash
  */
@@ -56,7 +127,10 @@ static bool bootloader_read_boot_info(bootloader_boot_info_t *boot_info) {
         return false;
     }
 
-    /* TODO: Verify CRC32 */
+    /* A block without a valid CRC must not vouch for an image */
+    if (boot_info->crc32 != crc32_calculate(boot_info, sizeof(bootloader_boot_info_t) - sizeof(uint32_t))) {
+        return bootloader_adopt_boot_info(boot_info);
+    }
 
     return true;
 }
@@ -64,17 +138,22 @@ static bool bootloader_read_boot_info(bootloader_boot_info_t *boot_info) {
 /**
  * @brief Write boot information to flash
  */
-static bool bootloader_write_boot_info(const bootloader_boot_info_t *boot_info) {
+static bool bootloader_write_boot_info(bootloader_boot_info_t *boot_info) {
     flash_error_t err;
 
+    boot_info->crc32 = crc32_calculate(boot_info, sizeof(bootloader_boot_info_t) - sizeof(uint32_t));
+
     /* Erase data partition */
     err = flash_erase_sector(FLASH_DATA_START);
     if (err != FLASH_OK) {
         return false;
     }
 
-    /* Write boot info */
+    /* Write boot info, programmed before the jump to the application */
     err = flash_write(FLASH_DATA_START, boot_info, sizeof(bootloader_boot_info_t));
+    if (err == FLASH_OK) {
+        err = flash_flush();
+    }
     if (err != FLASH_OK) {
         return false;
     }
@@ -84,8 +163,13 @@ static bool bootloader_write_boot_info(const bootloader_boot_info_t *boot_info)
 
 /**
  * @brief Verify firmware image in partition
+ *
+ * Unless full is set, an image matching the cached result of an earlier
+ * full check only has its header checked. A full check refreshes the
+ * cache; the caller saves the boot info.
  */
-static bool bootloader_verify_partition(ota_partition_type_t partition) {
+static bool bootloader_verify_partition(bootloader_boot_info_t *boot_info,
+                                        ota_partition_type_t partition, bool full) {
     ota_partition_info_t partition_info;
     ota_error_t err = ota_get_partition_info(partition, &partition_info);
     if (err != OTA_OK) {
@@ -110,7 +194,26 @@ static bool bootloader_verify_partition(ota_partition_type_t partition) {
         return false;
     }
 
-    /* TODO: Verify CRC32 and signature */
+    uint32_t header_crc = crc32_calculate(&header, sizeof(header));
+    if (!full &&
+        boot_info->verified_partition == partition &&
+        boot_info->verified_generation == boot_info->flash_generation &&
+        boot_info->verified_header_crc32 == header_crc) {
+        printf("Bootloader: Image unchanged since last full check, skipping rehash\n");
+        return true;
+    }
+
+    /* CRC32 and, with a key provisioned, the signature in one pass over the image */
+    if (ota_verify_image(partition, bootloader_public_key(), NULL) != OTA_OK) {
+        if (boot_info->verified_partition == partition) {
+            boot_info->verified_partition = OTA_PARTITION_MAX;
+        }
+        return false;
+    }
+
+    boot_info->verified_partition = partition;
+    boot_info->verified_generation = boot_info->flash_generation;
+    boot_info->verified_header_crc32 = header_crc;
 
     return true;
 }
@@ -180,6 +283,7 @@ void bootloader_main(void) {
     bootloader_boot_info_t boot_info;
     ota_partition_type_t boot_partition;
     uint32_t app_address;
+    bool full_verify;
 
     printf("\n");
     printf("========================================\n");
@@ -212,21 +316,35 @@ void bootloader_main(void) {
         boot_info.rollback_enabled = true;
         boot_info.boot_confirmed = true;
         boot_info.boot_attempts = 0;
+        boot_info.verified_partition = OTA_PARTITION_MAX;
 
         /* Save default boot info */
         bootloader_write_boot_info(&boot_info);
     }
 
+    /*
+     * Rehash the image after an update, while a new image is unconfirmed
+     * (it may have crashed), after a suspected fault, and every
+     * FULL_VERIFY_INTERVAL boots to catch flash decay. Otherwise a cached
+     * result from an earlier full check is enough.
+     */
+    full_verify = !boot_info.boot_confirmed ||
+                  boot_info.pending_partition != boot_info.active_partition ||
+                  bootloader_fault_suspected() ||
+                  (boot_info.boot_count % FULL_VERIFY_INTERVAL) == 0;
+    printf("Bootloader: %s image check\n", full_verify ? "Full" : "Fast");
+
     /* Check if there's a pending update */
     if (boot_info.pending_partition != boot_info.active_partition && !boot_info.boot_confirmed) {
         printf("Bootloader: Pending update detected\n");
         boot_partition = boot_info.pending_partition;
 
         /* Verify the new firmware */
-        if (bootloader_verify_partition(boot_partition)) {
+        if (bootloader_verify_partition(&boot_info, boot_partition, true)) {
             printf("Bootloader: New firmware verified, switching partition\n");
             boot_info.active_partition = boot_partition;
             boot_info.boot_attempts = 0;
+            full_verify = false;    /* Just checked: the check below hits the cache */
         } else {
             printf("Bootloader: New firmware verification failed, staying on current partition\n");
             boot_partition = boot_info.active_partition;
@@ -258,7 +376,7 @@ void bootloader_main(void) {
     }
 
     /* Verify selected partition */
-    if (!bootloader_verify_partition(boot_partition)) {
+    if (!bootloader_verify_partition(&boot_info, boot_partition, full_verify)) {
         printf("Bootloader: Firmware verification failed!\n");
 
         if (boot_info.rollback_enabled) {
@@ -266,7 +384,7 @@ void bootloader_main(void) {
             boot_partition = boot_info.active_partition;
 
             /* Retry verification */
-            if (!bootloader_verify_partition(boot_partition)) {
+            if (!bootloader_verify_partition(&boot_info, boot_partition, full_verify)) {
                 printf("Bootloader: Rollback partition also invalid, cannot boot\n");
                 return;
             }
@@ -337,6 +455,14 @@ void bootloader_print_info(void) {
         printf("Boot Confirmed: %s\n", boot_info.boot_confirmed ? "Yes" : "No");
         printf("Boot Attempts: %lu/%d\n", (unsigned long)boot_info.boot_attempts, MAX_BOOT_ATTEMPTS);
         printf("Rollback Enabled: %s\n", boot_info.rollback_enabled ? "Yes" : "No");
+        printf("Flash Generation: %lu\n", (unsigned long)boot_info.flash_generation);
+        if (boot_info.verified_partition == OTA_PARTITION_APP_A ||
+            boot_info.verified_partition == OTA_PARTITION_APP_B) {
+            printf("Verified Image: %s, generation %lu%s\n",
+                   boot_info.verified_partition == OTA_PARTITION_APP_A ? "APP_A" : "APP_B",
+                   (unsigned long)boot_info.verified_generation,
+                   (boot_info.verified_generation == boot_info.flash_generation) ? "" : " (stale)");
+        }
     } else {
         printf("Boot info not available\n");
     }
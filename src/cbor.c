@@ -0,0 +1,721 @@
+/**
+ * @file cbor.c
+ * @brief CBOR Encoder/Decoder and SenML Implementation for TinyOS-RTOS
+ */
+
+#include "tinyos/cbor.h"
+#include <string.h>
+
+/* Major types */
+#define CBOR_MAJOR_UINT         0
+#define CBOR_MAJOR_NEGINT       1
+#define CBOR_MAJOR_BYTES        2
+#define CBOR_MAJOR_TEXT         3
+#define CBOR_MAJOR_ARRAY        4
+#define CBOR_MAJOR_MAP          5
+#define CBOR_MAJOR_TAG          6
+#define CBOR_MAJOR_SIMPLE       7
+
+/* Additional information values */
+#define CBOR_INFO_UINT8         24
+#define CBOR_INFO_INDEFINITE    31
+#define CBOR_SIMPLE_FALSE       20
+#define CBOR_SIMPLE_TRUE        21
+#define CBOR_SIMPLE_NULL        22
+#define CBOR_SIMPLE_UNDEFINED   23
+#define CBOR_FLOAT_HALF         25
+#define CBOR_FLOAT_SINGLE       26
+#define CBOR_FLOAT_DOUBLE       27
+
+/* ====================
+ * Float Conversion
+ * ==================== */
+
+static uint32_t cbor_float_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float cbor_bits_float(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Convert to half precision if no information is lost
+ */
+static bool cbor_float_to_half(float value, uint16_t *half) {
+    uint32_t bits = cbor_float_bits(value);
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 128) {
+        /* Infinity or NaN: the payload must survive the shorter mantissa */
+        if (mantissa & 0x1FFF) {
+            return false;
+        }
+        *half = sign | 0x7C00 | (mantissa >> 13);
+        return true;
+    }
+    if (exponent == -127 && mantissa == 0) {
+        *half = sign;
+        return true;
+    }
+    if (exponent >= -14 && exponent <= 15) {
+        if (mantissa & 0x1FFF) {
+            return false;
+        }
+        *half = sign | ((exponent + 15) << 10) | (mantissa >> 13);
+        return true;
+    }
+    if (exponent >= -24 && exponent < -14) {
+        /* Half subnormal: value = h * 2^-24 */
+        uint32_t full = mantissa | 0x800000;
+        uint32_t shift = -exponent - 1;
+        if (full & ((1u << shift) - 1)) {
+            return false;
+        }
+        *half = sign | (full >> shift);
+        return true;
+    }
+    return false;
+}
+
+static float cbor_half_to_float(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            return cbor_bits_float(sign);
+        }
+        /* Subnormal: normalize into the float's wider exponent range */
+        exponent = 127 - 14;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        return cbor_bits_float(sign | (exponent << 23) | ((mantissa & 0x3FF) << 13));
+    }
+    if (exponent == 31) {
+        return cbor_bits_float(sign | 0x7F800000 | (mantissa << 13));
+    }
+    return cbor_bits_float(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+/**
+ * @brief Narrow a double (given as raw bits) to float without libm or FPU doubles
+ */
+static float cbor_double_to_float(uint64_t bits) {
+    uint32_t sign = (uint32_t)(bits >> 32) & 0x80000000;
+    int32_t exponent = (int32_t)((bits >> 52) & 0x7FF) - 1023;
+    uint64_t mantissa = bits & 0xFFFFFFFFFFFFFull;
+
+    if (exponent == 1024) {
+        return cbor_bits_float(sign | 0x7F800000 | (mantissa ? 0x400000 : 0));
+    }
+    if (exponent > 127) {
+        return cbor_bits_float(sign | 0x7F800000);     /* Out of range: infinity */
+    }
+    if (exponent < -126) {
+        return cbor_bits_float(sign);                  /* Float subnormals flushed to zero */
+    }
+
+    /* Round to nearest, ties to even */
+    uint32_t result = ((uint32_t)(exponent + 127) << 23) | (uint32_t)(mantissa >> 29);
+    uint32_t rest = (uint32_t)(mantissa & 0x1FFFFFFF);
+    if (rest > 0x10000000 || (rest == 0x10000000 && (result & 1))) {
+        result++;
+    }
+    return cbor_bits_float(sign | result);
+}
+
+/* ====================
+ * Encoder
+ * ==================== */
+
+void cbor_encoder_init(cbor_encoder_t *encoder, uint8_t *buffer, size_t size) {
+    encoder->buffer = buffer;
+    encoder->size = size;
+    encoder->length = 0;
+    encoder->error = CBOR_OK;
+}
+
+/**
+ * @brief Reserve length bytes of output, or record NO_SPACE
+ */
+static uint8_t *cbor_reserve(cbor_encoder_t *encoder, size_t length) {
+    if (encoder->error != CBOR_OK) {
+        return NULL;
+    }
+    if (length > encoder->size - encoder->length) {
+        encoder->error = CBOR_ERROR_NO_SPACE;
+        return NULL;
+    }
+    uint8_t *out = encoder->buffer + encoder->length;
+    encoder->length += length;
+    return out;
+}
+
+/**
+ * @brief Write an item head in its shortest form
+ */
+static cbor_error_t cbor_put_head(cbor_encoder_t *encoder, uint8_t major, uint64_t argument) {
+    uint8_t bytes;
+    uint8_t info;
+
+    if (argument < CBOR_INFO_UINT8) {
+        bytes = 0;
+        info = (uint8_t)argument;
+    } else if (argument <= UINT8_MAX) {
+        bytes = 1;
+        info = 24;
+    } else if (argument <= UINT16_MAX) {
+        bytes = 2;
+        info = 25;
+    } else if (argument <= UINT32_MAX) {
+        bytes = 4;
+        info = 26;
+    } else {
+        bytes = 8;
+        info = 27;
+    }
+
+    uint8_t *out = cbor_reserve(encoder, 1 + bytes);
+    if (!out) {
+        return encoder->error;
+    }
+    out[0] = (major << 5) | info;
+    for (uint8_t i = 0; i < bytes; i++) {
+        out[bytes - i] = (uint8_t)(argument >> (8 * i));
+    }
+    return CBOR_OK;
+}
+
+cbor_error_t cbor_encode_uint(cbor_encoder_t *encoder, uint64_t value) {
+    return cbor_put_head(encoder, CBOR_MAJOR_UINT, value);
+}
+
+cbor_error_t cbor_encode_int(cbor_encoder_t *encoder, int64_t value) {
+    if (value >= 0) {
+        return cbor_put_head(encoder, CBOR_MAJOR_UINT, (uint64_t)value);
+    }
+    return cbor_put_head(encoder, CBOR_MAJOR_NEGINT, (uint64_t)(-1 - value));
+}
+
+static cbor_error_t cbor_put_string(cbor_encoder_t *encoder, uint8_t major, const void *data, size_t length) {
+    if (cbor_put_head(encoder, major, length) != CBOR_OK) {
+        return encoder->error;
+    }
+    uint8_t *out = cbor_reserve(encoder, length);
+    if (!out) {
+        return encoder->error;
+    }
+    if (length > 0) {
+        memcpy(out, data, length);
+    }
+    return CBOR_OK;
+}
+
+cbor_error_t cbor_encode_bytes(cbor_encoder_t *encoder, const uint8_t *data, size_t length) {
+    return cbor_put_string(encoder, CBOR_MAJOR_BYTES, data, length);
+}
+
+cbor_error_t cbor_encode_text(cbor_encoder_t *encoder, const char *text, size_t length) {
+    return cbor_put_string(encoder, CBOR_MAJOR_TEXT, text, length);
+}
+
+cbor_error_t cbor_encode_string(cbor_encoder_t *encoder, const char *text) {
+    return cbor_put_string(encoder, CBOR_MAJOR_TEXT, text, strlen(text));
+}
+
+cbor_error_t cbor_encode_array(cbor_encoder_t *encoder, size_t count) {
+    return cbor_put_head(encoder, CBOR_MAJOR_ARRAY, count);
+}
+
+cbor_error_t cbor_encode_map(cbor_encoder_t *encoder, size_t count) {
+    return cbor_put_head(encoder, CBOR_MAJOR_MAP, count);
+}
+
+cbor_error_t cbor_encode_tag(cbor_encoder_t *encoder, uint64_t tag) {
+    return cbor_put_head(encoder, CBOR_MAJOR_TAG, tag);
+}
+
+cbor_error_t cbor_encode_bool(cbor_encoder_t *encoder, bool value) {
+    return cbor_put_head(encoder, CBOR_MAJOR_SIMPLE, value ? CBOR_SIMPLE_TRUE : CBOR_SIMPLE_FALSE);
+}
+
+cbor_error_t cbor_encode_null(cbor_encoder_t *encoder) {
+    return cbor_put_head(encoder, CBOR_MAJOR_SIMPLE, CBOR_SIMPLE_NULL);
+}
+
+cbor_error_t cbor_encode_float(cbor_encoder_t *encoder, float value) {
+    uint16_t half;
+    uint8_t *out;
+
+    if (cbor_float_to_half(value, &half)) {
+        out = cbor_reserve(encoder, 3);
+        if (out) {
+            out[0] = (CBOR_MAJOR_SIMPLE << 5) | CBOR_FLOAT_HALF;
+            out[1] = half >> 8;
+            out[2] = half & 0xFF;
+        }
+    } else {
+        uint32_t bits = cbor_float_bits(value);
+        out = cbor_reserve(encoder, 5);
+        if (out) {
+            out[0] = (CBOR_MAJOR_SIMPLE << 5) | CBOR_FLOAT_SINGLE;
+            out[1] = bits >> 24;
+            out[2] = (bits >> 16) & 0xFF;
+            out[3] = (bits >> 8) & 0xFF;
+            out[4] = bits & 0xFF;
+        }
+    }
+    return encoder->error;
+}
+
+/* ====================
+ * Decoder
+ * ==================== */
+
+void cbor_decoder_init(cbor_decoder_t *decoder, const uint8_t *data, size_t size) {
+    decoder->data = data;
+    decoder->size = size;
+    decoder->offset = 0;
+}
+
+/**
+ * @brief Read an item head; argument is CBOR_INDEFINITE for info 31
+ */
+static cbor_error_t cbor_get_head(cbor_decoder_t *decoder, uint8_t *major, uint8_t *info, uint64_t *argument) {
+    if (decoder->offset >= decoder->size) {
+        return CBOR_ERROR_END;
+    }
+
+    uint8_t initial = decoder->data[decoder->offset++];
+    *major = initial >> 5;
+    *info = initial & 0x1F;
+
+    if (*info < CBOR_INFO_UINT8) {
+        *argument = *info;
+        return CBOR_OK;
+    }
+    if (*info == CBOR_INFO_INDEFINITE) {
+        *argument = CBOR_INDEFINITE;
+        return CBOR_OK;
+    }
+    if (*info > 27) {
+        return CBOR_ERROR_INVALID;
+    }
+
+    uint8_t bytes = 1u << (*info - CBOR_INFO_UINT8);
+    if (bytes > decoder->size - decoder->offset) {
+        return CBOR_ERROR_TRUNCATED;
+    }
+    *argument = 0;
+    for (uint8_t i = 0; i < bytes; i++) {
+        *argument = (*argument << 8) | decoder->data[decoder->offset++];
+    }
+    return CBOR_OK;
+}
+
+cbor_error_t cbor_decode_next(cbor_decoder_t *decoder, cbor_item_t *item) {
+    uint8_t major, info;
+    uint64_t argument;
+    size_t start = decoder->offset;
+
+    cbor_error_t err = cbor_get_head(decoder, &major, &info, &argument);
+    if (err != CBOR_OK) {
+        decoder->offset = (err == CBOR_ERROR_END) ? decoder->offset : start;
+        return err;
+    }
+
+    bool indefinite = (info == CBOR_INFO_INDEFINITE);
+    if (indefinite && (major < CBOR_MAJOR_BYTES || major == CBOR_MAJOR_TAG)) {
+        decoder->offset = start;
+        return CBOR_ERROR_INVALID;
+    }
+
+    switch (major) {
+    case CBOR_MAJOR_UINT:
+        item->type = CBOR_TYPE_UINT;
+        item->value.uint = argument;
+        break;
+
+    case CBOR_MAJOR_NEGINT:
+        if (argument > (uint64_t)INT64_MAX) {
+            decoder->offset = start;
+            return CBOR_ERROR_UNSUPPORTED;
+        }
+        item->type = CBOR_TYPE_NEGINT;
+        item->value.integer = -1 - (int64_t)argument;
+        break;
+
+    case CBOR_MAJOR_BYTES:
+    case CBOR_MAJOR_TEXT:
+        if (indefinite) {
+            decoder->offset = start;
+            return CBOR_ERROR_UNSUPPORTED;  /* Chunks are not contiguous */
+        }
+        if (argument > decoder->size - decoder->offset) {
+            decoder->offset = start;
+            return CBOR_ERROR_TRUNCATED;
+        }
+        item->type = (major == CBOR_MAJOR_BYTES) ? CBOR_TYPE_BYTES : CBOR_TYPE_TEXT;
+        item->value.string.data = decoder->data + decoder->offset;
+        item->value.string.length = (size_t)argument;
+        decoder->offset += (size_t)argument;
+        break;
+
+    case CBOR_MAJOR_ARRAY:
+    case CBOR_MAJOR_MAP:
+        item->type = (major == CBOR_MAJOR_ARRAY) ? CBOR_TYPE_ARRAY : CBOR_TYPE_MAP;
+        item->value.count = argument;
+        break;
+
+    case CBOR_MAJOR_TAG:
+        item->type = CBOR_TYPE_TAG;
+        item->value.tag = argument;
+        break;
+
+    default:
+        if (info == CBOR_SIMPLE_FALSE || info == CBOR_SIMPLE_TRUE) {
+            item->type = CBOR_TYPE_BOOL;
+            item->value.boolean = (info == CBOR_SIMPLE_TRUE);
+        } else if (info == CBOR_SIMPLE_NULL) {
+            item->type = CBOR_TYPE_NULL;
+        } else if (info == CBOR_SIMPLE_UNDEFINED) {
+            item->type = CBOR_TYPE_UNDEFINED;
+        } else if (info == CBOR_FLOAT_HALF) {
+            item->type = CBOR_TYPE_FLOAT;
+            item->value.number = cbor_half_to_float((uint16_t)argument);
+        } else if (info == CBOR_FLOAT_SINGLE) {
+            item->type = CBOR_TYPE_FLOAT;
+            item->value.number = cbor_bits_float((uint32_t)argument);
+        } else if (info == CBOR_FLOAT_DOUBLE) {
+            item->type = CBOR_TYPE_FLOAT;
+            item->value.number = cbor_double_to_float(argument);
+        } else if (indefinite) {
+            item->type = CBOR_TYPE_BREAK;
+        } else {
+            decoder->offset = start;
+            return CBOR_ERROR_UNSUPPORTED;  /* Other simple values */
+        }
+        break;
+    }
+
+    return CBOR_OK;
+}
+
+cbor_error_t cbor_decode_skip(cbor_decoder_t *decoder) {
+    /* Items still to read per open container; CBOR_INDEFINITE until a break */
+    uint64_t remaining[CBOR_MAX_NESTING];
+    int depth = 0;
+    remaining[0] = 1;
+
+    while (1) {
+        if (remaining[depth] == 0) {
+            if (depth == 0) {
+                return CBOR_OK;
+            }
+            depth--;
+            continue;
+        }
+
+        cbor_item_t item;
+        cbor_error_t err = cbor_decode_next(decoder, &item);
+        if (err != CBOR_OK) {
+            return (err == CBOR_ERROR_END) ? CBOR_ERROR_TRUNCATED : err;
+        }
+
+        if (item.type == CBOR_TYPE_BREAK) {
+            if (remaining[depth] != CBOR_INDEFINITE || depth == 0) {
+                return CBOR_ERROR_INVALID;
+            }
+            depth--;
+            continue;
+        }
+        if (remaining[depth] != CBOR_INDEFINITE) {
+            remaining[depth]--;
+        }
+
+        uint64_t nested = 0;
+        if (item.type == CBOR_TYPE_ARRAY || item.type == CBOR_TYPE_MAP) {
+            nested = item.value.count;
+            if (nested != CBOR_INDEFINITE && item.type == CBOR_TYPE_MAP) {
+                if (nested > decoder->size) {
+                    return CBOR_ERROR_TRUNCATED;
+                }
+                nested *= 2;
+            }
+        } else if (item.type == CBOR_TYPE_TAG) {
+            nested = 1;
+        } else {
+            continue;
+        }
+
+        if (depth + 1 >= CBOR_MAX_NESTING) {
+            return CBOR_ERROR_UNSUPPORTED;
+        }
+        remaining[++depth] = nested;
+    }
+}
+
+cbor_error_t cbor_decode_int(cbor_decoder_t *decoder, int64_t *value) {
+    size_t start = decoder->offset;
+    cbor_item_t item;
+    cbor_error_t err = cbor_decode_next(decoder, &item);
+    if (err != CBOR_OK) {
+        return err;
+    }
+    if ((item.type != CBOR_TYPE_UINT || item.value.uint > (uint64_t)INT64_MAX) &&
+        item.type != CBOR_TYPE_NEGINT) {
+        decoder->offset = start;
+        return CBOR_ERROR_TYPE;
+    }
+    *value = item.value.integer;
+    return CBOR_OK;
+}
+
+cbor_error_t cbor_decode_number(cbor_decoder_t *decoder, float *value) {
+    size_t start = decoder->offset;
+    cbor_item_t item;
+    cbor_error_t err = cbor_decode_next(decoder, &item);
+    if (err != CBOR_OK) {
+        return err;
+    }
+
+    if (item.type == CBOR_TYPE_FLOAT) {
+        *value = item.value.number;
+    } else if (item.type == CBOR_TYPE_UINT) {
+        *value = (float)item.value.uint;
+    } else if (item.type == CBOR_TYPE_NEGINT) {
+        *value = (float)item.value.integer;
+    } else {
+        decoder->offset = start;
+        return CBOR_ERROR_TYPE;
+    }
+    return CBOR_OK;
+}
+
+/* ====================
+ * SenML
+ * ==================== */
+
+cbor_error_t senml_encode(cbor_encoder_t *encoder, const senml_record_t *records, size_t count) {
+    cbor_encode_array(encoder, count);
+
+    for (size_t i = 0; i < count; i++) {
+        const senml_record_t *record = &records[i];
+        bool base_name = (i == 0 && record->base_name);
+        bool base_time = (i == 0 && record->base_time != 0);
+
+        size_t fields = base_name + base_time + (record->name != NULL) + (record->unit != NULL) +
+                        (record->time != 0) + (record->value_type != SENML_VALUE_NONE);
+        cbor_encode_map(encoder, fields);
+
+        if (base_name) {
+            cbor_encode_int(encoder, SENML_LABEL_BASE_NAME);
+            cbor_encode_string(encoder, record->base_name);
+        }
+        if (base_time) {
+            cbor_encode_int(encoder, SENML_LABEL_BASE_TIME);
+            cbor_encode_int(encoder, record->base_time);
+        }
+        if (record->name) {
+            cbor_encode_int(encoder, SENML_LABEL_NAME);
+            cbor_encode_string(encoder, record->name);
+        }
+        if (record->unit) {
+            cbor_encode_int(encoder, SENML_LABEL_UNIT);
+            cbor_encode_string(encoder, record->unit);
+        }
+        if (record->time != 0) {
+            cbor_encode_int(encoder, SENML_LABEL_TIME);
+            cbor_encode_int(encoder, record->time);
+        }
+
+        switch (record->value_type) {
+        case SENML_VALUE_NUMBER:
+            cbor_encode_int(encoder, SENML_LABEL_VALUE);
+            /* Whole numbers go out as integers, which are shorter than floats */
+            if (record->value.number == (float)(int32_t)record->value.number) {
+                cbor_encode_int(encoder, (int32_t)record->value.number);
+            } else {
+                cbor_encode_float(encoder, record->value.number);
+            }
+            break;
+        case SENML_VALUE_BOOL:
+            cbor_encode_int(encoder, SENML_LABEL_BOOL);
+            cbor_encode_bool(encoder, record->value.boolean);
+            break;
+        case SENML_VALUE_STRING:
+            cbor_encode_int(encoder, SENML_LABEL_STRING);
+            cbor_encode_string(encoder, record->value.string.data);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return encoder->error;
+}
+
+/**
+ * @brief Decode a text item into a string view
+ */
+static cbor_error_t senml_get_text(cbor_decoder_t *decoder, const char **text, uint16_t *length) {
+    cbor_item_t item;
+    cbor_error_t err = cbor_decode_next(decoder, &item);
+    if (err != CBOR_OK) {
+        return err;
+    }
+    if (item.type != CBOR_TYPE_TEXT || item.value.string.length > UINT16_MAX) {
+        return CBOR_ERROR_TYPE;
+    }
+    *text = (const char *)item.value.string.data;
+    *length = (uint16_t)item.value.string.length;
+    return CBOR_OK;
+}
+
+/**
+ * @brief Decode a time; integers keep full precision, floats are truncated
+ */
+static cbor_error_t senml_get_time(cbor_decoder_t *decoder, int32_t *time) {
+    int64_t value;
+    float number;
+
+    cbor_error_t err = cbor_decode_int(decoder, &value);
+    if (err == CBOR_ERROR_TYPE) {
+        err = cbor_decode_number(decoder, &number);
+        if (err != CBOR_OK) {
+            return err;
+        }
+        value = (int64_t)number;
+    } else if (err != CBOR_OK) {
+        return err;
+    }
+    *time = (int32_t)value;
+    return CBOR_OK;
+}
+
+/**
+ * @brief Decode one record map; base values carry over between records
+ */
+static cbor_error_t senml_decode_record(cbor_decoder_t *decoder, senml_record_t *record) {
+    cbor_item_t item;
+    cbor_error_t err = cbor_decode_next(decoder, &item);
+    if (err != CBOR_OK) {
+        return (err == CBOR_ERROR_END) ? CBOR_ERROR_TRUNCATED : err;
+    }
+    if (item.type != CBOR_TYPE_MAP) {
+        return CBOR_ERROR_TYPE;
+    }
+
+    record->name = NULL;
+    record->name_length = 0;
+    record->unit = NULL;
+    record->unit_length = 0;
+    record->time = 0;
+    record->value_type = SENML_VALUE_NONE;
+
+    for (uint64_t i = 0; item.value.count == CBOR_INDEFINITE || i < item.value.count; i++) {
+        cbor_item_t key;
+        err = cbor_decode_next(decoder, &key);
+        if (err != CBOR_OK) {
+            return (err == CBOR_ERROR_END) ? CBOR_ERROR_TRUNCATED : err;
+        }
+        if (key.type == CBOR_TYPE_BREAK && item.value.count == CBOR_INDEFINITE) {
+            break;
+        }
+        if (key.type != CBOR_TYPE_UINT && key.type != CBOR_TYPE_NEGINT) {
+            err = cbor_decode_skip(decoder);    /* String-labelled extension */
+            if (err != CBOR_OK) {
+                return err;
+            }
+            continue;
+        }
+
+        switch (key.value.integer) {
+        case SENML_LABEL_BASE_NAME:
+            err = senml_get_text(decoder, &record->base_name, &record->base_name_length);
+            break;
+        case SENML_LABEL_BASE_TIME:
+            err = senml_get_time(decoder, &record->base_time);
+            break;
+        case SENML_LABEL_NAME:
+            err = senml_get_text(decoder, &record->name, &record->name_length);
+            break;
+        case SENML_LABEL_UNIT:
+            err = senml_get_text(decoder, &record->unit, &record->unit_length);
+            break;
+        case SENML_LABEL_TIME:
+            err = senml_get_time(decoder, &record->time);
+            break;
+        case SENML_LABEL_VALUE:
+            err = cbor_decode_number(decoder, &record->value.number);
+            record->value_type = SENML_VALUE_NUMBER;
+            break;
+        case SENML_LABEL_STRING:
+            err = senml_get_text(decoder, &record->value.string.data, &record->value.string.length);
+            record->value_type = SENML_VALUE_STRING;
+            break;
+        case SENML_LABEL_BOOL: {
+            cbor_item_t flag;
+            err = cbor_decode_next(decoder, &flag);
+            if (err == CBOR_OK && flag.type != CBOR_TYPE_BOOL) {
+                err = CBOR_ERROR_TYPE;
+            }
+            record->value.boolean = flag.value.boolean;
+            record->value_type = SENML_VALUE_BOOL;
+            break;
+        }
+        default:
+            err = cbor_decode_skip(decoder);
+            break;
+        }
+        if (err != CBOR_OK) {
+            return (err == CBOR_ERROR_END) ? CBOR_ERROR_TRUNCATED : err;
+        }
+    }
+
+    return CBOR_OK;
+}
+
+cbor_error_t senml_decode(const uint8_t *data, size_t size, senml_record_callback_t callback, void *user_data) {
+    cbor_decoder_t decoder;
+    cbor_item_t pack;
+    senml_record_t record;
+
+    if (!data || !callback) {
+        return CBOR_ERROR_INVALID;
+    }
+
+    cbor_decoder_init(&decoder, data, size);
+    cbor_error_t err = cbor_decode_next(&decoder, &pack);
+    if (err != CBOR_OK) {
+        return err;
+    }
+    if (pack.type != CBOR_TYPE_ARRAY) {
+        return CBOR_ERROR_TYPE;
+    }
+
+    memset(&record, 0, sizeof(record));
+    for (uint64_t i = 0; pack.value.count == CBOR_INDEFINITE || i < pack.value.count; i++) {
+        if (pack.value.count == CBOR_INDEFINITE && decoder.offset < size &&
+            decoder.data[decoder.offset] == 0xFF) {
+            break;
+        }
+        err = senml_decode_record(&decoder, &record);
+        if (err != CBOR_OK) {
+            return err;
+        }
+        callback(&record, user_data);
+    }
+
+    return CBOR_OK;
+}
@@ -15,11 +15,40 @@
 #define COAP_HEADER_SIZE        4
 #define COAP_PAYLOAD_MARKER     0xFF
 
+/* Outgoing messages are built in a network buffer, after the UDP/IP/Ethernet headroom */
+#define COAP_TX_CAPACITY        (COAP_PDU_HEADROOM + COAP_MAX_PDU_SIZE)
+
+#if NET_TX_HEADROOM + COAP_TX_CAPACITY > NET_BUFFER_SIZE
+#error "COAP_MAX_PDU_SIZE does not fit a network buffer"
+#endif
+
+/* A full block with header, token and options must arrive untruncated */
+#if COAP_BLOCK_SIZE(COAP_BLOCK_SZX_MAX) + COAP_PDU_HEADROOM + \
+    (COAP_MAX_PDU_SIZE - COAP_MAX_PAYLOAD_SIZE) > NET_SOCKET_RX_SIZE
+#error "COAP_BLOCK_SZX_MAX blocks do not fit the socket receive buffer"
+#endif
+
 /* Get CoAP class from code */
 #define COAP_CODE_CLASS(c)      ((c) >> 5)
 #define COAP_CODE_DETAIL(c)     ((c) & 0x1F)
 #define COAP_MAKE_CODE(class, detail) (((class) << 5) | (detail))
 
+/* Context event bits */
+#define COAP_EVENT_RX           (1u << 0)   /* Datagram waiting on the socket */
+#define COAP_EVENT_TIMER        (1u << 1)   /* A transaction timer fired */
+#define COAP_EVENT_DEFERRED     (1u << 2)   /* A deferred response was completed */
+#define COAP_EVENT_LEISURE      (1u << 3)   /* A group response's leisure has passed */
+
+static void coap_transaction_complete(coap_context_t *context, coap_transaction_t *transaction,
+                                      const coap_pdu_t *pdu, coap_error_t error);
+static void coap_observe_reset(coap_context_t *context, uint16_t message_id, const sockaddr_in_t *from);
+static void coap_dedup_clear(coap_context_t *context);
+static void coap_exchange_release(coap_exchange_t *exchange);
+static void coap_leisure_timeout(void *param);
+static void coap_leisure_clear(coap_context_t *context);
+static void coap_path_free(struct coap_path_node *node);
+static void coap_well_known_register(coap_context_t *context);
+
 /* ====================
  * Static Helper Functions
  * ==================== */
@@ -28,11 +57,26 @@ static uint16_t coap_generate_message_id(coap_context_t *context) {
     return context->next_message_id++;
 }
 
-static void coap_generate_token(uint8_t *token, uint8_t length) {
-    /* Simple token generation using system ticks */
-    uint32_t tick = os_get_tick_count();
+/**
+ * @brief Next pseudo-random number (xorshift32)
+ */
+static uint32_t coap_random(coap_context_t *context) {
+    uint32_t x = context->rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    context->rng_state = x;
+    return x;
+}
+
+static void coap_generate_token(coap_context_t *context, uint8_t *token, uint8_t length) {
+    /* Random tokens: concurrent requests must not collide */
+    uint32_t value = 0;
     for (uint8_t i = 0; i < length && i < COAP_MAX_TOKEN_LEN; i++) {
-        token[i] = (tick >> (i * 8)) & 0xFF;
+        if ((i & 3) == 0) {
+            value = coap_random(context);
+        }
+        token[i] = (value >> ((i & 3) * 8)) & 0xFF;
     }
 }
 
@@ -68,10 +112,86 @@ static uint16_t coap_decode_option_delta_length(const uint8_t **buffer, uint16_t
     return 0;
 }
 
+static sockaddr_in_t coap_sockaddr(uint32_t ip, uint16_t port) {
+    sockaddr_in_t addr;
+    for (int i = 0; i < 4; i++) {
+        addr.addr.addr[i] = (ip >> (i * 8)) & 0xFF;
+    }
+    addr.port = port;
+    return addr;
+}
+
 /* ====================
  * PDU Functions
  * ==================== */
 
+static void coap_write_header(uint8_t *out, coap_msg_type_t type, uint8_t code, uint16_t message_id,
+                              const uint8_t *token, uint8_t token_length) {
+    out[0] = (COAP_VERSION << 6) | (type << 4) | token_length;
+    out[1] = code;
+    out[2] = message_id >> 8;
+    out[3] = message_id & 0xFF;
+    if (token_length > 0) {
+        memcpy(out + COAP_HEADER_SIZE, token, token_length);
+    }
+}
+
+static uint8_t coap_option_header_size(uint16_t delta, uint16_t length) {
+    return 1 + (delta >= 269 ? 2 : delta >= 13 ? 1 : 0) + (length >= 269 ? 2 : length >= 13 ? 1 : 0);
+}
+
+static uint8_t coap_write_option_header(uint8_t *out, uint16_t delta, uint16_t length) {
+    uint8_t *ptr = out + 1;
+
+    uint8_t delta_nibble = coap_encode_option_delta_length(ptr, delta);
+    ptr += (delta_nibble == 13) ? 1 : (delta_nibble == 14) ? 2 : 0;
+
+    uint8_t length_nibble = coap_encode_option_delta_length(ptr, length);
+    ptr += (length_nibble == 13) ? 1 : (length_nibble == 14) ? 2 : 0;
+
+    out[0] = (delta_nibble << 4) | length_nibble;
+    return ptr - out;
+}
+
+/**
+ * @brief Parse the option encoded at data[offset]
+ *
+ * @return Encoded size of the option, or 0 at the payload marker, at end
+ *         or if the option is malformed
+ */
+static uint16_t coap_option_parse(const uint8_t *data, uint16_t offset, uint16_t end,
+                                  uint16_t *delta, uint16_t *length, uint16_t *header_size) {
+    const uint8_t *start = data + offset;
+    const uint8_t *ptr = start;
+    const uint8_t *limit = data + end;
+
+    if (ptr >= limit || *ptr == COAP_PAYLOAD_MARKER) {
+        return 0;
+    }
+
+    uint8_t delta_nibble = (*ptr >> 4) & 0x0F;
+    uint8_t length_nibble = *ptr & 0x0F;
+    ptr++;
+
+    if (delta_nibble == 15 || length_nibble == 15) {
+        return 0;
+    }
+    uint8_t extended = (delta_nibble == 13) + (delta_nibble == 14) * 2 +
+                       (length_nibble == 13) + (length_nibble == 14) * 2;
+    if (extended > limit - ptr) {
+        return 0;
+    }
+
+    *delta = coap_decode_option_delta_length(&ptr, delta_nibble);
+    *length = coap_decode_option_delta_length(&ptr, length_nibble);
+    *header_size = ptr - start;
+
+    if (*length > limit - ptr) {
+        return 0;
+    }
+    return *header_size + *length;
+}
+
 coap_error_t coap_pdu_init(coap_pdu_t *pdu, coap_msg_type_t type, uint8_t code, uint16_t message_id) {
     if (!pdu) {
         return COAP_ERROR_INVALID_PARAM;
@@ -90,6 +210,27 @@ coap_error_t coap_pdu_init(coap_pdu_t *pdu, coap_msg_type_t type, uint8_t code,
     return COAP_OK;
 }
 
+coap_error_t coap_pdu_init_buffer(coap_pdu_t *pdu, coap_msg_type_t type, uint8_t code, uint16_t message_id,
+                                  uint8_t *buffer, uint16_t size) {
+    if (!buffer || size < COAP_PDU_HEADROOM) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    coap_error_t err = coap_pdu_init(pdu, type, code, message_id);
+    if (err != COAP_OK) {
+        return err;
+    }
+
+    /* Options start after room for the largest header and token */
+    pdu->data = buffer;
+    pdu->size = size;
+    pdu->options_offset = COAP_PDU_HEADROOM;
+    pdu->options_end = COAP_PDU_HEADROOM;
+    pdu->length = COAP_PDU_HEADROOM;
+
+    return COAP_OK;
+}
+
 coap_error_t coap_pdu_set_token(coap_pdu_t *pdu, const uint8_t *token, uint8_t token_length) {
     if (!pdu || token_length > COAP_MAX_TOKEN_LEN) {
         return COAP_ERROR_INVALID_PARAM;
@@ -107,203 +248,252 @@ coap_error_t coap_pdu_add_option(coap_pdu_t *pdu, uint16_t option_num, const uin
     if (!pdu || pdu->option_count >= COAP_MAX_OPTION_COUNT) {
         return COAP_ERROR_INVALID_PARAM;
     }
+    if (pdu->size == 0) {
+        return COAP_ERROR_NO_MEMORY;
+    }
 
-    coap_option_t *option = &pdu->options[pdu->option_count++];
-    option->number = option_num;
-    option->length = length;
-    option->value = value;
+    /* Insert after every option numbered <= option_num; in-order adds append */
+    uint16_t pos = pdu->options_end;
+    uint16_t prev = pdu->last_option;
+    coap_option_t next;
+    bool has_next = false;
+
+    if (option_num < pdu->last_option) {
+        coap_option_iter_t iter;
+        coap_option_iter_init(pdu, &iter);
+        prev = 0;
+        while (1) {
+            uint16_t at = iter.offset;
+            if (!coap_option_next(pdu, &iter, &next)) {
+                break;
+            }
+            if (next.number > option_num) {
+                pos = at;
+                has_next = true;
+                break;
+            }
+            prev = next.number;
+        }
+    }
+
+    /* The following option's delta shrinks, so its header is rewritten */
+    uint16_t next_old_header = 0;
+    uint16_t next_new_header = 0;
+    if (has_next) {
+        next_old_header = next.value - (pdu->data + pos);
+        next_new_header = coap_option_header_size(next.number - option_num, next.length);
+    }
+
+    int32_t growth = coap_option_header_size(option_num - prev, length) + length +
+                     next_new_header - next_old_header;
+    if (pdu->length + growth > pdu->size) {
+        return COAP_ERROR_NO_MEMORY;
+    }
+
+    uint16_t tail = pos + next_old_header;
+    memmove(pdu->data + tail + growth, pdu->data + tail, pdu->length - tail);
+
+    uint8_t *ptr = pdu->data + pos;
+    ptr += coap_write_option_header(ptr, option_num - prev, length);
+    if (length > 0) {
+        memcpy(ptr, value, length);
+        ptr += length;
+    }
+    if (has_next) {
+        coap_write_option_header(ptr, next.number - option_num, next.length);
+    }
+
+    pdu->length += growth;
+    pdu->options_end += growth;
+    if (pdu->payload) {
+        pdu->payload += growth;
+    }
+    if (option_num > pdu->last_option) {
+        pdu->last_option = option_num;
+    }
+    pdu->option_count++;
 
     return COAP_OK;
 }
 
+uint8_t *coap_pdu_payload_buffer(coap_pdu_t *pdu, uint16_t *capacity) {
+    if (!pdu || pdu->size == 0 || pdu->options_end + 1 >= pdu->size) {
+        if (capacity) {
+            *capacity = 0;
+        }
+        return NULL;
+    }
+
+    if (capacity) {
+        *capacity = pdu->size - pdu->options_end - 1;
+    }
+    return pdu->data + pdu->options_end + 1;
+}
+
 coap_error_t coap_pdu_set_payload(coap_pdu_t *pdu, const uint8_t *payload, uint16_t length) {
     if (!pdu || length > COAP_MAX_PAYLOAD_SIZE) {
         return COAP_ERROR_INVALID_PARAM;
     }
+    if (pdu->size == 0 || pdu->options_end + (length ? 1 + length : 0) > pdu->size) {
+        return COAP_ERROR_NO_MEMORY;
+    }
 
-    pdu->payload = (uint8_t *)payload;
+    /* Replaces any earlier payload; payload may already be in place */
+    uint8_t *dest = pdu->data + pdu->options_end + 1;
+    if (length > 0) {
+        memmove(dest, payload, length);
+        pdu->data[pdu->options_end] = COAP_PAYLOAD_MARKER;
+    }
+    pdu->payload = length ? dest : NULL;
     pdu->payload_length = length;
+    pdu->length = pdu->options_end + (length ? 1 + length : 0);
 
     return COAP_OK;
 }
 
-const coap_option_t *coap_pdu_get_option(const coap_pdu_t *pdu, uint16_t option_num) {
-    if (!pdu) {
-        return NULL;
+void coap_option_iter_init(const coap_pdu_t *pdu, coap_option_iter_t *iter) {
+    iter->offset = pdu ? pdu->options_offset : 0;
+    iter->number = 0;
+}
+
+bool coap_option_next(const coap_pdu_t *pdu, coap_option_iter_t *iter, coap_option_t *option) {
+    if (!pdu || !pdu->data) {
+        return false;
     }
 
-    for (uint8_t i = 0; i < pdu->option_count; i++) {
-        if (pdu->options[i].number == option_num) {
-            return &pdu->options[i];
+    uint16_t delta, length, header_size;
+    uint16_t size = coap_option_parse(pdu->data, iter->offset, pdu->options_end, &delta, &length, &header_size);
+    if (size == 0) {
+        return false;
+    }
+
+    iter->number += delta;
+    option->number = iter->number;
+    option->length = length;
+    option->value = pdu->data + iter->offset + header_size;
+    iter->offset += size;
+
+    return true;
+}
+
+bool coap_pdu_get_option(const coap_pdu_t *pdu, uint16_t option_num, coap_option_t *option) {
+    coap_option_iter_t iter;
+    coap_option_t current;
+
+    coap_option_iter_init(pdu, &iter);
+    while (coap_option_next(pdu, &iter, &current)) {
+        if (current.number == option_num) {
+            if (option) {
+                *option = current;
+            }
+            return true;
+        }
+        if (current.number > option_num) {
+            break;  /* Options are sorted */
         }
     }
 
-    return NULL;
+    return false;
 }
 
-int coap_pdu_encode(const coap_pdu_t *pdu, uint8_t *buffer, size_t buffer_size) {
-    if (!pdu || !buffer || buffer_size < COAP_HEADER_SIZE) {
-        return -1;
+uint8_t *coap_pdu_finalize(coap_pdu_t *pdu, uint16_t *length) {
+    if (!pdu || !pdu->data || !length || pdu->token_length > COAP_MAX_TOKEN_LEN) {
+        return NULL;
     }
 
-    uint8_t *ptr = buffer;
-    size_t remaining = buffer_size;
+    /* A received PDU is already encoded */
+    if (pdu->size == 0) {
+        *length = pdu->length;
+        return pdu->data;
+    }
 
-    /* Header */
-    *ptr++ = (pdu->version << 6) | (pdu->type << 4) | pdu->token_length;
-    *ptr++ = pdu->code;
-    *ptr++ = pdu->message_id >> 8;
-    *ptr++ = pdu->message_id & 0xFF;
-    remaining -= COAP_HEADER_SIZE;
+    /* Header and token go right-aligned in the headroom, against the options */
+    uint8_t *start = pdu->data + pdu->options_offset - pdu->token_length - COAP_HEADER_SIZE;
+    coap_write_header(start, pdu->type, pdu->code, pdu->message_id, pdu->token, pdu->token_length);
 
-    /* Token */
-    if (pdu->token_length > 0) {
-        if (remaining < pdu->token_length) {
-            return -1;
-        }
-        memcpy(ptr, pdu->token, pdu->token_length);
-        ptr += pdu->token_length;
-        remaining -= pdu->token_length;
-    }
-
-    /* Options (sorted by option number) */
-    uint16_t prev_option_num = 0;
-    for (uint8_t i = 0; i < pdu->option_count; i++) {
-        const coap_option_t *opt = &pdu->options[i];
-        uint16_t delta = opt->number - prev_option_num;
-
-        uint8_t delta_ext[2];
-        uint8_t length_ext[2];
-        uint8_t delta_nibble = coap_encode_option_delta_length(delta_ext, delta);
-        uint8_t length_nibble = coap_encode_option_delta_length(length_ext, opt->length);
-
-        if (remaining < 1) {
-            return -1;
-        }
-        *ptr++ = (delta_nibble << 4) | length_nibble;
-        remaining--;
-
-        /* Extended delta */
-        if (delta_nibble == 13) {
-            if (remaining < 1) return -1;
-            *ptr++ = delta_ext[0];
-            remaining--;
-        } else if (delta_nibble == 14) {
-            if (remaining < 2) return -1;
-            *ptr++ = delta_ext[0];
-            *ptr++ = delta_ext[1];
-            remaining -= 2;
-        }
-
-        /* Extended length */
-        if (length_nibble == 13) {
-            if (remaining < 1) return -1;
-            *ptr++ = length_ext[0];
-            remaining--;
-        } else if (length_nibble == 14) {
-            if (remaining < 2) return -1;
-            *ptr++ = length_ext[0];
-            *ptr++ = length_ext[1];
-            remaining -= 2;
-        }
-
-        /* Option value */
-        if (opt->length > 0) {
-            if (remaining < opt->length) {
-                return -1;
-            }
-            memcpy(ptr, opt->value, opt->length);
-            ptr += opt->length;
-            remaining -= opt->length;
-        }
+    *length = (pdu->data + pdu->length) - start;
+    return start;
+}
+
+int coap_pdu_encode(const coap_pdu_t *pdu, uint8_t *buffer, size_t buffer_size) {
+    if (!pdu || !buffer || pdu->token_length > COAP_MAX_TOKEN_LEN) {
+        return -1;
+    }
 
-        prev_option_num = opt->number;
+    /* Options and payload are already encoded; only the header is built */
+    uint16_t body_length = pdu->data ? pdu->length - pdu->options_offset : 0;
+    size_t total = COAP_HEADER_SIZE + pdu->token_length + body_length;
+    if (buffer_size < total) {
+        return -1;
     }
 
-    /* Payload */
-    if (pdu->payload_length > 0) {
-        if (remaining < 1 + pdu->payload_length) {
-            return -1;
-        }
-        *ptr++ = COAP_PAYLOAD_MARKER;
-        memcpy(ptr, pdu->payload, pdu->payload_length);
-        ptr += pdu->payload_length;
+    coap_write_header(buffer, pdu->type, pdu->code, pdu->message_id, pdu->token, pdu->token_length);
+    if (body_length > 0) {
+        memcpy(buffer + COAP_HEADER_SIZE + pdu->token_length, pdu->data + pdu->options_offset, body_length);
     }
 
-    return ptr - buffer;
+    return total;
 }
 
 coap_error_t coap_pdu_decode(coap_pdu_t *pdu, const uint8_t *buffer, size_t length) {
-    if (!pdu || !buffer || length < COAP_HEADER_SIZE) {
+    if (!pdu || !buffer || length < COAP_HEADER_SIZE || length > UINT16_MAX) {
         return COAP_ERROR_INVALID_PARAM;
     }
 
-    const uint8_t *ptr = buffer;
+    memset(pdu, 0, sizeof(coap_pdu_t));
 
     /* Header */
-    pdu->version = (*ptr >> 6) & 0x03;
-    pdu->type = (*ptr >> 4) & 0x03;
-    pdu->token_length = *ptr & 0x0F;
-    ptr++;
-
-    pdu->code = *ptr++;
-    pdu->message_id = (*ptr << 8) | *(ptr + 1);
-    ptr += 2;
+    pdu->version = (buffer[0] >> 6) & 0x03;
+    pdu->type = (buffer[0] >> 4) & 0x03;
+    pdu->token_length = buffer[0] & 0x0F;
+    pdu->code = buffer[1];
+    pdu->message_id = (buffer[2] << 8) | buffer[3];
 
     if (pdu->version != COAP_VERSION) {
         return COAP_ERROR_INVALID_MESSAGE;
     }
 
     /* Token */
-    if (pdu->token_length > 0) {
-        if (pdu->token_length > COAP_MAX_TOKEN_LEN ||
-            (ptr + pdu->token_length) > (buffer + length)) {
-            return COAP_ERROR_INVALID_MESSAGE;
-        }
-        memcpy(pdu->token, ptr, pdu->token_length);
-        ptr += pdu->token_length;
+    if (pdu->token_length > COAP_MAX_TOKEN_LEN ||
+        (size_t)(COAP_HEADER_SIZE + pdu->token_length) > length) {
+        return COAP_ERROR_INVALID_MESSAGE;
     }
+    memcpy(pdu->token, buffer + COAP_HEADER_SIZE, pdu->token_length);
 
-    /* Options and Payload */
-    pdu->option_count = 0;
-    uint16_t option_num = 0;
+    /* The PDU refers to the datagram; size 0 marks it read-only */
+    pdu->data = (uint8_t *)buffer;
+    pdu->length = length;
+    pdu->options_offset = COAP_HEADER_SIZE + pdu->token_length;
+    pdu->options_end = length;
 
-    while (ptr < buffer + length) {
-        if (*ptr == COAP_PAYLOAD_MARKER) {
+    /* Validate every option once so lookups later need no error handling */
+    uint16_t offset = pdu->options_offset;
+    uint32_t option_num = 0;
+
+    while (offset < length) {
+        if (buffer[offset] == COAP_PAYLOAD_MARKER) {
             /* Payload starts here */
-            ptr++;
-            pdu->payload_length = (buffer + length) - ptr;
-            if (pdu->payload_length > 0) {
-                memcpy(pdu->buffer, ptr, pdu->payload_length);
-                pdu->payload = pdu->buffer;
-            }
+            pdu->options_end = offset;
+            pdu->payload_length = length - offset - 1;
+            pdu->payload = pdu->payload_length ? pdu->data + offset + 1 : NULL;
             break;
         }
 
-        /* Parse option */
         if (pdu->option_count >= COAP_MAX_OPTION_COUNT) {
             return COAP_ERROR_INVALID_MESSAGE;
         }
 
-        uint8_t delta_nibble = (*ptr >> 4) & 0x0F;
-        uint8_t length_nibble = *ptr & 0x0F;
-        ptr++;
-
-        uint16_t delta = coap_decode_option_delta_length(&ptr, delta_nibble);
-        uint16_t opt_length = coap_decode_option_delta_length(&ptr, length_nibble);
-
+        uint16_t delta, opt_length, header_size;
+        uint16_t size = coap_option_parse(buffer, offset, length, &delta, &opt_length, &header_size);
         option_num += delta;
-
-        if ((ptr + opt_length) > (buffer + length)) {
+        if (size == 0 || option_num > UINT16_MAX) {
             return COAP_ERROR_INVALID_MESSAGE;
         }
 
-        coap_option_t *opt = &pdu->options[pdu->option_count++];
-        opt->number = option_num;
-        opt->length = opt_length;
-        opt->value = ptr;
-        ptr += opt_length;
+        pdu->option_count++;
+        offset += size;
     }
+    pdu->last_option = option_num;
 
     return COAP_OK;
 }
@@ -320,10 +510,27 @@ coap_error_t coap_init(coap_context_t *context, const coap_config_t *config, boo
     memset(context, 0, sizeof(coap_context_t));
     context->endpoint.ip_address = config->bind_address;
     context->endpoint.port = config->port ? config->port : COAP_DEFAULT_PORT;
-    context->next_message_id = 1;
     context->is_server = is_server;
+    context->enable_observe = config->enable_observe;
     context->socket_fd = -1;
     context->resources = NULL;
+    context->ack_timeout_ms = config->ack_timeout_ms ? config->ack_timeout_ms : COAP_ACK_TIMEOUT_MS;
+    context->max_retransmit = config->max_retransmit ? config->max_retransmit : COAP_MAX_RETRANSMIT;
+    context->nstart = config->nstart ? config->nstart : COAP_NSTART;
+    context->block_szx = config->block_szx ? config->block_szx : COAP_BLOCK_SZX_DEFAULT;
+    if (context->block_szx > COAP_BLOCK_SZX_MAX) {
+        context->block_szx = COAP_BLOCK_SZX_MAX;
+    }
+    context->leisure_ms = config->leisure_ms ? config->leisure_ms : COAP_DEFAULT_LEISURE_MS;
+
+    /* EXCHANGE_LIFETIME (RFC 7252, 4.8.2) bounds how long a MID may be repeated */
+    uint32_t transmit_span = context->ack_timeout_ms * ((1u << context->max_retransmit) - 1) * 3 / 2;
+    context->exchange_lifetime_ms = transmit_span + 2 * COAP_MAX_LATENCY_MS + context->ack_timeout_ms;
+
+    /* Seed from address, port and uptime; start message IDs at a random point */
+    context->rng_state = (config->bind_address ^ ((uint32_t)context->endpoint.port << 16) ^
+                          os_get_tick_count()) | 1;
+    context->next_message_id = (uint16_t)coap_random(context);
 
     return COAP_OK;
 }
@@ -340,9 +547,7 @@ coap_error_t coap_start(coap_context_t *context) {
     }
 
     /* Bind socket */
-    sockaddr_in_t addr;
-    addr.addr = context->endpoint.ip_address;
-    addr.port = context->endpoint.port;
+    sockaddr_in_t addr = coap_sockaddr(context->endpoint.ip_address, context->endpoint.port);
 
     if (net_bind(context->socket_fd, &addr) != OS_OK) {
         net_close(context->socket_fd);
@@ -350,6 +555,15 @@ coap_error_t coap_start(coap_context_t *context) {
         return COAP_ERROR_NETWORK;
     }
 
+    os_event_group_init(&context->events);
+    net_socket_set_notify(context->socket_fd, &context->events, COAP_EVENT_RX);
+
+    if (context->is_server) {
+        coap_well_known_register(context);
+        os_timer_create(&context->leisure_timer, "coap_leisure", TIMER_ONE_SHOT, 1,
+                        coap_leisure_timeout, context);
+    }
+
     return COAP_OK;
 }
 
@@ -358,157 +572,626 @@ void coap_stop(coap_context_t *context) {
         return;
     }
 
+    coap_proxy_stop(context);
+
+    /* Fail outstanding requests */
+    for (int i = 0; i < COAP_MAX_TRANSACTIONS; i++) {
+        if (context->transactions[i].in_use) {
+            coap_transaction_complete(context, &context->transactions[i], NULL, COAP_ERROR_NETWORK);
+        }
+    }
+
     if (context->socket_fd >= 0) {
+        for (int i = 0; i < COAP_MAX_GROUPS; i++) {
+            if (context->groups[i]) {
+                ipv4_addr_t group = coap_sockaddr(context->groups[i], 0).addr;
+                coap_leave_group(context, group);
+            }
+        }
+        if (context->is_server) {
+            os_timer_delete(&context->leisure_timer);
+        }
         net_close(context->socket_fd);
         context->socket_fd = -1;
     }
 
+    coap_dedup_clear(context);
+    coap_leisure_clear(context);
+    for (int i = 0; i < COAP_MAX_EXCHANGES; i++) {
+        coap_exchange_release(&context->exchanges[i]);
+    }
+
     /* Free resources */
     coap_resource_t *resource = context->resources;
     while (resource) {
         coap_resource_t *next = resource->next;
+        coap_resource_invalidate(resource);
+        if (resource->file_path) {
+            os_free(resource->file_path);
+        }
         os_free(resource);
         resource = next;
     }
     context->resources = NULL;
+    coap_path_free(context->routes);
+    context->routes = NULL;
 }
 
 /* ====================
  * Client API
  * ==================== */
 
-static coap_error_t coap_send_request_internal(
-    coap_context_t *context,
-    uint32_t server_ip,
-    uint16_t server_port,
-    coap_method_t method,
-    const char *uri_path,
-    coap_content_format_t content_format,
-    const uint8_t *payload,
-    uint16_t payload_length,
-    coap_response_t *response,
-    uint32_t timeout_ms
-) {
-    if (!context || !uri_path || !response) {
-        return COAP_ERROR_INVALID_PARAM;
+/* Synchronous wrapper state */
+typedef struct {
+    volatile bool done;
+    coap_response_t *response;
+    int32_t block;                  /* Block1/Block2 value from the response, -1 if none */
+} coap_sync_wait_t;
+
+/**
+ * @brief Encode an unsigned option value in the minimum number of bytes
+ */
+static uint8_t coap_encode_uint(uint8_t *buffer, uint32_t value) {
+    uint8_t length = 0;
+    uint8_t tmp[4];
+
+    while (value > 0) {
+        tmp[length++] = value & 0xFF;
+        value >>= 8;
+    }
+    for (uint8_t i = 0; i < length; i++) {
+        buffer[i] = tmp[length - 1 - i];
     }
+    return length;
+}
 
-    (void)timeout_ms;  /* net_recvfrom uses its own internal timeout */
+static uint32_t coap_decode_uint(const coap_option_t *option) {
+    uint32_t value = 0;
+    for (uint16_t i = 0; i < option->length && i < 4; i++) {
+        value = (value << 8) | option->value[i];
+    }
+    return value;
+}
 
-    /* Create request PDU */
-    coap_pdu_t request;
-    uint16_t msg_id = coap_generate_message_id(context);
-    coap_pdu_init(&request, COAP_TYPE_CON, method, msg_id);
+/**
+ * @brief Add one option per delimited segment of str
+ *
+ * Values are copied into the PDU's buffer.
+ */
+static coap_error_t coap_add_segments(coap_pdu_t *pdu, uint16_t option_num, const char *str, char delimiter) {
+    while (str && *str) {
+        const char *end = strchr(str, delimiter);
+        size_t len = end ? (size_t)(end - str) : strlen(str);
 
-    /* Generate token */
-    uint8_t token[4];
-    coap_generate_token(token, 4);
-    coap_pdu_set_token(&request, token, 4);
-
-    /* Add URI-Path option */
-    const char *path = uri_path;
-    if (*path == '/') path++;
-
-    char path_segment[64];
-    const char *slash = strchr(path, '/');
-    while (path && *path) {
-        size_t len;
-        if (slash) {
-            len = slash - path;
-            if (len >= sizeof(path_segment)) len = sizeof(path_segment) - 1;
-            memcpy(path_segment, path, len);
-            path_segment[len] = '\0';
-            path = slash + 1;
-            slash = strchr(path, '/');
-        } else {
-            strncpy(path_segment, path, sizeof(path_segment) - 1);
-            path_segment[sizeof(path_segment) - 1] = '\0';
-            path = NULL;
+        if (len > 0 && coap_pdu_add_option(pdu, option_num, (const uint8_t *)str, len) != COAP_OK) {
+            return COAP_ERROR_NO_MEMORY;
         }
+        str = end ? end + 1 : NULL;
+    }
+    return COAP_OK;
+}
 
-        if (strlen(path_segment) > 0) {
-            coap_pdu_add_option(&request, COAP_OPTION_URI_PATH,
-                              (const uint8_t *)path_segment, strlen(path_segment));
-        }
+static bool coap_peer_matches(const coap_endpoint_t *peer, const sockaddr_in_t *addr) {
+    return peer->ip_address == COAP_IPV4(addr->addr) && peer->port == addr->port;
+}
+
+/**
+ * @brief Take a transmit buffer from the network pool and build pdu in it
+ */
+static net_buffer_t *coap_tx_alloc(coap_pdu_t *pdu, coap_msg_type_t type, uint8_t code, uint16_t message_id) {
+    net_buffer_t *buf = net_buffer_alloc();
+    if (buf) {
+        coap_pdu_init_buffer(pdu, type, code, message_id, buf->data + NET_TX_HEADROOM, COAP_TX_CAPACITY);
+    }
+    return buf;
+}
+
+/**
+ * @brief Finalize pdu and point the buffer's offset and length at the message
+ */
+static void coap_tx_finalize(net_buffer_t *buf, coap_pdu_t *pdu) {
+    uint16_t length = 0;
+    uint8_t *message = coap_pdu_finalize(pdu, &length);
+    buf->offset = message - buf->data;
+    buf->length = length;
+}
+
+/**
+ * @brief Retransmission timer callback (tick context)
+ */
+static void coap_transaction_timeout(void *param) {
+    coap_transaction_t *transaction = param;
+    transaction->expired = true;
+    os_event_group_set_bits(&transaction->context->events, COAP_EVENT_TIMER);
+}
+
+static void coap_transaction_arm(coap_transaction_t *transaction, uint32_t timeout_ms) {
+    transaction->expired = false;
+    os_timer_change_period(&transaction->timer, timeout_ms ? timeout_ms : 1);
+    os_timer_start(&transaction->timer);
+}
+
+static void coap_transaction_release(coap_transaction_t *transaction) {
+    os_timer_delete(&transaction->timer);
+    if (transaction->pdu) {
+        os_free(transaction->pdu);
+        transaction->pdu = NULL;
     }
+    transaction->group = false;
+    transaction->in_use = false;
+}
 
-    /* Add Content-Format option for POST/PUT */
-    if ((method == COAP_METHOD_POST || method == COAP_METHOD_PUT) && payload_length > 0) {
-        uint8_t format = (uint8_t)content_format;
-        coap_pdu_add_option(&request, COAP_OPTION_CONTENT_FORMAT, &format, 1);
-        coap_pdu_set_payload(&request, payload, payload_length);
+/**
+ * @brief Describe a received response (or a transport error) for a handler
+ */
+static void coap_response_fill(coap_response_t *response, const coap_pdu_t *pdu, coap_error_t error,
+                               const coap_endpoint_t *source) {
+    memset(response, 0, sizeof(*response));
+    response->error = error;
+    response->content_format = COAP_CONTENT_FORMAT_TEXT_PLAIN;
+    response->source = *source;
+
+    if (pdu && error == COAP_OK) {
+        response->pdu = pdu;
+        response->code = pdu->code;
+        response->success = (COAP_CODE_CLASS(pdu->code) == 2);
+        response->payload = pdu->payload;
+        response->payload_length = pdu->payload_length;
+
+        coap_option_t cf_opt;
+        if (coap_pdu_get_option(pdu, COAP_OPTION_CONTENT_FORMAT, &cf_opt)) {
+            response->content_format = (coap_content_format_t)coap_decode_uint(&cf_opt);
+        }
     }
+}
 
-    /* Encode PDU */
-    uint8_t buffer[COAP_MAX_PDU_SIZE];
-    int len = coap_pdu_encode(&request, buffer, sizeof(buffer));
-    if (len < 0) {
-        return COAP_ERROR_PARSE;
+/**
+ * @brief Finish a transaction and call its handler
+ *
+ * The slot is released first so the handler may issue a new request.
+ */
+static void coap_transaction_complete(coap_context_t *context, coap_transaction_t *transaction,
+                                      const coap_pdu_t *pdu, coap_error_t error) {
+    coap_response_handler_t handler = transaction->handler;
+    void *user_data = transaction->user_data;
+    coap_response_t response;
+
+    coap_response_fill(&response, pdu, error, &transaction->peer);
+    coap_transaction_release(transaction);
+
+    if (handler) {
+        handler(context, &response, user_data);
     }
+}
 
-    /* Send request */
-    sockaddr_in_t dest_addr;
-    dest_addr.addr = server_ip;
-    dest_addr.port = server_port;
+static coap_transaction_t *coap_transaction_alloc(coap_context_t *context) {
+    for (int i = 0; i < COAP_MAX_TRANSACTIONS; i++) {
+        if (!context->transactions[i].in_use) {
+            return &context->transactions[i];
+        }
+    }
+    return NULL;
+}
 
-    int32_t sent = net_sendto(context->socket_fd, buffer, len, &dest_addr);
-    if (sent < 0) {
+/**
+ * @brief Send a CON message and track it until acknowledged
+ *
+ * The message is sent from buf as is; a right-sized copy is kept for
+ * retransmission. The caller fills in message ID, token, peer, handler
+ * and user data.
+ */
+static coap_error_t coap_transaction_send(coap_context_t *context, coap_transaction_t *transaction,
+                                          net_buffer_t *buf) {
+    transaction->pdu = os_malloc(buf->length);
+    if (!transaction->pdu) {
+        return COAP_ERROR_NO_MEMORY;
+    }
+    memcpy(transaction->pdu, buf->data + buf->offset, buf->length);
+    transaction->pdu_length = buf->length;
+    transaction->in_use = true;
+    transaction->acked = false;
+    transaction->retransmit_count = 0;
+    transaction->context = context;
+
+    /* Initial timeout is random in [ACK_TIMEOUT, ACK_TIMEOUT * ACK_RANDOM_FACTOR] */
+    uint32_t spread = (uint32_t)(context->ack_timeout_ms * (COAP_ACK_RANDOM_FACTOR - 1.0));
+    transaction->timeout_ms = context->ack_timeout_ms + coap_random(context) % (spread + 1);
+
+    os_timer_create(&transaction->timer, "coap", TIMER_ONE_SHOT, transaction->timeout_ms,
+                    coap_transaction_timeout, transaction);
+
+    sockaddr_in_t dest_addr = coap_sockaddr(transaction->peer.ip_address, transaction->peer.port);
+    if (net_sendto_buffer(context->socket_fd, buf, &dest_addr) < 0) {
+        coap_transaction_release(transaction);
         return COAP_ERROR_NETWORK;
     }
 
-    /* Wait for response */
-    uint8_t recv_buffer[COAP_MAX_PDU_SIZE];
-    sockaddr_in_t from_addr;
-    int32_t recv_len = net_recvfrom(context->socket_fd, recv_buffer, sizeof(recv_buffer), &from_addr);
+    coap_transaction_arm(transaction, transaction->timeout_ms);
+    return COAP_OK;
+}
 
-    if (recv_len <= 0) {
-        return COAP_ERROR_TIMEOUT;
+/**
+ * @brief Retransmit or fail transactions whose timer has fired
+ */
+static void coap_check_transactions(coap_context_t *context) {
+    for (int i = 0; i < COAP_MAX_TRANSACTIONS; i++) {
+        coap_transaction_t *transaction = &context->transactions[i];
+        if (!transaction->in_use || !transaction->expired) {
+            continue;
+        }
+
+        /* A group request ends when its collection window closes */
+        if (transaction->acked || transaction->group) {
+            coap_transaction_complete(context, transaction, NULL, COAP_ERROR_TIMEOUT);
+            continue;
+        }
+
+        if (transaction->retransmit_count >= context->max_retransmit) {
+            coap_transaction_complete(context, transaction, NULL, COAP_ERROR_MAX_RETRANSMIT);
+            continue;
+        }
+
+        sockaddr_in_t dest_addr = coap_sockaddr(transaction->peer.ip_address, transaction->peer.port);
+        net_sendto(context->socket_fd, transaction->pdu, transaction->pdu_length, &dest_addr);
+
+        /* A failed send is treated like a lost datagram and retried */
+        transaction->retransmit_count++;
+        transaction->timeout_ms *= 2;
+        coap_transaction_arm(transaction, transaction->timeout_ms);
     }
+}
 
-    /* Decode response */
-    coap_pdu_t resp_pdu;
-    if (coap_pdu_decode(&resp_pdu, recv_buffer, recv_len) != COAP_OK) {
-        return COAP_ERROR_PARSE;
+static coap_transaction_t *coap_find_transaction_by_mid(coap_context_t *context, uint16_t message_id,
+                                                        const sockaddr_in_t *from) {
+    for (int i = 0; i < COAP_MAX_TRANSACTIONS; i++) {
+        coap_transaction_t *transaction = &context->transactions[i];
+        if (transaction->in_use && transaction->message_id == message_id &&
+            coap_peer_matches(&transaction->peer, from)) {
+            return transaction;
+        }
     }
+    return NULL;
+}
 
-    /* Verify token matches */
-    if (resp_pdu.token_length != request.token_length ||
-        memcmp(resp_pdu.token, request.token, request.token_length) != 0) {
-        return COAP_ERROR_INVALID_MESSAGE;
+static coap_transaction_t *coap_find_transaction_by_token(coap_context_t *context, const coap_pdu_t *pdu,
+                                                          const sockaddr_in_t *from) {
+    for (int i = 0; i < COAP_MAX_TRANSACTIONS; i++) {
+        coap_transaction_t *transaction = &context->transactions[i];
+        if (transaction->in_use && transaction->token_length == pdu->token_length &&
+            memcmp(transaction->token, pdu->token, pdu->token_length) == 0 &&
+            (transaction->group || coap_peer_matches(&transaction->peer, from))) {
+            return transaction;
+        }
     }
+    return NULL;
+}
 
-    /* Fill response structure */
-    response->code = resp_pdu.code;
-    response->success = (COAP_CODE_CLASS(resp_pdu.code) == 2);
+static void coap_send_empty(coap_context_t *context, coap_msg_type_t type, uint16_t message_id,
+                            const sockaddr_in_t *to) {
+    uint8_t buffer[COAP_HEADER_SIZE];
+    coap_write_header(buffer, type, 0, message_id, NULL, 0);
+    net_sendto(context->socket_fd, buffer, sizeof(buffer), to);
+}
 
-    /* Get content format */
-    const coap_option_t *cf_opt = coap_pdu_get_option(&resp_pdu, COAP_OPTION_CONTENT_FORMAT);
-    if (cf_opt && cf_opt->length > 0) {
-        response->content_format = (coap_content_format_t)cf_opt->value[0];
-    } else {
-        response->content_format = COAP_CONTENT_FORMAT_TEXT_PLAIN;
+/**
+ * @brief Send a response as a separate message
+ *
+ * The options and payload are already encoded at body inside tx; the
+ * header and token are written in front of them, so one body can be sent
+ * to several peers. A CON response is retransmitted until acknowledged
+ * and goes out NON if no transaction slot or memory is free.
+ */
+static void coap_send_separate(coap_context_t *context, net_buffer_t *tx, uint8_t *body, uint16_t body_length,
+                               uint8_t code, const coap_endpoint_t *peer, const uint8_t *token,
+                               uint8_t token_length, bool confirmable) {
+    coap_transaction_t *transaction = confirmable ? coap_transaction_alloc(context) : NULL;
+    uint16_t msg_id = coap_generate_message_id(context);
+    uint8_t *start = body - token_length - COAP_HEADER_SIZE;
+
+    coap_write_header(start, transaction ? COAP_TYPE_CON : COAP_TYPE_NON, code, msg_id, token, token_length);
+    tx->offset = start - tx->data;
+    tx->length = COAP_HEADER_SIZE + token_length + body_length;
+
+    if (transaction) {
+        transaction->message_id = msg_id;
+        memcpy(transaction->token, token, token_length);
+        transaction->token_length = token_length;
+        transaction->peer = *peer;
+        transaction->notification = true;
+        transaction->exchange_timeout_ms = 0;
+        transaction->handler = NULL;
+        transaction->user_data = NULL;
+        if (coap_transaction_send(context, transaction, tx) == COAP_OK) {
+            return;
+        }
+        coap_write_header(start, COAP_TYPE_NON, code, msg_id, token, token_length);
     }
 
-    /* Copy payload */
-    if (resp_pdu.payload_length > 0) {
-        response->payload = os_malloc(resp_pdu.payload_length);
-        if (response->payload) {
-            memcpy(response->payload, resp_pdu.payload, resp_pdu.payload_length);
-            response->payload_length = resp_pdu.payload_length;
+    sockaddr_in_t dest_addr = coap_sockaddr(peer->ip_address, peer->port);
+    net_sendto_buffer(context->socket_fd, tx, &dest_addr);
+}
+
+/**
+ * @brief Match an ACK, RST or response against outstanding requests
+ */
+static void coap_handle_response(coap_context_t *context, const coap_pdu_t *pdu, const sockaddr_in_t *from) {
+    coap_transaction_t *transaction;
+
+    if (pdu->type == COAP_TYPE_ACK || pdu->type == COAP_TYPE_RST) {
+        transaction = coap_find_transaction_by_mid(context, pdu->message_id, from);
+        if (!transaction) {
+            if (pdu->type == COAP_TYPE_RST) {
+                coap_observe_reset(context, pdu->message_id, from);
+            }
+            return;
+        }
+
+        if (pdu->type == COAP_TYPE_RST) {
+            coap_transaction_complete(context, transaction, NULL, COAP_ERROR_NETWORK);
+        } else if (pdu->code == 0 && transaction->notification) {
+            coap_transaction_complete(context, transaction, NULL, COAP_OK);
+        } else if (pdu->code == 0) {
+            /* Empty ACK: stop retransmitting, response follows separately */
+            if (!transaction->acked) {
+                transaction->acked = true;
+                coap_transaction_arm(transaction, transaction->exchange_timeout_ms ?
+                                     transaction->exchange_timeout_ms : context->ack_timeout_ms);
+            }
+        } else if (transaction->token_length == pdu->token_length &&
+                   memcmp(transaction->token, pdu->token, pdu->token_length) == 0) {
+            coap_transaction_complete(context, transaction, pdu, COAP_OK);
         }
-    } else {
-        response->payload = NULL;
-        response->payload_length = 0;
+        return;
     }
 
-    return COAP_OK;
+    /* Separate (CON or NON) response: matched by token */
+    transaction = coap_find_transaction_by_token(context, pdu, from);
+    if (pdu->type == COAP_TYPE_CON) {
+        coap_send_empty(context, transaction ? COAP_TYPE_ACK : COAP_TYPE_RST, pdu->message_id, from);
+    }
+    if (transaction && transaction->group) {
+        /* One of many answers to a group request: deliver and keep collecting */
+        coap_endpoint_t source = { COAP_IPV4(from->addr), from->port };
+        coap_response_t response;
+        coap_response_fill(&response, pdu, COAP_OK, &source);
+        if (transaction->handler) {
+            transaction->handler(context, &response, transaction->user_data);
+        }
+    } else if (transaction) {
+        coap_transaction_complete(context, transaction, pdu, COAP_OK);
+    }
 }
 
-coap_error_t coap_get(
+/**
+ * @brief Encode a request's options and payload into pdu
+ */
+static coap_error_t coap_request_encode(coap_pdu_t *pdu, const coap_request_t *request,
+                                        const coap_option_t *options, uint8_t option_count) {
+    /* Options in number order are appended without moving anything */
+    uint8_t format[2];
+    coap_error_t err = coap_add_segments(pdu, COAP_OPTION_URI_PATH, request->uri_path, '/');
+    if (err == COAP_OK && request->payload_length > 0) {
+        err = coap_pdu_add_option(pdu, COAP_OPTION_CONTENT_FORMAT, format,
+                                  coap_encode_uint(format, request->content_format));
+    }
+    if (err == COAP_OK) {
+        err = coap_add_segments(pdu, COAP_OPTION_URI_QUERY, request->uri_query, '&');
+    }
+    if (err == COAP_OK && request->proxy_uri) {
+        err = coap_pdu_add_option(pdu, COAP_OPTION_PROXY_URI, (const uint8_t *)request->proxy_uri,
+                                  strlen(request->proxy_uri));
+    }
+    for (uint8_t i = 0; i < option_count && err == COAP_OK; i++) {
+        err = coap_pdu_add_option(pdu, options[i].number, options[i].value, options[i].length);
+    }
+    if (err == COAP_OK && request->payload_length > 0) {
+        err = coap_pdu_set_payload(pdu, request->payload, request->payload_length);
+    }
+    return err;
+}
+
+/**
+ * @brief Build, send and track a CON request with optional extra options
+ */
+static coap_error_t coap_request_start(
     coap_context_t *context,
     uint32_t server_ip,
     uint16_t server_port,
-    const char *uri_path,
+    const coap_request_t *request,
+    const coap_option_t *options,
+    uint8_t option_count,
+    coap_response_handler_t handler,
+    void *user_data
+) {
+    if (!context || !request || !(request->uri_path || request->proxy_uri) || context->socket_fd < 0) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    /* Enforce NSTART per server and find a free slot */
+    coap_transaction_t *transaction = coap_transaction_alloc(context);
+    uint8_t outstanding = 0;
+    for (int i = 0; i < COAP_MAX_TRANSACTIONS; i++) {
+        coap_transaction_t *t = &context->transactions[i];
+        if (t->in_use && !t->notification &&
+            t->peer.ip_address == server_ip && t->peer.port == server_port) {
+            outstanding++;
+        }
+    }
+    if (!transaction || outstanding >= context->nstart) {
+        return COAP_ERROR_BUSY;
+    }
+
+    /* Build the request directly in a transmit buffer */
+    coap_pdu_t pdu;
+    uint16_t msg_id = coap_generate_message_id(context);
+    net_buffer_t *tx = coap_tx_alloc(&pdu, COAP_TYPE_CON, request->method, msg_id);
+    if (!tx) {
+        return COAP_ERROR_NO_MEMORY;
+    }
+
+    uint8_t token[4];
+    coap_generate_token(context, token, sizeof(token));
+    coap_pdu_set_token(&pdu, token, sizeof(token));
+
+    coap_error_t err = coap_request_encode(&pdu, request, options, option_count);
+    if (err != COAP_OK) {
+        net_buffer_free(tx);
+        return err;
+    }
+    coap_tx_finalize(tx, &pdu);
+
+    transaction->message_id = msg_id;
+    memcpy(transaction->token, token, sizeof(token));
+    transaction->token_length = sizeof(token);
+    transaction->peer.ip_address = server_ip;
+    transaction->peer.port = server_port;
+    transaction->notification = false;
+    transaction->exchange_timeout_ms = request->timeout_ms;
+    transaction->handler = handler ? handler : context->response_handler;
+    transaction->user_data = user_data;
+
+    err = coap_transaction_send(context, transaction, tx);
+    net_buffer_free(tx);
+    return err;
+}
+
+coap_error_t coap_request_async(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const coap_request_t *request,
+    coap_response_handler_t handler,
+    void *user_data
+) {
+    return coap_request_start(context, server_ip, server_port, request, NULL, 0, handler, user_data);
+}
+
+/**
+ * @brief Completion handler for the blocking API: copies the response out
+ */
+static void coap_sync_handler(coap_context_t *context, const coap_response_t *response, void *user_data) {
+    coap_sync_wait_t *wait = user_data;
+    (void)context;
+
+    *wait->response = *response;
+    wait->response->payload = NULL;
+    wait->response->payload_length = 0;
+    wait->response->pdu = NULL;
+
+    if (response->payload_length > 0) {
+        wait->response->payload = os_malloc(response->payload_length);
+        if (wait->response->payload) {
+            memcpy(wait->response->payload, response->payload, response->payload_length);
+            wait->response->payload_length = response->payload_length;
+        }
+    }
+
+    /* Block-wise transfers need the server's Block1/Block2 answer */
+    coap_option_t block;
+    if (response->pdu && (coap_pdu_get_option(response->pdu, COAP_OPTION_BLOCK1, &block) ||
+                          coap_pdu_get_option(response->pdu, COAP_OPTION_BLOCK2, &block))) {
+        wait->block = (int32_t)coap_decode_uint(&block);
+    } else {
+        wait->block = -1;
+    }
+
+    wait->done = true;
+}
+
+/**
+ * @brief Cancel outstanding requests owned by user_data without calling handlers
+ */
+static void coap_cancel_requests(coap_context_t *context, void *user_data) {
+    for (int i = 0; i < COAP_MAX_TRANSACTIONS; i++) {
+        if (context->transactions[i].in_use && context->transactions[i].user_data == user_data) {
+            coap_transaction_release(&context->transactions[i]);
+        }
+    }
+}
+
+/**
+ * @brief Send a request and drive the context until it completes
+ */
+static coap_error_t coap_request_sync(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const coap_request_t *request,
+    const coap_option_t *options,
+    uint8_t option_count,
+    coap_response_t *response,
+    int32_t *block
+) {
+    if (!context || !request || !response) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    coap_sync_wait_t wait = { .done = false, .response = response, .block = -1 };
+    memset(response, 0, sizeof(*response));
+
+    coap_error_t err = coap_request_start(context, server_ip, server_port, request, options, option_count,
+                                          coap_sync_handler, &wait);
+    if (err != COAP_OK) {
+        return err;
+    }
+
+    /* Drive the context until our response arrives or the caller's timeout */
+    uint32_t start = os_get_uptime_ms();
+    while (!wait.done) {
+        uint32_t elapsed = os_get_uptime_ms() - start;
+        if (request->timeout_ms && elapsed >= request->timeout_ms) {
+            coap_cancel_requests(context, &wait);
+            return COAP_ERROR_TIMEOUT;
+        }
+        coap_process(context, request->timeout_ms ? request->timeout_ms - elapsed : OS_WAIT_FOREVER);
+    }
+
+    if (block) {
+        *block = wait.block;
+    }
+    return response->error;
+}
+
+coap_error_t coap_request(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const coap_request_t *request,
+    coap_response_t *response
+) {
+    return coap_request_sync(context, server_ip, server_port, request, NULL, 0, response, NULL);
+}
+
+static coap_error_t coap_send_request_internal(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    coap_method_t method,
+    const char *uri_path,
+    coap_content_format_t content_format,
+    const uint8_t *payload,
+    uint16_t payload_length,
+    coap_response_t *response,
+    uint32_t timeout_ms
+) {
+    coap_request_t request = {
+        .method = method,
+        .uri_path = uri_path,
+        .uri_query = NULL,
+        .content_format = content_format,
+        .payload = payload,
+        .payload_length = payload_length,
+        .timeout_ms = timeout_ms
+    };
+
+    return coap_request(context, server_ip, server_port, &request, response);
+}
+
+coap_error_t coap_get(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const char *uri_path,
     coap_response_t *response,
     uint32_t timeout_ms
 ) {
@@ -567,122 +1250,2270 @@ coap_error_t coap_delete(
 }
 
 /* ====================
- * Server API
+ * Block-Wise Transfer
  * ==================== */
 
-coap_resource_t *coap_resource_create(
-    coap_context_t *context,
-    const char *uri_path,
-    coap_resource_handler_t handler,
-    void *user_data
-) {
-    if (!context || !uri_path || !handler) {
-        return NULL;
+#define COAP_BLOCK_VALUE(num, more, szx) (((uint32_t)(num) << 4) | ((more) ? 0x08 : 0) | (szx))
+#define COAP_BLOCK_NUM(value)           ((value) >> 4)
+#define COAP_BLOCK_MORE(value)          (((value) & 0x08) != 0)
+#define COAP_BLOCK_SZX(value)           ((value) & 0x07)
+
+/**
+ * @brief Record block num as received
+ *
+ * @return 1 if new, 0 if a duplicate, -1 if beyond the tracking window
+ */
+static int coap_block_mark(coap_block_state_t *state, uint32_t num) {
+    if (num < state->next) {
+        return 0;
+    }
+    if (num - state->next >= COAP_BLOCK_WINDOW) {
+        return -1;
     }
 
-    coap_resource_t *resource = os_malloc(sizeof(coap_resource_t));
-    if (!resource) {
-        return NULL;
+    uint32_t bit = 1u << (num - state->next);
+    if (state->window & bit) {
+        return 0;
     }
+    state->window |= bit;
 
-    memset(resource, 0, sizeof(coap_resource_t));
-    strncpy(resource->uri_path, uri_path, sizeof(resource->uri_path) - 1);
-    resource->handler = handler;
-    resource->user_data = user_data;
-    resource->observable = false;
-    resource->max_age = 60;
-    resource->next = context->resources;
-    context->resources = resource;
+    while (state->window & 1) {
+        state->window >>= 1;
+        state->next++;
+    }
+    return 1;
+}
 
-    return resource;
+static bool coap_block_complete(const coap_block_state_t *state) {
+    return state->last_num >= 0 && state->next > (uint32_t)state->last_num;
 }
 
-coap_error_t coap_resource_set_observable(coap_resource_t *resource, uint32_t max_age) {
-    if (!resource) {
-        return COAP_ERROR_INVALID_PARAM;
+/**
+ * @brief Answer a GET from the resource's block source (Block2)
+ */
+static void coap_serve_block2(coap_context_t *context, coap_resource_t *resource,
+                              const coap_pdu_t *request, coap_pdu_t *response) {
+    uint32_t num = 0;
+    uint8_t szx = context->block_szx;
+
+    coap_option_t block2;
+    if (coap_pdu_get_option(request, COAP_OPTION_BLOCK2, &block2)) {
+        uint32_t value = coap_decode_uint(&block2);
+        num = COAP_BLOCK_NUM(value);
+        if (COAP_BLOCK_SZX(value) < szx) {
+            szx = COAP_BLOCK_SZX(value);  /* Client asked for smaller blocks */
+        } else {
+            num <<= COAP_BLOCK_SZX(value) - szx;  /* Same offset in our smaller blocks */
+        }
     }
 
-    resource->observable = true;
-    resource->max_age = max_age;
+    uint8_t option[4];
+    coap_pdu_add_option(response, COAP_OPTION_CONTENT_FORMAT, option,
+                        coap_encode_uint(option, resource->content_format));
+
+    /*
+     * Read one byte past the block, straight into the payload area of the
+     * transmit buffer, to learn whether more follow. Room is left for the
+     * Block2 and Size2 options added after it.
+     */
+    uint16_t size = COAP_BLOCK_SIZE(szx);
+    uint16_t capacity = 0;
+    uint8_t *data = coap_pdu_payload_buffer(response, &capacity);
+    if (!data || capacity < size + 1 + 2 * (3 + sizeof(option))) {
+        response->code = COAP_RESPONSE_500_INTERNAL_ERROR;
+        return;
+    }
+    uint32_t total_size = UINT32_MAX;
+    int32_t length = resource->block_read(resource->block_user_data, num * size, data, size + 1, &total_size);
 
-    return COAP_OK;
+    if (length < 0) {
+        response->code = COAP_RESPONSE_500_INTERNAL_ERROR;
+        return;
+    }
+    if (length == 0 && num > 0) {
+        response->code = COAP_RESPONSE_402_BAD_OPTION;  /* Block beyond the end */
+        return;
+    }
+
+    bool more = length > size;
+    if (more) {
+        length = size;
+    }
+
+    response->code = COAP_RESPONSE_205_CONTENT;
+    coap_pdu_set_payload(response, data, length);
+    coap_pdu_add_option(response, COAP_OPTION_BLOCK2, option,
+                        coap_encode_uint(option, COAP_BLOCK_VALUE(num, more, szx)));
+    if (total_size != UINT32_MAX) {
+        coap_pdu_add_option(response, COAP_OPTION_SIZE2, option, coap_encode_uint(option, total_size));
+    }
 }
 
-static coap_resource_t *coap_find_resource(coap_context_t *context, const char *uri_path) {
-    coap_resource_t *resource = context->resources;
-    while (resource) {
-        if (strcmp(resource->uri_path, uri_path) == 0) {
-            return resource;
+/**
+ * @brief Pass a PUT/POST body block to the resource's block sink (Block1)
+ *
+ * Blocks are written at their offset as they arrive; a window of
+ * COAP_BLOCK_WINDOW blocks past the first missing one is tracked, so
+ * reordered blocks need no buffering. Each block is answered 2.31
+ * Continue until the body is complete.
+ */
+static void coap_receive_block1(coap_context_t *context, coap_resource_t *resource,
+                                const coap_pdu_t *request, const sockaddr_in_t *from,
+                                coap_pdu_t *response) {
+    coap_block_state_t *rx = &resource->block_rx;
+    uint32_t num = 0;
+    bool more = false;
+    uint8_t szx = context->block_szx;
+
+    coap_option_t block1_option;
+    bool block1 = coap_pdu_get_option(request, COAP_OPTION_BLOCK1, &block1_option);
+    if (block1) {
+        uint32_t value = coap_decode_uint(&block1_option);
+        num = COAP_BLOCK_NUM(value);
+        more = COAP_BLOCK_MORE(value);
+        szx = COAP_BLOCK_SZX(value);
+        if (szx > COAP_BLOCK_SZX_MAX ||
+            (more && request->payload_length < COAP_BLOCK_SIZE(szx))) {
+            response->code = COAP_RESPONSE_400_BAD_REQUEST;
+            return;
         }
-        resource = resource->next;
     }
-    return NULL;
-}
 
-coap_error_t coap_process(coap_context_t *context, uint32_t timeout_ms) {
-    if (!context || context->socket_fd < 0) {
-        return COAP_ERROR_INVALID_PARAM;
+    bool same_peer = rx->active && coap_peer_matches(&rx->peer, from);
+
+    if (num == 0 && !(same_peer && rx->next > 0)) {
+        /* New body; a larger block than ours is accepted only up to our size */
+        memset(rx, 0, sizeof(*rx));
+        rx->active = true;
+        rx->peer.ip_address = COAP_IPV4(from->addr);
+        rx->peer.port = from->port;
+        rx->szx = (szx < context->block_szx || !block1) ? szx : context->block_szx;
+        rx->last_num = -1;
+        resource->block_write(resource->block_user_data, 0, NULL, 0, false);
+    } else if (!same_peer || (num > 0 && szx != rx->szx)) {
+        response->code = COAP_RESPONSE_408_REQUEST_INCOMPLETE;
+        return;
     }
 
-    /* Receive message */
-    uint8_t buffer[COAP_MAX_PDU_SIZE];
-    sockaddr_in_t from_addr;
-    int32_t recv_len = net_recvfrom(context->socket_fd, buffer, sizeof(buffer), &from_addr);
+    uint16_t size = COAP_BLOCK_SIZE(rx->szx);
+    uint16_t length = request->payload_length;
+    if (block1 && length > size) {
+        length = size;      /* Keep the first block of the negotiated size */
+        more = true;
+    }
 
-    if (recv_len <= 0) {
-        return COAP_ERROR_TIMEOUT;
+    int mark = coap_block_mark(rx, num);
+    if (mark < 0) {
+        response->code = COAP_RESPONSE_408_REQUEST_INCOMPLETE;
+        return;
+    }
+    if (!more) {
+        rx->last_num = num;
     }
 
-    /* Decode PDU */
-    coap_pdu_t request;
-    if (coap_pdu_decode(&request, buffer, recv_len) != COAP_OK) {
-        return COAP_ERROR_PARSE;
-    }
-
-    /* Process as server */
-    if (context->is_server && COAP_CODE_CLASS(request.code) == 0) {
-        /* Extract URI path from options */
-        char uri_path[128] = "/";
-        size_t path_len = 1;
-
-        for (uint8_t i = 0; i < request.option_count; i++) {
-            if (request.options[i].number == COAP_OPTION_URI_PATH) {
-                if (path_len + request.options[i].length + 1 < sizeof(uri_path)) {
-                    memcpy(uri_path + path_len, request.options[i].value, request.options[i].length);
-                    path_len += request.options[i].length;
-                    uri_path[path_len++] = '/';
-                }
+    bool complete = coap_block_complete(rx);
+    if (mark > 0 &&
+        resource->block_write(resource->block_user_data, num * size, request->payload, length,
+                              complete) != COAP_OK) {
+        rx->active = false;
+        response->code = COAP_RESPONSE_500_INTERNAL_ERROR;
+        return;
+    }
+
+    if (complete) {
+        rx->active = false;
+        response->code = (request->code == COAP_METHOD_POST) ? COAP_RESPONSE_201_CREATED
+                                                             : COAP_RESPONSE_204_CHANGED;
+    } else {
+        response->code = COAP_RESPONSE_231_CONTINUE;
+    }
+
+    if (block1) {
+        uint8_t option[4];
+        coap_pdu_add_option(response, COAP_OPTION_BLOCK1, option,
+                            coap_encode_uint(option, COAP_BLOCK_VALUE(num, !complete, rx->szx)));
+    }
+}
+
+/* Client download state */
+typedef struct {
+    coap_context_t *context;
+    uint32_t server_ip;
+    uint16_t server_port;
+    const char *uri_path;
+    uint32_t timeout_ms;
+    coap_block_write_t sink;
+    void *user_data;
+    coap_block_state_t state;
+    uint32_t next_request;          /* Next block number to ask for */
+    uint8_t in_flight;
+    bool size_known;                /* Size2 seen: last block known, pipelining allowed */
+    bool first_seen;                /* First response fixed the block size */
+    coap_error_t error;
+} coap_block_download_t;
+
+static void coap_download_handler(coap_context_t *context, const coap_response_t *response, void *user_data);
+
+static coap_error_t coap_download_request(coap_block_download_t *download, uint32_t num) {
+    uint8_t value[4];
+    coap_option_t option = {
+        .number = COAP_OPTION_BLOCK2,
+        .length = coap_encode_uint(value, COAP_BLOCK_VALUE(num, false, download->state.szx)),
+        .value = value
+    };
+    coap_request_t request = {
+        .method = COAP_METHOD_GET,
+        .uri_path = download->uri_path,
+        .timeout_ms = download->timeout_ms
+    };
+
+    coap_error_t err = coap_request_start(download->context, download->server_ip, download->server_port,
+                                          &request, &option, 1, coap_download_handler, download);
+    if (err == COAP_OK) {
+        download->in_flight++;
+    }
+    return err;
+}
+
+/**
+ * @brief Keep up to nstart block requests outstanding
+ */
+static void coap_download_fill(coap_block_download_t *download) {
+    uint8_t window = download->size_known ? download->context->nstart : 1;
+
+    while (download->error == COAP_OK && download->in_flight < window &&
+           download->next_request < download->state.next + COAP_BLOCK_WINDOW) {
+        if (download->first_seen && !download->size_known && download->in_flight > 0) {
+            break;  /* Size unknown: one block at a time until M=0 */
+        }
+        if (download->state.last_num >= 0 && download->next_request > (uint32_t)download->state.last_num) {
+            break;
+        }
+        coap_error_t err = coap_download_request(download, download->next_request);
+        if (err != COAP_OK) {
+            if (err != COAP_ERROR_BUSY || download->in_flight == 0) {
+                download->error = err;
             }
+            break;
         }
-        if (path_len > 1) {
-            uri_path[path_len - 1] = '\0';  /* Remove trailing slash */
+        download->next_request++;
+    }
+}
+
+static void coap_download_handler(coap_context_t *context, const coap_response_t *response, void *user_data) {
+    coap_block_download_t *download = user_data;
+    (void)context;
+
+    download->in_flight--;
+    if (download->error != COAP_OK) {
+        return;
+    }
+    if (response->error != COAP_OK) {
+        download->error = response->error;
+        return;
+    }
+    if (response->code != COAP_RESPONSE_205_CONTENT) {
+        download->error = COAP_ERROR_NOT_FOUND;
+        return;
+    }
+
+    /* No Block2: the whole body fit in one response */
+    uint32_t value = 0;
+    coap_option_t option;
+    bool block2 = coap_pdu_get_option(response->pdu, COAP_OPTION_BLOCK2, &option);
+    if (block2) {
+        value = coap_decode_uint(&option);
+    }
+    uint32_t num = COAP_BLOCK_NUM(value);
+    uint8_t szx = block2 ? COAP_BLOCK_SZX(value) : download->state.szx;
+
+    if (!download->first_seen) {
+        download->first_seen = true;
+        download->state.szx = szx;
+        download->next_request = num + 1;
+        if (coap_pdu_get_option(response->pdu, COAP_OPTION_SIZE2, &option)) {
+            uint32_t total = coap_decode_uint(&option);
+            uint32_t size = COAP_BLOCK_SIZE(szx);
+            download->state.last_num = total ? (int32_t)((total - 1) / size) : 0;
+            download->size_known = true;
         }
+    } else if (szx != download->state.szx) {
+        download->error = COAP_ERROR_INVALID_MESSAGE;
+        return;
+    }
 
-        /* Find resource */
-        coap_resource_t *resource = coap_find_resource(context, uri_path);
+    if (!COAP_BLOCK_MORE(value)) {
+        download->state.last_num = num;
+    }
 
-        /* Create response */
-        coap_pdu_t response;
-        coap_pdu_init(&response, COAP_TYPE_ACK, COAP_RESPONSE_404_NOT_FOUND, request.message_id);
-        coap_pdu_set_token(&response, request.token, request.token_length);
+    if (coap_block_mark(&download->state, num) > 0 &&
+        download->sink(download->user_data, num * COAP_BLOCK_SIZE(szx), response->payload,
+                       response->payload_length, coap_block_complete(&download->state)) != COAP_OK) {
+        download->error = COAP_ERROR_NO_MEMORY;
+    }
+}
 
-        if (resource) {
-            /* Call resource handler */
-            response.code = COAP_RESPONSE_205_CONTENT;
-            resource->handler(context, resource, &request, &response, resource->user_data);
+coap_error_t coap_block_download(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const char *uri_path,
+    coap_block_write_t sink,
+    void *user_data,
+    uint32_t timeout_ms
+) {
+    if (!context || !uri_path || !sink) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    coap_block_download_t download;
+    memset(&download, 0, sizeof(download));
+    download.context = context;
+    download.server_ip = server_ip;
+    download.server_port = server_port;
+    download.uri_path = uri_path;
+    download.timeout_ms = timeout_ms;
+    download.sink = sink;
+    download.user_data = user_data;
+    download.state.szx = context->block_szx;
+    download.state.last_num = -1;
+
+    sink(user_data, 0, NULL, 0, false);
+
+    /* Handlers reference the stack state, so wait for every request to finish */
+    coap_download_fill(&download);
+    while (download.in_flight > 0) {
+        coap_process(context, OS_WAIT_FOREVER);
+        if (!coap_block_complete(&download.state)) {
+            coap_download_fill(&download);
+        }
+    }
+
+    if (download.error == COAP_OK && !coap_block_complete(&download.state)) {
+        download.error = COAP_ERROR_INVALID_MESSAGE;
+    }
+    return download.error;
+}
+
+coap_error_t coap_block_upload(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const coap_request_t *request,
+    coap_block_read_t source,
+    void *user_data,
+    coap_response_t *response
+) {
+    if (!context || !request || !source || !response) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    uint8_t szx = context->block_szx;
+    uint8_t *buffer = os_malloc(COAP_BLOCK_SIZE(szx) + 1);
+    if (!buffer) {
+        return COAP_ERROR_NO_MEMORY;
+    }
+
+    coap_request_t block_request = *request;
+    uint32_t offset = 0;
+    coap_error_t err;
+    memset(response, 0, sizeof(*response));
+
+    while (1) {
+        uint16_t size = COAP_BLOCK_SIZE(szx);
+        uint32_t total_size = UINT32_MAX;
+        int32_t length = source(user_data, offset, buffer, size + 1, &total_size);
+        if (length < 0) {
+            err = COAP_ERROR_NOT_FOUND;
+            break;
+        }
+
+        bool more = length > size;
+        if (more) {
+            length = size;
+        }
+
+        uint8_t block_value[4], size_value[4];
+        coap_option_t options[2] = {
+            { COAP_OPTION_BLOCK1, 0, block_value },
+            { COAP_OPTION_SIZE1, 0, size_value }
+        };
+        options[0].length = coap_encode_uint(block_value, COAP_BLOCK_VALUE(offset / size, more, szx));
+        options[1].length = coap_encode_uint(size_value, total_size);
+        uint8_t option_count = (offset == 0 && total_size != UINT32_MAX) ? 2 : 1;
+
+        block_request.payload = buffer;
+        block_request.payload_length = length;
+
+        coap_response_free(response);
+        int32_t block1 = -1;
+        err = coap_request_sync(context, server_ip, server_port, &block_request,
+                                options, option_count, response, &block1);
+        if (err != COAP_OK || !more || response->code != COAP_RESPONSE_231_CONTINUE) {
+            break;  /* Done, failed, or the server answered early */
         }
 
-        /* Send response */
-        uint8_t resp_buffer[COAP_MAX_PDU_SIZE];
-        int len = coap_pdu_encode(&response, resp_buffer, sizeof(resp_buffer));
-        if (len > 0) {
-            net_sendto(context->socket_fd, resp_buffer, len, &from_addr);
+        /* The server may ask for smaller blocks; it then kept only that much */
+        if (block1 >= 0 && COAP_BLOCK_SZX(block1) < szx) {
+            szx = COAP_BLOCK_SZX(block1);
+            offset += COAP_BLOCK_SIZE(szx);
+        } else {
+            offset += length;
         }
     }
 
+    os_free(buffer);
+    return err;
+}
+
+/* ---- Filesystem bodies ---- */
+
+static int32_t coap_fd_read(void *user_data, uint32_t offset, uint8_t *buffer, uint16_t length,
+                            uint32_t *total_size) {
+    fs_file_t fd = *(fs_file_t *)user_data;
+    int32_t size = fs_size(fd);
+
+    if (size < 0 || fs_seek(fd, offset, FS_SEEK_SET) < 0) {
+        return -1;
+    }
+    *total_size = size;
+    return ((int32_t)offset >= size) ? 0 : fs_read(fd, buffer, length);
+}
+
+static coap_error_t coap_fd_write(void *user_data, uint32_t offset, const uint8_t *data, uint16_t length,
+                                  bool complete) {
+    fs_file_t fd = *(fs_file_t *)user_data;
+
+    if (!data) {
+        return fs_truncate(fd, 0) == OS_OK ? COAP_OK : COAP_ERROR_NO_MEMORY;
+    }
+    if (fs_seek(fd, offset, FS_SEEK_SET) < 0 || fs_write(fd, data, length) != length) {
+        return COAP_ERROR_NO_MEMORY;
+    }
+    if (complete) {
+        fs_sync(fd);
+    }
     return COAP_OK;
 }
 
+/* Server-side file bodies open the file per block: no descriptor is held between requests */
+static int32_t coap_file_read(void *user_data, uint32_t offset, uint8_t *buffer, uint16_t length,
+                              uint32_t *total_size) {
+    fs_file_t fd = fs_open((const char *)user_data, FS_O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    int32_t result = coap_fd_read(&fd, offset, buffer, length, total_size);
+    fs_close(fd);
+    return result;
+}
+
+static coap_error_t coap_file_write(void *user_data, uint32_t offset, const uint8_t *data, uint16_t length,
+                                    bool complete) {
+    uint32_t flags = FS_O_WRONLY | FS_O_CREAT | (data ? 0 : FS_O_TRUNC);
+    fs_file_t fd = fs_open((const char *)user_data, flags);
+    if (fd < 0) {
+        return COAP_ERROR_NO_MEMORY;
+    }
+    coap_error_t result = data ? coap_fd_write(&fd, offset, data, length, complete) : COAP_OK;
+    fs_close(fd);
+    return result;
+}
+
+coap_error_t coap_get_file(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const char *uri_path,
+    const char *file_path,
+    uint32_t timeout_ms
+) {
+    if (!file_path) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    fs_file_t fd = fs_open(file_path, FS_O_RDWR | FS_O_CREAT);
+    if (fd < 0) {
+        return COAP_ERROR_NOT_FOUND;
+    }
+
+    coap_error_t err = coap_block_download(context, server_ip, server_port, uri_path,
+                                           coap_fd_write, &fd, timeout_ms);
+    fs_close(fd);
+    return err;
+}
+
+coap_error_t coap_put_file(
+    coap_context_t *context,
+    uint32_t server_ip,
+    uint16_t server_port,
+    const char *uri_path,
+    const char *file_path,
+    coap_response_t *response,
+    uint32_t timeout_ms
+) {
+    if (!file_path) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    fs_file_t fd = fs_open(file_path, FS_O_RDONLY);
+    if (fd < 0) {
+        return COAP_ERROR_NOT_FOUND;
+    }
+
+    coap_request_t request = {
+        .method = COAP_METHOD_PUT,
+        .uri_path = uri_path,
+        .content_format = COAP_CONTENT_FORMAT_OCTET_STREAM,
+        .timeout_ms = timeout_ms
+    };
+    coap_error_t err = coap_block_upload(context, server_ip, server_port, &request,
+                                         coap_fd_read, &fd, response);
+    fs_close(fd);
+    return err;
+}
+
+/* ====================
+ * Duplicate Detection and Response Cache
+ * ==================== */
+
+/* Cached response: a tokenless encoded message (header, options, payload) */
+struct coap_cache_entry {
+    uint32_t expires_ms;                    /* Uptime at which the entry goes stale */
+    uint16_t length;
+    uint8_t message[];
+};
+
+static bool coap_expired(uint32_t expires_ms) {
+    return (int32_t)(expires_ms - os_get_uptime_ms()) <= 0;
+}
+
+static void coap_dedup_release(coap_dedup_entry_t *entry) {
+    if (entry->response) {
+        os_free(entry->response);
+        entry->response = NULL;
+    }
+    entry->in_use = false;
+}
+
+/**
+ * @brief Resend the stored response if this CON request is a duplicate
+ *
+ * @return true if the request was a duplicate and has been answered
+ */
+static bool coap_dedup_replay(coap_context_t *context, const coap_pdu_t *request, const sockaddr_in_t *from) {
+    for (int i = 0; i < COAP_DEDUP_ENTRIES; i++) {
+        coap_dedup_entry_t *entry = &context->dedup[i];
+        if (!entry->in_use) {
+            continue;
+        }
+        if (coap_expired(entry->expires_ms)) {
+            coap_dedup_release(entry);
+            continue;
+        }
+        if (entry->message_id == request->message_id && coap_peer_matches(&entry->peer, from)) {
+            net_sendto(context->socket_fd, entry->response, entry->response_length, from);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Remember the response to a CON request for EXCHANGE_LIFETIME
+ *
+ * When the table or the heap is full the oldest entries are dropped; a
+ * response that still cannot be stored is simply not deduplicated.
+ */
+static void coap_dedup_store(coap_context_t *context, const coap_pdu_t *request, const sockaddr_in_t *from,
+                             const net_buffer_t *tx) {
+    uint8_t *copy = NULL;
+
+    while (!copy) {
+        copy = os_malloc(tx->length);
+        if (copy) {
+            break;
+        }
+
+        coap_dedup_entry_t *oldest = NULL;
+        for (int i = 0; i < COAP_DEDUP_ENTRIES; i++) {
+            coap_dedup_entry_t *entry = &context->dedup[i];
+            if (entry->in_use && (!oldest || (int32_t)(entry->expires_ms - oldest->expires_ms) < 0)) {
+                oldest = entry;
+            }
+        }
+        if (!oldest) {
+            return;
+        }
+        coap_dedup_release(oldest);
+    }
+    memcpy(copy, tx->data + tx->offset, tx->length);
+
+    /* Free slot, else the one closest to expiry */
+    coap_dedup_entry_t *slot = NULL;
+    for (int i = 0; i < COAP_DEDUP_ENTRIES; i++) {
+        coap_dedup_entry_t *entry = &context->dedup[i];
+        if (!entry->in_use) {
+            slot = entry;
+            break;
+        }
+        if (!slot || (int32_t)(entry->expires_ms - slot->expires_ms) < 0) {
+            slot = entry;
+        }
+    }
+    coap_dedup_release(slot);
+
+    slot->in_use = true;
+    slot->message_id = request->message_id;
+    slot->peer.ip_address = COAP_IPV4(from->addr);
+    slot->peer.port = from->port;
+    slot->expires_ms = os_get_uptime_ms() + context->exchange_lifetime_ms;
+    slot->response = copy;
+    slot->response_length = tx->length;
+}
+
+static void coap_dedup_clear(coap_context_t *context) {
+    for (int i = 0; i < COAP_DEDUP_ENTRIES; i++) {
+        coap_dedup_release(&context->dedup[i]);
+    }
+}
+
+static void coap_cache_drop(struct coap_cache_entry **slot) {
+    if (*slot) {
+        os_free(*slot);
+        *slot = NULL;
+    }
+}
+
+void coap_resource_invalidate(coap_resource_t *resource) {
+    if (resource) {
+        coap_cache_drop(&resource->cache);
+    }
+}
+
+coap_error_t coap_resource_set_cache(coap_resource_t *resource, bool enable) {
+    if (!resource) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    resource->cacheable = enable;
+    coap_resource_invalidate(resource);
+
+    return COAP_OK;
+}
+
+/**
+ * @brief Whether a GET may be answered from, and stored in, the cache
+ *
+ * The cache holds one representation per resource, so requests that can
+ * select a different one, or that register an observer, bypass it.
+ */
+static bool coap_cache_applies(const coap_resource_t *resource, const coap_pdu_t *request) {
+    return resource->cacheable && request->code == COAP_METHOD_GET &&
+           !coap_pdu_get_option(request, COAP_OPTION_OBSERVE, NULL) &&
+           !coap_pdu_get_option(request, COAP_OPTION_URI_QUERY, NULL) &&
+           !coap_pdu_get_option(request, COAP_OPTION_ACCEPT, NULL);
+}
+
+/**
+ * @brief Build the response from a fresh cache entry
+ *
+ * Max-Age is rewritten to the entry's remaining lifetime. A stale entry
+ * is dropped.
+ *
+ * @return true if the response was served from the cache
+ */
+static bool coap_cache_serve(struct coap_cache_entry **slot, coap_pdu_t *response) {
+    struct coap_cache_entry *entry = *slot;
+    if (!entry) {
+        return false;
+    }
+    if (coap_expired(entry->expires_ms)) {
+        coap_cache_drop(slot);
+        return false;
+    }
+
+    coap_pdu_t cached;
+    if (coap_pdu_decode(&cached, entry->message, entry->length) != COAP_OK) {
+        coap_cache_drop(slot);
+        return false;
+    }
+
+    coap_option_iter_t iter;
+    coap_option_t option;
+    coap_option_iter_init(&cached, &iter);
+    while (coap_option_next(&cached, &iter, &option)) {
+        if (option.number != COAP_OPTION_MAX_AGE) {
+            coap_pdu_add_option(response, option.number, option.value, option.length);
+        }
+    }
+
+    uint8_t value[4];
+    uint32_t remaining = (entry->expires_ms - os_get_uptime_ms() + 999) / 1000;
+    coap_pdu_add_option(response, COAP_OPTION_MAX_AGE, value, coap_encode_uint(value, remaining));
+    coap_pdu_set_payload(response, cached.payload, cached.payload_length);
+    response->code = cached.code;
+
+    return true;
+}
+
+/**
+ * @brief 32-bit FNV-1a over the encoded options and payload, used as ETag
+ */
+static uint32_t coap_cache_etag(const coap_pdu_t *pdu) {
+    uint32_t hash = 2166136261u;
+    for (uint16_t i = pdu->options_offset; i < pdu->length; i++) {
+        hash = (hash ^ pdu->data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Give a 2.05 response without an ETag one derived from its content
+ */
+static void coap_cache_add_etag(coap_pdu_t *response) {
+    if (response->code != COAP_RESPONSE_205_CONTENT || coap_pdu_get_option(response, COAP_OPTION_ETAG, NULL)) {
+        return;
+    }
+
+    uint8_t value[4];
+    uint32_t etag = coap_cache_etag(response);
+    for (int i = 0; i < 4; i++) {
+        value[i] = etag >> (24 - 8 * i);
+    }
+    coap_pdu_add_option(response, COAP_OPTION_ETAG, value, sizeof(value));
+}
+
+/**
+ * @brief Store a fresh 2.05 response in slot, adding Max-Age if missing
+ *
+ * @param max_age Lifetime in seconds when the response has no Max-Age
+ */
+static void coap_cache_store(struct coap_cache_entry **slot, coap_pdu_t *response, uint32_t max_age) {
+    coap_cache_drop(slot);
+    if (response->code != COAP_RESPONSE_205_CONTENT) {
+        return;
+    }
+
+    uint8_t value[4];
+    coap_option_t option;
+    if (coap_pdu_get_option(response, COAP_OPTION_MAX_AGE, &option)) {
+        max_age = coap_decode_uint(&option);
+    } else {
+        coap_pdu_add_option(response, COAP_OPTION_MAX_AGE, value, coap_encode_uint(value, max_age));
+    }
+
+    if (max_age == 0) {
+        return;
+    }
+    if (max_age > 86400) {
+        max_age = 86400;    /* Keep expiry arithmetic well inside the uptime wrap */
+    }
+
+    uint16_t body_length = response->length - response->options_offset;
+    struct coap_cache_entry *entry = os_malloc(sizeof(*entry) + COAP_HEADER_SIZE + body_length);
+    if (!entry) {
+        return;
+    }
+
+    entry->expires_ms = os_get_uptime_ms() + max_age * 1000;
+    entry->length = COAP_HEADER_SIZE + body_length;
+    coap_write_header(entry->message, COAP_TYPE_ACK, response->code, 0, NULL, 0);
+    memcpy(entry->message + COAP_HEADER_SIZE, response->data + response->options_offset, body_length);
+    *slot = entry;
+}
+
+/**
+ * @brief Answer 2.03 Valid if the request names the response's ETag
+ *
+ * The 2.05 body is replaced by ETag and Max-Age only.
+ */
+static void coap_cache_validate(const coap_pdu_t *request, coap_pdu_t *response) {
+    coap_option_t etag;
+    if (response->code != COAP_RESPONSE_205_CONTENT ||
+        !coap_pdu_get_option(response, COAP_OPTION_ETAG, &etag)) {
+        return;
+    }
+
+    coap_option_iter_t iter;
+    coap_option_t option;
+    bool match = false;
+    coap_option_iter_init(request, &iter);
+    while (!match && coap_option_next(request, &iter, &option) && option.number <= COAP_OPTION_ETAG) {
+        match = option.number == COAP_OPTION_ETAG && option.length == etag.length &&
+                memcmp(option.value, etag.value, etag.length) == 0;
+    }
+    if (!match) {
+        return;
+    }
+
+    /* Values point into the response buffer, which is about to be rewritten */
+    uint8_t etag_value[8];
+    uint8_t etag_length = etag.length < sizeof(etag_value) ? etag.length : sizeof(etag_value);
+    memcpy(etag_value, etag.value, etag_length);
+
+    uint8_t max_age[4];
+    uint8_t max_age_length = 0;
+    bool has_max_age = coap_pdu_get_option(response, COAP_OPTION_MAX_AGE, &option);
+    if (has_max_age) {
+        max_age_length = coap_encode_uint(max_age, coap_decode_uint(&option));
+    }
+
+    coap_pdu_init_buffer(response, response->type, COAP_RESPONSE_203_VALID, response->message_id,
+                         response->data, response->size);
+    coap_pdu_set_token(response, request->token, request->token_length);
+    coap_pdu_add_option(response, COAP_OPTION_ETAG, etag_value, etag_length);
+    if (has_max_age) {
+        coap_pdu_add_option(response, COAP_OPTION_MAX_AGE, max_age, max_age_length);
+    }
+}
+
+/* ====================
+ * Forward Proxy
+ * ==================== */
+
+coap_error_t coap_proxy_start(coap_context_t *context, coap_proxy_t *proxy) {
+    if (!context || !proxy || !context->is_server) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    for (int i = 0; i < COAP_PROXY_MAX_PENDING; i++) {
+        proxy->pending[i].in_use = false;
+    }
+    for (int i = 0; i < COAP_PROXY_CACHE_ENTRIES; i++) {
+        proxy->cache[i].entry = NULL;
+    }
+    context->proxy = proxy;
+
+    return COAP_OK;
+}
+
+void coap_proxy_stop(coap_context_t *context) {
+    if (!context || !context->proxy) {
+        return;
+    }
+
+    coap_proxy_t *proxy = context->proxy;
+    for (int i = 0; i < COAP_PROXY_MAX_PENDING; i++) {
+        if (proxy->pending[i].in_use) {
+            coap_cancel_requests(context, &proxy->pending[i]);
+            proxy->pending[i].in_use = false;
+        }
+    }
+    for (int i = 0; i < COAP_PROXY_CACHE_ENTRIES; i++) {
+        coap_cache_drop(&proxy->cache[i].entry);
+    }
+    context->proxy = NULL;
+}
+
+static bool coap_proxy_target_equal(const coap_proxy_target_t *a, const coap_proxy_target_t *b) {
+    return a->server.ip_address == b->server.ip_address && a->server.port == b->server.port &&
+           strcmp(a->path, b->path) == 0 && strcmp(a->query, b->query) == 0;
+}
+
+/**
+ * @brief Append a segment to a delimited string
+ *
+ * @return false if it does not fit
+ */
+static bool coap_proxy_append(char *out, size_t size, char delimiter, const uint8_t *segment, size_t length) {
+    size_t used = strlen(out);
+    size_t needed = length + (used > 0 ? 1 : 0);
+    if (used + needed >= size) {
+        return false;
+    }
+    if (used > 0) {
+        out[used++] = delimiter;
+    }
+    memcpy(out + used, segment, length);
+    out[used + length] = '\0';
+    return true;
+}
+
+static bool coap_proxy_set_host(coap_proxy_target_t *target, const uint8_t *host, size_t length) {
+    char literal[16];
+    ipv4_addr_t ip;
+    if (length == 0 || length >= sizeof(literal)) {
+        return false;
+    }
+    memcpy(literal, host, length);
+    literal[length] = '\0';
+    if (!net_parse_ipv4(literal, &ip)) {
+        return false;
+    }
+    target->server.ip_address = COAP_IPV4(ip);
+    return true;
+}
+
+/**
+ * @brief Parse a Proxy-Uri of the form coap://host[:port][/path][?query]
+ *
+ * @return 0 on success, else the response code to answer with
+ */
+static uint8_t coap_proxy_parse_uri(const coap_option_t *uri, coap_proxy_target_t *target) {
+    static const char scheme[] = "coap://";
+    const uint8_t *p = uri->value;
+    const uint8_t *end = uri->value + uri->length;
+
+    if (uri->length < sizeof(scheme) - 1 || memcmp(p, scheme, sizeof(scheme) - 1) != 0) {
+        return COAP_RESPONSE_505_PROXYING_NOT_SUPPORTED;
+    }
+    p += sizeof(scheme) - 1;
+
+    const uint8_t *host = p;
+    while (p < end && *p != ':' && *p != '/' && *p != '?') {
+        p++;
+    }
+    if (!coap_proxy_set_host(target, host, p - host)) {
+        return COAP_RESPONSE_505_PROXYING_NOT_SUPPORTED;  /* Names would need DNS */
+    }
+
+    if (p < end && *p == ':') {
+        uint32_t port = 0;
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            port = port * 10 + (*p - '0');
+            if (port > 0xFFFF) {
+                return COAP_RESPONSE_402_BAD_OPTION;
+            }
+        }
+        target->server.port = port;
+    }
+
+    while (p < end && *p == '/') {
+        const uint8_t *segment = ++p;
+        while (p < end && *p != '/' && *p != '?') {
+            p++;
+        }
+        if (p > segment && !coap_proxy_append(target->path, sizeof(target->path), '/', segment, p - segment)) {
+            return COAP_RESPONSE_402_BAD_OPTION;
+        }
+    }
+
+    while (p < end && (*p == '?' || *p == '&')) {
+        const uint8_t *argument = ++p;
+        while (p < end && *p != '&') {
+            p++;
+        }
+        if (p > argument && !coap_proxy_append(target->query, sizeof(target->query), '&', argument, p - argument)) {
+            return COAP_RESPONSE_402_BAD_OPTION;
+        }
+    }
+
+    return (p == end) ? 0 : COAP_RESPONSE_402_BAD_OPTION;
+}
+
+/**
+ * @brief Resolve the upstream target from Proxy-Uri, or from Proxy-Scheme
+ *        and the Uri-Host, Uri-Port, Uri-Path and Uri-Query options
+ *
+ * @return 0 on success, else the response code to answer with
+ */
+static uint8_t coap_proxy_parse(const coap_pdu_t *request, coap_proxy_target_t *target) {
+    memset(target, 0, sizeof(*target));
+    target->server.port = COAP_DEFAULT_PORT;
+
+    coap_option_t option;
+    if (coap_pdu_get_option(request, COAP_OPTION_PROXY_URI, &option)) {
+        return coap_proxy_parse_uri(&option, target);
+    }
+
+    if (!coap_pdu_get_option(request, COAP_OPTION_PROXY_SCHEME, &option) ||
+        option.length != 4 || memcmp(option.value, "coap", 4) != 0) {
+        return COAP_RESPONSE_505_PROXYING_NOT_SUPPORTED;
+    }
+
+    bool have_host = false;
+    coap_option_iter_t iter;
+    coap_option_iter_init(request, &iter);
+    while (coap_option_next(request, &iter, &option)) {
+        bool ok = true;
+        switch (option.number) {
+        case COAP_OPTION_URI_HOST:
+            if (!coap_proxy_set_host(target, option.value, option.length)) {
+                return COAP_RESPONSE_505_PROXYING_NOT_SUPPORTED;
+            }
+            have_host = true;
+            break;
+        case COAP_OPTION_URI_PORT:
+            target->server.port = coap_decode_uint(&option);
+            break;
+        case COAP_OPTION_URI_PATH:
+            ok = coap_proxy_append(target->path, sizeof(target->path), '/', option.value, option.length);
+            break;
+        case COAP_OPTION_URI_QUERY:
+            ok = coap_proxy_append(target->query, sizeof(target->query), '&', option.value, option.length);
+            break;
+        default:
+            break;
+        }
+        if (!ok) {
+            return COAP_RESPONSE_402_BAD_OPTION;
+        }
+    }
+
+    return have_host ? 0 : COAP_RESPONSE_400_BAD_REQUEST;
+}
+
+/**
+ * @brief Cache slot for target; with create, a free or the stalest slot is claimed
+ */
+static coap_proxy_cached_t *coap_proxy_cache_slot(coap_proxy_t *proxy, const coap_proxy_target_t *target,
+                                                  bool create) {
+    coap_proxy_cached_t *victim = NULL;
+
+    for (int i = 0; i < COAP_PROXY_CACHE_ENTRIES; i++) {
+        coap_proxy_cached_t *slot = &proxy->cache[i];
+        if (slot->entry && coap_proxy_target_equal(&slot->target, target)) {
+            return slot;
+        }
+        if (!victim || (victim->entry && (!slot->entry ||
+                        (int32_t)(slot->entry->expires_ms - victim->entry->expires_ms) < 0))) {
+            victim = slot;
+        }
+    }
+
+    if (!create) {
+        return NULL;
+    }
+    coap_cache_drop(&victim->entry);
+    victim->target = *target;
+    return victim;
+}
+
+/**
+ * @brief Send the upstream response to every waiter
+ *
+ * Built once in tx with no token, like an Observe notification; each
+ * waiter's header and token are written in front of the shared body.
+ */
+static void coap_proxy_fanout(coap_context_t *context, const coap_proxy_pending_t *pending,
+                              const coap_pdu_t *reply, net_buffer_t *tx) {
+    uint8_t *body = reply->data + reply->options_offset;
+    uint16_t body_length = reply->length - reply->options_offset;
+
+    for (uint8_t i = 0; i < pending->waiter_count; i++) {
+        const coap_proxy_waiter_t *waiter = &pending->waiters[i];
+        coap_send_separate(context, tx, body, body_length, reply->code, &waiter->peer,
+                           waiter->token, waiter->token_length, waiter->confirmable);
+    }
+}
+
+/**
+ * @brief Upstream exchange finished: cache and relay the result
+ */
+static void coap_proxy_response(coap_context_t *context, const coap_response_t *response, void *user_data) {
+    coap_proxy_pending_t *pending = user_data;
+    coap_proxy_t *proxy = context->proxy;
+
+    coap_pdu_t reply;
+    net_buffer_t *tx = coap_tx_alloc(&reply, COAP_TYPE_NON, COAP_RESPONSE_502_BAD_GATEWAY, 0);
+    if (tx) {
+        if (response->pdu) {
+            coap_option_iter_t iter;
+            coap_option_t option;
+            coap_option_iter_init(response->pdu, &iter);
+            while (coap_option_next(response->pdu, &iter, &option)) {
+                coap_pdu_add_option(&reply, option.number, option.value, option.length);
+            }
+            coap_pdu_set_payload(&reply, response->pdu->payload, response->pdu->payload_length);
+            reply.code = response->pdu->code;
+
+            if (proxy && pending->coalescable) {
+                coap_proxy_cached_t *slot = coap_proxy_cache_slot(proxy, &pending->target, true);
+                coap_cache_store(&slot->entry, &reply, 60);
+            }
+        } else if (response->error == COAP_ERROR_TIMEOUT || response->error == COAP_ERROR_MAX_RETRANSMIT) {
+            reply.code = COAP_RESPONSE_504_GATEWAY_TIMEOUT;
+        }
+
+        coap_proxy_fanout(context, pending, &reply, tx);
+        net_buffer_free(tx);
+    }
+
+    pending->in_use = false;
+}
+
+static bool coap_proxy_is_waiting(const coap_proxy_pending_t *pending, const coap_pdu_t *request,
+                                  const sockaddr_in_t *from) {
+    for (uint8_t i = 0; i < pending->waiter_count; i++) {
+        const coap_proxy_waiter_t *waiter = &pending->waiters[i];
+        if (coap_peer_matches(&waiter->peer, from) && waiter->token_length == request->token_length &&
+            memcmp(waiter->token, request->token, request->token_length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Add a client to a pending upstream request
+ *
+ * @return false if the request has no room for another waiter
+ */
+static bool coap_proxy_add_waiter(coap_proxy_pending_t *pending, const coap_pdu_t *request,
+                                  const sockaddr_in_t *from) {
+    if (pending->waiter_count >= COAP_PROXY_MAX_WAITERS) {
+        return false;
+    }
+
+    coap_proxy_waiter_t *waiter = &pending->waiters[pending->waiter_count++];
+    waiter->peer.ip_address = COAP_IPV4(from->addr);
+    waiter->peer.port = from->port;
+    memcpy(waiter->token, request->token, request->token_length);
+    waiter->token_length = request->token_length;
+    waiter->confirmable = (request->type == COAP_TYPE_CON);
+    return true;
+}
+
+/**
+ * @brief Answer from the cache, join a pending request, or go upstream
+ *
+ * @return 0 if the response will follow separately, else the code of the
+ *         piggybacked response built in response
+ */
+static uint8_t coap_proxy_forward(coap_context_t *context, coap_proxy_t *proxy, const coap_pdu_t *request,
+                                  const sockaddr_in_t *from, const coap_proxy_target_t *target,
+                                  coap_pdu_t *response) {
+    bool get = (request->code == COAP_METHOD_GET);
+    coap_proxy_pending_t *pending = NULL;
+
+    /* A retransmission whose empty ACK was lost is already being served */
+    for (int i = 0; i < COAP_PROXY_MAX_PENDING; i++) {
+        if (proxy->pending[i].in_use && coap_proxy_is_waiting(&proxy->pending[i], request, from)) {
+            return 0;
+        }
+    }
+
+    if (get) {
+        coap_proxy_cached_t *slot = coap_proxy_cache_slot(proxy, target, false);
+        if (slot && coap_cache_serve(&slot->entry, response)) {
+            proxy->cache_hits++;
+            return response->code;
+        }
+
+        for (int i = 0; i < COAP_PROXY_MAX_PENDING; i++) {
+            coap_proxy_pending_t *candidate = &proxy->pending[i];
+            if (candidate->in_use && candidate->coalescable &&
+                coap_proxy_target_equal(&candidate->target, target)) {
+                if (!coap_proxy_add_waiter(candidate, request, from)) {
+                    return COAP_RESPONSE_503_SERVICE_UNAVAILABLE;
+                }
+                proxy->coalesced++;
+                return 0;
+            }
+        }
+    } else {
+        coap_proxy_cached_t *slot = coap_proxy_cache_slot(proxy, target, false);
+        if (slot) {
+            coap_cache_drop(&slot->entry);
+        }
+    }
+
+    for (int i = 0; i < COAP_PROXY_MAX_PENDING && !pending; i++) {
+        if (!proxy->pending[i].in_use) {
+            pending = &proxy->pending[i];
+        }
+    }
+    if (!pending) {
+        return COAP_RESPONSE_503_SERVICE_UNAVAILABLE;
+    }
+
+    pending->coalescable = get;
+    pending->target = *target;
+    pending->waiter_count = 0;
+    coap_proxy_add_waiter(pending, request, from);
+
+    coap_option_t format;
+    coap_request_t upstream = {
+        .method = (coap_method_t)request->code,
+        .uri_path = target->path,
+        .uri_query = target->query,
+        .content_format = coap_pdu_get_option(request, COAP_OPTION_CONTENT_FORMAT, &format) ?
+                          (coap_content_format_t)coap_decode_uint(&format) : COAP_CONTENT_FORMAT_OCTET_STREAM,
+        .payload = request->payload,
+        .payload_length = request->payload_length,
+        .timeout_ms = proxy->timeout_ms
+    };
+
+    coap_error_t err = coap_request_start(context, target->server.ip_address, target->server.port,
+                                          &upstream, NULL, 0, coap_proxy_response, pending);
+    if (err != COAP_OK) {
+        return (err == COAP_ERROR_BUSY) ? COAP_RESPONSE_503_SERVICE_UNAVAILABLE
+                                        : COAP_RESPONSE_500_INTERNAL_ERROR;
+    }
+
+    pending->in_use = true;
+    proxy->upstream++;
+    return 0;
+}
+
+/**
+ * @brief Handle a request carrying Proxy-Uri or Proxy-Scheme
+ */
+static void coap_proxy_request(coap_context_t *context, const coap_pdu_t *request, const sockaddr_in_t *from) {
+    coap_pdu_t response;
+    coap_msg_type_t type = (request->type == COAP_TYPE_CON) ? COAP_TYPE_ACK : COAP_TYPE_NON;
+    net_buffer_t *tx = coap_tx_alloc(&response, type, COAP_RESPONSE_505_PROXYING_NOT_SUPPORTED,
+                                     request->message_id);
+    if (!tx) {
+        return;
+    }
+    coap_pdu_set_token(&response, request->token, request->token_length);
+
+    coap_proxy_t *proxy = context->proxy;
+    if (proxy) {
+        coap_proxy_target_t target;
+        proxy->requests++;
+        response.code = coap_proxy_parse(request, &target);
+        if (response.code == 0) {
+            response.code = coap_proxy_forward(context, proxy, request, from, &target, &response);
+        }
+    }
+
+    if (response.code != 0) {
+        coap_tx_finalize(tx, &response);
+        net_sendto_buffer(context->socket_fd, tx, from);
+    } else if (request->type == COAP_TYPE_CON) {
+        /* The upstream answer follows as a separate response */
+        coap_send_empty(context, COAP_TYPE_ACK, request->message_id, from);
+    }
+    net_buffer_free(tx);
+}
+
+/* ====================
+ * Separate Responses
+ * ==================== */
+
+coap_exchange_t *coap_response_defer(coap_context_t *context, const coap_pdu_t *request) {
+    if (!context || !request || !context->request_from || context->deferred) {
+        return NULL;
+    }
+
+    for (int i = 0; i < COAP_MAX_EXCHANGES; i++) {
+        coap_exchange_t *exchange = &context->exchanges[i];
+        if (exchange->state != COAP_EXCHANGE_FREE) {
+            continue;
+        }
+
+        exchange->confirmable = (request->type == COAP_TYPE_CON);
+        exchange->peer.ip_address = COAP_IPV4(context->request_from->addr);
+        exchange->peer.port = context->request_from->port;
+        memcpy(exchange->token, request->token, request->token_length);
+        exchange->token_length = request->token_length;
+        exchange->payload = NULL;
+        exchange->payload_length = 0;
+        exchange->state = COAP_EXCHANGE_WAITING;
+        context->deferred = exchange;
+        return exchange;
+    }
+    return NULL;
+}
+
+coap_error_t coap_response_complete(
+    coap_context_t *context,
+    coap_exchange_t *exchange,
+    uint8_t code,
+    coap_content_format_t content_format,
+    const uint8_t *payload,
+    uint16_t payload_length
+) {
+    if (!context || !exchange || payload_length > COAP_MAX_PAYLOAD_SIZE) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    /* Claim the exchange: of two completers, only one gets past here */
+    uint32_t state = os_enter_critical();
+    if (exchange->state != COAP_EXCHANGE_WAITING) {
+        os_exit_critical(state);
+        return COAP_ERROR_INVALID_PARAM;
+    }
+    exchange->state = COAP_EXCHANGE_COMPLETING;
+    os_exit_critical(state);
+
+    if (payload_length > 0) {
+        exchange->payload = os_malloc(payload_length);
+        if (!exchange->payload) {
+            exchange->state = COAP_EXCHANGE_WAITING;
+            return COAP_ERROR_NO_MEMORY;
+        }
+        memcpy(exchange->payload, payload, payload_length);
+    }
+    exchange->payload_length = payload_length;
+    exchange->code = code;
+    exchange->content_format = content_format;
+
+    /* Published last: the server task only reads a READY exchange */
+    state = os_enter_critical();
+    exchange->state = COAP_EXCHANGE_READY;
+    os_exit_critical(state);
+
+    os_event_group_set_bits(&context->events, COAP_EVENT_DEFERRED);
+    return COAP_OK;
+}
+
+static void coap_exchange_release(coap_exchange_t *exchange) {
+    if (exchange->payload) {
+        os_free(exchange->payload);
+        exchange->payload = NULL;
+    }
+    exchange->state = COAP_EXCHANGE_FREE;
+}
+
+/**
+ * @brief Whether a deferred exchange is still open for this request
+ */
+static bool coap_exchange_pending(coap_context_t *context, const coap_pdu_t *request, const sockaddr_in_t *from) {
+    for (int i = 0; i < COAP_MAX_EXCHANGES; i++) {
+        const coap_exchange_t *exchange = &context->exchanges[i];
+        if (exchange->state != COAP_EXCHANGE_FREE && coap_peer_matches(&exchange->peer, from) &&
+            exchange->token_length == request->token_length &&
+            memcmp(exchange->token, request->token, request->token_length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Send the responses completed since the last call (server task)
+ */
+static void coap_send_deferred(coap_context_t *context) {
+    for (int i = 0; i < COAP_MAX_EXCHANGES; i++) {
+        coap_exchange_t *exchange = &context->exchanges[i];
+        if (exchange->state != COAP_EXCHANGE_READY) {
+            continue;
+        }
+
+        coap_pdu_t response;
+        net_buffer_t *tx = coap_tx_alloc(&response, COAP_TYPE_NON, exchange->code, 0);
+        if (!tx) {
+            os_event_group_set_bits(&context->events, COAP_EVENT_DEFERRED);  /* Retry next call */
+            return;
+        }
+
+        uint8_t code = exchange->code;
+        if (exchange->payload_length > 0) {
+            uint8_t format[2];
+            if (coap_pdu_add_option(&response, COAP_OPTION_CONTENT_FORMAT, format,
+                                    coap_encode_uint(format, exchange->content_format)) != COAP_OK ||
+                coap_pdu_set_payload(&response, exchange->payload, exchange->payload_length) != COAP_OK) {
+                /* Never a success code without the body it stands for */
+                code = COAP_RESPONSE_500_INTERNAL_ERROR;
+                response.length = response.options_offset;
+            }
+        }
+
+        coap_send_separate(context, tx, response.data + response.options_offset,
+                           response.length - response.options_offset, code, &exchange->peer,
+                           exchange->token, exchange->token_length, exchange->confirmable);
+        net_buffer_free(tx);
+        coap_exchange_release(exchange);
+    }
+}
+
+/* ====================
+ * Group Communication
+ * ==================== */
+
+coap_error_t coap_join_group(coap_context_t *context, ipv4_addr_t group) {
+    if (!context || !context->is_server || context->socket_fd < 0 || !IPV4_IS_MULTICAST(group)) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    int free_slot = -1;
+    for (int i = 0; i < COAP_MAX_GROUPS; i++) {
+        if (context->groups[i] == COAP_IPV4(group)) {
+            return COAP_OK;
+        }
+        if (!context->groups[i] && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0) {
+        return COAP_ERROR_BUSY;
+    }
+
+    if (net_multicast_join(group) != OS_OK) {
+        return COAP_ERROR_NETWORK;
+    }
+    context->groups[free_slot] = COAP_IPV4(group);
+    return COAP_OK;
+}
+
+coap_error_t coap_leave_group(coap_context_t *context, ipv4_addr_t group) {
+    if (!context) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    for (int i = 0; i < COAP_MAX_GROUPS; i++) {
+        if (context->groups[i] && context->groups[i] == COAP_IPV4(group)) {
+            context->groups[i] = 0;
+            net_multicast_leave(group);
+            return COAP_OK;
+        }
+    }
+    return COAP_ERROR_INVALID_PARAM;
+}
+
+coap_error_t coap_group_request(
+    coap_context_t *context,
+    uint32_t group_ip,
+    uint16_t port,
+    const coap_request_t *request,
+    coap_response_handler_t handler,
+    void *user_data
+) {
+    if (!context || !request || !request->uri_path || context->socket_fd < 0) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    coap_transaction_t *transaction = coap_transaction_alloc(context);
+    if (!transaction) {
+        return COAP_ERROR_BUSY;
+    }
+
+    /* Multicast requests are NON (RFC 7252, 8.1): nothing to retransmit */
+    coap_pdu_t pdu;
+    uint16_t msg_id = coap_generate_message_id(context);
+    net_buffer_t *tx = coap_tx_alloc(&pdu, COAP_TYPE_NON, request->method, msg_id);
+    if (!tx) {
+        return COAP_ERROR_NO_MEMORY;
+    }
+
+    uint8_t token[4];
+    coap_generate_token(context, token, sizeof(token));
+    coap_pdu_set_token(&pdu, token, sizeof(token));
+
+    coap_error_t err = coap_request_encode(&pdu, request, NULL, 0);
+    if (err != COAP_OK) {
+        net_buffer_free(tx);
+        return err;
+    }
+    coap_tx_finalize(tx, &pdu);
+
+    transaction->in_use = true;
+    transaction->acked = false;
+    transaction->notification = false;
+    transaction->group = true;
+    transaction->retransmit_count = 0;
+    transaction->message_id = msg_id;
+    memcpy(transaction->token, token, sizeof(token));
+    transaction->token_length = sizeof(token);
+    transaction->peer.ip_address = group_ip;
+    transaction->peer.port = port;
+    transaction->handler = handler ? handler : context->response_handler;
+    transaction->user_data = user_data;
+    transaction->context = context;
+
+    /* Servers wait up to their leisure before answering */
+    transaction->timeout_ms = request->timeout_ms ? request->timeout_ms :
+                              context->leisure_ms + context->ack_timeout_ms;
+    os_timer_create(&transaction->timer, "coap", TIMER_ONE_SHOT, transaction->timeout_ms,
+                    coap_transaction_timeout, transaction);
+
+    sockaddr_in_t dest_addr = coap_sockaddr(group_ip, port);
+    if (net_sendto_buffer(context->socket_fd, tx, &dest_addr) < 0) {
+        coap_transaction_release(transaction);
+        net_buffer_free(tx);
+        return COAP_ERROR_NETWORK;
+    }
+    net_buffer_free(tx);
+
+    coap_transaction_arm(transaction, transaction->timeout_ms);
+    return COAP_OK;
+}
+
+/**
+ * @brief Leisure timer callback (tick context)
+ */
+static void coap_leisure_timeout(void *param) {
+    coap_context_t *context = param;
+    os_event_group_set_bits(&context->events, COAP_EVENT_LEISURE);
+}
+
+/**
+ * @brief Arm the leisure timer for the earliest held response
+ */
+static void coap_leisure_arm(coap_context_t *context) {
+    uint32_t now = os_get_uptime_ms();
+    uint32_t next = UINT32_MAX;
+
+    for (int i = 0; i < COAP_MAX_LEISURE; i++) {
+        const coap_leisure_t *held = &context->leisure[i];
+        if (held->in_use) {
+            int32_t wait = (int32_t)(held->send_at - now);
+            if (wait < 1) {
+                wait = 1;
+            }
+            if ((uint32_t)wait < next) {
+                next = wait;
+            }
+        }
+    }
+
+    if (next != UINT32_MAX) {
+        os_timer_change_period(&context->leisure_timer, next);
+        os_timer_start(&context->leisure_timer);
+    }
+}
+
+/**
+ * @brief Hold a finalized group response back for a random leisure
+ *
+ * With no free slot or memory the response is dropped, as if lost: the
+ * group client gets one answer fewer.
+ */
+static void coap_leisure_hold(coap_context_t *context, const net_buffer_t *tx, const sockaddr_in_t *to) {
+    for (int i = 0; i < COAP_MAX_LEISURE; i++) {
+        coap_leisure_t *held = &context->leisure[i];
+        if (held->in_use) {
+            continue;
+        }
+
+        held->message = os_malloc(tx->length);
+        if (!held->message) {
+            return;
+        }
+        memcpy(held->message, tx->data + tx->offset, tx->length);
+        held->length = tx->length;
+        held->peer.ip_address = COAP_IPV4(to->addr);
+        held->peer.port = to->port;
+        held->send_at = os_get_uptime_ms() + coap_random(context) % context->leisure_ms;
+        held->in_use = true;
+
+        coap_leisure_arm(context);
+        return;
+    }
+}
+
+/**
+ * @brief Send the group responses whose leisure has passed
+ */
+static void coap_send_leisure(coap_context_t *context) {
+    for (int i = 0; i < COAP_MAX_LEISURE; i++) {
+        coap_leisure_t *held = &context->leisure[i];
+        if (held->in_use && coap_expired(held->send_at)) {
+            sockaddr_in_t dest_addr = coap_sockaddr(held->peer.ip_address, held->peer.port);
+            net_sendto(context->socket_fd, held->message, held->length, &dest_addr);
+            os_free(held->message);
+            held->message = NULL;
+            held->in_use = false;
+        }
+    }
+    coap_leisure_arm(context);
+}
+
+static void coap_leisure_clear(coap_context_t *context) {
+    for (int i = 0; i < COAP_MAX_LEISURE; i++) {
+        if (context->leisure[i].in_use) {
+            os_free(context->leisure[i].message);
+            context->leisure[i].message = NULL;
+            context->leisure[i].in_use = false;
+        }
+    }
+}
+
+/* ====================
+ * Server API
+ * ==================== */
+
+/* Path-segment trie node; siblings are kept sorted so discovery output is stable */
+struct coap_path_node {
+    struct coap_path_node *child;           /* First child */
+    struct coap_path_node *sibling;         /* Next child of the same parent */
+    coap_resource_t *resource;              /* Resource registered at this path, or NULL */
+    uint8_t length;
+    char segment[];
+};
+
+static bool coap_path_is_wildcard(const struct coap_path_node *node) {
+    return node->length == 1 && node->segment[0] == '*';
+}
+
+static struct coap_path_node *coap_path_node_create(const char *segment, uint8_t length) {
+    struct coap_path_node *node = os_malloc(sizeof(*node) + length);
+    if (node) {
+        memset(node, 0, sizeof(*node));
+        memcpy(node->segment, segment, length);
+        node->length = length;
+    }
+    return node;
+}
+
+/**
+ * @brief Find or insert the child of node for one path segment
+ */
+static struct coap_path_node *coap_path_child(struct coap_path_node *node, const char *segment, uint8_t length) {
+    struct coap_path_node **link = &node->child;
+
+    while (*link) {
+        const struct coap_path_node *child = *link;
+        int order = memcmp(child->segment, segment, child->length < length ? child->length : length);
+        if (order == 0) {
+            order = child->length - length;
+        }
+        if (order == 0) {
+            return *link;
+        }
+        if (order > 0) {
+            break;
+        }
+        link = &(*link)->sibling;
+    }
+
+    struct coap_path_node *child = coap_path_node_create(segment, length);
+    if (child) {
+        child->sibling = *link;
+        *link = child;
+    }
+    return child;
+}
+
+/**
+ * @brief Add a resource to the trie under its uri_path
+ */
+static coap_error_t coap_path_add(coap_context_t *context, coap_resource_t *resource) {
+    if (!context->routes) {
+        context->routes = coap_path_node_create("", 0);
+        if (!context->routes) {
+            return COAP_ERROR_NO_MEMORY;
+        }
+    }
+
+    struct coap_path_node *node = context->routes;
+    const char *path = resource->uri_path;
+    while (*path) {
+        const char *end = path;
+        while (*end && *end != '/') {
+            end++;
+        }
+        if (end > path) {
+            node = coap_path_child(node, path, end - path);
+            if (!node) {
+                return COAP_ERROR_NO_MEMORY;
+            }
+        }
+        path = *end ? end + 1 : end;
+    }
+
+    if (node->resource) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+    node->resource = resource;
+    return COAP_OK;
+}
+
+static void coap_path_free(struct coap_path_node *node) {
+    while (node) {
+        struct coap_path_node *next = node->sibling;
+        coap_path_free(node->child);
+        os_free(node);
+        node = next;
+    }
+}
+
+/* Link-format writer: keeps only the bytes in [offset, offset + length) */
+typedef struct {
+    uint8_t *buffer;
+    uint32_t offset;
+    uint16_t length;
+    uint32_t position;                      /* Bytes generated so far */
+} coap_link_writer_t;
+
+static void coap_link_put(coap_link_writer_t *writer, const char *text) {
+    for (; *text; text++, writer->position++) {
+        if (writer->position >= writer->offset && writer->position - writer->offset < writer->length) {
+            writer->buffer[writer->position - writer->offset] = *text;
+        }
+    }
+}
+
+static void coap_well_known_handler(coap_context_t *context, coap_resource_t *resource,
+                                    const coap_pdu_t *request, coap_pdu_t *response, void *user_data);
+
+/**
+ * @brief Emit a link for every resource at or below node, depth first
+ *
+ * Wildcard branches are templates, not resources, and are left out.
+ */
+static void coap_link_walk(const struct coap_path_node *node, coap_link_writer_t *writer) {
+    for (; node; node = node->sibling) {
+        if (coap_path_is_wildcard(node)) {
+            continue;
+        }
+
+        const coap_resource_t *resource = node->resource;
+        if (resource && resource->handler != coap_well_known_handler) {
+            if (writer->position > 0) {
+                coap_link_put(writer, ",");
+            }
+            coap_link_put(writer, "<");
+            coap_link_put(writer, resource->uri_path);
+            coap_link_put(writer, ">");
+            if (resource->observable) {
+                coap_link_put(writer, ";obs");
+            }
+            if (resource->link_attributes) {
+                coap_link_put(writer, ";");
+                coap_link_put(writer, resource->link_attributes);
+            }
+        }
+        coap_link_walk(node->child, writer);
+    }
+}
+
+/**
+ * @brief Block source for /.well-known/core, regenerated from the trie per block
+ */
+static int32_t coap_well_known_read(void *user_data, uint32_t offset, uint8_t *buffer, uint16_t length,
+                                    uint32_t *total_size) {
+    coap_context_t *context = user_data;
+    coap_link_writer_t writer = { buffer, offset, length, 0 };
+
+    coap_link_walk(context->routes, &writer);
+
+    *total_size = writer.position;
+    if (offset >= writer.position) {
+        return 0;
+    }
+    return (writer.position - offset < length) ? (int32_t)(writer.position - offset) : length;
+}
+
+static void coap_well_known_handler(coap_context_t *context, coap_resource_t *resource,
+                                    const coap_pdu_t *request, coap_pdu_t *response, void *user_data) {
+    (void)context;
+    (void)resource;
+    (void)request;
+    (void)user_data;
+
+    /* GET is served by coap_well_known_read() */
+    response->code = COAP_RESPONSE_405_METHOD_NOT_ALLOWED;
+}
+
+static void coap_well_known_register(coap_context_t *context) {
+    coap_resource_t *resource = coap_resource_create(context, "/.well-known/core", coap_well_known_handler, NULL);
+    if (resource) {
+        resource->content_format = COAP_CONTENT_FORMAT_LINK_FORMAT;
+        coap_resource_set_block_handlers(resource, coap_well_known_read, NULL, context);
+    }
+}
+
+coap_resource_t *coap_resource_create(
+    coap_context_t *context,
+    const char *uri_path,
+    coap_resource_handler_t handler,
+    void *user_data
+) {
+    if (!context || !uri_path || !handler) {
+        return NULL;
+    }
+
+    coap_resource_t *resource = os_malloc(sizeof(coap_resource_t));
+    if (!resource) {
+        return NULL;
+    }
+
+    /* Stored with a leading '/', as listed in /.well-known/core */
+    size_t start = (uri_path[0] == '/') ? 0 : 1;
+    memset(resource, 0, sizeof(coap_resource_t));
+    resource->uri_path[0] = '/';
+    strncpy(resource->uri_path + start, uri_path, sizeof(resource->uri_path) - 1 - start);
+    resource->handler = handler;
+    resource->user_data = user_data;
+    resource->observable = false;
+    resource->max_age = 60;
+    resource->content_format = COAP_CONTENT_FORMAT_OCTET_STREAM;
+
+    if (coap_path_add(context, resource) != COAP_OK) {
+        os_free(resource);
+        return NULL;
+    }
+
+    resource->next = context->resources;
+    context->resources = resource;
+
+    return resource;
+}
+
+coap_error_t coap_resource_set_observable(coap_resource_t *resource, uint32_t max_age) {
+    if (!resource) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    resource->observable = true;
+    resource->max_age = max_age;
+
+    return COAP_OK;
+}
+
+coap_error_t coap_resource_set_link_attributes(coap_resource_t *resource, const char *attributes) {
+    if (!resource) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    resource->link_attributes = attributes;
+
+    return COAP_OK;
+}
+
+coap_error_t coap_resource_set_block_handlers(
+    coap_resource_t *resource,
+    coap_block_read_t read,
+    coap_block_write_t write,
+    void *user_data
+) {
+    if (!resource) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    resource->block_read = read;
+    resource->block_write = write;
+    resource->block_user_data = user_data;
+    memset(&resource->block_rx, 0, sizeof(resource->block_rx));
+
+    return COAP_OK;
+}
+
+coap_error_t coap_resource_set_file(coap_resource_t *resource, const char *file_path) {
+    if (!resource || !file_path) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    size_t length = strlen(file_path) + 1;
+    char *copy = os_malloc(length);
+    if (!copy) {
+        return COAP_ERROR_NO_MEMORY;
+    }
+    memcpy(copy, file_path, length);
+
+    if (resource->file_path) {
+        os_free(resource->file_path);
+    }
+    resource->file_path = copy;
+
+    return coap_resource_set_block_handlers(resource, coap_file_read, coap_file_write, copy);
+}
+
+/**
+ * @brief CON notification finished: an ACK keeps the observer, anything else drops it
+ */
+static void coap_observe_con_done(coap_context_t *context, const coap_response_t *response, void *user_data) {
+    coap_observer_t *observer = user_data;
+    (void)context;
+
+    observer->con_pending = false;
+    if (response->error != COAP_OK) {
+        observer->in_use = false;
+    }
+}
+
+/**
+ * @brief An RST answering a NON notification cancels that observation
+ */
+static void coap_observe_reset(coap_context_t *context, uint16_t message_id, const sockaddr_in_t *from) {
+    for (coap_resource_t *resource = context->resources; resource; resource = resource->next) {
+        for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+            coap_observer_t *observer = &resource->observers[i];
+            if (observer->in_use && observer->last_message_id == message_id &&
+                coap_peer_matches(&observer->peer, from)) {
+                observer->in_use = false;
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Send one encoded notification to every observer
+ *
+ * The notification is built in tx with no token. Each observer's header
+ * and token are then written directly in front of the shared options and
+ * payload, and the same buffer is sent again, so nothing is re-encoded or
+ * copied per observer.
+ */
+static coap_error_t coap_observe_fanout(coap_context_t *context, coap_resource_t *resource,
+                                        coap_pdu_t *notification, net_buffer_t *tx) {
+    bool any = false;
+    for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        any |= resource->observers[i].in_use;
+    }
+    if (!any) {
+        return COAP_OK;
+    }
+
+    resource->observe_seq = (resource->observe_seq + 1) & 0xFFFFFF;
+
+    uint8_t option[4];
+    coap_pdu_add_option(notification, COAP_OPTION_OBSERVE, option,
+                        coap_encode_uint(option, resource->observe_seq));
+    if (!coap_pdu_get_option(notification, COAP_OPTION_MAX_AGE, NULL)) {
+        coap_pdu_add_option(notification, COAP_OPTION_MAX_AGE, option,
+                            coap_encode_uint(option, resource->max_age));
+    }
+
+    uint8_t *body = notification->data + notification->options_offset;
+    uint16_t body_length = notification->length - notification->options_offset;
+
+    for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        coap_observer_t *observer = &resource->observers[i];
+        if (!observer->in_use) {
+            continue;
+        }
+
+        /* Periodic CON confirms the observer is still interested */
+        coap_transaction_t *transaction = NULL;
+        if (!observer->con_pending && observer->since_con + 1 >= COAP_OBSERVE_CON_INTERVAL) {
+            transaction = coap_transaction_alloc(context);
+        }
+
+        uint16_t msg_id = coap_generate_message_id(context);
+        coap_msg_type_t type = transaction ? COAP_TYPE_CON : COAP_TYPE_NON;
+        uint8_t *start = body - observer->token_length - COAP_HEADER_SIZE;
+
+        coap_write_header(start, type, notification->code, msg_id, observer->token, observer->token_length);
+        tx->offset = start - tx->data;
+        tx->length = COAP_HEADER_SIZE + observer->token_length + body_length;
+        observer->last_message_id = msg_id;
+
+        if (transaction) {
+            transaction->message_id = msg_id;
+            memcpy(transaction->token, observer->token, observer->token_length);
+            transaction->token_length = observer->token_length;
+            transaction->peer = observer->peer;
+            transaction->notification = true;
+            transaction->exchange_timeout_ms = 0;
+            transaction->handler = coap_observe_con_done;
+            transaction->user_data = observer;
+            if (coap_transaction_send(context, transaction, tx) == COAP_OK) {
+                observer->con_pending = true;
+                observer->since_con = 0;
+            }
+        } else {
+            sockaddr_in_t dest_addr = coap_sockaddr(observer->peer.ip_address, observer->peer.port);
+            net_sendto_buffer(context->socket_fd, tx, &dest_addr);
+            if (observer->since_con < UINT8_MAX) {
+                observer->since_con++;
+            }
+        }
+    }
+
+    return COAP_OK;
+}
+
+coap_error_t coap_resource_notify(coap_context_t *context, coap_resource_t *resource) {
+    if (!context || !resource || !resource->observable || context->socket_fd < 0) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    /* The state changed; render the representation once through the GET handler */
+    coap_resource_invalidate(resource);
+    coap_pdu_t request;
+    coap_pdu_t notification;
+    coap_pdu_init(&request, COAP_TYPE_NON, COAP_METHOD_GET, 0);
+    net_buffer_t *tx = coap_tx_alloc(&notification, COAP_TYPE_NON, COAP_RESPONSE_205_CONTENT, 0);
+    if (!tx) {
+        return COAP_ERROR_NO_MEMORY;
+    }
+    resource->handler(context, resource, &request, &notification, resource->user_data);
+
+    coap_error_t err = coap_observe_fanout(context, resource, &notification, tx);
+    net_buffer_free(tx);
+    return err;
+}
+
+coap_error_t coap_notify_observers(
+    coap_context_t *context,
+    coap_resource_t *resource,
+    const uint8_t *payload,
+    uint16_t payload_length
+) {
+    if (!context || !resource || !resource->observable || context->socket_fd < 0) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    coap_resource_invalidate(resource);
+
+    coap_pdu_t notification;
+    net_buffer_t *tx = coap_tx_alloc(&notification, COAP_TYPE_NON, COAP_RESPONSE_205_CONTENT, 0);
+    if (!tx) {
+        return COAP_ERROR_NO_MEMORY;
+    }
+
+    coap_error_t err = coap_pdu_set_payload(&notification, payload, payload_length);
+    if (err == COAP_OK) {
+        err = coap_observe_fanout(context, resource, &notification, tx);
+    }
+    net_buffer_free(tx);
+    return err;
+}
+
+/**
+ * @brief Advance to the request's next non-empty Uri-Path option
+ *
+ * @return false once the Uri-Path options are exhausted
+ */
+static bool coap_next_segment(const coap_pdu_t *request, coap_option_iter_t *iter, coap_option_t *segment) {
+    while (coap_option_next(request, iter, segment) && segment->number <= COAP_OPTION_URI_PATH) {
+        if (segment->number == COAP_OPTION_URI_PATH && segment->length > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Match the request's remaining Uri-Path options below node
+ *
+ * An exact segment is tried before a "*" sibling, falling back to the
+ * wildcard if the exact branch dead-ends further down.
+ */
+static coap_resource_t *coap_path_match(const struct coap_path_node *node, const coap_pdu_t *request,
+                                        coap_option_iter_t iter) {
+    coap_option_t segment;
+    if (!coap_next_segment(request, &iter, &segment)) {
+        return node->resource;
+    }
+
+    const struct coap_path_node *wildcard = NULL;
+    for (const struct coap_path_node *child = node->child; child; child = child->sibling) {
+        if (coap_path_is_wildcard(child)) {
+            wildcard = child;
+        } else if (child->length == segment.length && memcmp(child->segment, segment.value, segment.length) == 0) {
+            coap_resource_t *resource = coap_path_match(child, request, iter);
+            if (resource) {
+                return resource;
+            }
+            break;
+        }
+    }
+
+    return wildcard ? coap_path_match(wildcard, request, iter) : NULL;
+}
+
+static coap_resource_t *coap_find_resource(coap_context_t *context, const coap_pdu_t *request) {
+    if (!context->routes) {
+        return NULL;
+    }
+
+    coap_option_iter_t iter;
+    coap_option_iter_init(request, &iter);
+    return coap_path_match(context->routes, request, iter);
+}
+
+/**
+ * @brief Register, refresh or remove an observer for a GET with Observe
+ *
+ * @return true if the peer is (still) registered
+ */
+static bool coap_observe_register(coap_resource_t *resource, const coap_pdu_t *request,
+                                  const sockaddr_in_t *from, uint32_t observe) {
+    coap_observer_t *slot = NULL;
+
+    for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        coap_observer_t *observer = &resource->observers[i];
+        if (observer->in_use && coap_peer_matches(&observer->peer, from) &&
+            observer->token_length == request->token_length &&
+            memcmp(observer->token, request->token, request->token_length) == 0) {
+            if (observe == 1) {
+                observer->in_use = false;   /* Deregistration */
+                return false;
+            }
+            return true;                    /* Re-registration */
+        }
+        if (!observer->in_use && !slot) {
+            slot = observer;
+        }
+    }
+
+    if (observe != 0 || !slot) {
+        return false;
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->in_use = true;
+    slot->peer.ip_address = COAP_IPV4(from->addr);
+    slot->peer.port = from->port;
+    memcpy(slot->token, request->token, request->token_length);
+    slot->token_length = request->token_length;
+    return true;
+}
+
+/**
+ * @brief Dispatch a request to its resource and send the response
+ *
+ * The resource is matched on the Uri-Path options themselves and the
+ * response is encoded straight into a transmit buffer, so nothing
+ * message-sized is placed on the stack.
+ */
+static void coap_handle_request(coap_context_t *context, const coap_pdu_t *request, const sockaddr_in_t *from,
+                                bool multicast) {
+    /* Group requests are NON only and are never proxied (RFC 7252, 8.1) */
+    if (multicast && (request->type != COAP_TYPE_NON ||
+                      coap_pdu_get_option(request, COAP_OPTION_PROXY_URI, NULL) ||
+                      coap_pdu_get_option(request, COAP_OPTION_PROXY_SCHEME, NULL))) {
+        return;
+    }
+
+    /* A retransmitted CON gets the original response, not a second execution */
+    if (request->type == COAP_TYPE_CON && coap_dedup_replay(context, request, from)) {
+        return;
+    }
+
+    /* Its response is deferred: the client only missed our empty ACK */
+    if (request->type == COAP_TYPE_CON && coap_exchange_pending(context, request, from)) {
+        coap_send_empty(context, COAP_TYPE_ACK, request->message_id, from);
+        return;
+    }
+
+    /* Proxy-Uri or Proxy-Scheme: forward instead of dispatching locally */
+    if (coap_pdu_get_option(request, COAP_OPTION_PROXY_URI, NULL) ||
+        coap_pdu_get_option(request, COAP_OPTION_PROXY_SCHEME, NULL)) {
+        coap_proxy_request(context, request, from);
+        return;
+    }
+
+    /* Match the Uri-Path options against the resource trie */
+    coap_resource_t *resource = coap_find_resource(context, request);
+
+    /* Create response; without a buffer the request is dropped and the client retransmits */
+    coap_pdu_t response;
+    net_buffer_t *tx = multicast ?
+        coap_tx_alloc(&response, COAP_TYPE_NON, COAP_RESPONSE_404_NOT_FOUND, coap_generate_message_id(context)) :
+        coap_tx_alloc(&response, COAP_TYPE_ACK, COAP_RESPONSE_404_NOT_FOUND, request->message_id);
+    if (!tx) {
+        return;
+    }
+    coap_pdu_set_token(&response, request->token, request->token_length);
+    bool deferred = false;
+
+    if (resource && resource->block_read && request->code == COAP_METHOD_GET) {
+        coap_serve_block2(context, resource, request, &response);
+    } else if (resource && resource->block_write &&
+               (request->code == COAP_METHOD_PUT || request->code == COAP_METHOD_POST)) {
+        coap_resource_invalidate(resource);
+        coap_receive_block1(context, resource, request, from, &response);
+    } else if (resource) {
+        bool cached = coap_cache_applies(resource, request);
+        if (!cached || !coap_cache_serve(&resource->cache, &response)) {
+            /* Call resource handler */
+            response.code = COAP_RESPONSE_205_CONTENT;
+            context->request_from = from;
+            context->deferred = NULL;
+            resource->handler(context, resource, request, &response, resource->user_data);
+            context->request_from = NULL;
+            deferred = (context->deferred != NULL);
+
+            if (request->code != COAP_METHOD_GET) {
+                coap_resource_invalidate(resource);
+            } else if (cached && !deferred) {
+                coap_cache_add_etag(&response);
+                coap_cache_store(&resource->cache, &response, resource->max_age);
+            }
+        }
+        if (cached && !deferred) {
+            coap_cache_validate(request, &response);
+        }
+
+        /* Observe registration only sticks if the GET succeeded */
+        coap_option_t observe;
+        if (!deferred && coap_pdu_get_option(request, COAP_OPTION_OBSERVE, &observe) &&
+            resource->observable && context->enable_observe && request->code == COAP_METHOD_GET) {
+            uint32_t value = (response.code == COAP_RESPONSE_205_CONTENT) ? coap_decode_uint(&observe) : 1;
+            if (coap_observe_register(resource, request, from, value)) {
+                uint8_t value_buffer[4];
+                coap_pdu_add_option(&response, COAP_OPTION_OBSERVE, value_buffer,
+                                    coap_encode_uint(value_buffer, resource->observe_seq));
+                if (!coap_pdu_get_option(&response, COAP_OPTION_MAX_AGE, NULL)) {
+                    coap_pdu_add_option(&response, COAP_OPTION_MAX_AGE, value_buffer,
+                                        coap_encode_uint(value_buffer, resource->max_age));
+                }
+            }
+        }
+    }
+
+    if (deferred) {
+        /* Separate response: a CON is acknowledged now with an empty ACK */
+        if (request->type != COAP_TYPE_CON) {
+            net_buffer_free(tx);
+            return;
+        }
+        coap_pdu_init_buffer(&response, COAP_TYPE_ACK, 0, request->message_id, response.data, response.size);
+    }
+
+    /* Group responses: errors are suppressed, the rest wait out a random leisure */
+    if (multicast) {
+        if (COAP_CODE_CLASS(response.code) == 2) {
+            coap_tx_finalize(tx, &response);
+            coap_leisure_hold(context, tx, from);
+        }
+        net_buffer_free(tx);
+        return;
+    }
+
+    /* Send response */
+    coap_tx_finalize(tx, &response);
+    net_sendto_buffer(context->socket_fd, tx, from);
+    /* GET is safe to re-execute, so only state-changing requests use the heap */
+    if (request->type == COAP_TYPE_CON && request->code != COAP_METHOD_GET) {
+        coap_dedup_store(context, request, from, tx);
+    }
+    net_buffer_free(tx);
+}
+
+coap_error_t coap_process(coap_context_t *context, uint32_t timeout_ms) {
+    if (!context || context->socket_fd < 0) {
+        return COAP_ERROR_INVALID_PARAM;
+    }
+
+    /* Sleep until a datagram arrives or a retransmission timer fires */
+    uint32_t bits = 0;
+    if (net_socket_available(context->socket_fd) <= 0 &&
+        os_event_group_wait_bits(&context->events,
+                                 COAP_EVENT_RX | COAP_EVENT_TIMER | COAP_EVENT_DEFERRED | COAP_EVENT_LEISURE,
+                                 EVENT_WAIT_ANY | EVENT_CLEAR_ON_EXIT, &bits, timeout_ms) != OS_OK) {
+        return COAP_ERROR_TIMEOUT;
+    }
+
+    coap_check_transactions(context);
+    coap_send_deferred(context);
+    if (bits & COAP_EVENT_LEISURE) {
+        coap_send_leisure(context);
+    }
+
+    if (net_socket_available(context->socket_fd) <= 0) {
+        return COAP_OK;
+    }
+
+    /* Receive into a pool buffer; the decoded PDU is a view over it */
+    net_buffer_t *rx = net_buffer_alloc();
+    if (!rx) {
+        return COAP_ERROR_NO_MEMORY;  /* Datagram stays queued for the next call */
+    }
+
+    sockaddr_in_t from_addr;
+    ipv4_addr_t dest_addr;
+    coap_pdu_t pdu;
+    coap_error_t result = COAP_OK;
+    int32_t recv_len = net_recvfrom_to(context->socket_fd, rx->data, NET_BUFFER_SIZE, &from_addr, &dest_addr);
+    bool multicast = (recv_len > 0 && IPV4_IS_MULTICAST(dest_addr));
+
+    if (recv_len <= 0) {
+        result = COAP_ERROR_TIMEOUT;
+    } else if (coap_pdu_decode(&pdu, rx->data, recv_len) != COAP_OK) {
+        result = COAP_ERROR_PARSE;
+    } else if (pdu.type == COAP_TYPE_ACK || pdu.type == COAP_TYPE_RST || COAP_CODE_CLASS(pdu.code) >= 2) {
+        /* Responses, ACKs and RSTs belong to our outstanding requests (never multicast) */
+        if (!multicast) {
+            coap_handle_response(context, &pdu, &from_addr);
+        }
+    } else if (context->is_server && COAP_CODE_CLASS(pdu.code) == 0) {
+        coap_handle_request(context, &pdu, &from_addr, multicast);
+    }
+
+    net_buffer_free(rx);
+    return result;
+}
+
 /* ====================
  * Utility Functions
  * ==================== */
@@ -697,6 +3528,9 @@ const char *coap_error_to_string(coap_error_t error) {
         case COAP_ERROR_PARSE: return "Parse error";
         case COAP_ERROR_INVALID_MESSAGE: return "Invalid message";
         case COAP_ERROR_NOT_FOUND: return "Not found";
+        case COAP_ERROR_OBSERVE_FAILED: return "Observe failed";
+        case COAP_ERROR_MAX_RETRANSMIT: return "Max retransmissions reached";
+        case COAP_ERROR_BUSY: return "Too many outstanding requests";
         default: return "Unknown error";
     }
 }
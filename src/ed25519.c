@@ -0,0 +1,658 @@
+/**
+ * @file ed25519.c
+ * @brief Ed25519 Signature Verification Implementation for TinyOS-RTOS
+ *
+ * Field elements mod p = 2^255 - 19 use ten signed 32-bit limbs of
+ * alternately 26 and 25 bits (radix 2^25.5), so every limb product fits
+ * a 32x32->64 multiply. Points use extended twisted Edwards coordinates.
+ */
+
+#include "tinyos/ed25519.h"
+#include <string.h>
+
+/* ============================================================================
+ * SHA-512 (challenge hash only)
+ * ============================================================================ */
+
+typedef struct {
+    uint64_t state[8];
+    uint64_t length;
+    uint8_t block[128];
+} sha512_ctx_t;
+
+static const uint64_t sha512_k[80] = {
+    0x428A2F98D728AE22ULL, 0x7137449123EF65CDULL, 0xB5C0FBCFEC4D3B2FULL, 0xE9B5DBA58189DBBCULL,
+    0x3956C25BF348B538ULL, 0x59F111F1B605D019ULL, 0x923F82A4AF194F9BULL, 0xAB1C5ED5DA6D8118ULL,
+    0xD807AA98A3030242ULL, 0x12835B0145706FBEULL, 0x243185BE4EE4B28CULL, 0x550C7DC3D5FFB4E2ULL,
+    0x72BE5D74F27B896FULL, 0x80DEB1FE3B1696B1ULL, 0x9BDC06A725C71235ULL, 0xC19BF174CF692694ULL,
+    0xE49B69C19EF14AD2ULL, 0xEFBE4786384F25E3ULL, 0x0FC19DC68B8CD5B5ULL, 0x240CA1CC77AC9C65ULL,
+    0x2DE92C6F592B0275ULL, 0x4A7484AA6EA6E483ULL, 0x5CB0A9DCBD41FBD4ULL, 0x76F988DA831153B5ULL,
+    0x983E5152EE66DFABULL, 0xA831C66D2DB43210ULL, 0xB00327C898FB213FULL, 0xBF597FC7BEEF0EE4ULL,
+    0xC6E00BF33DA88FC2ULL, 0xD5A79147930AA725ULL, 0x06CA6351E003826FULL, 0x142929670A0E6E70ULL,
+    0x27B70A8546D22FFCULL, 0x2E1B21385C26C926ULL, 0x4D2C6DFC5AC42AEDULL, 0x53380D139D95B3DFULL,
+    0x650A73548BAF63DEULL, 0x766A0ABB3C77B2A8ULL, 0x81C2C92E47EDAEE6ULL, 0x92722C851482353BULL,
+    0xA2BFE8A14CF10364ULL, 0xA81A664BBC423001ULL, 0xC24B8B70D0F89791ULL, 0xC76C51A30654BE30ULL,
+    0xD192E819D6EF5218ULL, 0xD69906245565A910ULL, 0xF40E35855771202AULL, 0x106AA07032BBD1B8ULL,
+    0x19A4C116B8D2D0C8ULL, 0x1E376C085141AB53ULL, 0x2748774CDF8EEB99ULL, 0x34B0BCB5E19B48A8ULL,
+    0x391C0CB3C5C95A63ULL, 0x4ED8AA4AE3418ACBULL, 0x5B9CCA4F7763E373ULL, 0x682E6FF3D6B2B8A3ULL,
+    0x748F82EE5DEFB2FCULL, 0x78A5636F43172F60ULL, 0x84C87814A1F0AB72ULL, 0x8CC702081A6439ECULL,
+    0x90BEFFFA23631E28ULL, 0xA4506CEBDE82BDE9ULL, 0xBEF9A3F7B2C67915ULL, 0xC67178F2E372532BULL,
+    0xCA273ECEEA26619CULL, 0xD186B8C721C0C207ULL, 0xEADA7DD6CDE0EB1EULL, 0xF57D4F7FEE6ED178ULL,
+    0x06F067AA72176FBAULL, 0x0A637DC5A2C898A6ULL, 0x113F9804BEF90DAEULL, 0x1B710B35131C471BULL,
+    0x28DB77F523047D84ULL, 0x32CAAB7B40C72493ULL, 0x3C9EBE0A15C9BEBCULL, 0x431D67C49C100D4CULL,
+    0x4CC5D4BECB3E42B6ULL, 0x597F299CFC657E2AULL, 0x5FCB6FAB3AD6FAECULL, 0x6C44198C4A475817ULL
+};
+
+#define ROTR64(x, n)    (((x) >> (n)) | ((x) << (64 - (n))))
+
+static void sha512_transform(uint64_t state[8], const uint8_t *block) {
+    uint64_t w[16];
+    uint64_t v[8];
+
+    memcpy(v, state, sizeof(v));
+
+    for (int i = 0; i < 80; i++) {
+        uint64_t word;
+        if (i < 16) {
+            word = 0;
+            for (int j = 0; j < 8; j++) {
+                word = (word << 8) | block[i * 8 + j];
+            }
+        } else {
+            uint64_t w2 = w[(i - 2) & 15], w15 = w[(i - 15) & 15];
+            word = (ROTR64(w2, 19) ^ ROTR64(w2, 61) ^ (w2 >> 6)) + w[(i - 7) & 15] +
+                   (ROTR64(w15, 1) ^ ROTR64(w15, 8) ^ (w15 >> 7)) + w[i & 15];
+        }
+        w[i & 15] = word;
+
+        uint64_t t1 = v[7] + (ROTR64(v[4], 14) ^ ROTR64(v[4], 18) ^ ROTR64(v[4], 41)) +
+                      ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha512_k[i] + word;
+        uint64_t t2 = (ROTR64(v[0], 28) ^ ROTR64(v[0], 34) ^ ROTR64(v[0], 39)) +
+                      ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(&v[1], &v[0], 7 * sizeof(uint64_t));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        state[i] += v[i];
+    }
+}
+
+static void sha512_init(sha512_ctx_t *ctx) {
+    static const uint64_t iv[8] = {
+        0x6A09E667F3BCC908ULL, 0xBB67AE8584CAA73BULL, 0x3C6EF372FE94F82BULL, 0xA54FF53A5F1D36F1ULL,
+        0x510E527FADE682D1ULL, 0x9B05688C2B3E6C1FULL, 0x1F83D9ABFB41BD6BULL, 0x5BE0CD19137E2179ULL
+    };
+
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->length = 0;
+}
+
+static void sha512_update(sha512_ctx_t *ctx, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        size_t fill = (size_t)(ctx->length % sizeof(ctx->block));
+        size_t take = sizeof(ctx->block) - fill;
+        if (take > length) {
+            take = length;
+        }
+
+        memcpy(&ctx->block[fill], data, take);
+        ctx->length += take;
+        data += take;
+        length -= take;
+
+        if (fill + take == sizeof(ctx->block)) {
+            sha512_transform(ctx->state, ctx->block);
+        }
+    }
+}
+
+static void sha512_final(sha512_ctx_t *ctx, uint8_t digest[64]) {
+    uint64_t bits = ctx->length * 8;
+    size_t fill = (size_t)(ctx->length % sizeof(ctx->block));
+
+    /* Padding: 0x80, zeros, then the 128-bit length big-endian */
+    ctx->block[fill++] = 0x80;
+    if (fill > sizeof(ctx->block) - 16) {
+        memset(&ctx->block[fill], 0, sizeof(ctx->block) - fill);
+        sha512_transform(ctx->state, ctx->block);
+        fill = 0;
+    }
+    memset(&ctx->block[fill], 0, sizeof(ctx->block) - 8 - fill);
+    for (int i = 0; i < 8; i++) {
+        ctx->block[sizeof(ctx->block) - 1 - i] = (uint8_t)(bits >> (i * 8));
+    }
+    sha512_transform(ctx->state, ctx->block);
+
+    for (int i = 0; i < 64; i++) {
+        digest[i] = (uint8_t)(ctx->state[i / 8] >> (56 - 8 * (i % 8)));
+    }
+}
+
+/* ============================================================================
+ * Field Arithmetic mod 2^255 - 19
+ * ============================================================================ */
+
+typedef int32_t fe[10];
+
+/* Limb i holds bits fe_offset[i] .. fe_offset[i] + FE_BITS(i) - 1 */
+static const uint8_t fe_offset[10] = { 0, 26, 51, 77, 102, 128, 153, 179, 204, 230 };
+
+#define FE_BITS(i)      (((i) & 1) ? 25 : 26)
+
+/* d = -121665/121666 */
+static const fe ed25519_d = {
+    0x35978A3, 0x0D37284, 0x3156EBD, 0x06A0A0E, 0x001C029,
+    0x179E898, 0x3A03CBB, 0x1CE7198, 0x2E2B6FF, 0x1480DB3
+};
+
+/* 2d */
+static const fe ed25519_d2 = {
+    0x2B2F159, 0x1A6E509, 0x22ADD7A, 0x0D4141D, 0x0038052,
+    0x0F3D130, 0x3407977, 0x19CE331, 0x1C56DFF, 0x0901B67
+};
+
+/* sqrt(-1) = 2^((p-1)/4) */
+static const fe ed25519_sqrtm1 = {
+    0x20EA0B0, 0x186C9D2, 0x08F189D, 0x035697F, 0x0BD0C60,
+    0x1FBD7A7, 0x2804C9E, 0x1E16569, 0x004FC1D, 0x0AE0C92
+};
+
+/**
+ * @brief Carry 64-bit limb sums back into 26/25-bit limbs
+ *
+ * Rounding carries leave every limb within +-2^25 (+-2^24 for odd limbs,
+ * plus a little for limb 1), small enough that any two reduced elements
+ * can be added and still multiplied without overflowing 64 bits.
+ */
+static void fe_reduce(fe h, int64_t t[10]) {
+    int64_t carry;
+
+    for (int i = 0; i < 10; i++) {
+        int bits = FE_BITS(i);
+        carry = (t[i] + ((int64_t)1 << (bits - 1))) >> bits;
+        t[i] -= carry * ((int64_t)1 << bits);
+        if (i == 9) {
+            t[0] += carry * 19;     /* 2^255 = 19 mod p */
+        } else {
+            t[i + 1] += carry;
+        }
+    }
+    carry = (t[0] + ((int64_t)1 << 25)) >> 26;
+    t[0] -= carry * ((int64_t)1 << 26);
+    t[1] += carry;
+
+    for (int i = 0; i < 10; i++) {
+        h[i] = (int32_t)t[i];
+    }
+}
+
+static void fe_set(fe h, int32_t value) {
+    memset(h, 0, sizeof(fe));
+    h[0] = value;
+}
+
+static void fe_add(fe h, const fe f, const fe g) {
+    int64_t t[10];
+    for (int i = 0; i < 10; i++) {
+        t[i] = (int64_t)f[i] + g[i];
+    }
+    fe_reduce(h, t);
+}
+
+static void fe_sub(fe h, const fe f, const fe g) {
+    int64_t t[10];
+    for (int i = 0; i < 10; i++) {
+        t[i] = (int64_t)f[i] - g[i];
+    }
+    fe_reduce(h, t);
+}
+
+static void fe_neg(fe h, const fe f) {
+    for (int i = 0; i < 10; i++) {
+        h[i] = -f[i];
+    }
+}
+
+static void fe_mul(fe h, const fe f, const fe g) {
+    int64_t t[19] = {0};
+
+    for (int i = 0; i < 10; i++) {
+        for (int j = 0; j < 10; j++) {
+            int64_t product = (int64_t)f[i] * g[j];
+            /* Two odd limbs each sit half a bit high: their product counts twice */
+            t[i + j] += (i & j & 1) ? product * 2 : product;
+        }
+    }
+    for (int i = 0; i < 9; i++) {
+        t[i] += t[i + 10] * 19;
+    }
+
+    fe_reduce(h, t);
+}
+
+static void fe_sq(fe h, const fe f) {
+    int64_t t[19] = {0};
+
+    for (int i = 0; i < 10; i++) {
+        t[2 * i] += (int64_t)f[i] * f[i] * ((i & 1) ? 2 : 1);
+        for (int j = i + 1; j < 10; j++) {
+            int64_t product = (int64_t)f[i] * f[j] * 2;
+            t[i + j] += (i & j & 1) ? product * 2 : product;
+        }
+    }
+    for (int i = 0; i < 9; i++) {
+        t[i] += t[i + 10] * 19;
+    }
+
+    fe_reduce(h, t);
+}
+
+/**
+ * @brief h = f^(2^n)
+ */
+static void fe_sqn(fe h, const fe f, int n) {
+    fe_sq(h, f);
+    while (--n > 0) {
+        fe_sq(h, h);
+    }
+}
+
+/**
+ * @brief z^(2^250 - 1) and z^11, the common prefix of inversion and square root
+ */
+static void fe_pow2_250_1(fe out, fe z11, const fe z) {
+    fe t0, t1, t2;
+
+    fe_sq(t0, z);               /* z^2 */
+    fe_sqn(t1, t0, 2);          /* z^8 */
+    fe_mul(t1, z, t1);          /* z^9 */
+    fe_mul(z11, t0, t1);        /* z^11 */
+    fe_sq(t0, z11);             /* z^22 */
+    fe_mul(t0, t1, t0);         /* z^(2^5 - 1) */
+    fe_sqn(t1, t0, 5);
+    fe_mul(t0, t1, t0);         /* z^(2^10 - 1) */
+    fe_sqn(t1, t0, 10);
+    fe_mul(t1, t1, t0);         /* z^(2^20 - 1) */
+    fe_sqn(t2, t1, 20);
+    fe_mul(t1, t2, t1);         /* z^(2^40 - 1) */
+    fe_sqn(t1, t1, 10);
+    fe_mul(t0, t1, t0);         /* z^(2^50 - 1) */
+    fe_sqn(t1, t0, 50);
+    fe_mul(t1, t1, t0);         /* z^(2^100 - 1) */
+    fe_sqn(t2, t1, 100);
+    fe_mul(t1, t2, t1);         /* z^(2^200 - 1) */
+    fe_sqn(t1, t1, 50);
+    fe_mul(out, t1, t0);        /* z^(2^250 - 1) */
+}
+
+/**
+ * @brief h = 1/z = z^(p - 2)
+ */
+static void fe_invert(fe h, const fe z) {
+    fe t, z11;
+
+    fe_pow2_250_1(t, z11, z);
+    fe_sqn(t, t, 5);            /* z^(2^255 - 32) */
+    fe_mul(h, t, z11);          /* z^(2^255 - 21) */
+}
+
+/**
+ * @brief h = z^((p - 5) / 8) = z^(2^252 - 3)
+ */
+static void fe_pow22523(fe h, const fe z) {
+    fe t, z11;
+
+    fe_pow2_250_1(t, z11, z);
+    fe_sqn(t, t, 2);            /* z^(2^252 - 4) */
+    fe_mul(h, t, z);
+}
+
+/**
+ * @brief Load 255 bits little-endian (bit 255 is ignored)
+ */
+static void fe_frombytes(fe h, const uint8_t s[32]) {
+    for (int i = 0; i < 10; i++) {
+        int byte = fe_offset[i] / 8;
+        uint64_t window = 0;
+        for (int j = 0; j < 5 && byte + j < 32; j++) {
+            window |= (uint64_t)s[byte + j] << (8 * j);
+        }
+        h[i] = (int32_t)((window >> (fe_offset[i] % 8)) & (((uint64_t)1 << FE_BITS(i)) - 1));
+    }
+}
+
+/**
+ * @brief Store the canonical value (0 <= h < p) little-endian
+ */
+static void fe_tobytes(uint8_t s[32], const fe f) {
+    int64_t h[10];
+    int64_t q;
+
+    for (int i = 0; i < 10; i++) {
+        h[i] = f[i];
+    }
+
+    /* q = floor(h / p), 0 or 1 for reduced input (or -1 if negative) */
+    q = (19 * h[9] + ((int64_t)1 << 24)) >> 25;
+    for (int i = 0; i < 10; i++) {
+        q = (h[i] + q) >> FE_BITS(i);
+    }
+
+    /* h - q * p: add 19q, then drop the 2^255 multiple while carrying */
+    h[0] += 19 * q;
+    for (int i = 0; i < 10; i++) {
+        int64_t carry = h[i] >> FE_BITS(i);
+        h[i] -= carry * ((int64_t)1 << FE_BITS(i));
+        if (i < 9) {
+            h[i + 1] += carry;
+        }
+    }
+
+    uint64_t acc = 0;
+    int acc_bits = 0;
+    int n = 0;
+    for (int i = 0; i < 10; i++) {
+        acc |= (uint64_t)h[i] << acc_bits;
+        acc_bits += FE_BITS(i);
+        while (acc_bits >= 8) {
+            s[n++] = (uint8_t)acc;
+            acc >>= 8;
+            acc_bits -= 8;
+        }
+    }
+    s[n] = (uint8_t)acc;
+}
+
+static bool fe_equal(const fe f, const fe g) {
+    uint8_t a[32], b[32];
+
+    fe_tobytes(a, f);
+    fe_tobytes(b, g);
+    return memcmp(a, b, sizeof(a)) == 0;
+}
+
+static bool fe_is_odd(const fe f) {
+    uint8_t s[32];
+
+    fe_tobytes(s, f);
+    return s[0] & 1;
+}
+
+/* ============================================================================
+ * Curve -x^2 + y^2 = 1 + d x^2 y^2
+ * ============================================================================ */
+
+/* Extended coordinates: x = X/Z, y = Y/Z, x * y = T/Z */
+typedef struct {
+    fe X;
+    fe Y;
+    fe Z;
+    fe T;
+} ge_t;
+
+/* Base point B, y = 4/5, x even */
+static const ge_t ed25519_base = {
+    { 0x325D51A, 0x18B5823, 0x0F6592A, 0x104A92D, 0x1A4B31D,
+      0x1D6DC5C, 0x27118FE, 0x07FD814, 0x13CD6E5, 0x085A4DB },
+    { 0x2666658, 0x1999999, 0x0CCCCCC, 0x1333333, 0x1999999,
+      0x0666666, 0x3333333, 0x0CCCCCC, 0x2666666, 0x1999999 },
+    { 1 },
+    { 0x1B7DDA3, 0x1A2ACE9, 0x25EADBB, 0x003BA8A, 0x083C27E,
+      0x0ABE37D, 0x1274732, 0x0CCACDD, 0x0FD78B7, 0x19E1D7C }
+};
+
+/**
+ * @brief r = p + q (add-2008-hwcd-3)
+ */
+static void ge_add(ge_t *r, const ge_t *p, const ge_t *q) {
+    fe a, b, c, d, t;
+
+    fe_sub(a, p->Y, p->X);
+    fe_sub(t, q->Y, q->X);
+    fe_mul(a, a, t);            /* A = (Y1 - X1)(Y2 - X2) */
+    fe_add(b, p->Y, p->X);
+    fe_add(t, q->Y, q->X);
+    fe_mul(b, b, t);            /* B = (Y1 + X1)(Y2 + X2) */
+    fe_mul(c, p->T, q->T);
+    fe_mul(c, c, ed25519_d2);   /* C = 2d T1 T2 */
+    fe_mul(d, p->Z, q->Z);
+    fe_add(d, d, d);            /* D = 2 Z1 Z2 */
+
+    fe_sub(t, b, a);            /* E */
+    fe_add(b, b, a);            /* H */
+    fe_sub(a, d, c);            /* F */
+    fe_add(d, d, c);            /* G */
+
+    fe_mul(r->X, t, a);
+    fe_mul(r->Y, d, b);
+    fe_mul(r->T, t, b);
+    fe_mul(r->Z, a, d);
+}
+
+/**
+ * @brief r = 2p (dbl-2008-hwcd with a = -1)
+ */
+static void ge_double(ge_t *r, const ge_t *p) {
+    fe a, b, c, e, t;
+
+    fe_sq(a, p->X);             /* A = X1^2 */
+    fe_sq(b, p->Y);             /* B = Y1^2 */
+    fe_sq(c, p->Z);
+    fe_add(c, c, c);            /* C = 2 Z1^2 */
+    fe_add(e, p->X, p->Y);
+    fe_sq(e, e);
+    fe_sub(e, e, a);
+    fe_sub(e, e, b);            /* E = (X1 + Y1)^2 - A - B */
+
+    fe_sub(t, b, a);            /* G = B - A */
+    fe_add(b, a, b);
+    fe_neg(b, b);               /* H = -A - B */
+    fe_sub(c, t, c);            /* F = G - C */
+
+    fe_mul(r->X, e, c);
+    fe_mul(r->Y, t, b);
+    fe_mul(r->T, e, b);
+    fe_mul(r->Z, c, t);
+}
+
+/**
+ * @brief Decode a point (RFC 8032 5.1.3)
+ * @return false if s is not the encoding of a curve point
+ */
+__attribute__((noinline)) static bool ge_frombytes(ge_t *r, const uint8_t s[32]) {
+    fe u, v, v3, vxx, check;
+    uint8_t canonical[32];
+
+    fe_frombytes(r->Y, s);
+
+    /* y must be below p */
+    fe_tobytes(canonical, r->Y);
+    if (memcmp(canonical, s, 31) != 0 || canonical[31] != (s[31] & 0x7F)) {
+        return false;
+    }
+
+    fe_set(r->Z, 1);
+    fe_sq(u, r->Y);
+    fe_mul(v, u, ed25519_d);
+    fe_sub(u, u, r->Z);         /* u = y^2 - 1 */
+    fe_add(v, v, r->Z);         /* v = d y^2 + 1 */
+
+    /* x = u v^3 (u v^7)^((p - 5) / 8) */
+    fe_sq(v3, v);
+    fe_mul(v3, v3, v);
+    fe_sq(r->X, v3);
+    fe_mul(r->X, r->X, v);
+    fe_mul(r->X, r->X, u);
+    fe_pow22523(r->X, r->X);
+    fe_mul(r->X, r->X, v3);
+    fe_mul(r->X, r->X, u);
+
+    fe_sq(vxx, r->X);
+    fe_mul(vxx, vxx, v);
+    if (!fe_equal(vxx, u)) {
+        fe_neg(check, u);
+        if (!fe_equal(vxx, check)) {
+            return false;
+        }
+        fe_mul(r->X, r->X, ed25519_sqrtm1);
+    }
+
+    /* Pick the root with the encoded sign; -0 is not a valid encoding */
+    bool odd = fe_is_odd(r->X);
+    if ((s[31] >> 7) != odd) {
+        fe_set(check, 0);
+        if (fe_equal(r->X, check)) {
+            return false;
+        }
+        fe_neg(r->X, r->X);
+    }
+
+    fe_mul(r->T, r->X, r->Y);
+    return true;
+}
+
+__attribute__((noinline)) static void ge_tobytes(uint8_t s[32], const ge_t *p) {
+    fe recip, x, y;
+
+    fe_invert(recip, p->Z);
+    fe_mul(x, p->X, recip);
+    fe_mul(y, p->Y, recip);
+    fe_tobytes(s, y);
+    s[31] ^= (uint8_t)(fe_is_odd(x) << 7);
+}
+
+/* ============================================================================
+ * Scalars mod L = 2^252 + 27742317777372353535851937790883648493
+ * ============================================================================ */
+
+static const uint8_t ed25519_l[32] = {
+    0xED, 0xD3, 0xF5, 0x5C, 0x1A, 0x63, 0x12, 0x58, 0xD6, 0x9C, 0xF7, 0xA2, 0xDE, 0xF9, 0xDE, 0x14,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+};
+
+/**
+ * @brief Reduce a 512-bit little-endian number mod L
+ *
+ * Each top byte is folded down with 2^252 = -(L - 2^252) mod L, then the
+ * remainder is brought into [0, L) with one conditional subtraction.
+ */
+__attribute__((noinline)) static void sc_reduce(uint8_t r[32], const uint8_t s[64]) {
+    int64_t x[64];
+    int64_t carry;
+
+    for (int i = 0; i < 64; i++) {
+        x[i] = s[i];
+    }
+
+    for (int i = 63; i >= 32; i--) {
+        int j;
+        carry = 0;
+        for (j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * ed25519_l[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+
+    carry = 0;
+    for (int j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * ed25519_l[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (int j = 0; j < 32; j++) {
+        x[j] -= carry * ed25519_l[j];
+    }
+    for (int i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = (uint8_t)(x[i] & 255);
+    }
+}
+
+/**
+ * @brief Check 0 <= s < L (rejects malleable signatures)
+ */
+static bool sc_is_canonical(const uint8_t s[32]) {
+    for (int i = 31; i >= 0; i--) {
+        if (s[i] < ed25519_l[i]) {
+            return true;
+        }
+        if (s[i] > ed25519_l[i]) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief SHA-512(R || A || M)
+ *
+ * Kept out of line, like sc_reduce(), so the hash state and the 512-bit
+ * reduction are never on the stack together or during the scalar
+ * multiplication.
+ */
+__attribute__((noinline)) static void ed25519_hash(uint8_t digest[64], const uint8_t *r,
+                                                   const uint8_t *public_key,
+                                                   const uint8_t *message, size_t length) {
+    sha512_ctx_t ctx;
+
+    sha512_init(&ctx);
+    sha512_update(&ctx, r, 32);
+    sha512_update(&ctx, public_key, ED25519_PUBLIC_KEY_SIZE);
+    sha512_update(&ctx, message, length);
+    sha512_final(&ctx, digest);
+}
+
+static bool scalar_bit(const uint8_t s[32], int bit) {
+    return (s[bit >> 3] >> (bit & 7)) & 1;
+}
+
+/* ============================================================================
+ * Public API
+ * ============================================================================ */
+
+bool ed25519_verify(const uint8_t *signature, const uint8_t *message, size_t length,
+                    const uint8_t *public_key) {
+    ge_t a, r;
+    uint8_t digest[64];
+    uint8_t k[32];
+    const uint8_t *s = signature + 32;
+
+    if (signature == NULL || public_key == NULL || (message == NULL && length > 0)) {
+        return false;
+    }
+
+    if (!sc_is_canonical(s) || !ge_frombytes(&a, public_key)) {
+        return false;
+    }
+
+    /* k = SHA-512(R || A || M) mod L */
+    ed25519_hash(digest, signature, public_key, message, length);
+    sc_reduce(k, digest);
+
+    /* R' = [S]B - [k]A, one shared doubling chain for both scalars */
+    fe_neg(a.X, a.X);
+    fe_neg(a.T, a.T);
+
+    memset(&r, 0, sizeof(r));
+    r.Y[0] = 1;
+    r.Z[0] = 1;
+
+    for (int bit = 252; bit >= 0; bit--) {
+        ge_double(&r, &r);
+        if (scalar_bit(s, bit)) {
+            ge_add(&r, &r, &ed25519_base);
+        }
+        if (scalar_bit(k, bit)) {
+            ge_add(&r, &r, &a);
+        }
+    }
+
+    /* Valid when R' encodes to the R in the signature */
+    ge_tobytes(digest, &r);
+    return memcmp(digest, signature, 32) == 0;
+}
@@ -10,15 +10,15 @@
 
 /* Internal helper functions */
 static uint16_t mqtt_encode_remaining_length(uint8_t *buffer, uint32_t length);
-static uint32_t mqtt_decode_remaining_length(const uint8_t *buffer, uint16_t *bytes_used);
 static uint16_t mqtt_encode_string(uint8_t *buffer, const char *str);
 static uint16_t mqtt_next_message_id(mqtt_client_t *client);
 static mqtt_error_t mqtt_send_packet(mqtt_client_t *client, const uint8_t *data, uint16_t length);
-static mqtt_error_t mqtt_receive_packet(mqtt_client_t *client, uint8_t *msg_type, uint32_t timeout_ms);
+static mqtt_error_t mqtt_send_packet_locked(mqtt_client_t *client, const uint8_t *data, uint16_t length);
 static mqtt_error_t mqtt_send_connect(mqtt_client_t *client);
 static mqtt_error_t mqtt_send_disconnect(mqtt_client_t *client);
 static mqtt_error_t mqtt_send_pingreq(mqtt_client_t *client);
-static mqtt_error_t mqtt_send_subscribe(mqtt_client_t *client, const char *topic, mqtt_qos_t qos);
+static mqtt_error_t mqtt_send_subscribe(mqtt_client_t *client, const char *topic,
+                                        mqtt_qos_t qos, uint16_t message_id);
 static mqtt_error_t mqtt_send_unsubscribe(mqtt_client_t *client, const char *topic);
 static mqtt_error_t mqtt_send_publish(mqtt_client_t *client, const char *topic,
                                        const void *payload, uint16_t payload_len,
@@ -26,9 +26,15 @@ static mqtt_error_t mqtt_send_publish(mqtt_client_t *client, const char *topic,
 static mqtt_error_t mqtt_handle_connack(mqtt_client_t *client);
 static mqtt_error_t mqtt_handle_publish(mqtt_client_t *client);
 static mqtt_error_t mqtt_handle_puback(mqtt_client_t *client);
+static mqtt_error_t mqtt_handle_pubrec(mqtt_client_t *client);
+static mqtt_error_t mqtt_handle_pubrel(mqtt_client_t *client);
 static mqtt_error_t mqtt_handle_suback(mqtt_client_t *client);
-static void mqtt_task(void *param);
-static bool mqtt_topic_matches(const char *subscription, const char *topic);
+static mqtt_error_t mqtt_handle_disconnect(mqtt_client_t *client);
+static mqtt_error_t mqtt_send_ack(mqtt_client_t *client, uint8_t type, uint8_t flags, uint16_t message_id);
+static void mqtt_connection_lost(mqtt_client_t *client, mqtt_error_t reason);
+static void mqtt_session_restore(mqtt_client_t *client);
+static void mqtt_pending_complete(mqtt_client_t *client, uint8_t ack_type,
+                                  uint16_t message_id, mqtt_error_t result);
 
 /**
  * @brief Get system time in milliseconds
@@ -53,25 +59,6 @@ static uint16_t mqtt_encode_remaining_length(uint8_t *buffer, uint32_t length) {
     return pos;
 }
 
-/**
- * @brief Decode remaining length field
- */
-static uint32_t mqtt_decode_remaining_length(const uint8_t *buffer, uint16_t *bytes_used) {
-    uint32_t multiplier = 1;
-    uint32_t value = 0;
-    uint16_t pos = 0;
-    uint8_t byte;
-
-    do {
-        byte = buffer[pos++];
-        value += (byte & 0x7F) * multiplier;
-        multiplier *= 128;
-    } while ((byte & 0x80) != 0 && pos < 4);
-
-    *bytes_used = pos;
-    return value;
-}
-
 /**
  * @brief Encode UTF-8 string with length prefix
  */
@@ -85,6 +72,250 @@ static uint16_t mqtt_encode_string(uint8_t *buffer, const char *str) {
     return len + 2;
 }
 
+/**
+ * @brief Check whether the client speaks MQTT 5
+ */
+static bool mqtt_is_v5(const mqtt_client_t *client) {
+    return client->config.protocol_version == MQTT_PROTOCOL_VERSION_5;
+}
+
+/**
+ * @brief Inbound Receive Maximum we announce and enforce
+ */
+static uint16_t mqtt_receive_maximum(const mqtt_client_t *client) {
+    uint16_t max = client->config.receive_maximum;
+    return (max == 0 || max > MQTT_MAX_INFLIGHT) ? MQTT_MAX_INFLIGHT : max;
+}
+
+/* ========== In-flight Packet IDs ========== */
+
+/**
+ * @brief Check whether a packet id is in an in-flight table
+ */
+static bool mqtt_inflight_find(const uint16_t *ids, uint16_t message_id) {
+    for (int i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        if (ids[i] == message_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Add a packet id to an in-flight table
+ * @return false if the table is full
+ */
+static bool mqtt_inflight_add(uint16_t *ids, uint16_t *count, uint16_t message_id) {
+    for (int i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        if (ids[i] == 0) {
+            ids[i] = message_id;
+            (*count)++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Remove a packet id from an in-flight table
+ * @return false if it was not in flight (a duplicate or stray ack)
+ */
+static bool mqtt_inflight_remove(uint16_t *ids, uint16_t *count, uint16_t message_id) {
+    for (int i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        if (ids[i] == message_id) {
+            ids[i] = 0;
+            (*count)--;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief End an outbound QoS>0 publish, reopening its Receive Maximum slot
+ */
+static void mqtt_inflight_release(mqtt_client_t *client, uint16_t message_id) {
+    os_mutex_lock(&client->mutex, OS_WAIT_FOREVER);
+    mqtt_inflight_remove(client->inflight_ids, &client->inflight_count, message_id);
+    os_mutex_unlock(&client->mutex);
+}
+
+/**
+ * @brief Decode variable byte integer with bounds checking
+ */
+static bool mqtt_decode_varint(const uint8_t *buffer, uint32_t length,
+                               uint32_t *pos, uint32_t *value) {
+    uint32_t multiplier = 1;
+    uint32_t result = 0;
+
+    for (int i = 0; i < 4; i++) {
+        if (*pos >= length) {
+            return false;
+        }
+        uint8_t byte = buffer[(*pos)++];
+        result += (byte & 0x7F) * multiplier;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+        multiplier *= 128;
+    }
+
+    return false;  /* More than 4 bytes is malformed */
+}
+
+/* ========== MQTT 5 Properties ========== */
+
+/**
+ * @brief Decoded MQTT 5 property
+ */
+typedef struct {
+    uint8_t id;
+    uint32_t value;          /* Byte, two/four byte and variable integers */
+    const uint8_t *data;     /* String and binary data (not NUL terminated) */
+    uint16_t length;
+} mqtt_property_t;
+
+/**
+ * @brief Append a two byte integer property
+ */
+static uint16_t mqtt_property_put_u16(uint8_t *buffer, uint8_t id, uint16_t value) {
+    buffer[0] = id;
+    buffer[1] = (value >> 8) & 0xFF;
+    buffer[2] = value & 0xFF;
+    return 3;
+}
+
+/**
+ * @brief Append a four byte integer property
+ */
+static uint16_t mqtt_property_put_u32(uint8_t *buffer, uint8_t id, uint32_t value) {
+    buffer[0] = id;
+    buffer[1] = (value >> 24) & 0xFF;
+    buffer[2] = (value >> 16) & 0xFF;
+    buffer[3] = (value >> 8) & 0xFF;
+    buffer[4] = value & 0xFF;
+    return 5;
+}
+
+/**
+ * @brief Write a property block (length prefix + properties)
+ */
+static uint16_t mqtt_properties_write(uint8_t *buffer, const uint8_t *props, uint16_t props_len) {
+    uint16_t pos = mqtt_encode_remaining_length(buffer, props_len);
+    if (props_len > 0) {
+        memcpy(&buffer[pos], props, props_len);
+    }
+    return pos + props_len;
+}
+
+/**
+ * @brief Locate the property block starting at *pos
+ *
+ * On success *pos is advanced past the block and the block bounds are
+ * returned through props/props_len.
+ */
+static bool mqtt_properties_read(const uint8_t *buffer, uint32_t length, uint32_t *pos,
+                                 const uint8_t **props, uint32_t *props_len) {
+    uint32_t len;
+    if (!mqtt_decode_varint(buffer, length, pos, &len) || *pos + len > length) {
+        return false;
+    }
+    *props = &buffer[*pos];
+    *props_len = len;
+    *pos += len;
+    return true;
+}
+
+/**
+ * @brief Decode next property from a property block
+ *
+ * @return true if a property was decoded; false at the end of the block or
+ *         on a malformed property (in which case *pos < props_len)
+ */
+static bool mqtt_property_next(const uint8_t *props, uint32_t props_len,
+                               uint32_t *pos, mqtt_property_t *prop) {
+    if (*pos >= props_len) {
+        return false;
+    }
+
+    uint32_t start = *pos;
+    prop->id = props[(*pos)++];
+    prop->value = 0;
+    prop->data = NULL;
+    prop->length = 0;
+
+    switch (prop->id) {
+        case MQTT_PROP_PAYLOAD_FORMAT_INDICATOR:
+        case MQTT_PROP_REQUEST_PROBLEM_INFO:
+        case MQTT_PROP_REQUEST_RESPONSE_INFO:
+        case MQTT_PROP_MAXIMUM_QOS:
+        case MQTT_PROP_RETAIN_AVAILABLE:
+        case MQTT_PROP_WILDCARD_SUB_AVAILABLE:
+        case MQTT_PROP_SUB_ID_AVAILABLE:
+        case MQTT_PROP_SHARED_SUB_AVAILABLE:
+            if (*pos + 1 > props_len) break;
+            prop->value = props[(*pos)++];
+            return true;
+
+        case MQTT_PROP_SERVER_KEEP_ALIVE:
+        case MQTT_PROP_RECEIVE_MAXIMUM:
+        case MQTT_PROP_TOPIC_ALIAS_MAXIMUM:
+        case MQTT_PROP_TOPIC_ALIAS:
+            if (*pos + 2 > props_len) break;
+            prop->value = ((uint32_t)props[*pos] << 8) | props[*pos + 1];
+            *pos += 2;
+            return true;
+
+        case MQTT_PROP_MESSAGE_EXPIRY_INTERVAL:
+        case MQTT_PROP_SESSION_EXPIRY_INTERVAL:
+        case MQTT_PROP_WILL_DELAY_INTERVAL:
+        case MQTT_PROP_MAXIMUM_PACKET_SIZE:
+            if (*pos + 4 > props_len) break;
+            prop->value = ((uint32_t)props[*pos] << 24) | ((uint32_t)props[*pos + 1] << 16) |
+                          ((uint32_t)props[*pos + 2] << 8) | props[*pos + 3];
+            *pos += 4;
+            return true;
+
+        case MQTT_PROP_SUBSCRIPTION_IDENTIFIER:
+            if (!mqtt_decode_varint(props, props_len, pos, &prop->value)) break;
+            return true;
+
+        case MQTT_PROP_CONTENT_TYPE:
+        case MQTT_PROP_RESPONSE_TOPIC:
+        case MQTT_PROP_CORRELATION_DATA:
+        case MQTT_PROP_ASSIGNED_CLIENT_ID:
+        case MQTT_PROP_AUTHENTICATION_METHOD:
+        case MQTT_PROP_AUTHENTICATION_DATA:
+        case MQTT_PROP_RESPONSE_INFO:
+        case MQTT_PROP_SERVER_REFERENCE:
+        case MQTT_PROP_REASON_STRING:
+        case MQTT_PROP_USER_PROPERTY: {
+            /* User property is a string pair; data covers both strings */
+            int strings = (prop->id == MQTT_PROP_USER_PROPERTY) ? 2 : 1;
+            bool ok = true;
+            for (int i = 0; i < strings && ok; i++) {
+                if (*pos + 2 > props_len) { ok = false; break; }
+                uint16_t len = (props[*pos] << 8) | props[*pos + 1];
+                if (*pos + 2 + len > props_len) { ok = false; break; }
+                if (i == 0) {
+                    prop->data = &props[*pos + 2];
+                    prop->length = len;
+                }
+                *pos += 2 + len;
+            }
+            if (!ok) break;
+            return true;
+        }
+
+        default:
+            break;
+    }
+
+    *pos = start;  /* Unknown or truncated property: leave position at it */
+    return false;
+}
+
 /**
  * @brief Get next message ID
  */
@@ -115,55 +346,15 @@ static mqtt_error_t mqtt_send_packet(mqtt_client_t *client, const uint8_t *data,
 }
 
 /**
- * @brief Receive packet from broker
+ * @brief Send packet from the service task
+ *
+ * Serialises with application tasks that are sending under the client mutex.
  */
-static mqtt_error_t mqtt_receive_packet(mqtt_client_t *client, uint8_t *msg_type, uint32_t timeout_ms) {
-    uint8_t header[5];
-    int32_t received;
-
-    /* Read fixed header (minimum 2 bytes) */
-    received = net_recv(client->socket, header, 1, timeout_ms);
-    if (received <= 0) {
-        return (received == 0) ? MQTT_ERROR_TIMEOUT : MQTT_ERROR_NETWORK;
-    }
-
-    *msg_type = (header[0] >> 4) & 0x0F;
-
-    /* Read remaining length */
-    uint16_t len_bytes = 0;
-    do {
-        received = net_recv(client->socket, &header[1 + len_bytes], 1, timeout_ms);
-        if (received <= 0) {
-            return MQTT_ERROR_NETWORK;
-        }
-        len_bytes++;
-    } while ((header[len_bytes] & 0x80) != 0 && len_bytes < 4);
-
-    uint16_t bytes_used;
-    uint32_t remaining_length = mqtt_decode_remaining_length(&header[1], &bytes_used);
-
-    /* Read remaining packet */
-    if (remaining_length > 0) {
-        if (remaining_length > MQTT_MAX_PACKET_SIZE) {
-            return MQTT_ERROR_BUFFER_OVERFLOW;
-        }
-
-        uint32_t total_received = 0;
-        while (total_received < remaining_length) {
-            received = net_recv(client->socket,
-                               &client->rx_buffer[total_received],
-                               remaining_length - total_received,
-                               timeout_ms);
-            if (received <= 0) {
-                return MQTT_ERROR_NETWORK;
-            }
-            total_received += received;
-        }
-        client->rx_buffer_pos = remaining_length;
-    }
-
-    client->last_activity_ms = mqtt_get_time_ms();
-    return MQTT_OK;
+static mqtt_error_t mqtt_send_packet_locked(mqtt_client_t *client, const uint8_t *data, uint16_t length) {
+    os_mutex_lock(&client->mutex, OS_WAIT_FOREVER);
+    mqtt_error_t err = mqtt_send_packet(client, data, length);
+    os_mutex_unlock(&client->mutex);
+    return err;
 }
 
 /**
@@ -184,7 +375,8 @@ static mqtt_error_t mqtt_send_connect(mqtt_client_t *client) {
     payload_pos += mqtt_encode_string(&buf[payload_pos], "MQTT");
 
     /* Protocol Level */
-    buf[payload_pos++] = MQTT_PROTOCOL_VERSION_3_1_1;
+    buf[payload_pos++] = mqtt_is_v5(client) ? MQTT_PROTOCOL_VERSION_5
+                                            : MQTT_PROTOCOL_VERSION_3_1_1;
 
     /* Connect Flags */
     uint8_t flags = 0;
@@ -203,11 +395,33 @@ static mqtt_error_t mqtt_send_connect(mqtt_client_t *client) {
     buf[payload_pos++] = (keepalive >> 8) & 0xFF;
     buf[payload_pos++] = keepalive & 0xFF;
 
+    /* Properties (MQTT 5) - advertise our limits so the broker respects them */
+    if (mqtt_is_v5(client)) {
+        uint8_t props[24];
+        uint16_t props_len = 0;
+        if (client->config.session_expiry_sec > 0) {
+            props_len += mqtt_property_put_u32(&props[props_len], MQTT_PROP_SESSION_EXPIRY_INTERVAL,
+                                               client->config.session_expiry_sec);
+        }
+        props_len += mqtt_property_put_u16(&props[props_len], MQTT_PROP_RECEIVE_MAXIMUM,
+                                           mqtt_receive_maximum(client));
+        props_len += mqtt_property_put_u32(&props[props_len], MQTT_PROP_MAXIMUM_PACKET_SIZE,
+                                           MQTT_MAX_PACKET_SIZE);
+        if (client->config.topic_alias_maximum > 0) {
+            props_len += mqtt_property_put_u16(&props[props_len], MQTT_PROP_TOPIC_ALIAS_MAXIMUM,
+                                               client->config.topic_alias_maximum);
+        }
+        payload_pos += mqtt_properties_write(&buf[payload_pos], props, props_len);
+    }
+
     /* Payload - Client ID */
     payload_pos += mqtt_encode_string(&buf[payload_pos], client->config.client_id);
 
     /* Will Topic and Message */
     if (client->config.will_topic) {
+        if (mqtt_is_v5(client)) {
+            buf[payload_pos++] = 0;  /* Empty Will Properties */
+        }
         payload_pos += mqtt_encode_string(&buf[payload_pos], client->config.will_topic);
         buf[payload_pos++] = (client->config.will_message_len >> 8) & 0xFF;
         buf[payload_pos++] = client->config.will_message_len & 0xFF;
@@ -249,6 +463,18 @@ static mqtt_error_t mqtt_send_disconnect(mqtt_client_t *client) {
     return mqtt_send_packet(client, packet, sizeof(packet));
 }
 
+/**
+ * @brief Send DISCONNECT with a reason code from the service task (MQTT 5)
+ */
+static mqtt_error_t mqtt_send_disconnect_reason(mqtt_client_t *client, mqtt_reason_code_t reason) {
+    uint8_t packet[3] = {
+        (MQTT_MSG_TYPE_DISCONNECT << 4),
+        1,  /* Remaining length */
+        (uint8_t)reason
+    };
+    return mqtt_send_packet_locked(client, packet, sizeof(packet));
+}
+
 /**
  * @brief Send PINGREQ packet
  */
@@ -257,7 +483,47 @@ static mqtt_error_t mqtt_send_pingreq(mqtt_client_t *client) {
         (MQTT_MSG_TYPE_PINGREQ << 4),
         0  /* Remaining length = 0 */
     };
-    return mqtt_send_packet(client, packet, sizeof(packet));
+    return mqtt_send_packet_locked(client, packet, sizeof(packet));
+}
+
+/**
+ * @brief Resolve outbound topic alias (MQTT 5)
+ *
+ * Returns the alias to use (0 = none). *send_topic is cleared when the
+ * broker already knows the alias, so only the two byte alias goes on the wire.
+ */
+static uint16_t mqtt_tx_alias_lookup(mqtt_client_t *client, const char *topic, bool *send_topic) {
+    *send_topic = true;
+
+    if (!mqtt_is_v5(client) || client->server_topic_alias_maximum == 0) {
+        return 0;
+    }
+
+    uint16_t limit = client->server_topic_alias_maximum;
+    if (limit > MQTT_MAX_TOPIC_ALIASES) {
+        limit = MQTT_MAX_TOPIC_ALIASES;
+    }
+
+    int free_slot = -1;
+    for (uint16_t i = 0; i < limit; i++) {
+        if (client->tx_aliases[i].active) {
+            if (strcmp(client->tx_aliases[i].topic, topic) == 0) {
+                *send_topic = false;
+                return i + 1;
+            }
+        } else if (free_slot < 0) {
+            free_slot = i;
+        }
+    }
+
+    /* Establish a new alias; the first publish carries topic and alias */
+    if (free_slot >= 0 && strlen(topic) < MQTT_MAX_TOPIC_LENGTH) {
+        strcpy(client->tx_aliases[free_slot].topic, topic);
+        client->tx_aliases[free_slot].active = true;
+        return free_slot + 1;
+    }
+
+    return 0;
 }
 
 /**
@@ -269,6 +535,16 @@ static mqtt_error_t mqtt_send_publish(mqtt_client_t *client, const char *topic,
     uint16_t pos = 0;
     uint8_t *buf = client->tx_buffer;
 
+    /* Topic alias (MQTT 5) */
+    bool send_topic = true;
+    uint16_t alias = mqtt_tx_alias_lookup(client, topic, &send_topic);
+
+    uint8_t props[3];
+    uint16_t props_len = 0;
+    if (alias > 0) {
+        props_len = mqtt_property_put_u16(props, MQTT_PROP_TOPIC_ALIAS, alias);
+    }
+
     /* Fixed header */
     uint8_t flags = 0;
     if (retained) flags |= 0x01;
@@ -276,16 +552,30 @@ static mqtt_error_t mqtt_send_publish(mqtt_client_t *client, const char *topic,
     buf[pos++] = (MQTT_MSG_TYPE_PUBLISH << 4) | flags;
 
     /* Calculate remaining length */
-    uint16_t topic_len = strlen(topic);
+    uint16_t topic_len = send_topic ? strlen(topic) : 0;
     uint32_t remaining_length = 2 + topic_len + payload_len;
     if (qos > MQTT_QOS_0) {
         remaining_length += 2;  /* Message ID */
     }
+    if (mqtt_is_v5(client)) {
+        remaining_length += 1 + props_len;  /* Property length fits in one byte */
+    }
+
+    /* Respect our buffer and the broker's Maximum Packet Size */
+    uint32_t packet_size = remaining_length + 1 + (remaining_length < 128 ? 1 : 2);
+    if (packet_size > MQTT_MAX_PACKET_SIZE ||
+        (client->server_maximum_packet_size > 0 &&
+         packet_size > client->server_maximum_packet_size)) {
+        if (alias > 0 && send_topic) {
+            client->tx_aliases[alias - 1].active = false;  /* Alias never reached the broker */
+        }
+        return MQTT_ERROR_BUFFER_OVERFLOW;
+    }
 
     pos += mqtt_encode_remaining_length(&buf[pos], remaining_length);
 
-    /* Variable header - Topic */
-    pos += mqtt_encode_string(&buf[pos], topic);
+    /* Variable header - Topic (empty when an established alias is used) */
+    pos += mqtt_encode_string(&buf[pos], send_topic ? topic : NULL);
 
     /* Message ID (for QoS > 0) */
     if (qos > MQTT_QOS_0) {
@@ -293,6 +583,11 @@ static mqtt_error_t mqtt_send_publish(mqtt_client_t *client, const char *topic,
         buf[pos++] = message_id & 0xFF;
     }
 
+    /* Properties (MQTT 5) */
+    if (mqtt_is_v5(client)) {
+        pos += mqtt_properties_write(&buf[pos], props, props_len);
+    }
+
     /* Payload */
     if (payload_len > 0) {
         memcpy(&buf[pos], payload, payload_len);
@@ -305,7 +600,8 @@ static mqtt_error_t mqtt_send_publish(mqtt_client_t *client, const char *topic,
 /**
  * @brief Send SUBSCRIBE packet
  */
-static mqtt_error_t mqtt_send_subscribe(mqtt_client_t *client, const char *topic, mqtt_qos_t qos) {
+static mqtt_error_t mqtt_send_subscribe(mqtt_client_t *client, const char *topic,
+                                        mqtt_qos_t qos, uint16_t message_id) {
     uint16_t pos = 0;
     uint8_t *buf = client->tx_buffer;
 
@@ -315,15 +611,23 @@ static mqtt_error_t mqtt_send_subscribe(mqtt_client_t *client, const char *topic
     /* Calculate remaining length */
     uint16_t topic_len = strlen(topic);
     uint32_t remaining_length = 2 + 2 + topic_len + 1;  /* Message ID + Topic + QoS */
+    if (mqtt_is_v5(client)) {
+        remaining_length += 1;  /* Empty properties */
+    }
+    if (remaining_length + 3 > MQTT_MAX_PACKET_SIZE) {
+        return MQTT_ERROR_BUFFER_OVERFLOW;
+    }
 
     pos += mqtt_encode_remaining_length(&buf[pos], remaining_length);
 
     /* Variable header - Message ID */
-    uint16_t message_id = mqtt_next_message_id(client);
     buf[pos++] = (message_id >> 8) & 0xFF;
     buf[pos++] = message_id & 0xFF;
+    if (mqtt_is_v5(client)) {
+        buf[pos++] = 0;
+    }
 
-    /* Payload - Topic filter */
+    /* Payload - Topic filter and options (QoS in the low bits for both versions) */
     pos += mqtt_encode_string(&buf[pos], topic);
     buf[pos++] = qos;
 
@@ -343,6 +647,12 @@ static mqtt_error_t mqtt_send_unsubscribe(mqtt_client_t *client, const char *top
     /* Calculate remaining length */
     uint16_t topic_len = strlen(topic);
     uint32_t remaining_length = 2 + 2 + topic_len;  /* Message ID + Topic */
+    if (mqtt_is_v5(client)) {
+        remaining_length += 1;  /* Empty properties */
+    }
+    if (remaining_length + 3 > MQTT_MAX_PACKET_SIZE) {
+        return MQTT_ERROR_BUFFER_OVERFLOW;
+    }
 
     pos += mqtt_encode_remaining_length(&buf[pos], remaining_length);
 
@@ -350,6 +660,9 @@ static mqtt_error_t mqtt_send_unsubscribe(mqtt_client_t *client, const char *top
     uint16_t message_id = mqtt_next_message_id(client);
     buf[pos++] = (message_id >> 8) & 0xFF;
     buf[pos++] = message_id & 0xFF;
+    if (mqtt_is_v5(client)) {
+        buf[pos++] = 0;
+    }
 
     /* Payload - Topic filter */
     pos += mqtt_encode_string(&buf[pos], topic);
@@ -357,6 +670,32 @@ static mqtt_error_t mqtt_send_unsubscribe(mqtt_client_t *client, const char *top
     return mqtt_send_packet(client, buf, pos);
 }
 
+/**
+ * @brief Send a two byte acknowledgement (PUBACK, PUBREC, PUBREL, PUBCOMP)
+ *
+ * MQTT 5 allows the reason code to be omitted when it is Success, so the
+ * same four byte packet serves both protocol versions.
+ */
+static mqtt_error_t mqtt_send_ack(mqtt_client_t *client, uint8_t type, uint8_t flags, uint16_t message_id) {
+    uint8_t packet[4] = {
+        (uint8_t)((type << 4) | flags),
+        2,  /* Remaining length */
+        (uint8_t)((message_id >> 8) & 0xFF),
+        (uint8_t)(message_id & 0xFF)
+    };
+    return mqtt_send_packet_locked(client, packet, sizeof(packet));
+}
+
+/* MQTT 3.1.1 CONNACK return codes mapped onto MQTT 5 reason codes */
+static const uint8_t mqtt_connack_reason_map[] = {
+    MQTT_RC_SUCCESS,
+    MQTT_RC_UNSUPPORTED_PROTOCOL_VERSION,
+    MQTT_RC_CLIENT_ID_NOT_VALID,
+    MQTT_RC_SERVER_UNAVAILABLE,
+    MQTT_RC_BAD_USERNAME_OR_PASSWORD,
+    MQTT_RC_NOT_AUTHORIZED
+};
+
 /**
  * @brief Handle CONNACK packet
  */
@@ -367,8 +706,79 @@ static mqtt_error_t mqtt_handle_connack(mqtt_client_t *client) {
 
     uint8_t return_code = client->rx_buffer[1];
 
-    if (return_code == MQTT_CONNACK_ACCEPTED) {
+    /* Session Present is only meaningful when we asked to keep the session */
+    client->session_present = !client->config.clean_session && (client->rx_buffer[0] & 0x01);
+
+    /* Session limits default to "unlimited" unless the broker says otherwise */
+    client->server_receive_maximum = 65535;
+    client->server_topic_alias_maximum = 0;
+    client->server_maximum_packet_size = 0;
+    client->inflight_count = 0;
+    memset(client->inflight_ids, 0, sizeof(client->inflight_ids));
+
+    /* Inbound QoS 2 state belongs to the session */
+    if (!client->session_present) {
+        client->rx_inflight_count = 0;
+        memset(client->rx_inflight_ids, 0, sizeof(client->rx_inflight_ids));
+    }
+
+    /* Topic aliases only live as long as the network connection */
+    memset(client->tx_aliases, 0, sizeof(client->tx_aliases));
+    memset(client->rx_aliases, 0, sizeof(client->rx_aliases));
+
+    if (mqtt_is_v5(client)) {
+        client->last_reason_code = (mqtt_reason_code_t)return_code;
+
+        uint32_t pos = 2;
+        const uint8_t *props;
+        uint32_t props_len;
+        if (!mqtt_properties_read(client->rx_buffer, client->rx_buffer_pos, &pos, &props, &props_len)) {
+            return MQTT_ERROR_PROTOCOL;
+        }
+
+        uint32_t prop_pos = 0;
+        mqtt_property_t prop;
+        while (mqtt_property_next(props, props_len, &prop_pos, &prop)) {
+            switch (prop.id) {
+                case MQTT_PROP_RECEIVE_MAXIMUM:
+                    if (prop.value > 0) {
+                        client->server_receive_maximum = (uint16_t)prop.value;
+                    }
+                    break;
+                case MQTT_PROP_TOPIC_ALIAS_MAXIMUM:
+                    client->server_topic_alias_maximum = (uint16_t)prop.value;
+                    break;
+                case MQTT_PROP_MAXIMUM_PACKET_SIZE:
+                    client->server_maximum_packet_size = prop.value;
+                    break;
+                case MQTT_PROP_SERVER_KEEP_ALIVE:
+                    client->config.keepalive_sec = (uint16_t)prop.value;
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (prop_pos != props_len) {
+            return MQTT_ERROR_PROTOCOL;
+        }
+    } else {
+        client->last_reason_code = (return_code < sizeof(mqtt_connack_reason_map))
+                                 ? (mqtt_reason_code_t)mqtt_connack_reason_map[return_code]
+                                 : MQTT_RC_UNSPECIFIED_ERROR;
+    }
+
+    if (client->last_reason_code == MQTT_RC_SUCCESS) {
         client->state = MQTT_STATE_CONNECTED;
+        client->ping_outstanding = false;
+        client->reconnect_attempts = 0;
+
+        mqtt_session_restore(client);
+
+        mqtt_complete_callback_t callback = client->connect_callback;
+        client->connect_callback = NULL;
+        if (callback) {
+            callback(client, MQTT_OK, client->connect_callback_data);
+        }
         if (client->connection_callback) {
             client->connection_callback(client, true, client->connection_callback_data);
         }
@@ -382,13 +792,20 @@ static mqtt_error_t mqtt_handle_connack(mqtt_client_t *client) {
  * @brief Handle PUBLISH packet
  */
 static mqtt_error_t mqtt_handle_publish(mqtt_client_t *client) {
-    uint16_t pos = 0;
+    uint32_t pos = 0;
+    uint32_t length = client->rx_buffer_pos;
+    mqtt_qos_t qos = (mqtt_qos_t)((client->rx_header >> 1) & 0x03);
+    bool retained = (client->rx_header & 0x01) != 0;
+
+    if (length < 2 || qos > MQTT_QOS_2) {
+        return MQTT_ERROR_PROTOCOL;
+    }
 
     /* Topic name */
     uint16_t topic_len = (client->rx_buffer[pos] << 8) | client->rx_buffer[pos + 1];
     pos += 2;
 
-    if (topic_len >= MQTT_MAX_TOPIC_LENGTH || pos + topic_len > client->rx_buffer_pos) {
+    if (topic_len >= MQTT_MAX_TOPIC_LENGTH || pos + topic_len > length) {
         return MQTT_ERROR_PROTOCOL;
     }
 
@@ -397,35 +814,157 @@ static mqtt_error_t mqtt_handle_publish(mqtt_client_t *client) {
     topic[topic_len] = '\0';
     pos += topic_len;
 
-    /* Message ID (for QoS > 0) - we'll skip for now */
-    /* QoS would be in the fixed header flags */
+    /* Message ID (for QoS > 0) */
+    uint16_t message_id = 0;
+    if (qos > MQTT_QOS_0) {
+        if (pos + 2 > length) {
+            return MQTT_ERROR_PROTOCOL;
+        }
+        message_id = (client->rx_buffer[pos] << 8) | client->rx_buffer[pos + 1];
+        pos += 2;
+        if (message_id == 0) {
+            return MQTT_ERROR_PROTOCOL;
+        }
+    }
+
+    /* Properties (MQTT 5) - resolve topic alias */
+    if (mqtt_is_v5(client)) {
+        const uint8_t *props;
+        uint32_t props_len;
+        if (!mqtt_properties_read(client->rx_buffer, length, &pos, &props, &props_len)) {
+            return MQTT_ERROR_PROTOCOL;
+        }
+
+        uint16_t alias = 0;
+        uint32_t prop_pos = 0;
+        mqtt_property_t prop;
+        while (mqtt_property_next(props, props_len, &prop_pos, &prop)) {
+            if (prop.id == MQTT_PROP_TOPIC_ALIAS) {
+                alias = (uint16_t)prop.value;
+                if (alias == 0 || alias > client->config.topic_alias_maximum) {
+                    client->last_reason_code = MQTT_RC_TOPIC_ALIAS_INVALID;
+                    return MQTT_ERROR_PROTOCOL;
+                }
+            }
+        }
+        if (prop_pos != props_len) {
+            return MQTT_ERROR_PROTOCOL;
+        }
+
+        if (alias > 0) {
+            mqtt_topic_alias_t *entry = &client->rx_aliases[alias - 1];
+            if (topic_len > 0) {
+                memcpy(entry->topic, topic, topic_len + 1);
+                entry->active = true;
+            } else if (entry->active) {
+                strcpy(topic, entry->topic);
+            } else {
+                client->last_reason_code = MQTT_RC_TOPIC_ALIAS_INVALID;
+                return MQTT_ERROR_PROTOCOL;
+            }
+        } else if (topic_len == 0) {
+            return MQTT_ERROR_PROTOCOL;
+        }
+    }
+
+    /*
+     * QoS 2 is delivered once per packet id: a retransmission of one still
+     * awaiting PUBREL is only acknowledged again. QoS 1 is acknowledged
+     * right after delivery, so only QoS 2 holds the Receive Maximum window.
+     */
+    bool duplicate = (qos == MQTT_QOS_2) && mqtt_inflight_find(client->rx_inflight_ids, message_id);
+    if (qos > MQTT_QOS_0 && !duplicate && mqtt_is_v5(client) &&
+        client->rx_inflight_count >= mqtt_receive_maximum(client)) {
+        client->last_reason_code = MQTT_RC_RECEIVE_MAXIMUM_EXCEEDED;
+        mqtt_send_disconnect_reason(client, MQTT_RC_RECEIVE_MAXIMUM_EXCEEDED);
+        return MQTT_ERROR_PROTOCOL;
+    }
+    if (qos == MQTT_QOS_2 && !duplicate) {
+        /* MQTT 3.1.1 has no window: past the table, duplicates go undetected */
+        mqtt_inflight_add(client->rx_inflight_ids, &client->rx_inflight_count, message_id);
+    }
 
     /* Payload */
-    uint16_t payload_len = client->rx_buffer_pos - pos;
+    uint16_t payload_len = length - pos;
     const uint8_t *payload = &client->rx_buffer[pos];
 
     /* Call user callback */
-    if (client->message_callback) {
+    if (client->message_callback && !duplicate) {
         mqtt_message_t msg = {
             .topic = topic,
             .payload = payload,
             .payload_length = payload_len,
-            .qos = MQTT_QOS_0,
-            .retained = false,
-            .message_id = 0
+            .qos = qos,
+            .retained = retained,
+            .message_id = message_id
         };
         client->message_callback(client, &msg, client->message_callback_data);
     }
 
+    /* Acknowledge */
+    if (qos == MQTT_QOS_1) {
+        return mqtt_send_ack(client, MQTT_MSG_TYPE_PUBACK, 0, message_id);
+    } else if (qos == MQTT_QOS_2) {
+        return mqtt_send_ack(client, MQTT_MSG_TYPE_PUBREC, 0, message_id);
+    }
+
     return MQTT_OK;
 }
 
 /**
- * @brief Handle PUBACK packet
+ * @brief Handle PUBACK / PUBCOMP packet (end of an outbound QoS 1 / 2 flow)
  */
 static mqtt_error_t mqtt_handle_puback(mqtt_client_t *client) {
-    /* For now, just acknowledge receipt */
-    return MQTT_OK;
+    if (client->rx_buffer_pos < 2) {
+        return MQTT_ERROR_PROTOCOL;
+    }
+
+    uint16_t message_id = (client->rx_buffer[0] << 8) | client->rx_buffer[1];
+    mqtt_inflight_release(client, message_id);
+
+    client->last_reason_code = (mqtt_is_v5(client) && client->rx_buffer_pos >= 3)
+                             ? (mqtt_reason_code_t)client->rx_buffer[2]
+                             : MQTT_RC_SUCCESS;
+
+    mqtt_error_t result = (client->last_reason_code >= 0x80) ? MQTT_ERROR_PUBLISH_FAILED : MQTT_OK;
+    mqtt_pending_complete(client, (client->rx_header >> 4) & 0x0F, message_id, result);
+    return result;
+}
+
+/**
+ * @brief Handle PUBREC packet (outbound QoS 2, step 1)
+ */
+static mqtt_error_t mqtt_handle_pubrec(mqtt_client_t *client) {
+    if (client->rx_buffer_pos < 2) {
+        return MQTT_ERROR_PROTOCOL;
+    }
+
+    uint16_t message_id = (client->rx_buffer[0] << 8) | client->rx_buffer[1];
+    client->last_reason_code = (mqtt_is_v5(client) && client->rx_buffer_pos >= 3)
+                             ? (mqtt_reason_code_t)client->rx_buffer[2]
+                             : MQTT_RC_SUCCESS;
+
+    /* A failure reason ends the flow without PUBREL */
+    if (client->last_reason_code >= 0x80) {
+        mqtt_inflight_release(client, message_id);
+        mqtt_pending_complete(client, MQTT_MSG_TYPE_PUBCOMP, message_id, MQTT_ERROR_PUBLISH_FAILED);
+        return MQTT_ERROR_PUBLISH_FAILED;
+    }
+
+    return mqtt_send_ack(client, MQTT_MSG_TYPE_PUBREL, 0x02, message_id);
+}
+
+/**
+ * @brief Handle PUBREL packet (inbound QoS 2, step 2)
+ */
+static mqtt_error_t mqtt_handle_pubrel(mqtt_client_t *client) {
+    if (client->rx_buffer_pos < 2) {
+        return MQTT_ERROR_PROTOCOL;
+    }
+
+    uint16_t message_id = (client->rx_buffer[0] << 8) | client->rx_buffer[1];
+    mqtt_inflight_remove(client->rx_inflight_ids, &client->rx_inflight_count, message_id);
+    return mqtt_send_ack(client, MQTT_MSG_TYPE_PUBCOMP, 0, message_id);
 }
 
 /**
@@ -437,18 +976,45 @@ static mqtt_error_t mqtt_handle_suback(mqtt_client_t *client) {
         return MQTT_ERROR_PROTOCOL;
     }
 
-    uint8_t return_code = client->rx_buffer[2];
-    if (return_code == 0x80) {
-        return MQTT_ERROR_SUBSCRIBE_FAILED;
+    uint32_t pos = 2;  /* Skip message ID */
+    if (mqtt_is_v5(client)) {
+        const uint8_t *props;
+        uint32_t props_len;
+        if (!mqtt_properties_read(client->rx_buffer, client->rx_buffer_pos, &pos, &props, &props_len) ||
+            pos >= client->rx_buffer_pos) {
+            return MQTT_ERROR_PROTOCOL;
+        }
     }
 
-    return MQTT_OK;
+    uint16_t message_id = (client->rx_buffer[0] << 8) | client->rx_buffer[1];
+    uint8_t return_code = client->rx_buffer[pos];
+    client->last_reason_code = (mqtt_reason_code_t)return_code;
+
+    mqtt_error_t result = (return_code >= 0x80) ? MQTT_ERROR_SUBSCRIBE_FAILED : MQTT_OK;
+    mqtt_pending_complete(client, MQTT_MSG_TYPE_SUBACK, message_id, result);
+    return result;
 }
 
 /**
- * @brief Check if topic matches subscription pattern
+ * @brief Handle DISCONNECT packet (broker initiated, MQTT 5 only)
  */
-static bool mqtt_topic_matches(const char *subscription, const char *topic) {
+static mqtt_error_t mqtt_handle_disconnect(mqtt_client_t *client) {
+    if (!mqtt_is_v5(client)) {
+        return MQTT_ERROR_PROTOCOL;
+    }
+
+    client->last_reason_code = (client->rx_buffer_pos >= 1)
+                             ? (mqtt_reason_code_t)client->rx_buffer[0]
+                             : MQTT_RC_SUCCESS;
+
+    return MQTT_ERROR_NOT_CONNECTED;  /* Caller tears the connection down */
+}
+
+bool mqtt_topic_matches(const char *subscription, const char *topic) {
+    if (!subscription || !topic) {
+        return false;
+    }
+
     /* Simple wildcard matching */
     /* + matches single level, # matches multiple levels */
 
@@ -471,26 +1037,573 @@ static bool mqtt_topic_matches(const char *subscription, const char *topic) {
         }
     }
 
+    /* "a/#" also matches the parent level "a" */
+    if (*t == '\0' && s[0] == '/' && s[1] == '#' && s[2] == '\0') {
+        return true;
+    }
+
     return (*s == '\0' && *t == '\0');
 }
 
+/* ========== Event-Driven Service ========== */
+
+/* Receive parser states */
+#define MQTT_RX_HEADER  0   /* Waiting for fixed header byte */
+#define MQTT_RX_LENGTH  1   /* Reading remaining length bytes */
+#define MQTT_RX_BODY    2   /* Reading variable header + payload */
+
+/* Service event bits: one RX, TIMER and COMMAND bit per client slot */
+#define MQTT_EV_RX(slot)        (1UL << (slot))
+#define MQTT_EV_TIMER(slot)     (1UL << (8 + (slot)))
+#define MQTT_EV_CMD(slot)       (1UL << (16 + (slot)))
+#define MQTT_EV_SLOT(slot)      (MQTT_EV_RX(slot) | MQTT_EV_TIMER(slot) | MQTT_EV_CMD(slot))
+#define MQTT_EV_ALL             0x00FFFFFFUL
+
+#if MQTT_SERVICE_MAX_CLIENTS > 8
+#error "MQTT_SERVICE_MAX_CLIENTS must not exceed 8"
+#endif
+
+static struct {
+    tcb_t task;
+    bool running;
+    event_group_t events;
+    mqtt_client_t *clients[MQTT_SERVICE_MAX_CLIENTS];
+} mqtt_service;
+
 /**
- * @brief MQTT background task
+ * @brief Keepalive timer callback (timer context: only signals the service)
  */
-static void mqtt_task(void *param) {
+static void mqtt_keepalive_timer_callback(void *param) {
     mqtt_client_t *client = (mqtt_client_t *)param;
-
-    while (client->task_running) {
-        mqtt_loop(client);
-        os_task_delay(10);  /* 10ms delay */
+    if (client->service_slot >= 0) {
+        os_event_group_set_bits(&mqtt_service.events, MQTT_EV_TIMER(client->service_slot));
     }
 }
 
-/* ========== Public API ========== */
+/**
+ * @brief Service task: sleeps until a socket or timer needs attention
+ */
+static void mqtt_service_task(void *param) {
+    (void)param;
+
+    while (mqtt_service.running) {
+        uint32_t bits = 0;
+        if (os_event_group_wait_bits(&mqtt_service.events, MQTT_EV_ALL,
+                                     EVENT_WAIT_ANY | EVENT_CLEAR_ON_EXIT,
+                                     &bits, OS_WAIT_FOREVER) != OS_OK) {
+            continue;
+        }
 
-mqtt_error_t mqtt_client_init(mqtt_client_t *client, const mqtt_config_t *config) {
-    if (!client || !config) {
-        return MQTT_ERROR_INVALID_PARAM;
+        for (int i = 0; i < MQTT_SERVICE_MAX_CLIENTS; i++) {
+            mqtt_client_t *client = mqtt_service.clients[i];
+            if (client != NULL && (bits & MQTT_EV_SLOT(i))) {
+                mqtt_loop(client);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Register client with the service task
+ */
+static mqtt_error_t mqtt_service_register(mqtt_client_t *client) {
+    if (client->service_slot >= 0) {
+        return MQTT_OK;
+    }
+
+    mqtt_error_t err = mqtt_service_start(PRIORITY_NORMAL);
+    if (err != MQTT_OK) {
+        return err;
+    }
+
+    uint32_t state = os_enter_critical();
+    for (int i = 0; i < MQTT_SERVICE_MAX_CLIENTS; i++) {
+        if (mqtt_service.clients[i] == NULL) {
+            mqtt_service.clients[i] = client;
+            client->service_slot = i;
+            break;
+        }
+    }
+    os_exit_critical(state);
+
+    if (client->service_slot < 0) {
+        return MQTT_ERROR_NO_MEMORY;
+    }
+
+    os_timer_create(&client->keepalive_timer, "mqtt_ka", TIMER_AUTO_RELOAD,
+                    MQTT_SERVICE_TICK_MS, mqtt_keepalive_timer_callback, client);
+    os_timer_start(&client->keepalive_timer);
+    return MQTT_OK;
+}
+
+/**
+ * @brief Remove client from the service task
+ */
+static void mqtt_service_unregister(mqtt_client_t *client) {
+    if (client->service_slot < 0) {
+        return;
+    }
+
+    os_timer_stop(&client->keepalive_timer);
+
+    uint32_t state = os_enter_critical();
+    mqtt_service.clients[client->service_slot] = NULL;
+    client->service_slot = -1;
+    os_exit_critical(state);
+}
+
+/**
+ * @brief Record an operation awaiting acknowledgement
+ */
+static mqtt_error_t mqtt_pending_add(mqtt_client_t *client, uint8_t ack_type, uint16_t message_id,
+                                     mqtt_complete_callback_t callback, void *user_data) {
+    for (int i = 0; i < MQTT_MAX_PENDING; i++) {
+        mqtt_pending_t *p = &client->pending[i];
+        if (p->ack_type == 0) {
+            p->ack_type = ack_type;
+            p->message_id = message_id;
+            p->sent_ms = mqtt_get_time_ms();
+            p->callback = callback;
+            p->user_data = user_data;
+            return MQTT_OK;
+        }
+    }
+    return MQTT_ERROR_NO_MEMORY;
+}
+
+/**
+ * @brief Check whether a free pending slot exists
+ */
+static bool mqtt_pending_available(const mqtt_client_t *client) {
+    for (int i = 0; i < MQTT_MAX_PENDING; i++) {
+        if (client->pending[i].ack_type == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Complete the operation matching an acknowledgement
+ *
+ * The callback runs without the client mutex held so it may issue new
+ * requests.
+ */
+static void mqtt_pending_complete(mqtt_client_t *client, uint8_t ack_type,
+                                  uint16_t message_id, mqtt_error_t result) {
+    mqtt_complete_callback_t callback = NULL;
+    void *user_data = NULL;
+
+    os_mutex_lock(&client->mutex, OS_WAIT_FOREVER);
+    for (int i = 0; i < MQTT_MAX_PENDING; i++) {
+        mqtt_pending_t *p = &client->pending[i];
+        if (p->ack_type == ack_type && p->message_id == message_id) {
+            callback = p->callback;
+            user_data = p->user_data;
+            p->ack_type = 0;
+            break;
+        }
+    }
+    os_mutex_unlock(&client->mutex);
+
+    if (callback) {
+        callback(client, result, user_data);
+    }
+}
+
+/**
+ * @brief Fail outstanding operations (all, or only those older than timeout)
+ */
+static void mqtt_pending_expire(mqtt_client_t *client, mqtt_error_t result, bool all) {
+    uint32_t now = mqtt_get_time_ms();
+
+    for (int i = 0; i < MQTT_MAX_PENDING; i++) {
+        mqtt_pending_t *p = &client->pending[i];
+        if (p->ack_type != 0 && (all || (now - p->sent_ms) >= client->config.timeout_ms)) {
+            mqtt_complete_callback_t callback = p->callback;
+            void *user_data = p->user_data;
+            p->ack_type = 0;
+            if (callback) {
+                callback(client, result, user_data);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Open TCP connection and send CONNECT (runs in the service task)
+ *
+ * DNS and TCP connect in this stack are blocking, so they run here rather
+ * than in the caller; CONNACK is then awaited via socket readiness.
+ */
+static mqtt_error_t mqtt_open_connection(mqtt_client_t *client) {
+    client->connect_start_ms = mqtt_get_time_ms();
+    client->rx_state = MQTT_RX_HEADER;
+
+    /* Timer may still be running at the backoff period */
+    os_timer_change_period(&client->keepalive_timer, MQTT_SERVICE_TICK_MS);
+
+    net_socket_t sock = net_socket(SOCK_STREAM);
+    if (sock < 0) {
+        return MQTT_ERROR_NETWORK;
+    }
+
+    ipv4_addr_t broker_ip;
+    os_error_t err = net_dns_resolve(client->config.broker_host, &broker_ip, client->config.timeout_ms);
+    if (err == OS_OK) {
+        sockaddr_in_t broker_addr = {
+            .addr = broker_ip,
+            .port = client->config.broker_port
+        };
+        err = net_connect(sock, &broker_addr, client->config.timeout_ms);
+    }
+    if (err != OS_OK) {
+        net_close(sock);
+        return MQTT_ERROR_NETWORK;
+    }
+
+    os_mutex_lock(&client->mutex, OS_WAIT_FOREVER);
+    client->socket = sock;
+    mqtt_error_t mqtt_err = mqtt_send_connect(client);
+    os_mutex_unlock(&client->mutex);
+    if (mqtt_err != MQTT_OK) {
+        return mqtt_err;
+    }
+
+    net_socket_set_notify(sock, &mqtt_service.events, MQTT_EV_RX(client->service_slot));
+    return MQTT_OK;
+}
+
+/* ========== Reconnection ========== */
+
+/**
+ * @brief Seed the backoff jitter PRNG
+ *
+ * Mixes the client ID into the seed so devices that boot together (same
+ * uptime) still pick different reconnect times.
+ */
+static void mqtt_random_seed(mqtt_client_t *client) {
+    uint32_t hash = 2166136261u;  /* FNV-1a */
+    for (const char *p = client->config.client_id; p && *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    client->rng_state = hash ^ os_get_tick_count();
+    if (client->rng_state == 0) {
+        client->rng_state = 0x9E3779B9u;
+    }
+}
+
+/**
+ * @brief Next pseudo-random number (xorshift32)
+ */
+static uint32_t mqtt_random(mqtt_client_t *client) {
+    uint32_t x = client->rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    client->rng_state = x;
+    return x;
+}
+
+/**
+ * @brief Schedule the next reconnect attempt
+ *
+ * Exponential backoff capped at reconnect_max_interval_ms with "equal
+ * jitter": the delay is uniformly distributed in [d/2, d], which spreads
+ * a fleet's reconnects after a broker restart while keeping a floor.
+ */
+static void mqtt_schedule_reconnect(mqtt_client_t *client) {
+    uint32_t delay = client->config.reconnect_interval_ms;
+    for (uint16_t i = 0; i < client->reconnect_attempts && delay < client->config.reconnect_max_interval_ms; i++) {
+        delay <<= 1;
+    }
+    if (delay > client->config.reconnect_max_interval_ms) {
+        delay = client->config.reconnect_max_interval_ms;
+    }
+
+    delay = delay / 2 + mqtt_random(client) % (delay / 2 + 1);
+    if (delay == 0) {
+        delay = 1;
+    }
+
+    if (client->reconnect_attempts < UINT16_MAX) {
+        client->reconnect_attempts++;
+    }
+    client->reconnect_at_ms = mqtt_get_time_ms() + delay;
+    client->reconnect_pending = true;
+
+    /* One service tick at the attempt time instead of polling every second */
+    os_timer_change_period(&client->keepalive_timer, delay);
+}
+
+/**
+ * @brief Queue a publish while reconnecting (client mutex held)
+ *
+ * Record: flags (qos | retain << 2), topic length, payload length (2),
+ * topic, payload.
+ */
+static mqtt_error_t mqtt_offline_enqueue(mqtt_client_t *client, const char *topic,
+                                         const void *payload, uint16_t payload_length,
+                                         mqtt_qos_t qos, bool retained) {
+    size_t topic_len = strlen(topic);
+    if (topic_len >= MQTT_MAX_TOPIC_LENGTH) {
+        return MQTT_ERROR_INVALID_PARAM;
+    }
+
+    uint32_t record_len = 4 + topic_len + payload_length;
+    if (client->offline_queue_length + record_len > MQTT_OFFLINE_QUEUE_SIZE) {
+        return MQTT_ERROR_NO_MEMORY;
+    }
+
+    uint8_t *p = &client->offline_queue[client->offline_queue_length];
+    p[0] = (uint8_t)qos | (retained ? 0x04 : 0);
+    p[1] = (uint8_t)topic_len;
+    p[2] = (payload_length >> 8) & 0xFF;
+    p[3] = payload_length & 0xFF;
+    memcpy(&p[4], topic, topic_len);
+    if (payload_length > 0) {
+        memcpy(&p[4 + topic_len], payload, payload_length);
+    }
+
+    client->offline_queue_length += record_len;
+    return MQTT_OK;
+}
+
+/**
+ * @brief Send publishes queued while offline
+ *
+ * Stops at the first failure (e.g. Receive Maximum reached) and keeps the
+ * remainder for the next CONNACK.
+ */
+static void mqtt_offline_flush(mqtt_client_t *client) {
+    char topic[MQTT_MAX_TOPIC_LENGTH];
+    uint16_t pos = 0;
+
+    while (pos < client->offline_queue_length) {
+        const uint8_t *p = &client->offline_queue[pos];
+        uint8_t topic_len = p[1];
+        uint16_t payload_length = ((uint16_t)p[2] << 8) | p[3];
+
+        memcpy(topic, &p[4], topic_len);
+        topic[topic_len] = '\0';
+
+        if (mqtt_publish_async(client, topic, &p[4 + topic_len], payload_length,
+                               (mqtt_qos_t)(p[0] & 0x03), (p[0] & 0x04) != 0,
+                               NULL, NULL) != MQTT_OK) {
+            break;
+        }
+        pos += 4 + topic_len + payload_length;
+    }
+
+    os_mutex_lock(&client->mutex, OS_WAIT_FOREVER);
+    memmove(client->offline_queue, &client->offline_queue[pos], client->offline_queue_length - pos);
+    client->offline_queue_length -= pos;
+    os_mutex_unlock(&client->mutex);
+}
+
+/**
+ * @brief Restore session state after CONNACK
+ *
+ * A resumed session (session-present) already holds our subscriptions;
+ * otherwise they are re-sent. Queued publishes go out immediately.
+ */
+static void mqtt_session_restore(mqtt_client_t *client) {
+    if (!client->session_present) {
+        os_mutex_lock(&client->mutex, OS_WAIT_FOREVER);
+        for (int i = 0; i < MQTT_MAX_SUBSCRIPTIONS; i++) {
+            mqtt_subscription_t *sub = &client->subscriptions[i];
+            if (sub->active) {
+                mqtt_send_subscribe(client, sub->topic, sub->qos, mqtt_next_message_id(client));
+            }
+        }
+        os_mutex_unlock(&client->mutex);
+    }
+
+    if (client->offline_queue_length > 0) {
+        mqtt_offline_flush(client);
+    }
+}
+
+/**
+ * @brief Tear down the connection after an error or broker DISCONNECT
+ */
+static void mqtt_connection_lost(mqtt_client_t *client, mqtt_error_t reason) {
+    bool was_connected = (client->state == MQTT_STATE_CONNECTED);
+
+    os_mutex_lock(&client->mutex, OS_WAIT_FOREVER);
+    if (client->socket != INVALID_SOCKET) {
+        net_socket_set_notify(client->socket, NULL, 0);
+        net_close(client->socket);
+        client->socket = INVALID_SOCKET;
+    }
+    client->state = MQTT_STATE_DISCONNECTED;
+    client->ping_outstanding = false;
+    client->inflight_count = 0;
+    memset(client->inflight_ids, 0, sizeof(client->inflight_ids));
+    client->rx_state = MQTT_RX_HEADER;
+    os_mutex_unlock(&client->mutex);
+
+    /* Stay registered while reconnecting: the service timer drives backoff */
+    if (client->config.auto_reconnect) {
+        mqtt_schedule_reconnect(client);
+    } else {
+        mqtt_service_unregister(client);
+    }
+    mqtt_pending_expire(client, MQTT_ERROR_NOT_CONNECTED, true);
+
+    mqtt_complete_callback_t callback = client->connect_callback;
+    client->connect_callback = NULL;
+    if (callback) {
+        callback(client, reason, client->connect_callback_data);
+    }
+
+    if (was_connected && client->connection_callback) {
+        client->connection_callback(client, false, client->connection_callback_data);
+    }
+}
+
+/**
+ * @brief Dispatch a fully received packet
+ */
+static mqtt_error_t mqtt_dispatch_packet(mqtt_client_t *client) {
+    uint8_t msg_type = (client->rx_header >> 4) & 0x0F;
+
+    if (client->state == MQTT_STATE_CONNECTING) {
+        /* Nothing but CONNACK is valid before the session exists */
+        return (msg_type == MQTT_MSG_TYPE_CONNACK) ? mqtt_handle_connack(client)
+                                                   : MQTT_ERROR_PROTOCOL;
+    }
+
+    switch (msg_type) {
+        case MQTT_MSG_TYPE_PUBLISH:
+            return mqtt_handle_publish(client);
+        case MQTT_MSG_TYPE_PUBACK:
+        case MQTT_MSG_TYPE_PUBCOMP:
+            return mqtt_handle_puback(client);
+        case MQTT_MSG_TYPE_PUBREC:
+            return mqtt_handle_pubrec(client);
+        case MQTT_MSG_TYPE_PUBREL:
+            return mqtt_handle_pubrel(client);
+        case MQTT_MSG_TYPE_SUBACK:
+            return mqtt_handle_suback(client);
+        case MQTT_MSG_TYPE_DISCONNECT:
+            return mqtt_handle_disconnect(client);
+        case MQTT_MSG_TYPE_PINGRESP:
+            /* Keepalive response received */
+            client->ping_outstanding = false;
+            return MQTT_OK;
+        default:
+            /* Unknown or unhandled message type */
+            return MQTT_OK;
+    }
+}
+
+/**
+ * @brief Check whether an error leaves the connection unusable
+ */
+static bool mqtt_error_is_fatal(mqtt_error_t err) {
+    return err != MQTT_OK &&
+           err != MQTT_ERROR_PUBLISH_FAILED &&
+           err != MQTT_ERROR_SUBSCRIBE_FAILED;
+}
+
+/**
+ * @brief Drain buffered socket data through the packet parser (non-blocking)
+ *
+ * Header bytes are read one at a time; packet bodies are read straight
+ * into rx_buffer, so no intermediate copy is needed.
+ */
+static mqtt_error_t mqtt_rx_process(mqtt_client_t *client) {
+    int32_t available;
+
+    while ((available = net_socket_available(client->socket)) > 0) {
+        if (client->rx_state == MQTT_RX_BODY) {
+            uint32_t want = client->rx_packet_length - client->rx_buffer_pos;
+            int32_t received = net_recv(client->socket, &client->rx_buffer[client->rx_buffer_pos],
+                                        (uint16_t)want, 1);
+            if (received < 0) {
+                return MQTT_ERROR_NETWORK;
+            }
+            client->rx_buffer_pos += received;
+        } else {
+            uint8_t byte;
+            if (net_recv(client->socket, &byte, 1, 1) != 1) {
+                return MQTT_ERROR_NETWORK;
+            }
+
+            if (client->rx_state == MQTT_RX_HEADER) {
+                client->rx_header = byte;
+                client->rx_packet_length = 0;
+                client->rx_length_bytes = 0;
+                client->rx_state = MQTT_RX_LENGTH;
+                continue;
+            }
+
+            /* Remaining length: up to 4 bytes, 7 bits each */
+            client->rx_packet_length |= (uint32_t)(byte & 0x7F) << (7 * client->rx_length_bytes);
+            client->rx_length_bytes++;
+            if (byte & 0x80) {
+                if (client->rx_length_bytes >= 4) {
+                    return MQTT_ERROR_PROTOCOL;
+                }
+                continue;
+            }
+            if (client->rx_packet_length > MQTT_MAX_PACKET_SIZE) {
+                return MQTT_ERROR_BUFFER_OVERFLOW;
+            }
+            client->rx_buffer_pos = 0;
+            client->rx_state = MQTT_RX_BODY;
+        }
+
+        if (client->rx_state == MQTT_RX_BODY && client->rx_buffer_pos == client->rx_packet_length) {
+            client->rx_state = MQTT_RX_HEADER;
+            mqtt_error_t err = mqtt_dispatch_packet(client);
+            if (mqtt_error_is_fatal(err) || client->state == MQTT_STATE_DISCONNECTED) {
+                return err;
+            }
+        }
+    }
+
+    return (available < 0) ? MQTT_ERROR_NETWORK : MQTT_OK;
+}
+
+/**
+ * @brief Keepalive, CONNACK and acknowledgement timeouts
+ */
+static mqtt_error_t mqtt_check_timers(mqtt_client_t *client) {
+    uint32_t now = mqtt_get_time_ms();
+
+    if (client->state == MQTT_STATE_CONNECTING) {
+        return ((now - client->connect_start_ms) >= client->config.timeout_ms)
+               ? MQTT_ERROR_TIMEOUT : MQTT_OK;
+    }
+
+    /* Broker must answer PINGREQ within the command timeout */
+    if (client->ping_outstanding) {
+        if ((now - client->last_ping_ms) >= client->config.timeout_ms) {
+            return MQTT_ERROR_TIMEOUT;
+        }
+    } else {
+        uint32_t keepalive_ms = client->config.keepalive_sec * 1000;
+        if (keepalive_ms > 0 && (now - client->last_activity_ms) >= keepalive_ms) {
+            mqtt_error_t err = mqtt_send_pingreq(client);
+            if (err != MQTT_OK) {
+                return err;
+            }
+            client->ping_outstanding = true;
+            client->last_ping_ms = now;
+        }
+    }
+
+    mqtt_pending_expire(client, MQTT_ERROR_TIMEOUT, false);
+    return MQTT_OK;
+}
+
+/* ========== Public API ========== */
+
+mqtt_error_t mqtt_client_init(mqtt_client_t *client, const mqtt_config_t *config) {
+    if (!client || !config) {
+        return MQTT_ERROR_INVALID_PARAM;
     }
 
     memset(client, 0, sizeof(mqtt_client_t));
@@ -506,16 +1619,54 @@ mqtt_error_t mqtt_client_init(mqtt_client_t *client, const mqtt_config_t *config
     if (client->config.timeout_ms == 0) {
         client->config.timeout_ms = MQTT_DEFAULT_TIMEOUT_MS;
     }
+    if (client->config.reconnect_interval_ms == 0) {
+        client->config.reconnect_interval_ms = MQTT_DEFAULT_RECONNECT_MS;
+    }
+    if (client->config.reconnect_max_interval_ms < client->config.reconnect_interval_ms) {
+        client->config.reconnect_max_interval_ms = (client->config.reconnect_interval_ms > MQTT_DEFAULT_RECONNECT_MAX_MS)
+                                                 ? client->config.reconnect_interval_ms
+                                                 : MQTT_DEFAULT_RECONNECT_MAX_MS;
+    }
+    if (client->config.protocol_version == 0) {
+        client->config.protocol_version = MQTT_PROTOCOL_VERSION_3_1_1;
+    }
+    if (client->config.protocol_version != MQTT_PROTOCOL_VERSION_3_1_1 &&
+        client->config.protocol_version != MQTT_PROTOCOL_VERSION_5) {
+        return MQTT_ERROR_INVALID_PARAM;
+    }
+    if (client->config.topic_alias_maximum > MQTT_MAX_TOPIC_ALIASES) {
+        client->config.topic_alias_maximum = MQTT_MAX_TOPIC_ALIASES;
+    }
 
     client->state = MQTT_STATE_DISCONNECTED;
+    client->socket = INVALID_SOCKET;
+    client->service_slot = -1;
     client->next_message_id = 1;
+    mqtt_random_seed(client);
 
     os_mutex_init(&client->mutex);
 
     return MQTT_OK;
 }
 
-mqtt_error_t mqtt_connect(mqtt_client_t *client) {
+mqtt_error_t mqtt_service_start(task_priority_t priority) {
+    if (mqtt_service.running) {
+        return MQTT_OK;
+    }
+
+    os_event_group_init(&mqtt_service.events);
+    memset(mqtt_service.clients, 0, sizeof(mqtt_service.clients));
+    mqtt_service.running = true;
+
+    if (os_task_create(&mqtt_service.task, "mqtt", mqtt_service_task, NULL, priority) != OS_OK) {
+        mqtt_service.running = false;
+        return MQTT_ERROR_NO_MEMORY;
+    }
+
+    return MQTT_OK;
+}
+
+mqtt_error_t mqtt_connect_async(mqtt_client_t *client, mqtt_complete_callback_t callback, void *user_data) {
     if (!client) {
         return MQTT_ERROR_INVALID_PARAM;
     }
@@ -527,75 +1678,64 @@ mqtt_error_t mqtt_connect(mqtt_client_t *client) {
         return MQTT_ERROR_ALREADY_CONNECTED;
     }
 
-    client->state = MQTT_STATE_CONNECTING;
-
-    /* Create TCP connection */
-    client->socket = net_socket(SOCK_STREAM);
-    if (client->socket < 0) {
-        client->state = MQTT_STATE_DISCONNECTED;
+    mqtt_error_t err = mqtt_service_register(client);
+    if (err != MQTT_OK) {
         os_mutex_unlock(&client->mutex);
-        return MQTT_ERROR_NETWORK;
+        return err;
     }
 
-    /* Resolve hostname and connect */
-    ipv4_addr_t broker_ip;
-    os_error_t err = net_dns_resolve(client->config.broker_host, &broker_ip, client->config.timeout_ms);
-    if (err != OS_OK) {
-        net_close(client->socket);
-        client->state = MQTT_STATE_DISCONNECTED;
-        os_mutex_unlock(&client->mutex);
-        return MQTT_ERROR_NETWORK;
-    }
+    /* An explicit connect overrides any pending backoff */
+    client->reconnect_pending = false;
+    client->reconnect_attempts = 0;
 
-    sockaddr_in_t broker_addr = {
-        .addr = broker_ip,
-        .port = client->config.broker_port
-    };
+    client->state = MQTT_STATE_CONNECTING;
+    client->connect_callback = callback;
+    client->connect_callback_data = user_data;
 
-    err = net_connect(client->socket, &broker_addr, client->config.timeout_ms);
-    if (err != OS_OK) {
-        net_close(client->socket);
-        client->state = MQTT_STATE_DISCONNECTED;
-        os_mutex_unlock(&client->mutex);
-        return MQTT_ERROR_NETWORK;
-    }
+    os_mutex_unlock(&client->mutex);
 
-    /* Send CONNECT packet */
-    mqtt_error_t mqtt_err = mqtt_send_connect(client);
-    if (mqtt_err != MQTT_OK) {
-        net_close(client->socket);
-        client->state = MQTT_STATE_DISCONNECTED;
-        os_mutex_unlock(&client->mutex);
-        return mqtt_err;
-    }
+    /* The service task opens the connection */
+    os_event_group_set_bits(&mqtt_service.events, MQTT_EV_CMD(client->service_slot));
+    return MQTT_OK;
+}
 
-    /* Wait for CONNACK */
-    uint8_t msg_type;
-    mqtt_err = mqtt_receive_packet(client, &msg_type, client->config.timeout_ms);
-    if (mqtt_err != MQTT_OK || msg_type != MQTT_MSG_TYPE_CONNACK) {
-        net_close(client->socket);
-        client->state = MQTT_STATE_DISCONNECTED;
-        os_mutex_unlock(&client->mutex);
-        return (mqtt_err != MQTT_OK) ? mqtt_err : MQTT_ERROR_PROTOCOL;
+/**
+ * @brief Completion used by the blocking wrappers
+ */
+typedef struct {
+    semaphore_t done;
+    mqtt_error_t result;
+} mqtt_sync_wait_t;
+
+static void mqtt_sync_complete(mqtt_client_t *client, mqtt_error_t result, void *user_data) {
+    (void)client;
+    mqtt_sync_wait_t *wait = (mqtt_sync_wait_t *)user_data;
+    wait->result = result;
+    os_semaphore_post(&wait->done);
+}
+
+mqtt_error_t mqtt_connect(mqtt_client_t *client) {
+    if (!client) {
+        return MQTT_ERROR_INVALID_PARAM;
     }
 
-    mqtt_err = mqtt_handle_connack(client);
-    if (mqtt_err != MQTT_OK) {
-        net_close(client->socket);
-        client->state = MQTT_STATE_DISCONNECTED;
-        os_mutex_unlock(&client->mutex);
-        return mqtt_err;
+    /* Blocking here would stall the task that has to complete the connect */
+    if (mqtt_service.running && os_task_get_current() == &mqtt_service.task) {
+        return MQTT_ERROR_INVALID_PARAM;
     }
 
-    /* Start background task */
-    client->task_running = true;
-    os_task_create(&client->task, "mqtt", mqtt_task, client, PRIORITY_NORMAL);
+    mqtt_sync_wait_t wait;
+    os_semaphore_init(&wait.done, 0);
+    wait.result = MQTT_ERROR_TIMEOUT;
 
-    client->last_activity_ms = mqtt_get_time_ms();
-    client->last_ping_ms = mqtt_get_time_ms();
+    mqtt_error_t err = mqtt_connect_async(client, mqtt_sync_complete, &wait);
+    if (err != MQTT_OK) {
+        return err;
+    }
 
-    os_mutex_unlock(&client->mutex);
-    return MQTT_OK;
+    /* DNS, TCP connect and CONNACK are each bounded by timeout_ms */
+    os_semaphore_wait(&wait.done, OS_WAIT_FOREVER);
+    return wait.result;
 }
 
 mqtt_error_t mqtt_disconnect(mqtt_client_t *client) {
@@ -605,6 +1745,15 @@ mqtt_error_t mqtt_disconnect(mqtt_client_t *client) {
 
     os_mutex_lock(&client->mutex, OS_WAIT_FOREVER);
 
+    if (client->state == MQTT_STATE_DISCONNECTED && client->reconnect_pending) {
+        /* Waiting to reconnect: just stop trying */
+        client->reconnect_pending = false;
+        client->offline_queue_length = 0;
+        os_mutex_unlock(&client->mutex);
+        mqtt_service_unregister(client);
+        return MQTT_OK;
+    }
+
     if (client->state != MQTT_STATE_CONNECTED) {
         os_mutex_unlock(&client->mutex);
         return MQTT_ERROR_NOT_CONNECTED;
@@ -612,28 +1761,42 @@ mqtt_error_t mqtt_disconnect(mqtt_client_t *client) {
 
     client->state = MQTT_STATE_DISCONNECTING;
 
-    /* Stop background task */
-    client->task_running = false;
-
     /* Send DISCONNECT */
     mqtt_send_disconnect(client);
 
     /* Close socket */
+    net_socket_set_notify(client->socket, NULL, 0);
     net_close(client->socket);
+    client->socket = INVALID_SOCKET;
 
     client->state = MQTT_STATE_DISCONNECTED;
+    client->inflight_count = 0;
+    memset(client->inflight_ids, 0, sizeof(client->inflight_ids));
+    client->offline_queue_length = 0;
+
+    os_mutex_unlock(&client->mutex);
+
+    /* Stop servicing this client */
+    mqtt_service_unregister(client);
+    mqtt_pending_expire(client, MQTT_ERROR_NOT_CONNECTED, true);
 
     if (client->connection_callback) {
         client->connection_callback(client, false, client->connection_callback_data);
     }
 
-    os_mutex_unlock(&client->mutex);
     return MQTT_OK;
 }
 
 mqtt_error_t mqtt_publish(mqtt_client_t *client, const char *topic,
                           const void *payload, uint16_t payload_length,
                           mqtt_qos_t qos, bool retained) {
+    return mqtt_publish_async(client, topic, payload, payload_length, qos, retained, NULL, NULL);
+}
+
+mqtt_error_t mqtt_publish_async(mqtt_client_t *client, const char *topic,
+                                const void *payload, uint16_t payload_length,
+                                mqtt_qos_t qos, bool retained,
+                                mqtt_complete_callback_t callback, void *user_data) {
     if (!client || !topic) {
         return MQTT_ERROR_INVALID_PARAM;
     }
@@ -641,8 +1804,26 @@ mqtt_error_t mqtt_publish(mqtt_client_t *client, const char *topic,
     os_mutex_lock(&client->mutex, OS_WAIT_FOREVER);
 
     if (client->state != MQTT_STATE_CONNECTED) {
+        mqtt_error_t err = MQTT_ERROR_NOT_CONNECTED;
+        if (callback == NULL && client->config.auto_reconnect &&
+            (client->reconnect_pending || client->state == MQTT_STATE_CONNECTING)) {
+            err = mqtt_offline_enqueue(client, topic, payload, payload_length, qos, retained);
+        }
         os_mutex_unlock(&client->mutex);
-        return MQTT_ERROR_NOT_CONNECTED;
+        return err;
+    }
+
+    /* Flow control: never exceed the broker's Receive Maximum */
+    if (qos > MQTT_QOS_0 && (client->inflight_count >= client->server_receive_maximum ||
+                             client->inflight_count >= MQTT_MAX_INFLIGHT)) {
+        os_mutex_unlock(&client->mutex);
+        return MQTT_ERROR_FLOW_CONTROL;
+    }
+
+    bool track = (qos > MQTT_QOS_0 && callback != NULL);
+    if (track && !mqtt_pending_available(client)) {
+        os_mutex_unlock(&client->mutex);
+        return MQTT_ERROR_NO_MEMORY;
     }
 
     uint16_t message_id = 0;
@@ -652,12 +1833,30 @@ mqtt_error_t mqtt_publish(mqtt_client_t *client, const char *topic,
 
     mqtt_error_t err = mqtt_send_publish(client, topic, payload, payload_length,
                                          qos, retained, message_id);
+    if (err == MQTT_OK && qos > MQTT_QOS_0) {
+        mqtt_inflight_add(client->inflight_ids, &client->inflight_count, message_id);
+        if (track) {
+            mqtt_pending_add(client, (qos == MQTT_QOS_1) ? MQTT_MSG_TYPE_PUBACK : MQTT_MSG_TYPE_PUBCOMP,
+                             message_id, callback, user_data);
+        }
+    }
 
     os_mutex_unlock(&client->mutex);
+
+    /* QoS 0 has no acknowledgement: complete once it is on the wire */
+    if (err == MQTT_OK && qos == MQTT_QOS_0 && callback) {
+        callback(client, MQTT_OK, user_data);
+    }
+
     return err;
 }
 
 mqtt_error_t mqtt_subscribe(mqtt_client_t *client, const char *topic, mqtt_qos_t qos) {
+    return mqtt_subscribe_async(client, topic, qos, NULL, NULL);
+}
+
+mqtt_error_t mqtt_subscribe_async(mqtt_client_t *client, const char *topic, mqtt_qos_t qos,
+                                  mqtt_complete_callback_t callback, void *user_data) {
     if (!client || !topic) {
         return MQTT_ERROR_INVALID_PARAM;
     }
@@ -678,18 +1877,23 @@ mqtt_error_t mqtt_subscribe(mqtt_client_t *client, const char *topic, mqtt_qos_t
         }
     }
 
-    if (slot == -1) {
+    if (slot == -1 || (callback != NULL && !mqtt_pending_available(client))) {
         os_mutex_unlock(&client->mutex);
         return MQTT_ERROR_NO_MEMORY;
     }
 
-    mqtt_error_t err = mqtt_send_subscribe(client, topic, qos);
+    uint16_t message_id = mqtt_next_message_id(client);
+    mqtt_error_t err = mqtt_send_subscribe(client, topic, qos, message_id);
     if (err == MQTT_OK) {
         /* Store subscription */
         strncpy(client->subscriptions[slot].topic, topic, MQTT_MAX_TOPIC_LENGTH - 1);
         client->subscriptions[slot].topic[MQTT_MAX_TOPIC_LENGTH - 1] = '\0';
         client->subscriptions[slot].qos = qos;
         client->subscriptions[slot].active = true;
+
+        if (callback != NULL) {
+            mqtt_pending_add(client, MQTT_MSG_TYPE_SUBACK, message_id, callback, user_data);
+        }
     }
 
     os_mutex_unlock(&client->mutex);
@@ -749,45 +1953,57 @@ mqtt_state_t mqtt_get_state(const mqtt_client_t *client) {
     return client ? client->state : MQTT_STATE_DISCONNECTED;
 }
 
-mqtt_error_t mqtt_loop(mqtt_client_t *client) {
-    if (!client || client->state != MQTT_STATE_CONNECTED) {
-        return MQTT_ERROR_NOT_CONNECTED;
+mqtt_reason_code_t mqtt_get_last_reason_code(const mqtt_client_t *client) {
+    return client ? client->last_reason_code : MQTT_RC_UNSPECIFIED_ERROR;
+}
+
+void mqtt_set_service_hook(mqtt_client_t *client,
+                           mqtt_service_hook_t hook,
+                           void *user_data) {
+    if (client) {
+        client->service_hook = hook;
+        client->service_hook_data = user_data;
     }
+}
 
-    uint32_t now = mqtt_get_time_ms();
+void mqtt_service_wake(mqtt_client_t *client) {
+    if (client && client->service_slot >= 0) {
+        os_event_group_set_bits(&mqtt_service.events, MQTT_EV_CMD(client->service_slot));
+    }
+}
 
-    /* Check for keepalive timeout */
-    uint32_t keepalive_ms = client->config.keepalive_sec * 1000;
-    if ((now - client->last_ping_ms) >= keepalive_ms) {
-        mqtt_send_pingreq(client);
-        client->last_ping_ms = now;
+mqtt_error_t mqtt_loop(mqtt_client_t *client) {
+    if (!client) {
+        return MQTT_ERROR_INVALID_PARAM;
     }
 
-    /* Try to receive packet (non-blocking) */
-    uint8_t msg_type;
-    mqtt_error_t err = mqtt_receive_packet(client, &msg_type, 100);  /* 100ms timeout */
+    mqtt_error_t err;
 
-    if (err == MQTT_ERROR_TIMEOUT) {
-        return MQTT_OK;  /* No message available, that's OK */
-    } else if (err != MQTT_OK) {
-        return err;
+    if (client->state == MQTT_STATE_DISCONNECTED && client->reconnect_pending) {
+        if ((int32_t)(mqtt_get_time_ms() - client->reconnect_at_ms) < 0) {
+            return MQTT_OK;
+        }
+        client->reconnect_pending = false;
+        client->state = MQTT_STATE_CONNECTING;
+        err = mqtt_open_connection(client);
+    } else if (client->state == MQTT_STATE_CONNECTING && client->socket == INVALID_SOCKET) {
+        err = mqtt_open_connection(client);
+    } else if (client->state == MQTT_STATE_CONNECTING || client->state == MQTT_STATE_CONNECTED) {
+        err = mqtt_rx_process(client);
+        if (!mqtt_error_is_fatal(err) && client->state != MQTT_STATE_DISCONNECTED) {
+            err = mqtt_check_timers(client);
+        }
+    } else {
+        return MQTT_ERROR_NOT_CONNECTED;
     }
 
-    /* Handle received packet */
-    switch (msg_type) {
-        case MQTT_MSG_TYPE_PUBLISH:
-            return mqtt_handle_publish(client);
-        case MQTT_MSG_TYPE_PUBACK:
-            return mqtt_handle_puback(client);
-        case MQTT_MSG_TYPE_SUBACK:
-            return mqtt_handle_suback(client);
-        case MQTT_MSG_TYPE_PINGRESP:
-            /* Keepalive response received */
-            return MQTT_OK;
-        default:
-            /* Unknown or unhandled message type */
-            return MQTT_OK;
+    if (mqtt_error_is_fatal(err)) {
+        mqtt_connection_lost(client, err);
+    } else if (client->state == MQTT_STATE_CONNECTED && client->service_hook) {
+        client->service_hook(client, client->service_hook_data);
     }
+
+    return err;
 }
 
 const char *mqtt_error_to_string(mqtt_error_t error) {
@@ -804,6 +2020,7 @@ const char *mqtt_error_to_string(mqtt_error_t error) {
         case MQTT_ERROR_SUBSCRIBE_FAILED: return "Subscribe failed";
         case MQTT_ERROR_PUBLISH_FAILED: return "Publish failed";
         case MQTT_ERROR_NO_MEMORY: return "No memory";
+        case MQTT_ERROR_FLOW_CONTROL: return "Receive Maximum reached";
         default: return "Unknown error";
     }
 }
@@ -817,3 +2034,45 @@ const char *mqtt_state_to_string(mqtt_state_t state) {
         default: return "Unknown";
     }
 }
+
+const char *mqtt_reason_code_to_string(mqtt_reason_code_t code) {
+    switch (code) {
+        case MQTT_RC_SUCCESS: return "Success";
+        case MQTT_RC_GRANTED_QOS_1: return "Granted QoS 1";
+        case MQTT_RC_GRANTED_QOS_2: return "Granted QoS 2";
+        case MQTT_RC_DISCONNECT_WITH_WILL: return "Disconnect with Will";
+        case MQTT_RC_NO_MATCHING_SUBSCRIBERS: return "No matching subscribers";
+        case MQTT_RC_NO_SUBSCRIPTION_EXISTED: return "No subscription existed";
+        case MQTT_RC_UNSPECIFIED_ERROR: return "Unspecified error";
+        case MQTT_RC_MALFORMED_PACKET: return "Malformed packet";
+        case MQTT_RC_PROTOCOL_ERROR: return "Protocol error";
+        case MQTT_RC_IMPLEMENTATION_SPECIFIC: return "Implementation specific error";
+        case MQTT_RC_UNSUPPORTED_PROTOCOL_VERSION: return "Unsupported protocol version";
+        case MQTT_RC_CLIENT_ID_NOT_VALID: return "Client identifier not valid";
+        case MQTT_RC_BAD_USERNAME_OR_PASSWORD: return "Bad user name or password";
+        case MQTT_RC_NOT_AUTHORIZED: return "Not authorized";
+        case MQTT_RC_SERVER_UNAVAILABLE: return "Server unavailable";
+        case MQTT_RC_SERVER_BUSY: return "Server busy";
+        case MQTT_RC_BANNED: return "Banned";
+        case MQTT_RC_SERVER_SHUTTING_DOWN: return "Server shutting down";
+        case MQTT_RC_KEEPALIVE_TIMEOUT: return "Keep alive timeout";
+        case MQTT_RC_SESSION_TAKEN_OVER: return "Session taken over";
+        case MQTT_RC_TOPIC_FILTER_INVALID: return "Topic filter invalid";
+        case MQTT_RC_TOPIC_NAME_INVALID: return "Topic name invalid";
+        case MQTT_RC_PACKET_ID_IN_USE: return "Packet identifier in use";
+        case MQTT_RC_PACKET_ID_NOT_FOUND: return "Packet identifier not found";
+        case MQTT_RC_RECEIVE_MAXIMUM_EXCEEDED: return "Receive Maximum exceeded";
+        case MQTT_RC_TOPIC_ALIAS_INVALID: return "Topic alias invalid";
+        case MQTT_RC_PACKET_TOO_LARGE: return "Packet too large";
+        case MQTT_RC_MESSAGE_RATE_TOO_HIGH: return "Message rate too high";
+        case MQTT_RC_QUOTA_EXCEEDED: return "Quota exceeded";
+        case MQTT_RC_ADMINISTRATIVE_ACTION: return "Administrative action";
+        case MQTT_RC_PAYLOAD_FORMAT_INVALID: return "Payload format invalid";
+        case MQTT_RC_RETAIN_NOT_SUPPORTED: return "Retain not supported";
+        case MQTT_RC_QOS_NOT_SUPPORTED: return "QoS not supported";
+        case MQTT_RC_USE_ANOTHER_SERVER: return "Use another server";
+        case MQTT_RC_SERVER_MOVED: return "Server moved";
+        case MQTT_RC_CONNECTION_RATE_EXCEEDED: return "Connection rate exceeded";
+        default: return "Unknown reason";
+    }
+}
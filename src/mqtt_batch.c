@@ -0,0 +1,364 @@
+/**
+ * @file mqtt_batch.c
+ * @brief MQTT Publish Batching Implementation for TinyOS-RTOS
+ */
+
+#include "tinyos/mqtt_batch.h"
+#include <string.h>
+
+/**
+ * @brief Encode a varint (MQTT remaining-length style)
+ */
+static uint16_t mqtt_batch_put_varint(uint8_t *buffer, uint32_t value) {
+    uint16_t pos = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value > 0) {
+            byte |= 0x80;
+        }
+        buffer[pos++] = byte;
+    } while (value > 0);
+    return pos;
+}
+
+/**
+ * @brief Size of a varint in bytes
+ */
+static uint16_t mqtt_batch_varint_size(uint32_t value) {
+    uint16_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/**
+ * @brief Decode a varint (max 4 bytes), returns bytes consumed or 0 on error
+ */
+static uint16_t mqtt_batch_get_varint(const uint8_t *buffer, uint16_t length, uint32_t *value) {
+    *value = 0;
+    for (uint16_t i = 0; i < length && i < 4; i++) {
+        *value |= (uint32_t)(buffer[i] & 0x7F) << (7 * i);
+        if ((buffer[i] & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Publish one topic's batch and reset it (batch mutex held)
+ */
+static mqtt_error_t mqtt_batch_flush_topic(mqtt_batch_t *batch, mqtt_batch_topic_t *t) {
+    if (t->count == 0) {
+        return MQTT_OK;
+    }
+
+    t->buffer[1] = t->count;
+
+    mqtt_error_t err = mqtt_publish(batch->client, t->topic, t->buffer, t->length,
+                                    batch->config.qos, batch->config.retained);
+    if (err != MQTT_OK) {
+        return err;
+    }
+
+    batch->stats.batches++;
+    batch->stats.batch_bytes += t->length;
+    t->count = 0;
+    t->length = 0;
+    return MQTT_OK;
+}
+
+/**
+ * @brief Arm the flush timer for the oldest open batch (batch mutex held)
+ */
+static void mqtt_batch_arm_timer(mqtt_batch_t *batch) {
+    uint32_t now = os_get_uptime_ms();
+    uint32_t oldest_age = 0;
+    bool any = false;
+
+    for (int i = 0; i < MQTT_BATCH_MAX_TOPICS; i++) {
+        mqtt_batch_topic_t *t = &batch->topics[i];
+        if (t->count > 0) {
+            uint32_t age = now - t->base_ms;
+            if (!any || age > oldest_age) {
+                oldest_age = age;
+                any = true;
+            }
+        }
+    }
+
+    if (!any) {
+        os_timer_stop(&batch->flush_timer);
+        return;
+    }
+
+    /* Overdue batches failed to publish: retry after another full interval */
+    uint32_t delay = (oldest_age < batch->config.max_latency_ms)
+                   ? batch->config.max_latency_ms - oldest_age
+                   : batch->config.max_latency_ms;
+
+    os_timer_change_period(&batch->flush_timer, delay);
+    os_timer_start(&batch->flush_timer);
+}
+
+/**
+ * @brief Flush timer callback (timer context: only wakes the service task)
+ */
+static void mqtt_batch_timer_callback(void *param) {
+    mqtt_batch_t *batch = (mqtt_batch_t *)param;
+    mqtt_service_wake(batch->client);
+}
+
+/**
+ * @brief Service hook: publish batches that reached max_latency_ms
+ */
+static void mqtt_batch_service(mqtt_client_t *client, void *user_data) {
+    (void)client;
+    mqtt_batch_t *batch = (mqtt_batch_t *)user_data;
+    uint32_t now = os_get_uptime_ms();
+    bool flushed = false;
+
+    os_mutex_lock(&batch->mutex, OS_WAIT_FOREVER);
+
+    for (int i = 0; i < MQTT_BATCH_MAX_TOPICS; i++) {
+        mqtt_batch_topic_t *t = &batch->topics[i];
+        if (t->count > 0 && (now - t->base_ms) >= batch->config.max_latency_ms) {
+            if (mqtt_batch_flush_topic(batch, t) == MQTT_OK) {
+                batch->stats.time_flushes++;
+                flushed = true;
+            }
+        }
+    }
+
+    if (flushed || !os_timer_is_active(&batch->flush_timer)) {
+        mqtt_batch_arm_timer(batch);
+    }
+
+    os_mutex_unlock(&batch->mutex);
+}
+
+/**
+ * @brief Find the slot for a topic, binding a free one if needed
+ */
+static mqtt_batch_topic_t *mqtt_batch_find_topic(mqtt_batch_t *batch, const char *topic) {
+    mqtt_batch_topic_t *free_slot = NULL;
+
+    for (int i = 0; i < MQTT_BATCH_MAX_TOPICS; i++) {
+        mqtt_batch_topic_t *t = &batch->topics[i];
+        if (t->active && strcmp(t->topic, topic) == 0) {
+            return t;
+        }
+        if (!t->active && free_slot == NULL) {
+            free_slot = t;
+        }
+    }
+
+    if (free_slot != NULL) {
+        strncpy(free_slot->topic, topic, MQTT_MAX_TOPIC_LENGTH - 1);
+        free_slot->topic[MQTT_MAX_TOPIC_LENGTH - 1] = '\0';
+        free_slot->count = 0;
+        free_slot->length = 0;
+        free_slot->active = true;
+    }
+
+    return free_slot;
+}
+
+/* ========== Public API ========== */
+
+mqtt_error_t mqtt_batch_init(mqtt_batch_t *batch, mqtt_client_t *client,
+                             const mqtt_batch_config_t *config) {
+    if (!batch || !client) {
+        return MQTT_ERROR_INVALID_PARAM;
+    }
+
+    memset(batch, 0, sizeof(mqtt_batch_t));
+    batch->client = client;
+    if (config) {
+        memcpy(&batch->config, config, sizeof(mqtt_batch_config_t));
+    }
+
+    /* Set defaults */
+    if (batch->config.max_batch_bytes == 0 || batch->config.max_batch_bytes > MQTT_BATCH_BUFFER_SIZE) {
+        batch->config.max_batch_bytes = MQTT_BATCH_BUFFER_SIZE;
+    }
+    if (batch->config.max_batch_bytes <= MQTT_BATCH_HEADER_SIZE) {
+        return MQTT_ERROR_INVALID_PARAM;
+    }
+    if (batch->config.max_latency_ms == 0) {
+        batch->config.max_latency_ms = MQTT_BATCH_DEFAULT_LATENCY_MS;
+    }
+
+    os_mutex_init(&batch->mutex);
+    os_timer_create(&batch->flush_timer, "mqtt_batch", TIMER_ONE_SHOT,
+                    batch->config.max_latency_ms, mqtt_batch_timer_callback, batch);
+
+    mqtt_set_service_hook(client, mqtt_batch_service, batch);
+    return MQTT_OK;
+}
+
+void mqtt_batch_deinit(mqtt_batch_t *batch) {
+    if (!batch || !batch->client) {
+        return;
+    }
+
+    mqtt_set_service_hook(batch->client, NULL, NULL);
+    os_timer_delete(&batch->flush_timer);
+    batch->client = NULL;
+}
+
+mqtt_error_t mqtt_batch_add(mqtt_batch_t *batch, const char *topic,
+                            const void *data, uint16_t length) {
+    if (!batch || !batch->client || !topic || (!data && length > 0)) {
+        return MQTT_ERROR_INVALID_PARAM;
+    }
+
+    os_mutex_lock(&batch->mutex, OS_WAIT_FOREVER);
+
+    mqtt_batch_topic_t *t = mqtt_batch_find_topic(batch, topic);
+    if (t == NULL) {
+        os_mutex_unlock(&batch->mutex);
+        return MQTT_ERROR_NO_MEMORY;
+    }
+
+    uint32_t now = os_get_uptime_ms();
+    uint32_t delta = (t->count > 0) ? now - t->last_ms : 0;
+    uint16_t record_size = mqtt_batch_varint_size(delta) + mqtt_batch_varint_size(length) + length;
+
+    /* Must fit on its own in an empty batch (delta 0 encodes in one byte) */
+    if (MQTT_BATCH_HEADER_SIZE + 1 + mqtt_batch_varint_size(length) + length > batch->config.max_batch_bytes) {
+        os_mutex_unlock(&batch->mutex);
+        return MQTT_ERROR_BUFFER_OVERFLOW;
+    }
+
+    /* Make room: publish what we have if the sample does not fit */
+    if (t->count > 0 && (t->length + record_size > batch->config.max_batch_bytes ||
+                         t->count == MQTT_BATCH_MAX_SAMPLES)) {
+        mqtt_error_t err = mqtt_batch_flush_topic(batch, t);
+        if (err != MQTT_OK) {
+            batch->stats.dropped++;
+            os_mutex_unlock(&batch->mutex);
+            return err;
+        }
+        batch->stats.size_flushes++;
+    }
+
+    bool was_idle = true;
+    for (int i = 0; i < MQTT_BATCH_MAX_TOPICS; i++) {
+        if (batch->topics[i].count > 0) {
+            was_idle = false;
+            break;
+        }
+    }
+
+    /* Open a new batch */
+    if (t->count == 0) {
+        t->base_ms = now;
+        t->last_ms = now;
+        delta = 0;
+        t->buffer[0] = MQTT_BATCH_VERSION;
+        t->buffer[1] = 0;
+        t->buffer[2] = (now >> 24) & 0xFF;
+        t->buffer[3] = (now >> 16) & 0xFF;
+        t->buffer[4] = (now >> 8) & 0xFF;
+        t->buffer[5] = now & 0xFF;
+        t->length = MQTT_BATCH_HEADER_SIZE;
+    }
+
+    /* Append record */
+    t->length += mqtt_batch_put_varint(&t->buffer[t->length], delta);
+    t->length += mqtt_batch_put_varint(&t->buffer[t->length], length);
+    if (length > 0) {
+        memcpy(&t->buffer[t->length], data, length);
+        t->length += length;
+    }
+    t->count++;
+    t->last_ms = now;
+
+    batch->stats.samples++;
+    batch->stats.sample_bytes += length;
+
+    if (t->length >= batch->config.max_batch_bytes || t->count == MQTT_BATCH_MAX_SAMPLES) {
+        /* Full: a failure here is retried by the flush timer */
+        if (mqtt_batch_flush_topic(batch, t) == MQTT_OK) {
+            batch->stats.size_flushes++;
+        }
+    }
+
+    if (was_idle) {
+        mqtt_batch_arm_timer(batch);
+    }
+
+    os_mutex_unlock(&batch->mutex);
+    return MQTT_OK;
+}
+
+mqtt_error_t mqtt_batch_flush(mqtt_batch_t *batch) {
+    if (!batch || !batch->client) {
+        return MQTT_ERROR_INVALID_PARAM;
+    }
+
+    mqtt_error_t result = MQTT_OK;
+
+    os_mutex_lock(&batch->mutex, OS_WAIT_FOREVER);
+
+    for (int i = 0; i < MQTT_BATCH_MAX_TOPICS; i++) {
+        mqtt_error_t err = mqtt_batch_flush_topic(batch, &batch->topics[i]);
+        if (err != MQTT_OK && result == MQTT_OK) {
+            result = err;
+        }
+    }
+
+    mqtt_batch_arm_timer(batch);
+
+    os_mutex_unlock(&batch->mutex);
+    return result;
+}
+
+void mqtt_batch_get_stats(mqtt_batch_t *batch, mqtt_batch_stats_t *stats) {
+    if (!batch || !stats) {
+        return;
+    }
+
+    os_mutex_lock(&batch->mutex, OS_WAIT_FOREVER);
+    memcpy(stats, &batch->stats, sizeof(mqtt_batch_stats_t));
+    os_mutex_unlock(&batch->mutex);
+}
+
+int32_t mqtt_batch_decode(const uint8_t *payload, uint16_t length,
+                          mqtt_batch_sample_callback_t callback, void *user_data) {
+    if (!payload || length < MQTT_BATCH_HEADER_SIZE || payload[0] != MQTT_BATCH_VERSION) {
+        return -1;
+    }
+
+    uint8_t count = payload[1];
+    uint32_t timestamp = ((uint32_t)payload[2] << 24) | ((uint32_t)payload[3] << 16) |
+                         ((uint32_t)payload[4] << 8) | payload[5];
+    uint16_t pos = MQTT_BATCH_HEADER_SIZE;
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t delta, sample_len;
+        uint16_t used = mqtt_batch_get_varint(&payload[pos], length - pos, &delta);
+        if (used == 0) {
+            return -1;
+        }
+        pos += used;
+
+        used = mqtt_batch_get_varint(&payload[pos], length - pos, &sample_len);
+        if (used == 0 || sample_len > (uint32_t)(length - pos - used)) {
+            return -1;
+        }
+        pos += used;
+
+        timestamp += delta;
+        if (callback) {
+            callback(timestamp, &payload[pos], (uint16_t)sample_len, user_data);
+        }
+        pos += sample_len;
+    }
+
+    return (pos == length) ? count : -1;
+}
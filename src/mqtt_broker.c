@@ -0,0 +1,592 @@
+/**
+ * @file mqtt_broker.c
+ * @brief Minimal In-Process MQTT 3.1.1 Broker for TinyOS-RTOS
+ */
+
+#include "tinyos/mqtt_broker.h"
+#include "tinyos/net.h"
+#include <string.h>
+
+/* Receive parser states */
+#define BROKER_RX_HEADER    0
+#define BROKER_RX_LENGTH    1
+#define BROKER_RX_BODY      2
+
+/* Event bits: listener, one per session, and a control bit */
+#define BROKER_EV_LISTEN        (1UL << 0)
+#define BROKER_EV_SESSION(i)    (1UL << (1 + (i)))
+#define BROKER_EV_DROP          (1UL << 31)
+#define BROKER_EV_ALL           (BROKER_EV_LISTEN | BROKER_EV_DROP | \
+                                 (((1UL << MQTT_BROKER_MAX_CLIENTS) - 1) << 1))
+
+/**
+ * @brief Topic filter held by a session
+ */
+typedef struct {
+    char filter[MQTT_MAX_TOPIC_LENGTH];
+    mqtt_qos_t qos;
+    bool active;
+} broker_subscription_t;
+
+/**
+ * @brief Connected client
+ */
+typedef struct {
+    net_socket_t socket;         /* INVALID_SOCKET if slot free */
+    bool connected;              /* CONNECT accepted */
+    char client_id[MQTT_MAX_CLIENT_ID_LENGTH + 1];
+    uint16_t keepalive_sec;
+    uint32_t last_rx_ms;
+    uint16_t next_message_id;
+    broker_subscription_t subscriptions[MQTT_BROKER_MAX_SUBSCRIPTIONS];
+    uint16_t qos2_ids[MQTT_BROKER_MAX_QOS2];  /* Routed, awaiting PUBREL; 0 = free */
+
+    /* Incremental receive parser */
+    uint8_t rx_state;
+    uint8_t rx_header;
+    uint8_t rx_length_bytes;
+    uint32_t rx_length;
+    uint16_t rx_pos;
+    uint8_t rx_buffer[MQTT_MAX_PACKET_SIZE];
+} broker_session_t;
+
+static struct {
+    tcb_t task;
+    bool running;
+    uint16_t port;
+    net_socket_t listener;
+    event_group_t events;
+    broker_session_t sessions[MQTT_BROKER_MAX_CLIENTS];
+    uint8_t tx_buffer[MQTT_MAX_PACKET_SIZE + 8];  /* Routed PUBLISH may grow by a message id */
+    mqtt_broker_stats_t stats;
+} broker;
+
+/* ========== Helpers ========== */
+
+static uint16_t broker_get_u16(const uint8_t *p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static uint16_t broker_encode_length(uint8_t *buffer, uint32_t length) {
+    uint16_t pos = 0;
+    do {
+        uint8_t byte = length % 128;
+        length /= 128;
+        if (length > 0) {
+            byte |= 0x80;
+        }
+        buffer[pos++] = byte;
+    } while (length > 0);
+    return pos;
+}
+
+/**
+ * @brief Read a length-prefixed string into a NUL-terminated buffer
+ */
+static bool broker_get_string(const broker_session_t *s, uint16_t *pos, char *out, uint16_t out_size) {
+    if ((uint32_t)*pos + 2 > s->rx_length) {
+        return false;
+    }
+    uint16_t len = broker_get_u16(&s->rx_buffer[*pos]);
+    *pos += 2;
+    if ((uint32_t)*pos + len > s->rx_length || len >= out_size) {
+        return false;
+    }
+    memcpy(out, &s->rx_buffer[*pos], len);
+    out[len] = '\0';
+    *pos += len;
+    return true;
+}
+
+static bool broker_send(broker_session_t *s, const uint8_t *data, uint16_t length) {
+    /* net_send() waits for room in the driver queue */
+    if (net_send(s->socket, data, length, MQTT_DEFAULT_TIMEOUT_MS) != length) {
+        broker.stats.send_errors++;
+        return false;
+    }
+    return true;
+}
+
+static bool broker_send_ack(broker_session_t *s, uint8_t type, uint8_t flags, uint16_t message_id) {
+    uint8_t packet[4] = {
+        (uint8_t)((type << 4) | flags), 0x02,
+        (uint8_t)(message_id >> 8), (uint8_t)(message_id & 0xFF)
+    };
+    return broker_send(s, packet, sizeof(packet));
+}
+
+static void broker_close_session(broker_session_t *s) {
+    if (s->socket != INVALID_SOCKET) {
+        net_socket_set_notify(s->socket, NULL, 0);
+        net_close(s->socket);
+    }
+    memset(s, 0, sizeof(broker_session_t));
+    s->socket = INVALID_SOCKET;
+}
+
+/* ========== Packet Handlers ========== */
+
+/**
+ * @brief Handle CONNECT; returns false if the session must be closed
+ */
+static bool broker_handle_connect(broker_session_t *s) {
+    char protocol[8];
+    uint16_t pos = 0;
+
+    if (!broker_get_string(s, &pos, protocol, sizeof(protocol)) || (uint32_t)pos + 4 > s->rx_length) {
+        return false;
+    }
+
+    uint8_t level = s->rx_buffer[pos++];
+    pos++;  /* Connect flags: will, credentials and clean session are ignored */
+    s->keepalive_sec = broker_get_u16(&s->rx_buffer[pos]);
+    pos += 2;
+
+    uint8_t connack[4] = { MQTT_MSG_TYPE_CONNACK << 4, 0x02, 0x00, 0x00 };
+
+    if (strcmp(protocol, "MQTT") != 0 || level != MQTT_PROTOCOL_VERSION_3_1_1) {
+        connack[3] = 0x01;  /* Unacceptable protocol version */
+        broker_send(s, connack, sizeof(connack));
+        return false;
+    }
+
+    if (!broker_get_string(s, &pos, s->client_id, sizeof(s->client_id))) {
+        connack[3] = 0x02;  /* Identifier rejected */
+        broker_send(s, connack, sizeof(connack));
+        return false;
+    }
+
+    /* Session takeover: a second connection with the same ID replaces the first */
+    if (s->client_id[0] != '\0') {
+        for (int i = 0; i < MQTT_BROKER_MAX_CLIENTS; i++) {
+            broker_session_t *other = &broker.sessions[i];
+            if (other != s && other->connected && strcmp(other->client_id, s->client_id) == 0) {
+                broker_close_session(other);
+            }
+        }
+    }
+
+    s->connected = true;
+    s->next_message_id = 1;
+    broker.stats.connections++;
+    return broker_send(s, connack, sizeof(connack));
+}
+
+/**
+ * @brief Deliver a PUBLISH to every matching subscriber
+ */
+static void broker_route(const char *topic, uint16_t topic_len,
+                         const uint8_t *payload, uint16_t payload_len, mqtt_qos_t qos) {
+    for (int i = 0; i < MQTT_BROKER_MAX_CLIENTS; i++) {
+        broker_session_t *sub = &broker.sessions[i];
+        if (!sub->connected) {
+            continue;
+        }
+
+        /* One delivery per session, at the best matching QoS */
+        int granted = -1;
+        for (int j = 0; j < MQTT_BROKER_MAX_SUBSCRIPTIONS; j++) {
+            broker_subscription_t *f = &sub->subscriptions[j];
+            if (f->active && (int)f->qos > granted && mqtt_topic_matches(f->filter, topic)) {
+                granted = f->qos;
+            }
+        }
+        if (granted < 0) {
+            continue;
+        }
+
+        mqtt_qos_t out_qos = ((int)qos < granted) ? qos : (mqtt_qos_t)granted;
+        uint32_t remaining = 2 + topic_len + payload_len + (out_qos > MQTT_QOS_0 ? 2 : 0);
+        uint8_t *buf = broker.tx_buffer;
+        uint16_t pos = 0;
+
+        buf[pos++] = (MQTT_MSG_TYPE_PUBLISH << 4) | (out_qos << 1);
+        pos += broker_encode_length(&buf[pos], remaining);
+        if (pos + remaining > sizeof(broker.tx_buffer)) {
+            broker.stats.send_errors++;
+            continue;
+        }
+
+        buf[pos++] = topic_len >> 8;
+        buf[pos++] = topic_len & 0xFF;
+        memcpy(&buf[pos], topic, topic_len);
+        pos += topic_len;
+        if (out_qos > MQTT_QOS_0) {
+            uint16_t id = sub->next_message_id++;
+            if (sub->next_message_id == 0) {
+                sub->next_message_id = 1;
+            }
+            buf[pos++] = id >> 8;
+            buf[pos++] = id & 0xFF;
+        }
+        memcpy(&buf[pos], payload, payload_len);
+        pos += payload_len;
+
+        if (broker_send(sub, buf, pos)) {
+            broker.stats.publishes_out++;
+        }
+    }
+}
+
+/**
+ * @brief Find a QoS 2 packet id awaiting PUBREL (id 0 finds a free slot)
+ */
+static uint16_t *broker_qos2_find(broker_session_t *s, uint16_t message_id) {
+    for (int i = 0; i < MQTT_BROKER_MAX_QOS2; i++) {
+        if (s->qos2_ids[i] == message_id) {
+            return &s->qos2_ids[i];
+        }
+    }
+    return NULL;
+}
+
+static bool broker_handle_publish(broker_session_t *s) {
+    mqtt_qos_t qos = (mqtt_qos_t)((s->rx_header >> 1) & 0x03);
+    char topic[MQTT_MAX_TOPIC_LENGTH];
+    uint16_t pos = 0;
+
+    if (qos > MQTT_QOS_2 || !broker_get_string(s, &pos, topic, sizeof(topic))) {
+        return false;
+    }
+
+    uint16_t message_id = 0;
+    if (qos > MQTT_QOS_0) {
+        if ((uint32_t)pos + 2 > s->rx_length) {
+            return false;
+        }
+        message_id = broker_get_u16(&s->rx_buffer[pos]);
+        pos += 2;
+        if (message_id == 0) {
+            return false;
+        }
+    }
+
+    broker.stats.publishes_in++;
+
+    /* QoS 2 is routed once per packet id: a DUP before PUBREL only gets PUBREC again */
+    if (qos == MQTT_QOS_2) {
+        if (broker_qos2_find(s, message_id) != NULL) {
+            return broker_send_ack(s, MQTT_MSG_TYPE_PUBREC, 0, message_id);
+        }
+        uint16_t *slot = broker_qos2_find(s, 0);
+        if (slot == NULL) {
+            return false;  /* More in flight than we can deduplicate */
+        }
+        *slot = message_id;
+    }
+
+    broker_route(topic, (uint16_t)strlen(topic), &s->rx_buffer[pos], s->rx_length - pos, qos);
+
+    if (qos == MQTT_QOS_1) {
+        return broker_send_ack(s, MQTT_MSG_TYPE_PUBACK, 0, message_id);
+    }
+    if (qos == MQTT_QOS_2) {
+        return broker_send_ack(s, MQTT_MSG_TYPE_PUBREC, 0, message_id);
+    }
+    return true;
+}
+
+static bool broker_handle_pubrel(broker_session_t *s) {
+    uint16_t message_id = broker_get_u16(s->rx_buffer);
+    uint16_t *slot = broker_qos2_find(s, message_id);
+    if (slot != NULL && message_id != 0) {
+        *slot = 0;
+    }
+    return broker_send_ack(s, MQTT_MSG_TYPE_PUBCOMP, 0, message_id);
+}
+
+static bool broker_handle_subscribe(broker_session_t *s) {
+    if (s->rx_length < 2) {
+        return false;
+    }
+
+    uint8_t *buf = broker.tx_buffer;
+    uint16_t message_id = broker_get_u16(s->rx_buffer);
+    uint16_t pos = 2;
+    uint16_t count = 0;
+    uint8_t codes[16];
+
+    while (pos < s->rx_length && count < sizeof(codes)) {
+        char filter[MQTT_MAX_TOPIC_LENGTH];
+        if (!broker_get_string(s, &pos, filter, sizeof(filter)) || pos >= s->rx_length) {
+            return false;
+        }
+        mqtt_qos_t qos = (mqtt_qos_t)(s->rx_buffer[pos++] & 0x03);
+
+        /* Replace an existing filter, else take a free slot */
+        broker_subscription_t *slot = NULL;
+        for (int i = 0; i < MQTT_BROKER_MAX_SUBSCRIPTIONS; i++) {
+            broker_subscription_t *f = &s->subscriptions[i];
+            if (f->active && strcmp(f->filter, filter) == 0) {
+                slot = f;
+                break;
+            }
+            if (!f->active && slot == NULL) {
+                slot = f;
+            }
+        }
+
+        if (slot != NULL && qos <= MQTT_QOS_2) {
+            strcpy(slot->filter, filter);
+            slot->qos = qos;
+            slot->active = true;
+            codes[count++] = qos;
+        } else {
+            codes[count++] = 0x80;  /* Failure */
+        }
+    }
+
+    buf[0] = MQTT_MSG_TYPE_SUBACK << 4;
+    buf[1] = 2 + count;
+    buf[2] = message_id >> 8;
+    buf[3] = message_id & 0xFF;
+    memcpy(&buf[4], codes, count);
+    return broker_send(s, buf, 4 + count);
+}
+
+static bool broker_handle_unsubscribe(broker_session_t *s) {
+    if (s->rx_length < 2) {
+        return false;
+    }
+
+    uint16_t message_id = broker_get_u16(s->rx_buffer);
+    uint16_t pos = 2;
+
+    while (pos < s->rx_length) {
+        char filter[MQTT_MAX_TOPIC_LENGTH];
+        if (!broker_get_string(s, &pos, filter, sizeof(filter))) {
+            return false;
+        }
+        for (int i = 0; i < MQTT_BROKER_MAX_SUBSCRIPTIONS; i++) {
+            broker_subscription_t *f = &s->subscriptions[i];
+            if (f->active && strcmp(f->filter, filter) == 0) {
+                f->active = false;
+            }
+        }
+    }
+
+    return broker_send_ack(s, MQTT_MSG_TYPE_UNSUBACK, 0, message_id);
+}
+
+/**
+ * @brief Dispatch a complete packet; returns false if the session must be closed
+ */
+static bool broker_dispatch(broker_session_t *s) {
+    uint8_t type = (s->rx_header >> 4) & 0x0F;
+
+    if (!s->connected) {
+        return (type == MQTT_MSG_TYPE_CONNECT) && broker_handle_connect(s);
+    }
+
+    switch (type) {
+        case MQTT_MSG_TYPE_PUBLISH:
+            return broker_handle_publish(s);
+        case MQTT_MSG_TYPE_PUBREL:
+            return s->rx_length >= 2 && broker_handle_pubrel(s);
+        case MQTT_MSG_TYPE_PUBREC:
+            /* Subscriber acknowledged our QoS 2 delivery */
+            return s->rx_length >= 2 &&
+                   broker_send_ack(s, MQTT_MSG_TYPE_PUBREL, 0x02, broker_get_u16(s->rx_buffer));
+        case MQTT_MSG_TYPE_PUBACK:
+        case MQTT_MSG_TYPE_PUBCOMP:
+            return true;  /* Deliveries are not retained, nothing to release */
+        case MQTT_MSG_TYPE_SUBSCRIBE:
+            return broker_handle_subscribe(s);
+        case MQTT_MSG_TYPE_UNSUBSCRIBE:
+            return broker_handle_unsubscribe(s);
+        case MQTT_MSG_TYPE_PINGREQ: {
+            uint8_t pingresp[2] = { MQTT_MSG_TYPE_PINGRESP << 4, 0x00 };
+            return broker_send(s, pingresp, sizeof(pingresp));
+        }
+        case MQTT_MSG_TYPE_DISCONNECT:
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Drain a session's socket through the packet parser
+ */
+static void broker_session_input(broker_session_t *s) {
+    int32_t available;
+
+    while ((available = net_socket_available(s->socket)) > 0) {
+        if (s->rx_state == BROKER_RX_BODY) {
+            int32_t received = net_recv(s->socket, &s->rx_buffer[s->rx_pos],
+                                        (uint16_t)(s->rx_length - s->rx_pos), 1);
+            if (received < 0) {
+                break;
+            }
+            s->rx_pos += received;
+        } else {
+            uint8_t byte;
+            if (net_recv(s->socket, &byte, 1, 1) != 1) {
+                break;
+            }
+
+            if (s->rx_state == BROKER_RX_HEADER) {
+                s->rx_header = byte;
+                s->rx_length = 0;
+                s->rx_length_bytes = 0;
+                s->rx_state = BROKER_RX_LENGTH;
+                continue;
+            }
+
+            s->rx_length |= (uint32_t)(byte & 0x7F) << (7 * s->rx_length_bytes);
+            s->rx_length_bytes++;
+            if (byte & 0x80) {
+                if (s->rx_length_bytes >= 4) {
+                    broker_close_session(s);
+                    return;
+                }
+                continue;
+            }
+            if (s->rx_length > sizeof(s->rx_buffer)) {
+                broker_close_session(s);
+                return;
+            }
+            s->rx_pos = 0;
+            s->rx_state = BROKER_RX_BODY;
+        }
+
+        if (s->rx_state == BROKER_RX_BODY && s->rx_pos == s->rx_length) {
+            s->rx_state = BROKER_RX_HEADER;
+            s->last_rx_ms = os_get_uptime_ms();
+            if (!broker_dispatch(s)) {
+                broker_close_session(s);
+                return;
+            }
+        }
+    }
+
+    if (available < 0) {
+        broker_close_session(s);  /* Peer closed */
+    }
+}
+
+/**
+ * @brief Accept every pending connection
+ */
+static void broker_accept(void) {
+    while (net_socket_available(broker.listener) > 0) {
+        net_socket_t sock = net_accept(broker.listener, NULL);
+        if (sock == INVALID_SOCKET) {
+            return;
+        }
+
+        int slot = -1;
+        for (int i = 0; i < MQTT_BROKER_MAX_CLIENTS; i++) {
+            if (broker.sessions[i].socket == INVALID_SOCKET) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot < 0) {
+            net_close(sock);  /* Full */
+            continue;
+        }
+
+        broker_session_t *s = &broker.sessions[slot];
+        s->socket = sock;
+        s->rx_state = BROKER_RX_HEADER;
+        s->last_rx_ms = os_get_uptime_ms();
+        net_socket_set_notify(sock, &broker.events, BROKER_EV_SESSION(slot));
+    }
+}
+
+/**
+ * @brief Close sessions silent for 1.5x their keepalive (MQTT 3.1.1 3.1.2.10)
+ */
+static void broker_check_keepalive(void) {
+    uint32_t now = os_get_uptime_ms();
+
+    for (int i = 0; i < MQTT_BROKER_MAX_CLIENTS; i++) {
+        broker_session_t *s = &broker.sessions[i];
+        if (s->socket == INVALID_SOCKET) {
+            continue;
+        }
+        uint32_t limit_ms = s->connected ? s->keepalive_sec * 1500UL : MQTT_DEFAULT_TIMEOUT_MS;
+        if (limit_ms > 0 && (now - s->last_rx_ms) > limit_ms) {
+            broker_close_session(s);
+        }
+    }
+}
+
+static void broker_task(void *param) {
+    (void)param;
+
+    while (broker.running) {
+        uint32_t bits = 0;
+        os_event_group_wait_bits(&broker.events, BROKER_EV_ALL,
+                                 EVENT_WAIT_ANY | EVENT_CLEAR_ON_EXIT,
+                                 &bits, MQTT_BROKER_POLL_MS);
+
+        if (bits & BROKER_EV_DROP) {
+            for (int i = 0; i < MQTT_BROKER_MAX_CLIENTS; i++) {
+                broker_close_session(&broker.sessions[i]);
+            }
+        }
+
+        if (bits & BROKER_EV_LISTEN) {
+            broker_accept();
+        }
+
+        for (int i = 0; i < MQTT_BROKER_MAX_CLIENTS; i++) {
+            if ((bits & BROKER_EV_SESSION(i)) && broker.sessions[i].socket != INVALID_SOCKET) {
+                broker_session_input(&broker.sessions[i]);
+            }
+        }
+
+        broker_check_keepalive();
+    }
+}
+
+/* ========== Public API ========== */
+
+mqtt_error_t mqtt_broker_start(const mqtt_broker_config_t *config) {
+    if (broker.running) {
+        return MQTT_ERROR_ALREADY_CONNECTED;
+    }
+
+    memset(&broker, 0, sizeof(broker));
+    broker.port = (config && config->port) ? config->port : MQTT_DEFAULT_PORT;
+    for (int i = 0; i < MQTT_BROKER_MAX_CLIENTS; i++) {
+        broker.sessions[i].socket = INVALID_SOCKET;
+    }
+    os_event_group_init(&broker.events);
+
+    broker.listener = net_socket(SOCK_STREAM);
+    if (broker.listener == INVALID_SOCKET) {
+        return MQTT_ERROR_NO_MEMORY;
+    }
+
+    sockaddr_in_t addr = { .port = broker.port };
+    if (net_bind(broker.listener, &addr) != OS_OK ||
+        net_listen(broker.listener, MQTT_BROKER_MAX_CLIENTS) != OS_OK) {
+        net_close(broker.listener);
+        return MQTT_ERROR_NETWORK;
+    }
+    net_socket_set_notify(broker.listener, &broker.events, BROKER_EV_LISTEN);
+
+    broker.running = true;
+    if (os_task_create(&broker.task, "mqtt_brk", broker_task, NULL,
+                       config ? config->priority : PRIORITY_NORMAL) != OS_OK) {
+        broker.running = false;
+        net_close(broker.listener);
+        return MQTT_ERROR_NO_MEMORY;
+    }
+
+    return MQTT_OK;
+}
+
+void mqtt_broker_drop_clients(void) {
+    if (broker.running) {
+        os_event_group_set_bits(&broker.events, BROKER_EV_DROP);
+    }
+}
+
+void mqtt_broker_get_stats(mqtt_broker_stats_t *stats) {
+    if (stats) {
+        memcpy(stats, &broker.stats, sizeof(mqtt_broker_stats_t));
+    }
+}
@@ -254,7 +254,11 @@ void net_ethernet_input(const uint8_t *data, uint16_t length) {
                          eth->dest.addr[2] == 0xFF && eth->dest.addr[3] == 0xFF &&
                          eth->dest.addr[4] == 0xFF && eth->dest.addr[5] == 0xFF);
 
-    if (!is_for_us && !is_broadcast) {
+    /* IPv4 multicast (01:00:5e): the IP layer filters by joined group */
+    bool is_multicast = (eth->dest.addr[0] == 0x01 && eth->dest.addr[1] == 0x00 &&
+                         eth->dest.addr[2] == 0x5E);
+
+    if (!is_for_us && !is_broadcast && !is_multicast) {
         return;  /* Not for us */
     }
 
@@ -279,41 +283,84 @@ void net_ethernet_input(const uint8_t *data, uint16_t length) {
  *===========================================================================*/
 
 /**
- * @brief Send IP packet via Ethernet
+ * @brief Send IP packet via Ethernet without copying it
+ *
+ * The Ethernet header is written into the ETH_HEADER_SIZE bytes in front
+ * of the packet, which the caller must own (see NET_TX_HEADROOM).
+ *
  * @param dest_ip Destination IP address
- * @param data IP packet data
+ * @param packet IP packet, preceded by header room
  * @param length Packet length
  * @return OS_OK on success
  */
-os_error_t net_ethernet_send_ip(ipv4_addr_t dest_ip, const uint8_t *data, uint16_t length) {
+os_error_t net_ethernet_send_ip_inplace(ipv4_addr_t dest_ip, uint8_t *packet, uint16_t length) {
     if (length > NET_BUFFER_SIZE - ETH_HEADER_SIZE) {
         return OS_ERR_INVALID_PARAM;
     }
 
     mac_addr_t dest_mac;
+    ipv4_addr_t my_ip;
+    net_get_ip_addr(&my_ip);
 
+    /* Traffic to our own address goes to our own MAC (loopback testing) */
+    if (net_ipv4_equal(dest_ip, my_ip)) {
+        net_get_mac_addr(&dest_mac);
+    }
+    /* Multicast maps onto 01:00:5e plus the low 23 bits of the group; no ARP */
+    else if (IPV4_IS_MULTICAST(dest_ip)) {
+        dest_mac.addr[0] = 0x01;
+        dest_mac.addr[1] = 0x00;
+        dest_mac.addr[2] = 0x5E;
+        dest_mac.addr[3] = dest_ip.addr[1] & 0x7F;
+        dest_mac.addr[4] = dest_ip.addr[2];
+        dest_mac.addr[5] = dest_ip.addr[3];
+    }
     /* Lookup MAC address in ARP cache */
-    if (!arp_cache_lookup(dest_ip, &dest_mac)) {
+    else if (!arp_cache_lookup(dest_ip, &dest_mac)) {
         /* MAC not in cache, send ARP request */
         arp_send_request(dest_ip);
         return OS_ERR_TIMEOUT;  /* Caller should retry */
     }
 
-    /* Build ethernet frame */
-    uint8_t frame[NET_BUFFER_SIZE];
+    /* Build ethernet header in front of the packet */
+    uint8_t *frame = packet - ETH_HEADER_SIZE;
     eth_header_t *eth = (eth_header_t *)frame;
 
     net_get_mac_addr(&eth->src);
     eth->dest = dest_mac;
     eth->type = htons(ETH_TYPE_IP);
 
-    /* Copy IP packet */
-    memcpy(frame + ETH_HEADER_SIZE, data, length);
-
     /* Send frame */
     return net_driver_send(frame, ETH_HEADER_SIZE + length);
 }
 
+/**
+ * @brief Send IP packet via Ethernet
+ *
+ * Copies the packet into a pool buffer; the frame is not built on the stack.
+ *
+ * @param dest_ip Destination IP address
+ * @param data IP packet data
+ * @param length Packet length
+ * @return OS_OK on success, OS_ERR_NO_RESOURCE if no buffer is free
+ */
+os_error_t net_ethernet_send_ip(ipv4_addr_t dest_ip, const uint8_t *data, uint16_t length) {
+    if (length > NET_BUFFER_SIZE - ETH_HEADER_SIZE) {
+        return OS_ERR_INVALID_PARAM;
+    }
+
+    net_buffer_t *buf = net_buffer_alloc();
+    if (!buf) {
+        return OS_ERR_NO_RESOURCE;
+    }
+
+    memcpy(buf->data + ETH_HEADER_SIZE, data, length);
+    os_error_t err = net_ethernet_send_ip_inplace(dest_ip, buf->data + ETH_HEADER_SIZE, length);
+
+    net_buffer_free(buf);
+    return err;
+}
+
 /**
  * @brief Resolve IP to MAC address (with retry)
  * @param ip IP address
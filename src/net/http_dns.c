@@ -4,6 +4,7 @@
  */
 
 #include "tinyos/net.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -57,14 +58,17 @@ static bool parse_url(const char *url, ipv4_addr_t *ip, uint16_t *port, char *pa
     return true;
 }
 
-os_error_t net_http_request(
+/**
+ * @brief Connect to the server in url and send the request head and body
+ */
+static os_error_t http_send_request(
     http_method_t method,
     const char *url,
     const char **headers,
     const void *body,
     uint32_t body_length,
-    http_response_t *response,
-    uint32_t timeout_ms
+    uint32_t timeout_ms,
+    net_socket_t *sock_out
 ) {
     ipv4_addr_t server_ip;
     uint16_t port;
@@ -128,6 +132,26 @@ os_error_t net_http_request(
         net_send(sock, request, req_len, timeout_ms);
     }
 
+    *sock_out = sock;
+    return OS_OK;
+}
+
+os_error_t net_http_request(
+    http_method_t method,
+    const char *url,
+    const char **headers,
+    const void *body,
+    uint32_t body_length,
+    http_response_t *response,
+    uint32_t timeout_ms
+) {
+    net_socket_t sock;
+
+    os_error_t err = http_send_request(method, url, headers, body, body_length, timeout_ms, &sock);
+    if (err != OS_OK) {
+        return err;
+    }
+
     /* Receive response */
     uint8_t rx_buffer[2048];
     int32_t total_received = 0;
@@ -183,6 +207,107 @@ os_error_t net_http_get(const char *url, http_response_t *response, uint32_t tim
     return net_http_request(HTTP_GET, url, NULL, NULL, 0, response, timeout_ms);
 }
 
+/**
+ * @brief Case-insensitive check that line starts with a header name
+ */
+static bool http_header_is(const char *line, const char *name) {
+    while (*name) {
+        char c = *line++;
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        if (c != *name++) {
+            return false;
+        }
+    }
+    return true;
+}
+
+os_error_t net_http_get_stream(
+    const char *url,
+    const char **headers,
+    http_body_callback_t callback,
+    void *user_data,
+    uint16_t *status_code,
+    uint32_t timeout_ms
+) {
+    if (url == NULL || callback == NULL) {
+        return OS_ERR_INVALID_PARAM;
+    }
+
+    net_socket_t sock;
+    os_error_t err = http_send_request(HTTP_GET, url, headers, NULL, 0, timeout_ms, &sock);
+    if (err != OS_OK) {
+        return err;
+    }
+
+    /*
+     * The head is parsed a line at a time as it arrives. Only the status
+     * line and Content-Length matter, so longer lines are truncated.
+     */
+    uint8_t rx_buffer[HTTP_STREAM_CHUNK_SIZE];
+    char line[128];
+    uint16_t line_length = 0;
+    uint16_t status = 0;
+    uint32_t content_length = 0;
+    uint32_t received = 0;
+    bool in_body = false;
+    int32_t bytes;
+
+    while ((bytes = net_recv(sock, rx_buffer, sizeof(rx_buffer), timeout_ms)) > 0) {
+        int32_t i = 0;
+
+        while (!in_body && i < bytes) {
+            char c = (char)rx_buffer[i++];
+            if (c != '\n') {
+                if (c != '\r' && line_length < sizeof(line) - 1) {
+                    line[line_length++] = c;
+                }
+                continue;
+            }
+
+            line[line_length] = '\0';
+            if (line_length == 0) {
+                in_body = true;
+            } else if (status == 0) {
+                sscanf(line, "HTTP/1.%*d %hu", &status);
+            } else if (http_header_is(line, "content-length:")) {
+                content_length = strtoul(line + 15, NULL, 10);
+            }
+            line_length = 0;
+        }
+
+        if (in_body && status / 100 != 2) {
+            err = OS_ERROR;
+            break;
+        }
+
+        if (in_body && i < bytes) {
+            err = callback(rx_buffer + i, bytes - i, status, content_length, user_data);
+            received += bytes - i;
+            if (err != OS_OK) {
+                break;
+            }
+        }
+
+        if (content_length > 0 && received >= content_length) {
+            break;
+        }
+    }
+
+    net_close(sock);
+
+    if (status_code) {
+        *status_code = status;
+    }
+
+    if (err == OS_OK && (!in_body || (content_length > 0 && received < content_length))) {
+        err = OS_ERR_TIMEOUT;
+    }
+
+    return err;
+}
+
 os_error_t net_http_post(
     const char *url,
     const char *content_type,
@@ -232,6 +357,11 @@ os_error_t net_http_send_response(
 os_error_t net_dns_resolve(const char *hostname, ipv4_addr_t *ip, uint32_t timeout_ms) {
     (void)timeout_ms;
 
+    /* Dotted-quad literals need no lookup */
+    if (hostname != NULL && ip != NULL && net_parse_ipv4(hostname, ip)) {
+        return OS_OK;
+    }
+
     /* This is a stub - real DNS would:
      * 1. Create UDP socket
      * 2. Build DNS query packet
@@ -1,6 +1,6 @@
 /**
  * @file ip.c
- * @brief IPv4 Layer (Layer 3) and ICMP
+ * @brief IPv4 Layer (Layer 3), ICMP and IGMPv2
  */
 
 #include "tinyos/net.h"
@@ -11,6 +11,7 @@
  *===========================================================================*/
 
 #define IP_PROTOCOL_ICMP 1
+#define IP_PROTOCOL_IGMP 2
 #define IP_PROTOCOL_TCP  6
 #define IP_PROTOCOL_UDP  17
 
@@ -27,6 +28,9 @@ typedef struct __attribute__((packed)) {
     ipv4_addr_t dest;         /* Destination Address */
 } ip_header_t;
 
+/* Ethernet + IP header room in front of an outgoing IP payload */
+#define IP_TX_HEADROOM  (14 + sizeof(ip_header_t))
+
 /*===========================================================================
  * ICMP Header Structure
  *===========================================================================*/
@@ -42,6 +46,38 @@ typedef struct __attribute__((packed)) {
     uint16_t sequence;
 } icmp_header_t;
 
+/*===========================================================================
+ * IGMPv2 Message Structure
+ *===========================================================================*/
+
+#define IGMP_TYPE_QUERY         0x11
+#define IGMP_TYPE_REPORT_V1     0x12
+#define IGMP_TYPE_REPORT_V2     0x16
+#define IGMP_TYPE_LEAVE         0x17
+
+#define IGMP_V1_MAX_RESP        100     /* Max response time of an IGMPv1 query, 1/10 s */
+#define IGMP_UNSOLICITED_MS     10000   /* Unsolicited Report Interval */
+#define IP_OPTION_ROUTER_ALERT  0x94040000u
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t max_resp_time;    /* 1/10 s units (queries only) */
+    uint16_t checksum;
+    ipv4_addr_t group;
+} igmp_header_t;
+
+/* Joined multicast groups */
+typedef struct {
+    ipv4_addr_t group;
+    uint8_t refs;             /* Outstanding joins, 0 = free slot */
+    bool report_pending;      /* A report is due at report_at */
+    uint32_t report_at;
+} igmp_group_t;
+
+static igmp_group_t igmp_groups[NET_MAX_MULTICAST_GROUPS];
+static mutex_t igmp_mutex;
+static uint32_t igmp_rng_state;
+
 /* Ping tracking */
 static uint16_t ping_id = 0;
 static uint16_t ping_sequence = 0;
@@ -52,7 +88,9 @@ static semaphore_t ping_sem;
 
 /* External functions */
 extern os_error_t net_ethernet_send_ip(ipv4_addr_t dest_ip, const uint8_t *data, uint16_t length);
+extern os_error_t net_ethernet_send_ip_inplace(ipv4_addr_t dest_ip, uint8_t *packet, uint16_t length);
 extern void net_get_ip_addr(ipv4_addr_t *ip);
+extern void net_get_mac_addr(mac_addr_t *mac);
 extern void net_udp_input(const uint8_t *data, uint16_t length, ipv4_addr_t src_ip, ipv4_addr_t dest_ip);
 extern void net_tcp_input(const uint8_t *data, uint16_t length, ipv4_addr_t src_ip, ipv4_addr_t dest_ip);
 
@@ -84,6 +122,16 @@ void net_ip_init(void) {
     ping_id = 0;
     ping_sequence = 0;
     ping_reply_received = false;
+
+    os_mutex_init(&igmp_mutex);
+    memset(igmp_groups, 0, sizeof(igmp_groups));
+
+    /* Report delays only need to differ between hosts: seed from the MAC */
+    mac_addr_t mac;
+    net_get_mac_addr(&mac);
+    igmp_rng_state = ((uint32_t)mac.addr[2] << 24 | (uint32_t)mac.addr[3] << 16 |
+                      (uint32_t)mac.addr[4] << 8 | mac.addr[5]) ^ os_get_tick_count();
+    igmp_rng_state |= 1;
 }
 
 /*===========================================================================
@@ -230,6 +278,221 @@ os_error_t net_ping(ipv4_addr_t dest_ip, uint32_t timeout_ms, uint32_t *rtt) {
     return OS_ERR_TIMEOUT;
 }
 
+/*===========================================================================
+ * IGMPv2 (RFC 2236)
+ *===========================================================================*/
+
+/**
+ * @brief Random report delay below max_ms (xorshift32)
+ */
+static uint32_t igmp_random_delay(uint32_t max_ms) {
+    uint32_t x = igmp_rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    igmp_rng_state = x;
+    return max_ms ? x % max_ms : 0;
+}
+
+static bool igmp_is_all_systems(ipv4_addr_t group) {
+    return net_ipv4_equal(group, IPV4(224, 0, 0, 1));
+}
+
+static igmp_group_t *igmp_find(ipv4_addr_t group) {
+    for (int i = 0; i < NET_MAX_MULTICAST_GROUPS; i++) {
+        if (igmp_groups[i].refs > 0 && net_ipv4_equal(igmp_groups[i].group, group)) {
+            return &igmp_groups[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Send an IGMPv2 message (TTL 1, Router Alert option)
+ */
+static os_error_t igmp_send(uint8_t type, ipv4_addr_t group, ipv4_addr_t dest_ip) {
+    uint8_t packet[sizeof(ip_header_t) + 4 + sizeof(igmp_header_t)];
+    ip_header_t *ip_hdr = (ip_header_t *)packet;
+    uint32_t router_alert = htonl(IP_OPTION_ROUTER_ALERT);
+    igmp_header_t *igmp = (igmp_header_t *)(packet + sizeof(ip_header_t) + 4);
+
+    ipv4_addr_t my_ip;
+    net_get_ip_addr(&my_ip);
+
+    ip_hdr->version_ihl = 0x46;  /* Version 4, IHL 6 (Router Alert) */
+    ip_hdr->tos = 0;
+    ip_hdr->total_length = htons(sizeof(packet));
+    ip_hdr->identification = 0;
+    ip_hdr->flags_fragment = 0;
+    ip_hdr->ttl = 1;
+    ip_hdr->protocol = IP_PROTOCOL_IGMP;
+    ip_hdr->src = my_ip;
+    ip_hdr->dest = dest_ip;
+    memcpy(packet + sizeof(ip_header_t), &router_alert, 4);
+    ip_hdr->checksum = 0;
+    ip_hdr->checksum = net_checksum(ip_hdr, sizeof(ip_header_t) + 4);
+
+    igmp->type = type;
+    igmp->max_resp_time = 0;
+    igmp->group = group;
+    igmp->checksum = 0;
+    igmp->checksum = net_checksum(igmp, sizeof(igmp_header_t));
+
+    return net_ethernet_send_ip(dest_ip, packet, sizeof(packet));
+}
+
+/**
+ * @brief Schedule a report within max_ms unless one is already due sooner
+ */
+static void igmp_schedule(igmp_group_t *entry, uint32_t max_ms) {
+    uint32_t now = os_get_tick_count();
+    uint32_t delay = igmp_random_delay(max_ms);
+
+    if (!entry->report_pending || (int32_t)(entry->report_at - now) > (int32_t)delay) {
+        entry->report_at = now + delay;
+        entry->report_pending = true;
+    }
+}
+
+/**
+ * @brief Handle incoming IGMP message
+ */
+static void igmp_input(const uint8_t *data, uint16_t length, ipv4_addr_t src_ip) {
+    if (length < sizeof(igmp_header_t) || net_checksum(data, length) != 0) {
+        return;
+    }
+
+    const igmp_header_t *igmp = (const igmp_header_t *)data;
+
+    os_mutex_lock(&igmp_mutex, OS_WAIT_FOREVER);
+
+    switch (igmp->type) {
+        case IGMP_TYPE_QUERY: {
+            /* General query (group 0.0.0.0) or group-specific query */
+            uint8_t max_resp = igmp->max_resp_time ? igmp->max_resp_time : IGMP_V1_MAX_RESP;
+            bool general = net_ipv4_equal(igmp->group, IPV4(0, 0, 0, 0));
+
+            for (int i = 0; i < NET_MAX_MULTICAST_GROUPS; i++) {
+                if (igmp_groups[i].refs > 0 &&
+                    (general || net_ipv4_equal(igmp_groups[i].group, igmp->group))) {
+                    igmp_schedule(&igmp_groups[i], max_resp * 100u);
+                }
+            }
+            break;
+        }
+
+        case IGMP_TYPE_REPORT_V1:
+        case IGMP_TYPE_REPORT_V2: {
+            /* Another member answered: suppress our own report */
+            ipv4_addr_t my_ip;
+            net_get_ip_addr(&my_ip);
+            igmp_group_t *entry = igmp_find(igmp->group);
+            if (entry && !net_ipv4_equal(src_ip, my_ip)) {
+                entry->report_pending = false;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    os_mutex_unlock(&igmp_mutex);
+}
+
+/**
+ * @brief Send reports that have come due (called from the network task)
+ */
+void net_igmp_process(void) {
+    uint32_t now = os_get_tick_count();
+
+    os_mutex_lock(&igmp_mutex, OS_WAIT_FOREVER);
+
+    for (int i = 0; i < NET_MAX_MULTICAST_GROUPS; i++) {
+        igmp_group_t *entry = &igmp_groups[i];
+        if (entry->refs > 0 && entry->report_pending && (int32_t)(now - entry->report_at) >= 0) {
+            entry->report_pending = false;
+            igmp_send(IGMP_TYPE_REPORT_V2, entry->group, entry->group);
+        }
+    }
+
+    os_mutex_unlock(&igmp_mutex);
+}
+
+os_error_t net_multicast_join(ipv4_addr_t group) {
+    if (!IPV4_IS_MULTICAST(group)) {
+        return OS_ERR_INVALID_PARAM;
+    }
+    if (igmp_is_all_systems(group)) {
+        return OS_OK;  /* Always a member, never reported */
+    }
+
+    os_mutex_lock(&igmp_mutex, OS_WAIT_FOREVER);
+
+    igmp_group_t *entry = igmp_find(group);
+    if (entry) {
+        entry->refs++;
+        os_mutex_unlock(&igmp_mutex);
+        return OS_OK;
+    }
+
+    for (int i = 0; i < NET_MAX_MULTICAST_GROUPS; i++) {
+        if (igmp_groups[i].refs == 0) {
+            entry = &igmp_groups[i];
+            break;
+        }
+    }
+    if (!entry) {
+        os_mutex_unlock(&igmp_mutex);
+        return OS_ERR_NO_RESOURCE;
+    }
+
+    entry->group = group;
+    entry->refs = 1;
+
+    /* Report now and once more later, in case the first is lost */
+    igmp_send(IGMP_TYPE_REPORT_V2, group, group);
+    entry->report_pending = false;
+    igmp_schedule(entry, IGMP_UNSOLICITED_MS);
+
+    os_mutex_unlock(&igmp_mutex);
+    return OS_OK;
+}
+
+os_error_t net_multicast_leave(ipv4_addr_t group) {
+    if (igmp_is_all_systems(group)) {
+        return OS_OK;
+    }
+
+    os_mutex_lock(&igmp_mutex, OS_WAIT_FOREVER);
+
+    igmp_group_t *entry = igmp_find(group);
+    if (!entry) {
+        os_mutex_unlock(&igmp_mutex);
+        return OS_ERR_INVALID_PARAM;
+    }
+
+    if (--entry->refs == 0) {
+        entry->report_pending = false;
+        igmp_send(IGMP_TYPE_LEAVE, group, IPV4(224, 0, 0, 2));  /* All routers */
+    }
+
+    os_mutex_unlock(&igmp_mutex);
+    return OS_OK;
+}
+
+bool net_multicast_is_member(ipv4_addr_t group) {
+    if (igmp_is_all_systems(group)) {
+        return true;
+    }
+
+    os_mutex_lock(&igmp_mutex, OS_WAIT_FOREVER);
+    bool member = (igmp_find(group) != NULL);
+    os_mutex_unlock(&igmp_mutex);
+
+    return member;
+}
+
 /*===========================================================================
  * IP Input
  *===========================================================================*/
@@ -264,17 +527,21 @@ void net_ip_input(const uint8_t *data, uint16_t length, const mac_addr_t *src_ma
         return;  /* Checksum mismatch */
     }
 
-    /* Check if packet is for us */
+    /* Check if packet is for us: our address or a joined multicast group */
     ipv4_addr_t my_ip;
     net_get_ip_addr(&my_ip);
 
-    if (!net_ipv4_equal(ip_hdr->dest, my_ip)) {
+    if (IPV4_IS_MULTICAST(ip_hdr->dest)) {
+        if (!net_multicast_is_member(ip_hdr->dest)) {
+            return;  /* Group not joined */
+        }
+    } else if (!net_ipv4_equal(ip_hdr->dest, my_ip)) {
         return;  /* Not for us */
     }
 
     /* Get payload */
     uint16_t total_length = ntohs(ip_hdr->total_length);
-    if (total_length > length) {
+    if (total_length > length || total_length < ihl) {
         return;  /* Invalid length */
     }
 
@@ -284,7 +551,14 @@ void net_ip_input(const uint8_t *data, uint16_t length, const mac_addr_t *src_ma
     /* Process based on protocol */
     switch (ip_hdr->protocol) {
         case IP_PROTOCOL_ICMP:
-            icmp_input(payload, payload_length, ip_hdr->src);
+            /* No echo replies to multicast pings */
+            if (!IPV4_IS_MULTICAST(ip_hdr->dest)) {
+                icmp_input(payload, payload_length, ip_hdr->src);
+            }
+            break;
+
+        case IP_PROTOCOL_IGMP:
+            igmp_input(payload, payload_length, ip_hdr->src);
             break;
 
         case IP_PROTOCOL_UDP:
@@ -306,19 +580,23 @@ void net_ip_input(const uint8_t *data, uint16_t length, const mac_addr_t *src_ma
  *===========================================================================*/
 
 /**
- * @brief Send IP packet
+ * @brief Send IP packet without copying the payload
+ *
+ * The IP and Ethernet headers are written into the bytes in front of the
+ * payload, which the caller must own (IP_TX_HEADROOM bytes).
+ *
  * @param dest_ip Destination IP
  * @param protocol IP protocol number
- * @param data Payload data
+ * @param payload Payload data, preceded by header room
  * @param length Payload length
  * @return OS_OK on success
  */
-os_error_t net_ip_send(ipv4_addr_t dest_ip, uint8_t protocol, const uint8_t *data, uint16_t length) {
-    if (length > NET_BUFFER_SIZE - sizeof(ip_header_t)) {
+os_error_t net_ip_send_inplace(ipv4_addr_t dest_ip, uint8_t protocol, uint8_t *payload, uint16_t length) {
+    if (length > NET_BUFFER_SIZE - IP_TX_HEADROOM) {
         return OS_ERR_INVALID_PARAM;
     }
 
-    uint8_t packet[NET_BUFFER_SIZE];
+    uint8_t *packet = payload - sizeof(ip_header_t);
     ip_header_t *ip_hdr = (ip_header_t *)packet;
     ipv4_addr_t my_ip;
 
@@ -330,16 +608,39 @@ os_error_t net_ip_send(ipv4_addr_t dest_ip, uint8_t protocol, const uint8_t *dat
     ip_hdr->total_length = htons(sizeof(ip_header_t) + length);
     ip_hdr->identification = 0;
     ip_hdr->flags_fragment = 0;
-    ip_hdr->ttl = 64;
+    ip_hdr->ttl = IPV4_IS_MULTICAST(dest_ip) ? 1 : 64;  /* Multicast stays on the link */
     ip_hdr->protocol = protocol;
     ip_hdr->src = my_ip;
     ip_hdr->dest = dest_ip;
     ip_hdr->checksum = 0;
     ip_hdr->checksum = net_checksum(ip_hdr, sizeof(ip_header_t));
 
-    /* Copy payload */
-    memcpy(packet + sizeof(ip_header_t), data, length);
-
     /* Send via ethernet */
-    return net_ethernet_send_ip(dest_ip, packet, sizeof(ip_header_t) + length);
+    return net_ethernet_send_ip_inplace(dest_ip, packet, sizeof(ip_header_t) + length);
+}
+
+/**
+ * @brief Send IP packet
+ * @param dest_ip Destination IP
+ * @param protocol IP protocol number
+ * @param data Payload data
+ * @param length Payload length
+ * @return OS_OK on success, OS_ERR_NO_RESOURCE if no buffer is free
+ */
+os_error_t net_ip_send(ipv4_addr_t dest_ip, uint8_t protocol, const uint8_t *data, uint16_t length) {
+    if (length > NET_BUFFER_SIZE - IP_TX_HEADROOM) {
+        return OS_ERR_INVALID_PARAM;
+    }
+
+    /* Copy once into a pool buffer; lower layers prepend headers in place */
+    net_buffer_t *buf = net_buffer_alloc();
+    if (!buf) {
+        return OS_ERR_NO_RESOURCE;
+    }
+
+    memcpy(buf->data + IP_TX_HEADROOM, data, length);
+    os_error_t err = net_ip_send_inplace(dest_ip, protocol, buf->data + IP_TX_HEADROOM, length);
+
+    net_buffer_free(buf);
+    return err;
 }
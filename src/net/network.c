@@ -35,6 +35,7 @@ extern void net_ip_init(void);
 extern void net_ip_input(const uint8_t *data, uint16_t length, const mac_addr_t *src_mac);
 
 extern void net_icmp_init(void);
+extern void net_igmp_process(void);
 extern void net_udp_init(void);
 extern void net_tcp_init(void);
 
@@ -156,6 +157,9 @@ static void network_task_func(void *param) {
             }
         }
 
+        /* Send IGMP membership reports that have come due */
+        net_igmp_process();
+
         /* Small delay to prevent busy-waiting */
         os_task_delay(1);  /* 1ms polling interval */
     }
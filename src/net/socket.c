@@ -40,16 +40,27 @@ typedef struct {
     bool in_use;
     sockaddr_in_t local_addr;
     sockaddr_in_t remote_addr;
+    ipv4_addr_t rx_dest;            /* UDP: destination of the datagram in rx_buffer */
     tcp_state_t state;
 
     /* RX buffer */
-    uint8_t rx_buffer[1024];
+    uint8_t rx_buffer[NET_SOCKET_RX_SIZE];
     uint16_t rx_length;
+    uint16_t rx_offset;             /* Bytes of rx_buffer already consumed */
     semaphore_t rx_sem;
 
+    /* Readiness notification */
+    event_group_t *notify_group;
+    uint32_t notify_bits;
+
     /* TCP specific */
     uint32_t seq_num;
     uint32_t ack_num;
+
+    /* Passive open */
+    int8_t parent;                  /* Listening socket that created us, -1 if none */
+    bool accept_pending;            /* Established but not yet returned by accept */
+    uint8_t backlog;                /* Listening sockets: max pending connections */
 } socket_t;
 
 static socket_t sockets[NET_MAX_SOCKETS];
@@ -57,6 +68,7 @@ static mutex_t socket_mutex;
 static uint16_t next_ephemeral_port = 49152;
 
 extern os_error_t net_ip_send(ipv4_addr_t dest_ip, uint8_t protocol, const uint8_t *data, uint16_t length);
+extern os_error_t net_ip_send_inplace(ipv4_addr_t dest_ip, uint8_t protocol, uint8_t *payload, uint16_t length);
 
 static uint16_t htons(uint16_t h) { return ((h & 0xFF) << 8) | ((h & 0xFF00) >> 8); }
 static uint16_t ntohs(uint16_t n) { return htons(n); }
@@ -65,6 +77,34 @@ static uint32_t htonl(uint32_t h) {
 }
 static uint32_t ntohl(uint32_t n) { return htonl(n); }
 
+/**
+ * @brief Signal readiness to a registered event group (if any)
+ */
+static void socket_notify(socket_t *s) {
+    if (s->notify_group != NULL) {
+        os_event_group_set_bits(s->notify_group, s->notify_bits);
+    }
+}
+
+/**
+ * @brief Send a TCP segment without payload (SYN-ACK, FIN)
+ */
+static os_error_t tcp_send_control(socket_t *s, uint8_t flags) {
+    tcp_header_t tcp;
+
+    tcp.src_port = htons(s->local_addr.port);
+    tcp.dest_port = htons(s->remote_addr.port);
+    tcp.seq_num = htonl(s->seq_num);
+    tcp.ack_num = htonl(s->ack_num);
+    tcp.data_offset_flags = 0x50;
+    tcp.flags = flags;
+    tcp.window = htons(sizeof(s->rx_buffer));
+    tcp.checksum = 0;
+    tcp.urgent_ptr = 0;
+
+    return net_ip_send(s->remote_addr.addr, 6, (const uint8_t *)&tcp, sizeof(tcp));
+}
+
 /*===========================================================================
  * Initialization
  *===========================================================================*/
@@ -74,6 +114,8 @@ void net_udp_init(void) {
     for (int i = 0; i < NET_MAX_SOCKETS; i++) {
         sockets[i].in_use = false;
         sockets[i].rx_length = 0;
+        sockets[i].rx_offset = 0;
+        sockets[i].notify_group = NULL;
         os_semaphore_init(&sockets[i].rx_sem, 0);
     }
 }
@@ -95,10 +137,16 @@ net_socket_t net_socket(socket_type_t type) {
             sockets[i].type = type;
             sockets[i].state = TCP_CLOSED;
             sockets[i].rx_length = 0;
+            sockets[i].rx_offset = 0;
+            sockets[i].notify_group = NULL;
+            sockets[i].notify_bits = 0;
             sockets[i].local_addr.port = 0;
             sockets[i].remote_addr.port = 0;
             sockets[i].seq_num = os_get_tick_count();
             sockets[i].ack_num = 0;
+            sockets[i].parent = -1;
+            sockets[i].accept_pending = false;
+            sockets[i].backlog = 0;
             os_mutex_unlock(&socket_mutex);
             return i;
         }
@@ -122,24 +170,76 @@ os_error_t net_close(net_socket_t sock) {
         return OS_ERR_INVALID_PARAM;
     }
 
-    /* For TCP: send FIN and wait for close (simplified) */
+    /* For TCP: send FIN so the peer sees the close (no FIN_WAIT, simplified) */
     if (sockets[sock].type == SOCK_STREAM && sockets[sock].state == TCP_ESTABLISHED) {
-        /* Send FIN packet - simplified, not fully implemented */
-        sockets[sock].state = TCP_CLOSED;
+        tcp_send_control(&sockets[sock], TCP_FLAG_FIN | TCP_FLAG_ACK);
+    }
+    sockets[sock].state = TCP_CLOSED;
+
+    /* Closing a listener drops connections nobody accepted yet */
+    if (sockets[sock].backlog > 0) {
+        for (int i = 0; i < NET_MAX_SOCKETS; i++) {
+            if (sockets[i].in_use && sockets[i].parent == sock && sockets[i].accept_pending) {
+                net_close(i);
+            }
+        }
     }
 
     sockets[sock].in_use = false;
     sockets[sock].rx_length = 0;
+    sockets[sock].rx_offset = 0;
+    sockets[sock].notify_group = NULL;
     return OS_OK;
 }
 
+os_error_t net_socket_set_notify(net_socket_t sock, event_group_t *group, uint32_t bits) {
+    if (sock < 0 || sock >= NET_MAX_SOCKETS || !sockets[sock].in_use) {
+        return OS_ERR_INVALID_PARAM;
+    }
+
+    uint32_t state = os_enter_critical();
+    sockets[sock].notify_group = group;
+    sockets[sock].notify_bits = bits;
+    os_exit_critical(state);
+
+    /* Data may already be waiting */
+    if (group != NULL && sockets[sock].rx_length > sockets[sock].rx_offset) {
+        os_event_group_set_bits(group, bits);
+    }
+
+    return OS_OK;
+}
+
+int32_t net_socket_available(net_socket_t sock) {
+    if (sock < 0 || sock >= NET_MAX_SOCKETS || !sockets[sock].in_use) {
+        return -1;
+    }
+
+    /* Listening socket: connections waiting for net_accept() */
+    if (sockets[sock].state == TCP_LISTEN) {
+        int32_t pending = 0;
+        for (int i = 0; i < NET_MAX_SOCKETS; i++) {
+            if (sockets[i].in_use && sockets[i].parent == sock && sockets[i].accept_pending) {
+                pending++;
+            }
+        }
+        return pending;
+    }
+
+    if (sockets[sock].type == SOCK_STREAM &&
+        sockets[sock].state != TCP_ESTABLISHED &&
+        sockets[sock].rx_length == sockets[sock].rx_offset) {
+        return -1;  /* Connection gone and nothing left to read */
+    }
+
+    return sockets[sock].rx_length - sockets[sock].rx_offset;
+}
+
 /*===========================================================================
  * UDP Implementation
  *===========================================================================*/
 
 void net_udp_input(const uint8_t *data, uint16_t length, ipv4_addr_t src_ip, ipv4_addr_t dest_ip) {
-    (void)dest_ip;
-
     if (length < sizeof(udp_header_t)) {
         return;
     }
@@ -161,46 +261,73 @@ void net_udp_input(const uint8_t *data, uint16_t length, ipv4_addr_t src_ip, ipv
 
             memcpy(sockets[i].rx_buffer, data + sizeof(udp_header_t), payload_len);
             sockets[i].rx_length = payload_len;
+            sockets[i].rx_offset = 0;
             sockets[i].remote_addr.addr = src_ip;
             sockets[i].remote_addr.port = src_port;
+            sockets[i].rx_dest = dest_ip;
 
             /* Signal data available */
             os_semaphore_post(&sockets[i].rx_sem);
+            socket_notify(&sockets[i]);
             break;
         }
     }
 }
 
-int32_t net_sendto(net_socket_t sock, const void *data, uint16_t length, const sockaddr_in_t *addr) {
+int32_t net_sendto_buffer(net_socket_t sock, net_buffer_t *buf, const sockaddr_in_t *addr) {
     if (sock < 0 || sock >= NET_MAX_SOCKETS || !sockets[sock].in_use) {
         return -1;
     }
 
-    if (sockets[sock].type != SOCK_DGRAM) {
+    if (sockets[sock].type != SOCK_DGRAM || !buf || !addr || buf->offset < NET_TX_HEADROOM ||
+        buf->offset + buf->length > NET_BUFFER_SIZE) {
         return -1;
     }
 
-    uint8_t packet[sizeof(udp_header_t) + length];
+    /* Build UDP header in the headroom */
+    uint8_t *packet = buf->data + buf->offset - sizeof(udp_header_t);
     udp_header_t *udp = (udp_header_t *)packet;
 
-    /* Build UDP header */
     udp->src_port = htons(sockets[sock].local_addr.port);
     udp->dest_port = htons(addr->port);
-    udp->length = htons(sizeof(udp_header_t) + length);
+    udp->length = htons(sizeof(udp_header_t) + buf->length);
     udp->checksum = 0;  /* Optional for IPv4 */
 
-    /* Copy payload */
-    memcpy(packet + sizeof(udp_header_t), data, length);
-
     /* Send via IP */
-    if (net_ip_send(addr->addr, 17, packet, sizeof(packet)) == OS_OK) {
-        return length;
+    if (net_ip_send_inplace(addr->addr, 17, packet, sizeof(udp_header_t) + buf->length) == OS_OK) {
+        return buf->length;
     }
 
     return -1;
 }
 
+int32_t net_sendto(net_socket_t sock, const void *data, uint16_t length, const sockaddr_in_t *addr) {
+    if (length > NET_BUFFER_SIZE - NET_TX_HEADROOM) {
+        return -1;
+    }
+
+    /* One copy into a pool buffer instead of a stack packet per layer */
+    net_buffer_t *buf = net_buffer_alloc();
+    if (!buf) {
+        return -1;
+    }
+
+    buf->offset = NET_TX_HEADROOM;
+    buf->length = length;
+    memcpy(buf->data + buf->offset, data, length);
+
+    int32_t result = net_sendto_buffer(sock, buf, addr);
+
+    net_buffer_free(buf);
+    return result;
+}
+
 int32_t net_recvfrom(net_socket_t sock, void *buffer, uint16_t max_length, sockaddr_in_t *addr) {
+    return net_recvfrom_to(sock, buffer, max_length, addr, NULL);
+}
+
+int32_t net_recvfrom_to(net_socket_t sock, void *buffer, uint16_t max_length, sockaddr_in_t *addr,
+                        ipv4_addr_t *dest) {
     if (sock < 0 || sock >= NET_MAX_SOCKETS || !sockets[sock].in_use) {
         return -1;
     }
@@ -225,6 +352,9 @@ int32_t net_recvfrom(net_socket_t sock, void *buffer, uint16_t max_length, socka
     if (addr) {
         *addr = sockets[sock].remote_addr;
     }
+    if (dest) {
+        *dest = sockets[sock].rx_dest;
+    }
 
     sockets[sock].rx_length = 0;
 
@@ -235,6 +365,61 @@ int32_t net_recvfrom(net_socket_t sock, void *buffer, uint16_t max_length, socka
  * TCP Implementation (Simplified)
  *===========================================================================*/
 
+/**
+ * @brief Create a connection for a SYN arriving at a listening socket
+ *
+ * Simplified handshake: the new socket is ESTABLISHED as soon as the
+ * SYN-ACK is sent, matching net_connect() which does not send the final ACK.
+ */
+static void tcp_accept_syn(const tcp_header_t *tcp, ipv4_addr_t src_ip,
+                           uint16_t dest_port, uint16_t src_port) {
+    int listener = -1;
+    for (int i = 0; i < NET_MAX_SOCKETS; i++) {
+        if (sockets[i].in_use && sockets[i].type == SOCK_STREAM &&
+            sockets[i].state == TCP_LISTEN && sockets[i].local_addr.port == dest_port) {
+            listener = i;
+            break;
+        }
+    }
+    if (listener < 0) {
+        return;
+    }
+
+    /* Respect the backlog */
+    uint8_t pending = 0;
+    for (int i = 0; i < NET_MAX_SOCKETS; i++) {
+        if (sockets[i].in_use && sockets[i].parent == listener && sockets[i].accept_pending) {
+            pending++;
+        }
+    }
+    if (pending >= sockets[listener].backlog) {
+        return;
+    }
+
+    net_socket_t child = net_socket(SOCK_STREAM);
+    if (child == INVALID_SOCKET) {
+        return;
+    }
+
+    socket_t *s = &sockets[child];
+    s->local_addr = sockets[listener].local_addr;
+    s->remote_addr.addr = src_ip;
+    s->remote_addr.port = src_port;
+    s->ack_num = ntohl(tcp->seq_num) + 1;
+    s->parent = listener;
+
+    if (tcp_send_control(s, TCP_FLAG_SYN | TCP_FLAG_ACK) != OS_OK) {
+        s->in_use = false;
+        return;
+    }
+    s->state = TCP_ESTABLISHED;
+    s->accept_pending = true;
+
+    /* Wake net_accept() */
+    os_semaphore_post(&sockets[listener].rx_sem);
+    socket_notify(&sockets[listener]);
+}
+
 void net_tcp_input(const uint8_t *data, uint16_t length, ipv4_addr_t src_ip, ipv4_addr_t dest_ip) {
     (void)dest_ip;
 
@@ -266,17 +451,37 @@ void net_tcp_input(const uint8_t *data, uint16_t length, ipv4_addr_t src_ip, ipv
                 /* Data received */
                 uint8_t data_offset = (tcp->data_offset_flags >> 4) * 4;
                 uint16_t payload_len = length - data_offset;
+                socket_t *s = &sockets[i];
 
-                if (payload_len > 0 && payload_len <= sizeof(sockets[i].rx_buffer)) {
-                    memcpy(sockets[i].rx_buffer, data + data_offset, payload_len);
-                    sockets[i].rx_length = payload_len;
-                    os_semaphore_post(&sockets[i].rx_sem);
+                /* Compact unread data so segments append instead of overwrite */
+                if (s->rx_offset > 0) {
+                    memmove(s->rx_buffer, s->rx_buffer + s->rx_offset, s->rx_length - s->rx_offset);
+                    s->rx_length -= s->rx_offset;
+                    s->rx_offset = 0;
                 }
+
+                if (payload_len > 0 && s->rx_length + payload_len <= sizeof(s->rx_buffer)) {
+                    memcpy(s->rx_buffer + s->rx_length, data + data_offset, payload_len);
+                    s->rx_length += payload_len;
+                    os_semaphore_post(&s->rx_sem);
+                    socket_notify(s);
+                }
+            }
+            else if (flags & (TCP_FLAG_FIN | TCP_FLAG_RST)) {
+                /* Peer closed: wake readers so they observe the closed state */
+                sockets[i].state = TCP_CLOSED;
+                os_semaphore_post(&sockets[i].rx_sem);
+                socket_notify(&sockets[i]);
             }
 
-            break;
+            return;
         }
     }
+
+    /* No connection matched: a SYN may open one on a listening socket */
+    if ((tcp->flags & TCP_FLAG_SYN) && !(tcp->flags & TCP_FLAG_ACK)) {
+        tcp_accept_syn(tcp, src_ip, dest_port, src_port);
+    }
 }
 
 os_error_t net_connect(net_socket_t sock, const sockaddr_in_t *addr, uint32_t timeout_ms) {
@@ -329,8 +534,6 @@ os_error_t net_connect(net_socket_t sock, const sockaddr_in_t *addr, uint32_t ti
 }
 
 int32_t net_send(net_socket_t sock, const void *data, uint16_t length, uint32_t timeout_ms) {
-    (void)timeout_ms;
-
     if (sock < 0 || sock >= NET_MAX_SOCKETS || !sockets[sock].in_use) {
         return -1;
     }
@@ -355,7 +558,15 @@ int32_t net_send(net_socket_t sock, const void *data, uint16_t length, uint32_t
 
         memcpy(packet + sizeof(tcp_header_t), data, length);
 
-        if (net_ip_send(sockets[sock].remote_addr.addr, 6, packet, sizeof(packet)) == OS_OK) {
+        /* Driver TX queue full: wait for it to drain, up to timeout_ms */
+        uint32_t start = os_get_tick_count();
+        os_error_t err;
+        while ((err = net_ip_send(sockets[sock].remote_addr.addr, 6, packet, sizeof(packet))) == OS_ERR_NO_RESOURCE &&
+               (os_get_tick_count() - start) < timeout_ms) {
+            os_task_delay(1);
+        }
+
+        if (err == OS_OK) {
             sockets[sock].seq_num += length;
             return length;
         }
@@ -370,22 +581,36 @@ int32_t net_recv(net_socket_t sock, void *buffer, uint16_t max_length, uint32_t
     }
 
     if (sockets[sock].type == SOCK_STREAM) {
-        if (sockets[sock].state != TCP_ESTABLISHED) {
-            return -1;
-        }
+        socket_t *s = &sockets[sock];
+
+        if (s->rx_length == s->rx_offset) {
+            if (s->state != TCP_ESTABLISHED) {
+                return -1;
+            }
 
-        /* Wait for data */
-        if (os_semaphore_wait(&sockets[sock].rx_sem, timeout_ms) != OS_OK) {
-            return 0;
+            /* Wait for data */
+            if (os_semaphore_wait(&s->rx_sem, timeout_ms) != OS_OK) {
+                return 0;
+            }
+        } else if (os_semaphore_get_count(&s->rx_sem) > 0) {
+            /* Data already buffered: consume the pending signal without blocking */
+            os_semaphore_wait(&s->rx_sem, 1);
         }
 
-        uint16_t copy_len = sockets[sock].rx_length;
+        /* Partial reads leave the remainder for the next call */
+        uint32_t state = os_enter_critical();
+        uint16_t copy_len = s->rx_length - s->rx_offset;
         if (copy_len > max_length) {
             copy_len = max_length;
         }
 
-        memcpy(buffer, sockets[sock].rx_buffer, copy_len);
-        sockets[sock].rx_length = 0;
+        memcpy(buffer, s->rx_buffer + s->rx_offset, copy_len);
+        s->rx_offset += copy_len;
+        if (s->rx_offset == s->rx_length) {
+            s->rx_length = 0;
+            s->rx_offset = 0;
+        }
+        os_exit_critical(state);
 
         return copy_len;
     }
@@ -395,11 +620,52 @@ int32_t net_recv(net_socket_t sock, void *buffer, uint16_t max_length, uint32_t
 
 /* Stub implementations */
 os_error_t net_listen(net_socket_t sock, int backlog) {
-    (void)sock; (void)backlog;
-    return OS_ERR_NOT_IMPLEMENTED;
+    if (sock < 0 || sock >= NET_MAX_SOCKETS || !sockets[sock].in_use) {
+        return OS_ERR_INVALID_PARAM;
+    }
+
+    if (sockets[sock].type != SOCK_STREAM || sockets[sock].local_addr.port == 0) {
+        return OS_ERR_INVALID_PARAM;  /* Must be a bound TCP socket */
+    }
+
+    if (backlog < 1) {
+        backlog = 1;
+    }
+    if (backlog > NET_TCP_MAX_CONNECTIONS) {
+        backlog = NET_TCP_MAX_CONNECTIONS;
+    }
+
+    sockets[sock].backlog = (uint8_t)backlog;
+    sockets[sock].state = TCP_LISTEN;
+    return OS_OK;
 }
 
 net_socket_t net_accept(net_socket_t sock, sockaddr_in_t *addr) {
-    (void)sock; (void)addr;
+    if (sock < 0 || sock >= NET_MAX_SOCKETS || !sockets[sock].in_use) {
+        return INVALID_SOCKET;
+    }
+
+    if (sockets[sock].state != TCP_LISTEN) {
+        return INVALID_SOCKET;
+    }
+
+    while (sockets[sock].in_use && sockets[sock].state == TCP_LISTEN) {
+        uint32_t state = os_enter_critical();
+        for (int i = 0; i < NET_MAX_SOCKETS; i++) {
+            if (sockets[i].in_use && sockets[i].parent == sock && sockets[i].accept_pending) {
+                sockets[i].accept_pending = false;
+                os_exit_critical(state);
+                if (addr) {
+                    *addr = sockets[i].remote_addr;
+                }
+                return i;
+            }
+        }
+        os_exit_critical(state);
+
+        /* Block until the next SYN arrives */
+        os_semaphore_wait(&sockets[sock].rx_sem, OS_WAIT_FOREVER);
+    }
+
     return INVALID_SOCKET;
 }
@@ -5,6 +5,9 @@
 
 #include "tinyos/ota.h"
 #include "tinyos/net.h"
+#include "tinyos/crc.h"
+#include "tinyos/sha256.h"
+#include "tinyos/ed25519.h"
 #include "drivers/flash.h"
 #include <string.h>
 #include <stdio.h>
@@ -16,11 +19,20 @@
 #define OTA_MAGIC_NUMBER        0x544F5346  /* "TOSF" */
 #define OTA_MAX_DOWNLOAD_SIZE   (240 * 1024)  /* Maximum firmware size */
 #define OTA_BOOTINFO_MAGIC      0x424F4F54  /* "BOOT" */
+#define OTA_RESUME_MAGIC        0x5253554D  /* "RSUM" */
+#define OTA_RESUME_LOG_START    (FLASH_DATA_START + FLASH_SECTOR_SIZE)  /* Sector after boot info */
+#define OTA_VERIFY_CHUNK_SIZE   128         /* Flash read size when checking an image */
+#define OTA_LZ_COPY_SIZE        64          /* Bytes per step of a compressed-stream match copy */
+#define OTA_LZ_MIN_MATCH        4           /* LZ4 match lengths are stored minus this */
 
 /* ============================================================================
  * Partition Table
  * ============================================================================ */
 
+/*
+ * Boot info, shared with the bootloader: the layout must match
+ * bootloader_boot_info_t in bootloader.c.
+ */
 typedef struct {
     uint32_t magic;                      /* Magic: 0x424F4F54 */
     ota_partition_type_t active_partition;
@@ -29,9 +41,55 @@ typedef struct {
     uint32_t rollback_count;
     bool rollback_enabled;
     bool boot_confirmed;
+    uint32_t boot_attempts;              /* Bootloader only */
+    uint32_t last_boot_timestamp;        /* Bootloader only */
+    uint32_t flash_generation;           /* Bumped before an update rewrites a partition */
+    ota_partition_type_t verified_partition;  /* Bootloader's last full check (see bootloader.c) */
+    uint32_t verified_generation;
+    uint32_t verified_header_crc32;
     uint32_t crc32;
 } boot_info_t;
 
+/*
+ * Resume checkpoint, appended to the resume log sector each time a flash
+ * sector of the image has been programmed. A checkpoint costs one small
+ * write; the log sector is only erased when it is full.
+ */
+typedef struct {
+    uint32_t magic;                      /* Magic: 0x5253554D */
+    uint32_t partition;                  /* Update partition being written */
+    uint32_t image_size;                 /* From the image header */
+    uint32_t image_crc32;                /* From the image header */
+    uint32_t offset;                     /* Image bytes programmed, 0 = nothing to resume */
+    uint32_t crc_state;                  /* Running payload CRC32 up to offset */
+    uint32_t stream_offset;              /* Bytes of the stream as sent that produced them */
+    uint32_t lz_state;                   /* Decompressor state, LZ_OFF for a plain stream */
+    uint32_t lz_length;
+    uint32_t lz_offset;
+    uint32_t crc32;                      /* CRC32 of the fields above */
+} resume_record_t;
+
+#define OTA_RESUME_SLOTS        (FLASH_SECTOR_SIZE / sizeof(resume_record_t))
+
+/*
+ * Decompressor states for a compressed payload (one LZ4 block). Sequences
+ * are a token (literal count << 4 | match length - 4), extra literal
+ * count bytes, the literals, a 16-bit little-endian match distance and
+ * extra match length bytes; a count of 15 continues in bytes of up to
+ * 255. The block ends after the literals that complete the image.
+ */
+typedef enum {
+    LZ_OFF = 0,                          /* Payload not compressed */
+    LZ_TOKEN,
+    LZ_LITERAL_LENGTH,
+    LZ_LITERALS,
+    LZ_OFFSET_LOW,
+    LZ_OFFSET_HIGH,
+    LZ_MATCH_LENGTH,
+    LZ_MATCH,                            /* Copying from the image already written */
+    LZ_DONE
+} lz_state_t;
+
 static const ota_partition_info_t partition_table[OTA_PARTITION_MAX] = {
     {
         .type = OTA_PARTITION_BOOTLOADER,
@@ -84,48 +142,111 @@ static struct {
     ota_partition_type_t running_partition;
     ota_partition_type_t update_partition;
     boot_info_t boot_info;
-    uint32_t download_offset;
+    uint32_t download_offset;            /* Bytes of the stream as sent */
     ota_image_header_t current_header;
+
+    /* Streaming update */
+    uint32_t header_bytes;               /* Header bytes received so far */
+    uint32_t image_crc;                  /* Running CRC32 of the payload */
+    sha256_ctx_t image_sha;              /* Running image digest */
+    uint32_t erased_end;                 /* Partition offset erased up to */
+    uint32_t page_offset;                /* Partition offset of page_buffer */
+    uint32_t page_fill;                  /* Bytes held in page_buffer */
+    uint8_t page_buffer[FLASH_PAGE_SIZE];
+
+    /* Compressed payload */
+    lz_state_t lz_state;
+    uint32_t lz_length;                  /* Literal or match bytes left */
+    uint32_t lz_offset;                  /* Match distance (the token's match nibble before that) */
+
+    /* Download shaping */
+    int64_t rate_tokens;                 /* Token bucket, in thousandths of a byte */
+    uint32_t rate_time_ms;               /* Last refill */
+    uint32_t progress_time_ms;           /* Last progress callback */
+
+    /* Background update */
+    tcb_t task;
+    bool task_running;
+    const char *task_url;
+
+    /* Resume log */
+    uint32_t resume_slot;                /* Next free record in the log sector */
+    bool resume_active;                  /* Last record holds a checkpoint */
+    bool range_pending;                  /* Next HTTP body answers a Range request */
 } ota_state = {0};
 
+/**
+ * @brief A background update owns the OTA state and boot info: other tasks
+ * get OTA_ERROR_BUSY from the calls that change them until it ends
+ */
+static bool update_task_busy(void) {
+    return ota_state.task_running && os_task_get_current() != &ota_state.task;
+}
+
 /* ============================================================================
- * CRC32 Calculation
+ * Image Checks
  * ============================================================================ */
 
-static uint32_t crc32_table[256];
-static bool crc32_table_initialized = false;
+/**
+ * @brief Start an image digest: the header with its signature field zeroed
+ *
+ * The signature covers every header field as well as the payload, so
+ * version, size and flags cannot be changed without invalidating it.
+ */
+static void image_digest_begin(sha256_ctx_t *sha, const ota_image_header_t *header) {
+    ota_image_header_t unsigned_header;
 
-static void crc32_init_table(void) {
-    if (crc32_table_initialized) {
-        return;
-    }
+    memcpy(&unsigned_header, header, sizeof(unsigned_header));
+    memset(unsigned_header.signature, 0, sizeof(unsigned_header.signature));
 
-    for (uint32_t i = 0; i < 256; i++) {
-        uint32_t crc = i;
-        for (uint32_t j = 0; j < 8; j++) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0xEDB88320;
-            } else {
-                crc = crc >> 1;
-            }
-        }
-        crc32_table[i] = crc;
-    }
+    sha256_init(sha);
+    sha256_update(sha, &unsigned_header, sizeof(unsigned_header));
+}
 
-    crc32_table_initialized = true;
+/**
+ * @brief Let other tasks of the same priority run between flash operations
+ *
+ * Does nothing before the scheduler runs, e.g. when called at boot.
+ */
+static void update_yield(void) {
+    if (os_task_get_current() != NULL) {
+        os_task_yield();
+    }
 }
 
-static uint32_t crc32_calculate(const uint8_t *data, size_t length) {
-    uint32_t crc = 0xFFFFFFFF;
+/**
+ * @brief Feed image bytes from flash to a running CRC32 and/or digest
+ */
+static ota_error_t image_read(uint32_t address, uint32_t length, uint32_t *crc, sha256_ctx_t *sha) {
+    /* Stack buffer: verification runs at boot, before the heap is worth using */
+    uint8_t buffer[OTA_VERIFY_CHUNK_SIZE];
 
-    crc32_init_table();
+    while (length > 0) {
+        uint32_t chunk_size = (length < sizeof(buffer)) ? length : sizeof(buffer);
 
-    for (size_t i = 0; i < length; i++) {
-        uint8_t byte = data[i];
-        crc = (crc >> 8) ^ crc32_table[(crc ^ byte) & 0xFF];
+        if (flash_read(address, buffer, chunk_size) != FLASH_OK) {
+            return OTA_ERROR_FLASH_ERROR;
+        }
+        if (crc != NULL) {
+            *crc = crc32_update(*crc, buffer, chunk_size);
+        }
+        if (sha != NULL) {
+            sha256_update(sha, buffer, chunk_size);
+        }
+
+        address += chunk_size;
+        length -= chunk_size;
+        update_yield();
     }
 
-    return ~crc;
+    return OTA_OK;
+}
+
+/**
+ * @brief Public key to check updates against, NULL when unsigned images are accepted
+ */
+static const uint8_t *signature_key(void) {
+    return ota_state.config.verify_signature ? ota_state.config.signature_key : NULL;
 }
 
 /* ============================================================================
@@ -134,6 +255,41 @@ static uint32_t crc32_calculate(const uint8_t *data, size_t length) {
 
 static ota_error_t save_boot_info(void);  /* Forward declaration */
 
+/**
+ * @brief Adopt a boot info block that has the magic but no valid CRC
+ *
+ * Older firmware wrote a shorter block, and bootloaders from before the
+ * CRC check (which stay on the device across OTA updates) still rewrite
+ * it without one. Every layout shares the fields up to boot_confirmed:
+ * keep those if they make sense, reset the rest. The verification cache
+ * is never taken from such a block. Mirrors bootloader_adopt_boot_info().
+ * @return true if the shared fields were usable
+ */
+static bool boot_info_adopt(boot_info_t *info) {
+    uint8_t rollback_enabled;
+    uint8_t boot_confirmed;
+
+    /* Read as bytes: a bool holding anything but 0 or 1 is not a valid bool */
+    memcpy(&rollback_enabled, &info->rollback_enabled, 1);
+    memcpy(&boot_confirmed, &info->boot_confirmed, 1);
+
+    if ((info->active_partition != OTA_PARTITION_APP_A &&
+         info->active_partition != OTA_PARTITION_APP_B) ||
+        (info->pending_partition != OTA_PARTITION_APP_A &&
+         info->pending_partition != OTA_PARTITION_APP_B) ||
+        rollback_enabled > 1 || boot_confirmed > 1) {
+        return false;
+    }
+
+    info->boot_attempts = 0;
+    info->last_boot_timestamp = 0;
+    info->flash_generation = 0;
+    info->verified_partition = OTA_PARTITION_MAX;
+    info->verified_generation = 0;
+    info->verified_header_crc32 = 0;
+    return true;
+}
+
 static ota_error_t load_boot_info(void) {
     flash_error_t flash_err;
 
@@ -144,7 +300,14 @@ static ota_error_t load_boot_info(void) {
     }
 
     /* Validate magic and CRC */
-    if (ota_state.boot_info.magic != OTA_BOOTINFO_MAGIC) {
+    if (ota_state.boot_info.magic == OTA_BOOTINFO_MAGIC &&
+        ota_state.boot_info.crc32 == crc32_calculate((uint8_t *)&ota_state.boot_info,
+                                                     sizeof(boot_info_t) - sizeof(uint32_t))) {
+        return OTA_OK;
+    }
+
+    /* An older layout keeps its partition choice; anything else starts over */
+    if (ota_state.boot_info.magic != OTA_BOOTINFO_MAGIC || !boot_info_adopt(&ota_state.boot_info)) {
         /* Initialize default boot info */
         memset(&ota_state.boot_info, 0, sizeof(boot_info_t));
         ota_state.boot_info.magic = OTA_BOOTINFO_MAGIC;
@@ -152,12 +315,11 @@ static ota_error_t load_boot_info(void) {
         ota_state.boot_info.pending_partition = OTA_PARTITION_APP_A;
         ota_state.boot_info.rollback_enabled = true;
         ota_state.boot_info.boot_confirmed = true;
-
-        /* Save boot info */
-        return save_boot_info();
+        ota_state.boot_info.verified_partition = OTA_PARTITION_MAX;
     }
 
-    return OTA_OK;
+    /* Save boot info in the current layout */
+    return save_boot_info();
 }
 
 static ota_error_t save_boot_info(void) {
@@ -173,8 +335,11 @@ static ota_error_t save_boot_info(void) {
         return OTA_ERROR_FLASH_ERROR;
     }
 
-    /* Write boot info */
+    /* Write boot info; it must be in flash before a reset */
     flash_err = flash_write(FLASH_DATA_START, &ota_state.boot_info, sizeof(boot_info_t));
+    if (flash_err == FLASH_OK) {
+        flash_err = flash_flush();
+    }
     if (flash_err != FLASH_OK) {
         return OTA_ERROR_FLASH_ERROR;
     }
@@ -182,15 +347,114 @@ static ota_error_t save_boot_info(void) {
     return OTA_OK;
 }
 
+/**
+ * @brief Record that a partition is about to be rewritten
+ *
+ * The bootloader only trusts its cached verification result while the
+ * generation is unchanged, so any update forces one full check.
+ */
+static ota_error_t bump_flash_generation(void) {
+    ota_state.boot_info.flash_generation++;
+    return save_boot_info();
+}
+
+/* ============================================================================
+ * Resume Log
+ * ============================================================================ */
+
+/**
+ * @brief Find the latest checkpoint and the next free slot in the log
+ * @return true if the latest checkpoint has something to resume
+ */
+static bool resume_load(resume_record_t *latest) {
+    resume_record_t record;
+    bool found = false;
+    uint32_t slot;
+
+    for (slot = 0; slot < OTA_RESUME_SLOTS; slot++) {
+        if (flash_read(OTA_RESUME_LOG_START + slot * sizeof(resume_record_t),
+                       &record, sizeof(record)) != FLASH_OK) {
+            break;
+        }
+        if (record.magic == 0xFFFFFFFF) {
+            break;  /* Erased: end of log */
+        }
+
+        /* Records torn by a power loss fail the CRC and are skipped */
+        if (record.magic == OTA_RESUME_MAGIC &&
+            record.crc32 == crc32_calculate((uint8_t *)&record, sizeof(record) - sizeof(uint32_t))) {
+            *latest = record;
+            found = true;
+        }
+    }
+
+    ota_state.resume_slot = slot;
+    ota_state.resume_active = found && latest->offset != 0;
+
+    return ota_state.resume_active;
+}
+
+static void resume_append(uint32_t offset, uint32_t crc_state) {
+    resume_record_t record = {
+        .magic = OTA_RESUME_MAGIC,
+        .partition = ota_state.update_partition,
+        .image_size = ota_state.current_header.image_size,
+        .image_crc32 = ota_state.current_header.crc32,
+        .offset = offset,
+        .crc_state = crc_state,
+        .stream_offset = ota_state.download_offset,
+        .lz_state = ota_state.lz_state,
+        .lz_length = ota_state.lz_length,
+        .lz_offset = ota_state.lz_offset
+    };
+    record.crc32 = crc32_calculate((uint8_t *)&record, sizeof(record) - sizeof(uint32_t));
+
+    if (ota_state.resume_slot >= OTA_RESUME_SLOTS) {
+        if (flash_erase_sector(OTA_RESUME_LOG_START) != FLASH_OK) {
+            return;
+        }
+        ota_state.resume_slot = 0;
+    }
+
+    /* Best effort, not flushed: a lost checkpoint only means resuming from an earlier one */
+    flash_write(OTA_RESUME_LOG_START + ota_state.resume_slot * sizeof(resume_record_t),
+                &record, sizeof(record));
+    ota_state.resume_slot++;
+    ota_state.resume_active = (offset != 0);
+}
+
+static void resume_clear(void) {
+    if (ota_state.resume_active) {
+        resume_append(0, 0);
+    }
+}
+
 /* ============================================================================
  * Initialization
  * ============================================================================ */
 
+/**
+ * @brief Check a configuration: verify_signature needs a key to verify with
+ *
+ * Fails closed: asking for signatures without a key would otherwise
+ * accept every unsigned image.
+ */
+static bool config_valid(const ota_config_t *config) {
+    if (config->signature_key != NULL && config->signature_key_len != OTA_PUBLIC_KEY_SIZE) {
+        return false;
+    }
+    return !config->verify_signature || config->signature_key != NULL;
+}
+
 ota_error_t ota_init(const ota_config_t *config) {
     if (ota_state.initialized) {
         return OTA_OK;
     }
 
+    if (config != NULL && !config_valid(config)) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
     /* Initialize flash */
     flash_error_t flash_err = flash_init();
     if (flash_err != FLASH_OK) {
@@ -205,7 +469,7 @@ ota_error_t ota_init(const ota_config_t *config) {
         memset(&ota_state.config, 0, sizeof(ota_config_t));
         ota_state.config.timeout_ms = 30000;
         ota_state.config.retry_count = 3;
-        ota_state.config.verify_signature = true;
+        ota_state.config.verify_signature = false;     /* No key to verify with */
         ota_state.config.auto_rollback = true;
     }
 
@@ -220,6 +484,10 @@ ota_error_t ota_init(const ota_config_t *config) {
     ota_state.update_partition = (ota_state.running_partition == OTA_PARTITION_APP_A) ?
                                   OTA_PARTITION_APP_B : OTA_PARTITION_APP_A;
 
+    /* Locate the end of the resume log */
+    resume_record_t record;
+    resume_load(&record);
+
     /* Initialize progress */
     ota_state.progress.state = OTA_STATE_IDLE;
     ota_state.progress.total_bytes = 0;
@@ -247,6 +515,14 @@ ota_error_t ota_set_config(const ota_config_t *config) {
         return OTA_ERROR_INVALID_PARAM;
     }
 
+    if (update_task_busy()) {
+        return OTA_ERROR_BUSY;
+    }
+
+    if (!config_valid(config)) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
     memcpy(&ota_state.config, config, sizeof(ota_config_t));
     return OTA_OK;
 }
@@ -295,162 +571,708 @@ ota_error_t ota_mark_partition_invalid(ota_partition_type_t type) {
  * ============================================================================ */
 
 static void report_progress(void) {
+    ota_state.progress_time_ms = os_get_uptime_ms();
     if (ota_state.callback != NULL) {
         ota_state.callback(&ota_state.progress, ota_state.callback_user_data);
     }
 }
 
-ota_error_t ota_start_update(const char *url, ota_progress_callback_t callback, void *user_data) {
-    if (!ota_state.initialized || url == NULL) {
-        return OTA_ERROR_INVALID_PARAM;
+/**
+ * @brief Report download progress, at most once per progress_interval_ms
+ *
+ * State changes use report_progress() and are never held back.
+ */
+static void report_download_progress(void) {
+    uint32_t interval = ota_state.config.progress_interval_ms;
+    if (interval == 0 || os_get_uptime_ms() - ota_state.progress_time_ms >= interval) {
+        report_progress();
     }
+}
 
-    if (ota_state.progress.state != OTA_STATE_IDLE) {
-        return OTA_ERROR_BUSY;
+/**
+ * @brief Token bucket: hold the download until length more bytes are allowed
+ *
+ * Tokens accrue at rate_limit bytes per second up to rate_burst. A chunk
+ * larger than the tokens left still goes through and the deficit is
+ * waited out, so chunks bigger than the bucket cannot stall the stream.
+ */
+static void update_throttle(uint32_t length) {
+    uint32_t rate = ota_state.config.rate_limit;
+    if (rate == 0) {
+        return;
     }
 
-    /* Set callback */
-    ota_state.callback = callback;
-    ota_state.callback_user_data = user_data;
+    uint32_t burst = (ota_state.config.rate_burst != 0) ? ota_state.config.rate_burst : OTA_CHUNK_SIZE;
+    uint32_t now = os_get_uptime_ms();
+    int64_t tokens = ota_state.rate_tokens + (int64_t)(now - ota_state.rate_time_ms) * rate;
+
+    if (tokens > (int64_t)burst * 1000) {
+        tokens = (int64_t)burst * 1000;
+    }
+    tokens -= (int64_t)length * 1000;
+
+    ota_state.rate_tokens = tokens;
+    ota_state.rate_time_ms = now;
+
+    /* The refill after the delay brings the bucket back to zero */
+    if (tokens < 0) {
+        os_task_delay_ms((uint32_t)((-tokens + rate - 1) / rate));
+    }
+}
+
+static ota_error_t update_failed(ota_error_t err) {
+    /* Only a download failure leaves good data behind to resume from */
+    if (err != OTA_ERROR_DOWNLOAD_FAILED) {
+        resume_clear();
+    }
+
+    ota_state.progress.state = OTA_STATE_FAILED;
+    ota_state.progress.last_error = err;
+    report_progress();
+    return err;
+}
+
+static bool update_in_progress(void) {
+    return ota_state.progress.state == OTA_STATE_DOWNLOADING ||
+           ota_state.progress.state == OTA_STATE_WRITING ||
+           ota_state.progress.state == OTA_STATE_VERIFYING;
+}
+
+/**
+ * @brief Program the page buffer, erasing sectors just ahead of the write
+ *
+ * Only the sectors the image reaches are erased, one at a time as the
+ * stream arrives, instead of the whole partition before the download.
+ */
+static ota_error_t update_flush_page(void) {
+    uint32_t length = ota_state.page_fill;
+    if (length == 0) {
+        return OTA_OK;
+    }
+
+    uint32_t base = partition_table[ota_state.update_partition].start_address;
+    while (ota_state.erased_end < ota_state.page_offset + length) {
+        if (flash_erase_sector(base + ota_state.erased_end) != FLASH_OK) {
+            return OTA_ERROR_FLASH_ERROR;
+        }
+        ota_state.erased_end += FLASH_SECTOR_SIZE;
+        update_yield();
+    }
+
+    /* Pad a short final page to the write alignment with the erased value */
+    while (length % 4) {
+        ota_state.page_buffer[length++] = 0xFF;
+    }
+
+    if (flash_write(base + ota_state.page_offset, ota_state.page_buffer, length) != FLASH_OK) {
+        return OTA_ERROR_FLASH_ERROR;
+    }
+    update_yield();
+
+    ota_state.page_offset += ota_state.page_fill;
+    ota_state.page_fill = 0;
+    ota_state.progress.written_bytes = ota_state.page_offset;
+
+    /* Checkpoint each completed sector: flash programs its pages before the record */
+    if (ota_state.page_offset % FLASH_SECTOR_SIZE == 0) {
+        resume_append(ota_state.page_offset, ota_state.image_crc);
+    }
+
+    return OTA_OK;
+}
+
+/**
+ * @brief Image bytes produced so far (programmed or in the page buffer)
+ */
+static uint32_t update_position(void) {
+    return ota_state.page_offset + ota_state.page_fill;
+}
+
+static bool update_received(void) {
+    return ota_state.header_bytes == sizeof(ota_image_header_t) &&
+           update_position() == ota_state.progress.total_bytes &&
+           (ota_state.lz_state == LZ_OFF || ota_state.lz_state == LZ_DONE);
+}
+
+/**
+ * @brief Add payload bytes to the image: CRC, digest and page buffer
+ *
+ * length must fit in the page buffer, so a checkpoint taken when the page
+ * is programmed sees the stream state that produced exactly these bytes.
+ */
+static ota_error_t update_output(const uint8_t *data, uint32_t length) {
+    /* Checked against the header as it passes through */
+    if (length > ota_state.progress.total_bytes - update_position()) {
+        return OTA_ERROR_INVALID_IMAGE;
+    }
+
+    ota_state.image_crc = crc32_update(ota_state.image_crc, data, length);
+    sha256_update(&ota_state.image_sha, data, length);
+
+    memcpy(&ota_state.page_buffer[ota_state.page_fill], data, length);
+    ota_state.page_fill += length;
+
+    if (ota_state.page_fill == FLASH_PAGE_SIZE) {
+        return update_flush_page();
+    }
+    return OTA_OK;
+}
+
+/**
+ * @brief Run one decompressor step on a compressed payload
+ *
+ * Literals are copied from the stream; matches are copied from the image
+ * produced so far, out of the page buffer or back out of flash, so the
+ * window costs no RAM. A match step consumes no input.
+ *
+ * @param consumed Stream bytes used (output)
+ */
+static ota_error_t update_decompress(const uint8_t *data, uint32_t size, uint32_t *consumed) {
+    uint32_t position = update_position();
+    uint32_t left = ota_state.progress.total_bytes - position;
+    uint32_t room = FLASH_PAGE_SIZE - ota_state.page_fill;
+    uint32_t length;
+
+    *consumed = 0;
+
+    switch (ota_state.lz_state) {
+    case LZ_TOKEN:
+        ota_state.lz_length = data[0] >> 4;
+        ota_state.lz_offset = data[0] & 0x0F;
+        if (ota_state.lz_length == 15) {
+            ota_state.lz_state = LZ_LITERAL_LENGTH;
+        } else {
+            ota_state.lz_state = (ota_state.lz_length > 0) ? LZ_LITERALS : LZ_OFFSET_LOW;
+        }
+        *consumed = 1;
+        break;
+
+    case LZ_LITERAL_LENGTH:
+    case LZ_MATCH_LENGTH:
+        ota_state.lz_length += data[0];
+        if (ota_state.lz_length > left) {
+            return OTA_ERROR_INVALID_IMAGE;
+        }
+        if (data[0] != 255) {
+            ota_state.lz_state = (ota_state.lz_state == LZ_LITERAL_LENGTH) ? LZ_LITERALS : LZ_MATCH;
+        }
+        *consumed = 1;
+        break;
+
+    case LZ_LITERALS:
+        if (ota_state.lz_length > left) {
+            return OTA_ERROR_INVALID_IMAGE;
+        }
+        length = ota_state.lz_length;
+        if (length > size) {
+            length = size;
+        }
+        if (length > room) {
+            length = room;
+        }
+
+        ota_state.lz_length -= length;
+        if (ota_state.lz_length == 0) {
+            ota_state.lz_state = (length == left) ? LZ_DONE : LZ_OFFSET_LOW;
+        }
+        *consumed = length;
+        ota_state.download_offset += length;
+        return update_output(data, length);
+
+    case LZ_OFFSET_LOW:
+        ota_state.lz_length = ota_state.lz_offset + OTA_LZ_MIN_MATCH;
+        ota_state.lz_offset = data[0];
+        ota_state.lz_state = LZ_OFFSET_HIGH;
+        *consumed = 1;
+        break;
+
+    case LZ_OFFSET_HIGH:
+        ota_state.lz_offset |= (uint32_t)data[0] << 8;
+
+        /* Matches only reach back into the payload */
+        if (ota_state.lz_offset == 0 || ota_state.lz_offset > position - sizeof(ota_image_header_t)) {
+            return OTA_ERROR_INVALID_IMAGE;
+        }
+        ota_state.lz_state = (ota_state.lz_length == 15 + OTA_LZ_MIN_MATCH) ? LZ_MATCH_LENGTH : LZ_MATCH;
+        *consumed = 1;
+        break;
+
+    case LZ_MATCH: {
+        uint8_t copy[OTA_LZ_COPY_SIZE];
+        uint32_t from = position - ota_state.lz_offset;
+
+        if (ota_state.lz_length > left) {
+            return OTA_ERROR_INVALID_IMAGE;
+        }
+
+        /* No further back than the distance, so an overlapping match repeats */
+        length = ota_state.lz_length;
+        if (length > ota_state.lz_offset) {
+            length = ota_state.lz_offset;
+        }
+        if (length > room) {
+            length = room;
+        }
+        if (length > sizeof(copy)) {
+            length = sizeof(copy);
+        }
+
+        if (from < ota_state.page_offset) {
+            if (length > ota_state.page_offset - from) {
+                length = ota_state.page_offset - from;
+            }
+            if (flash_read(partition_table[ota_state.update_partition].start_address + from,
+                           copy, length) != FLASH_OK) {
+                return OTA_ERROR_FLASH_ERROR;
+            }
+        } else {
+            memcpy(copy, &ota_state.page_buffer[from - ota_state.page_offset], length);
+        }
+
+        ota_state.lz_length -= length;
+        if (ota_state.lz_length == 0) {
+            ota_state.lz_state = (length == left) ? LZ_DONE : LZ_TOKEN;
+        }
+        return update_output(copy, length);
+    }
+
+    case LZ_DONE:
+    case LZ_OFF:
+    default:
+        /* Trailing bytes after the image is complete */
+        return OTA_ERROR_INVALID_IMAGE;
+    }
+
+    ota_state.download_offset += *consumed;
+    return OTA_OK;
+}
+
+/**
+ * @brief Reset the stream and progress to the start of an image
+ */
+static void update_reset(void) {
+    ota_state.download_offset = 0;
+    ota_state.header_bytes = 0;
+    ota_state.image_crc = CRC32_INIT;
+    ota_state.erased_end = 0;
+    ota_state.page_offset = 0;
+    ota_state.page_fill = 0;
+    ota_state.lz_state = LZ_OFF;
 
-    /* Reset progress */
     ota_state.progress.state = OTA_STATE_DOWNLOADING;
+    ota_state.progress.total_bytes = 0;
     ota_state.progress.downloaded_bytes = 0;
     ota_state.progress.written_bytes = 0;
     ota_state.progress.progress_percent = 0;
-    ota_state.download_offset = 0;
-
-    report_progress();
+    ota_state.progress.last_error = OTA_OK;
 
-    /* Download firmware using HTTP */
-    http_response_t response;
-    os_error_t net_err = net_http_get(url, &response, ota_state.config.timeout_ms);
+    /* A full bucket: the first chunks arrive unthrottled */
+    ota_state.rate_tokens = (int64_t)((ota_state.config.rate_burst != 0) ?
+                                      ota_state.config.rate_burst : OTA_CHUNK_SIZE) * 1000;
+    ota_state.rate_time_ms = os_get_uptime_ms();
+}
 
-    if (net_err != OS_OK) {
-        ota_state.progress.state = OTA_STATE_FAILED;
-        ota_state.progress.last_error = OTA_ERROR_DOWNLOAD_FAILED;
-        report_progress();
-        return OTA_ERROR_DOWNLOAD_FAILED;
+/**
+ * @brief Body callback for net_http_get_stream(): feed the update stream
+ */
+static os_error_t update_http_body(const uint8_t *data, uint32_t length, uint16_t status_code,
+                                   uint32_t content_length, void *user_data) {
+    (void)content_length;
+    (void)user_data;
+
+    /* A server that ignores Range sends the whole image: start over */
+    if (ota_state.range_pending) {
+        ota_state.range_pending = false;
+        if (status_code != 206) {
+            resume_clear();
+            update_reset();
+        }
     }
 
-    /* Process downloaded firmware */
-    ota_error_t err = ota_start_update_from_buffer((const uint8_t *)response.body,
-                                                     response.body_length,
-                                                     callback, user_data);
+    /* Not reading the connection while throttled slows the server through TCP flow control */
+    update_throttle(length);
 
-    net_http_free_response(&response);
-    return err;
+    return (ota_write_chunk(data, length, ota_state.download_offset) == OTA_OK) ? OS_OK : OS_ERROR;
 }
 
-ota_error_t ota_start_update_from_buffer(const uint8_t *firmware_data, uint32_t size,
-                                         ota_progress_callback_t callback, void *user_data) {
-    if (!ota_state.initialized || firmware_data == NULL || size == 0) {
-        return OTA_ERROR_INVALID_PARAM;
+ota_error_t ota_begin_update(ota_progress_callback_t callback, void *user_data) {
+    if (!ota_state.initialized) {
+        return OTA_ERROR_NOT_INITIALIZED;
     }
 
-    if (size > OTA_MAX_DOWNLOAD_SIZE) {
-        return OTA_ERROR_NO_SPACE;
+    if (update_task_busy() || update_in_progress()) {
+        return OTA_ERROR_BUSY;
     }
 
     /* Set callback */
     ota_state.callback = callback;
     ota_state.callback_user_data = user_data;
 
-    /* Parse and verify header */
-    if (size < sizeof(ota_image_header_t)) {
-        ota_state.progress.state = OTA_STATE_FAILED;
-        ota_state.progress.last_error = OTA_ERROR_INVALID_IMAGE;
-        report_progress();
-        return OTA_ERROR_INVALID_IMAGE;
-    }
-
-    memcpy(&ota_state.current_header, firmware_data, sizeof(ota_image_header_t));
-
-    ota_error_t err = ota_verify_image_header(&ota_state.current_header);
+    /* Before the state changes: a failed save must not leave it in progress */
+    ota_error_t err = bump_flash_generation();
     if (err != OTA_OK) {
-        ota_state.progress.state = OTA_STATE_FAILED;
-        ota_state.progress.last_error = err;
-        report_progress();
         return err;
     }
 
-    /* Update progress */
-    ota_state.progress.state = OTA_STATE_WRITING;
-    ota_state.progress.total_bytes = size;
-    ota_state.progress.downloaded_bytes = size;
+    /* A fresh start discards any interrupted update */
+    resume_clear();
+    update_reset();
+
     report_progress();
 
-    /* Erase update partition */
-    ota_partition_info_t partition_info;
-    ota_get_partition_info(ota_state.update_partition, &partition_info);
+    return OTA_OK;
+}
 
-    flash_error_t flash_err = flash_erase_range(partition_info.start_address, partition_info.size);
-    if (flash_err != FLASH_OK) {
-        ota_state.progress.state = OTA_STATE_FAILED;
-        ota_state.progress.last_error = OTA_ERROR_FLASH_ERROR;
-        report_progress();
+ota_error_t ota_resume_update(ota_progress_callback_t callback, void *user_data, uint32_t *offset) {
+    if (!ota_state.initialized || offset == NULL) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
+    if (update_task_busy() || update_in_progress()) {
+        return OTA_ERROR_BUSY;
+    }
+
+    resume_record_t record;
+    if (!resume_load(&record) || record.partition != (uint32_t)ota_state.update_partition) {
+        return OTA_ERROR_INVALID_IMAGE;
+    }
+
+    /* The header was programmed with the first sector */
+    ota_image_header_t header;
+    if (flash_read(partition_table[ota_state.update_partition].start_address,
+                   &header, sizeof(header)) != FLASH_OK) {
         return OTA_ERROR_FLASH_ERROR;
     }
 
-    /* Write firmware to flash */
-    flash_err = flash_write(partition_info.start_address, firmware_data, size);
-    if (flash_err != FLASH_OK) {
-        ota_state.progress.state = OTA_STATE_FAILED;
-        ota_state.progress.last_error = OTA_ERROR_FLASH_ERROR;
-        report_progress();
+    if (ota_verify_image_header(&header) != OTA_OK ||
+        header.image_size != record.image_size || header.crc32 != record.image_crc32 ||
+        record.offset > header.image_size || record.lz_state > LZ_DONE ||
+        record.stream_offset < sizeof(header) ||
+        (record.lz_state == LZ_OFF && record.stream_offset != record.offset)) {
+        resume_clear();
+        return OTA_ERROR_INVALID_IMAGE;
+    }
+
+    /* The digest is not checkpointed: rebuild it from what is already in flash.
+     * This and the generation bump come before the update state changes, so
+     * an error leaves it idle. */
+    uint32_t image_start = partition_table[ota_state.update_partition].start_address;
+    image_digest_begin(&ota_state.image_sha, &header);
+    if (record.offset > sizeof(header) &&
+        image_read(image_start + sizeof(header), record.offset - sizeof(header), NULL,
+                   &ota_state.image_sha) != OTA_OK) {
+        return OTA_ERROR_FLASH_ERROR;
+    }
+    if (bump_flash_generation() != OTA_OK) {
         return OTA_ERROR_FLASH_ERROR;
     }
 
-    ota_state.progress.written_bytes = size;
-    ota_state.progress.progress_percent = 100;
+    /* Set callback */
+    ota_state.callback = callback;
+    ota_state.callback_user_data = user_data;
+
+    /* Continue after the checkpoint; the sectors before it stay as written */
+    update_reset();
+    memcpy(&ota_state.current_header, &header, sizeof(header));
+    ota_state.header_bytes = sizeof(header);
+    ota_state.image_crc = record.crc_state;
+    ota_state.download_offset = record.stream_offset;
+    ota_state.page_offset = record.offset;
+    ota_state.erased_end = record.offset;
+
+    /* A compressed stream continues mid-sequence where the checkpoint left it */
+    ota_state.lz_state = (lz_state_t)record.lz_state;
+    ota_state.lz_length = record.lz_length;
+    ota_state.lz_offset = record.lz_offset;
+
+    ota_state.progress.state = OTA_STATE_WRITING;
+    ota_state.progress.total_bytes = header.image_size;
+    ota_state.progress.downloaded_bytes = record.stream_offset;
+    ota_state.progress.written_bytes = record.offset;
+    ota_state.progress.progress_percent = (record.offset * 100) / header.image_size;
 
-    /* Verify written data */
-    ota_state.progress.state = OTA_STATE_VERIFYING;
     report_progress();
 
-    err = ota_verify_partition(ota_state.update_partition);
+    *offset = record.stream_offset;
+    return OTA_OK;
+}
+
+ota_error_t ota_start_update(const char *url, ota_progress_callback_t callback, void *user_data) {
+    if (!ota_state.initialized || url == NULL) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
+    if (update_task_busy()) {
+        return OTA_ERROR_BUSY;
+    }
+
+    /* Continue an update interrupted by a reset, or start a new one */
+    uint32_t offset;
+    ota_error_t err = ota_resume_update(callback, user_data, &offset);
     if (err != OTA_OK) {
-        ota_state.progress.state = OTA_STATE_FAILED;
-        ota_state.progress.last_error = err;
-        report_progress();
-        return err;
+        err = ota_begin_update(callback, user_data);
+        if (err != OTA_OK) {
+            return err;
+        }
     }
 
-    /* Mark update partition as pending */
-    ota_state.boot_info.pending_partition = ota_state.update_partition;
-    ota_state.boot_info.boot_confirmed = false;
-    save_boot_info();
+    /*
+     * Stream the body straight into the update partition. After a dropped
+     * connection the next attempt asks only for the bytes still missing.
+     */
+    char range[32];
+    const char *headers[] = { range, NULL };
+
+    for (uint32_t attempt = 0; !update_received(); attempt++) {
+        if (attempt > ota_state.config.retry_count) {
+            /* The checkpoints stay: a later call resumes from the last one */
+            return update_failed(OTA_ERROR_DOWNLOAD_FAILED);
+        }
 
-    /* Complete */
-    ota_state.progress.state = OTA_STATE_COMPLETE;
-    report_progress();
+        ota_state.range_pending = (ota_state.download_offset > 0);
+        snprintf(range, sizeof(range), "Range: bytes=%lu-", (unsigned long)ota_state.download_offset);
+
+        os_error_t net_err = net_http_get_stream(url, ota_state.range_pending ? headers : NULL,
+                                                 update_http_body, NULL, NULL,
+                                                 ota_state.config.timeout_ms);
+
+        /* A flash or image error has already been reported by ota_write_chunk() */
+        if (net_err != OS_OK && ota_state.progress.state == OTA_STATE_FAILED) {
+            return ota_state.progress.last_error;
+        }
+    }
+
+    return ota_end_update();
+}
+
+/**
+ * @brief Background update task: one update, then the task deletes itself
+ */
+static void update_task(void *param) {
+    (void)param;
+
+    ota_error_t err = ota_start_update(ota_state.task_url, ota_state.callback, ota_state.callback_user_data);
+
+    /* Failures before the download started have not been reported yet */
+    if (err != OTA_OK && ota_state.progress.state != OTA_STATE_FAILED) {
+        update_failed(err);
+    }
+
+    ota_state.task_running = false;
+    os_task_delete(os_task_get_current());
+}
+
+ota_error_t ota_start_update_background(const char *url, task_priority_t priority,
+                                        ota_progress_callback_t callback, void *user_data) {
+    if (!ota_state.initialized || url == NULL) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
+    /* Claim the task slot atomically: two callers must not both start one */
+    uint32_t state = os_enter_critical();
+    if (ota_state.task_running || update_in_progress()) {
+        os_exit_critical(state);
+        return OTA_ERROR_BUSY;
+    }
+    ota_state.task_running = true;
+    os_exit_critical(state);
+
+    /* Picked up by ota_start_update() in the task */
+    ota_state.callback = callback;
+    ota_state.callback_user_data = user_data;
+    ota_state.task_url = url;
+
+    if (os_task_create(&ota_state.task, "ota", update_task, NULL, priority) != OS_OK) {
+        ota_state.task_running = false;
+        return OTA_ERROR_NO_SPACE;
+    }
 
     return OTA_OK;
 }
 
+ota_error_t ota_start_update_from_buffer(const uint8_t *firmware_data, uint32_t size,
+                                         ota_progress_callback_t callback, void *user_data) {
+    if (!ota_state.initialized || firmware_data == NULL || size == 0) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
+    if (update_task_busy()) {
+        return OTA_ERROR_BUSY;
+    }
+
+    if (size > OTA_MAX_DOWNLOAD_SIZE) {
+        return OTA_ERROR_NO_SPACE;
+    }
+
+    ota_error_t err = ota_begin_update(callback, user_data);
+    if (err != OTA_OK) {
+        return err;
+    }
+
+    for (uint32_t offset = 0; offset < size; offset += OTA_CHUNK_SIZE) {
+        uint32_t chunk_size = (size - offset < OTA_CHUNK_SIZE) ? size - offset : OTA_CHUNK_SIZE;
+
+        err = ota_write_chunk(firmware_data + offset, chunk_size, offset);
+        if (err != OTA_OK) {
+            return err;
+        }
+    }
+
+    return ota_end_update();
+}
+
 ota_error_t ota_write_chunk(const uint8_t *data, uint32_t size, uint32_t offset) {
     if (!ota_state.initialized || data == NULL) {
         return OTA_ERROR_INVALID_PARAM;
     }
 
-    ota_partition_info_t partition_info;
-    ota_get_partition_info(ota_state.update_partition, &partition_info);
+    if (update_task_busy()) {
+        return OTA_ERROR_BUSY;
+    }
 
-    if (offset + size > partition_info.size) {
-        return OTA_ERROR_NO_SPACE;
+    /* The first chunk starts an update with the callback already set */
+    if (offset == 0 && !update_in_progress()) {
+        ota_error_t err = ota_begin_update(ota_state.callback, ota_state.callback_user_data);
+        if (err != OTA_OK) {
+            return err;
+        }
     }
 
-    flash_error_t flash_err = flash_write(partition_info.start_address + offset, data, size);
-    if (flash_err != FLASH_OK) {
-        return OTA_ERROR_FLASH_ERROR;
+    /* Chunks must arrive in order: nothing is buffered beyond one page */
+    if (!update_in_progress() || offset != ota_state.download_offset) {
+        return OTA_ERROR_INVALID_PARAM;
     }
 
-    ota_state.progress.written_bytes += size;
+    /* A pending match copy produces output without consuming input */
+    while (size > 0 || ota_state.lz_state == LZ_MATCH) {
+        uint32_t length = FLASH_PAGE_SIZE - ota_state.page_fill;
+        ota_error_t err;
+
+        if (length > size) {
+            length = size;
+        }
+
+        if (ota_state.header_bytes < sizeof(ota_image_header_t)) {
+            /* Header: parse it as soon as the last byte arrives */
+            uint32_t missing = sizeof(ota_image_header_t) - ota_state.header_bytes;
+            if (length > missing) {
+                length = missing;
+            }
+
+            memcpy((uint8_t *)&ota_state.current_header + ota_state.header_bytes, data, length);
+            memcpy(&ota_state.page_buffer[ota_state.page_fill], data, length);
+            ota_state.header_bytes += length;
+            ota_state.page_fill += length;
+            ota_state.download_offset += length;
+
+            if (ota_state.header_bytes == sizeof(ota_image_header_t)) {
+                err = ota_verify_image_header(&ota_state.current_header);
+                if (err != OTA_OK) {
+                    return update_failed(err);
+                }
+
+                /* The flag describes the transport: flash gets the image as signed */
+                if (ota_state.current_header.flags & OTA_IMAGE_FLAG_COMPRESSED) {
+                    ota_state.current_header.flags &= ~OTA_IMAGE_FLAG_COMPRESSED;
+                    memcpy(ota_state.page_buffer, &ota_state.current_header,
+                           sizeof(ota_image_header_t));
+                    ota_state.lz_state = (ota_state.current_header.image_size > sizeof(ota_image_header_t))
+                                       ? LZ_TOKEN : LZ_DONE;
+                }
+
+                ota_state.progress.state = OTA_STATE_WRITING;
+                ota_state.progress.total_bytes = ota_state.current_header.image_size;
+                image_digest_begin(&ota_state.image_sha, &ota_state.current_header);
+            }
+        } else if (ota_state.lz_state == LZ_OFF) {
+            ota_state.download_offset += length;
+            err = update_output(data, length);
+            if (err != OTA_OK) {
+                return update_failed(err);
+            }
+        } else {
+            err = update_decompress(data, size, &length);
+            if (err != OTA_OK) {
+                return update_failed(err);
+            }
+        }
+
+        data += length;
+        size -= length;
+    }
+
+    ota_state.progress.downloaded_bytes = ota_state.download_offset;
     if (ota_state.progress.total_bytes > 0) {
         ota_state.progress.progress_percent =
             (ota_state.progress.written_bytes * 100) / ota_state.progress.total_bytes;
     }
 
+    report_download_progress();
+
+    return OTA_OK;
+}
+
+ota_error_t ota_end_update(void) {
+    if (!ota_state.initialized) {
+        return OTA_ERROR_NOT_INITIALIZED;
+    }
+
+    if (update_task_busy()) {
+        return OTA_ERROR_BUSY;
+    }
+
+    if (!update_in_progress()) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
+    /* The stream must have delivered exactly the image the header announced */
+    if (!update_received()) {
+        return update_failed(OTA_ERROR_INVALID_IMAGE);
+    }
+
+    ota_error_t err = update_flush_page();
+    if (err != OTA_OK) {
+        return update_failed(err);
+    }
+
+    /* Programming is queued: wait for it, and for any program error */
+    if (flash_flush() != FLASH_OK) {
+        return update_failed(OTA_ERROR_FLASH_ERROR);
+    }
+
+    ota_state.progress.progress_percent = 100;
+
+    /* Verify: payload CRC computed on the way in, then the image as written */
+    ota_state.progress.state = OTA_STATE_VERIFYING;
+    report_progress();
+
+    if (crc32_final(ota_state.image_crc) != ota_state.current_header.crc32) {
+        return update_failed(OTA_ERROR_VERIFICATION_FAILED);
+    }
+
+    /* Signature over the digest computed on the way in */
+    const uint8_t *key = signature_key();
+    if (key != NULL) {
+        uint8_t digest[OTA_DIGEST_SIZE];
+        sha256_final(&ota_state.image_sha, digest);
+        if (!ed25519_verify(ota_state.current_header.signature, digest, sizeof(digest), key)) {
+            return update_failed(OTA_ERROR_VERIFICATION_FAILED);
+        }
+    }
+
+    err = ota_verify_partition(ota_state.update_partition);
+    if (err != OTA_OK) {
+        return update_failed(err);
+    }
+
+    /* Mark update partition as pending */
+    ota_state.boot_info.pending_partition = ota_state.update_partition;
+    ota_state.boot_info.boot_confirmed = false;
+    save_boot_info();
+    resume_clear();
+
+    /* Complete */
+    ota_state.progress.state = OTA_STATE_COMPLETE;
     report_progress();
 
     return OTA_OK;
@@ -461,6 +1283,18 @@ ota_error_t ota_finalize_update(void) {
         return OTA_ERROR_NOT_INITIALIZED;
     }
 
+    if (update_task_busy()) {
+        return OTA_ERROR_BUSY;
+    }
+
+    /* Chunks written with ota_write_chunk() are verified here */
+    if (update_in_progress()) {
+        ota_error_t err = ota_end_update();
+        if (err != OTA_OK) {
+            return err;
+        }
+    }
+
     if (ota_state.progress.state != OTA_STATE_COMPLETE) {
         return OTA_ERROR_INVALID_PARAM;
     }
@@ -474,7 +1308,13 @@ ota_error_t ota_abort_update(void) {
         return OTA_ERROR_NOT_INITIALIZED;
     }
 
-    /* Reset progress */
+    if (update_task_busy()) {
+        return OTA_ERROR_BUSY;
+    }
+
+    resume_clear();
+
+    /* Reset progress (the next update erases the partition again as it writes) */
     ota_state.progress.state = OTA_STATE_IDLE;
     ota_state.progress.total_bytes = 0;
     ota_state.progress.downloaded_bytes = 0;
@@ -503,7 +1343,9 @@ ota_error_t ota_verify_partition(ota_partition_type_t type) {
     }
 
     ota_partition_info_t partition_info;
-    ota_get_partition_info(type, &partition_info);
+    if (ota_get_partition_info(type, &partition_info) != OTA_OK) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
 
     /* Read header */
     ota_image_header_t header;
@@ -513,7 +1355,19 @@ ota_error_t ota_verify_partition(ota_partition_type_t type) {
     }
 
     /* Verify header */
-    return ota_verify_image_header(&header);
+    ota_error_t err = ota_verify_image_header(&header);
+    if (err != OTA_OK) {
+        return err;
+    }
+
+    /* Read back the payload: catches bytes that did not program correctly */
+    uint32_t crc32;
+    err = ota_compute_crc32(type, &crc32);
+    if (err != OTA_OK) {
+        return err;
+    }
+
+    return (crc32 == header.crc32) ? OTA_OK : OTA_ERROR_VERIFICATION_FAILED;
 }
 
 ota_error_t ota_verify_image_header(const ota_image_header_t *header) {
@@ -526,8 +1380,8 @@ ota_error_t ota_verify_image_header(const ota_image_header_t *header) {
         return OTA_ERROR_INVALID_IMAGE;
     }
 
-    /* Check image size */
-    if (header->image_size == 0 || header->image_size > OTA_MAX_DOWNLOAD_SIZE) {
+    /* Check image size (the header is part of the image) */
+    if (header->image_size < sizeof(ota_image_header_t) || header->image_size > OTA_MAX_DOWNLOAD_SIZE) {
         return OTA_ERROR_INVALID_IMAGE;
     }
 
@@ -540,53 +1394,96 @@ ota_error_t ota_compute_crc32(ota_partition_type_t type, uint32_t *crc32) {
     }
 
     ota_partition_info_t partition_info;
-    ota_get_partition_info(type, &partition_info);
+    if (ota_get_partition_info(type, &partition_info) != OTA_OK) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
 
-    /* Read data and compute CRC */
-    uint8_t *buffer = (uint8_t *)os_malloc(4096);
-    if (buffer == NULL) {
+    ota_image_header_t header;
+    if (flash_read(partition_info.start_address, &header, sizeof(ota_image_header_t)) != FLASH_OK) {
         return OTA_ERROR_FLASH_ERROR;
     }
 
-    crc32_init_table();  /* Ensure table is initialized before use */
+    /* The size to cover comes from the header */
+    ota_error_t err = ota_verify_image_header(&header);
+    if (err != OTA_OK) {
+        return err;
+    }
 
-    uint32_t computed_crc = 0xFFFFFFFF;
-    uint32_t remaining = partition_info.size;
-    uint32_t offset = 0;
+    uint32_t computed_crc = CRC32_INIT;
+    err = image_read(partition_info.start_address + sizeof(ota_image_header_t),
+                     header.image_size - sizeof(ota_image_header_t), &computed_crc, NULL);
+    if (err != OTA_OK) {
+        return err;
+    }
 
-    while (remaining > 0) {
-        uint32_t chunk_size = (remaining < 4096) ? remaining : 4096;
+    *crc32 = crc32_final(computed_crc);
 
-        flash_error_t flash_err = flash_read(partition_info.start_address + offset, buffer, chunk_size);
-        if (flash_err != FLASH_OK) {
-            os_free(buffer);
-            return OTA_ERROR_FLASH_ERROR;
-        }
+    return OTA_OK;
+}
 
-        for (uint32_t i = 0; i < chunk_size; i++) {
-            computed_crc = (computed_crc >> 8) ^ crc32_table[(computed_crc ^ buffer[i]) & 0xFF];
-        }
+ota_error_t ota_verify_image(ota_partition_type_t type, const uint8_t *public_key, uint8_t *digest) {
+    if (type >= OTA_PARTITION_MAX) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
+    ota_partition_info_t partition_info;
+    if (ota_get_partition_info(type, &partition_info) != OTA_OK) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
+    ota_image_header_t header;
+    if (flash_read(partition_info.start_address, &header, sizeof(ota_image_header_t)) != FLASH_OK) {
+        return OTA_ERROR_FLASH_ERROR;
+    }
+
+    ota_error_t err = ota_verify_image_header(&header);
+    if (err != OTA_OK) {
+        return err;
+    }
+
+    /* CRC32 and digest from the same flash reads */
+    bool hash = (public_key != NULL || digest != NULL);
+    uint32_t computed_crc = CRC32_INIT;
+    sha256_ctx_t sha;
+    if (hash) {
+        image_digest_begin(&sha, &header);
+    }
 
-        offset += chunk_size;
-        remaining -= chunk_size;
+    err = image_read(partition_info.start_address + sizeof(ota_image_header_t),
+                     header.image_size - sizeof(ota_image_header_t), &computed_crc, hash ? &sha : NULL);
+    if (err != OTA_OK) {
+        return err;
     }
 
-    os_free(buffer);
-    *crc32 = ~computed_crc;
+    if (crc32_final(computed_crc) != header.crc32) {
+        return OTA_ERROR_VERIFICATION_FAILED;
+    }
+
+    if (!hash) {
+        return OTA_OK;
+    }
+
+    uint8_t image_digest[OTA_DIGEST_SIZE];
+    sha256_final(&sha, image_digest);
+    if (digest != NULL) {
+        memcpy(digest, image_digest, OTA_DIGEST_SIZE);
+    }
+
+    if (public_key != NULL &&
+        !ed25519_verify(header.signature, image_digest, sizeof(image_digest), public_key)) {
+        return OTA_ERROR_VERIFICATION_FAILED;
+    }
 
     return OTA_OK;
 }
 
 ota_error_t ota_verify_signature(ota_partition_type_t type,
                                  const uint8_t *public_key, uint16_t key_len) {
-    /* Signature verification would use a crypto library (e.g., mbedTLS, TinyCrypt) */
-    /* This is a placeholder implementation */
-    (void)type;
-    (void)public_key;
-    (void)key_len;
+    if (public_key == NULL || key_len != OTA_PUBLIC_KEY_SIZE) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
 
-    /* TODO: Implement actual signature verification */
-    return OTA_OK;
+    return ota_verify_image(type, public_key, NULL);
 }
 
 /* ============================================================================
@@ -598,6 +1495,10 @@ ota_error_t ota_set_boot_partition(ota_partition_type_t type) {
         return OTA_ERROR_INVALID_PARAM;
     }
 
+    if (update_task_busy()) {
+        return OTA_ERROR_BUSY;
+    }
+
     ota_state.boot_info.pending_partition = type;
     ota_state.boot_info.boot_confirmed = false;
 
@@ -618,6 +1519,10 @@ ota_error_t ota_rollback(void) {
         return OTA_ERROR_NOT_INITIALIZED;
     }
 
+    if (update_task_busy()) {
+        return OTA_ERROR_BUSY;
+    }
+
     /* Swap partitions */
     ota_partition_type_t rollback_partition =
         (ota_state.running_partition == OTA_PARTITION_APP_A) ?
@@ -638,6 +1543,10 @@ ota_error_t ota_confirm_boot(void) {
         return OTA_ERROR_NOT_INITIALIZED;
     }
 
+    if (update_task_busy()) {
+        return OTA_ERROR_BUSY;
+    }
+
     ota_state.boot_info.boot_confirmed = true;
     ota_state.boot_info.active_partition = ota_state.running_partition;
 
@@ -676,7 +1585,9 @@ uint32_t ota_get_partition_version(ota_partition_type_t type) {
     }
 
     ota_partition_info_t partition_info;
-    ota_get_partition_info(type, &partition_info);
+    if (ota_get_partition_info(type, &partition_info) != OTA_OK) {
+        return 0;
+    }
 
     ota_image_header_t header;
     flash_error_t flash_err = flash_read(partition_info.start_address, &header, sizeof(ota_image_header_t));
@@ -766,6 +1677,10 @@ void ota_print_status(void) {
            ota_state.update_partition == OTA_PARTITION_APP_A ? "APP_A" : "APP_B");
     printf("Current State:     %s\n", ota_state_to_string(ota_state.progress.state));
     printf("Progress:          %d%%\n", ota_state.progress.progress_percent);
+    printf("Background Task:   %s\n", ota_state.task_running ? "Running" : "No");
+    if (ota_state.config.rate_limit != 0) {
+        printf("Rate Limit:        %lu bytes/s\n", (unsigned long)ota_state.config.rate_limit);
+    }
     printf("Boot Confirmed:    %s\n", ota_state.boot_info.boot_confirmed ? "Yes" : "No");
     printf("Boot Count:        %lu\n", ota_state.boot_info.boot_count);
     printf("Rollback Count:    %lu\n", ota_state.boot_info.rollback_count);
@@ -0,0 +1,359 @@
+/**
+ * @file ota_delta.c
+ * @brief Delta (Binary Patch) Firmware Update Implementation for TinyOS-RTOS
+ */
+
+#include "tinyos/ota_delta.h"
+#include "tinyos/net.h"
+#include "drivers/flash.h"
+#include <string.h>
+
+/* Patch parser states */
+typedef enum {
+    PATCH_HEADER,
+    PATCH_DIFF_LEN,
+    PATCH_EXTRA_LEN,
+    PATCH_SEEK,
+    PATCH_DIFF_TOKEN,
+    PATCH_DIFF_COPY,                /* Old bytes unchanged, no patch input */
+    PATCH_DIFF_ADD,                 /* Old bytes plus patch bytes */
+    PATCH_EXTRA,                    /* Patch bytes */
+    PATCH_DONE
+} patch_state_t;
+
+static struct {
+    bool active;
+    ota_error_t error;              /* Why the patch stopped */
+    patch_state_t state;
+    ota_patch_header_t header;
+    uint32_t header_bytes;
+    uint32_t varint;                /* Varint being decoded */
+    uint8_t varint_shift;
+    uint32_t diff_left;             /* Diff bytes left in this op */
+    uint32_t extra_left;            /* Extra bytes left in this op */
+    int32_t seek;
+    uint32_t run;                   /* Bytes left in this diff token */
+    uint32_t old_base;              /* Running partition start */
+    uint32_t old_pos;
+    uint32_t produced;              /* New image bytes produced */
+    uint32_t emitted;               /* New image bytes passed to the OTA stream */
+    uint32_t out_fill;
+    uint8_t out[OTA_PATCH_BUFFER_SIZE];
+} patch;
+
+/**
+ * @brief Abort the update on a bad patch
+ */
+static ota_error_t patch_fail(ota_error_t err) {
+    patch.active = false;
+    patch.error = err;
+    ota_abort_update();
+    return err;
+}
+
+/**
+ * @brief Pass the buffered reconstructed bytes to the OTA stream
+ */
+static ota_error_t patch_emit(void) {
+    if (patch.out_fill == 0) {
+        return OTA_OK;
+    }
+
+    /* On error the OTA stream has already failed the update */
+    ota_error_t err = ota_write_chunk(patch.out, patch.out_fill, patch.emitted);
+    patch.emitted += patch.out_fill;
+    patch.out_fill = 0;
+    if (err != OTA_OK) {
+        patch.active = false;
+        patch.error = err;
+    }
+    return err;
+}
+
+/**
+ * @brief Check the patch header against the running image
+ */
+static ota_error_t patch_check_header(void) {
+    ota_image_header_t old;
+
+    if (patch.header.magic != OTA_PATCH_MAGIC || patch.header.new_size < sizeof(ota_image_header_t)) {
+        return OTA_ERROR_INVALID_IMAGE;
+    }
+
+    if (flash_read(patch.old_base, &old, sizeof(old)) != FLASH_OK) {
+        return OTA_ERROR_FLASH_ERROR;
+    }
+
+    /* A patch only reproduces the new image from the exact base it was made against */
+    if (ota_verify_image_header(&old) != OTA_OK ||
+        old.image_size != patch.header.old_size || old.crc32 != patch.header.old_crc32) {
+        return OTA_ERROR_INVALID_IMAGE;
+    }
+
+    return OTA_OK;
+}
+
+/**
+ * @brief Accumulate one varint byte
+ * @return true when the varint is complete (value in patch.varint)
+ */
+static bool patch_varint(uint8_t byte, bool *overflow) {
+    if (patch.varint_shift == 0) {
+        patch.varint = 0;
+    }
+    if (patch.varint_shift > 28) {
+        *overflow = true;
+        return false;
+    }
+
+    patch.varint |= (uint32_t)(byte & 0x7F) << patch.varint_shift;
+    if (byte & 0x80) {
+        patch.varint_shift += 7;
+        return false;
+    }
+
+    patch.varint_shift = 0;
+    return true;
+}
+
+/**
+ * @brief Finish an op: apply the seek and start the next one
+ * @return false if the seek leaves the old image
+ */
+static bool patch_end_op(void) {
+    int64_t old_pos = (int64_t)patch.old_pos + patch.seek;
+    if (old_pos < 0 || old_pos > patch.header.old_size) {
+        return false;
+    }
+
+    patch.old_pos = (uint32_t)old_pos;
+    patch.state = (patch.produced == patch.header.new_size) ? PATCH_DONE : PATCH_DIFF_LEN;
+    return true;
+}
+
+/* ========== Public API ========== */
+
+ota_error_t ota_patch_begin(ota_progress_callback_t callback, void *user_data) {
+    ota_partition_info_t running;
+    ota_error_t err = ota_get_partition_info(ota_get_running_partition(), &running);
+    if (err != OTA_OK) {
+        return err;
+    }
+
+    err = ota_begin_update(callback, user_data);
+    if (err != OTA_OK) {
+        return err;
+    }
+
+    memset(&patch, 0, sizeof(patch));
+    patch.active = true;
+    patch.state = PATCH_HEADER;
+    patch.old_base = running.start_address;
+
+    return OTA_OK;
+}
+
+ota_error_t ota_patch_write(const uint8_t *data, uint32_t size) {
+    if (!patch.active || (data == NULL && size > 0)) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
+    ota_error_t err;
+    bool overflow = false;
+
+    while (size > 0 || patch.state == PATCH_DIFF_COPY) {
+        switch (patch.state) {
+        case PATCH_HEADER: {
+            uint32_t length = sizeof(patch.header) - patch.header_bytes;
+            if (length > size) {
+                length = size;
+            }
+            memcpy((uint8_t *)&patch.header + patch.header_bytes, data, length);
+            patch.header_bytes += length;
+            data += length;
+            size -= length;
+
+            if (patch.header_bytes == sizeof(patch.header)) {
+                err = patch_check_header();
+                if (err != OTA_OK) {
+                    return patch_fail(err);
+                }
+                patch.state = PATCH_DIFF_LEN;
+            }
+            break;
+        }
+
+        case PATCH_DIFF_LEN:
+        case PATCH_EXTRA_LEN:
+        case PATCH_SEEK:
+        case PATCH_DIFF_TOKEN:
+            size--;
+            if (!patch_varint(*data++, &overflow)) {
+                if (overflow) {
+                    return patch_fail(OTA_ERROR_INVALID_IMAGE);
+                }
+                break;
+            }
+
+            if (patch.state == PATCH_DIFF_LEN) {
+                patch.diff_left = patch.varint;
+                patch.state = PATCH_EXTRA_LEN;
+            } else if (patch.state == PATCH_EXTRA_LEN) {
+                patch.extra_left = patch.varint;
+                patch.state = PATCH_SEEK;
+            } else if (patch.state == PATCH_SEEK) {
+                patch.seek = (int32_t)(patch.varint >> 1) ^ -(int32_t)(patch.varint & 1);
+
+                /* The op must stay inside both images */
+                if (patch.diff_left > patch.header.old_size - patch.old_pos ||
+                    patch.diff_left > patch.header.new_size - patch.produced ||
+                    patch.extra_left > patch.header.new_size - patch.produced - patch.diff_left) {
+                    return patch_fail(OTA_ERROR_INVALID_IMAGE);
+                }
+
+                if (patch.diff_left > 0) {
+                    patch.state = PATCH_DIFF_TOKEN;
+                } else if (patch.extra_left > 0) {
+                    patch.state = PATCH_EXTRA;
+                } else if (!patch_end_op()) {
+                    return patch_fail(OTA_ERROR_INVALID_IMAGE);
+                }
+            } else {
+                patch.run = patch.varint >> 1;
+                if (patch.run == 0 || patch.run > patch.diff_left) {
+                    return patch_fail(OTA_ERROR_INVALID_IMAGE);
+                }
+                patch.state = (patch.varint & 1) ? PATCH_DIFF_ADD : PATCH_DIFF_COPY;
+            }
+            break;
+
+        case PATCH_DIFF_COPY:
+        case PATCH_DIFF_ADD:
+        case PATCH_EXTRA: {
+            uint32_t length = OTA_PATCH_BUFFER_SIZE - patch.out_fill;
+            uint32_t left = (patch.state == PATCH_EXTRA) ? patch.extra_left : patch.run;
+            if (length > left) {
+                length = left;
+            }
+            if (patch.state != PATCH_DIFF_COPY && length > size) {
+                length = size;
+            }
+
+            uint8_t *out = &patch.out[patch.out_fill];
+            if (patch.state == PATCH_EXTRA) {
+                memcpy(out, data, length);
+                patch.extra_left -= length;
+            } else {
+                if (flash_read(patch.old_base + patch.old_pos, out, length) != FLASH_OK) {
+                    return patch_fail(OTA_ERROR_FLASH_ERROR);
+                }
+                if (patch.state == PATCH_DIFF_ADD) {
+                    for (uint32_t i = 0; i < length; i++) {
+                        out[i] += data[i];
+                    }
+                }
+                patch.old_pos += length;
+                patch.diff_left -= length;
+                patch.run -= length;
+            }
+
+            if (patch.state != PATCH_DIFF_COPY) {
+                data += length;
+                size -= length;
+            }
+            patch.out_fill += length;
+            patch.produced += length;
+
+            if (patch.out_fill == OTA_PATCH_BUFFER_SIZE) {
+                err = patch_emit();
+                if (err != OTA_OK) {
+                    return err;
+                }
+            }
+
+            if (patch.state == PATCH_EXTRA) {
+                if (patch.extra_left == 0 && !patch_end_op()) {
+                    return patch_fail(OTA_ERROR_INVALID_IMAGE);
+                }
+            } else if (patch.run == 0) {
+                if (patch.diff_left > 0) {
+                    patch.state = PATCH_DIFF_TOKEN;
+                } else if (patch.extra_left > 0) {
+                    patch.state = PATCH_EXTRA;
+                } else if (!patch_end_op()) {
+                    return patch_fail(OTA_ERROR_INVALID_IMAGE);
+                }
+            }
+            break;
+        }
+
+        case PATCH_DONE:
+        default:
+            /* Trailing bytes after the last op */
+            return patch_fail(OTA_ERROR_INVALID_IMAGE);
+        }
+    }
+
+    return OTA_OK;
+}
+
+ota_error_t ota_patch_end(void) {
+    if (!patch.active) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
+    if (patch.state != PATCH_DONE) {
+        return patch_fail(OTA_ERROR_INVALID_IMAGE);
+    }
+
+    ota_error_t err = patch_emit();
+    if (err != OTA_OK) {
+        return err;
+    }
+    patch.active = false;
+
+    /* Length and CRC of the reconstructed image, as for a full download */
+    return ota_end_update();
+}
+
+/**
+ * @brief Body callback for net_http_get_stream(): apply the patch as it arrives
+ */
+static os_error_t patch_http_body(const uint8_t *data, uint32_t length, uint16_t status_code,
+                                  uint32_t content_length, void *user_data) {
+    (void)status_code;
+    (void)content_length;
+    (void)user_data;
+
+    return (ota_patch_write(data, length) == OTA_OK) ? OS_OK : OS_ERROR;
+}
+
+ota_error_t ota_start_patch_update(const char *url, ota_progress_callback_t callback, void *user_data) {
+    if (url == NULL) {
+        return OTA_ERROR_INVALID_PARAM;
+    }
+
+    ota_config_t config;
+    ota_error_t err = ota_get_config(&config);
+    if (err != OTA_OK) {
+        return err;
+    }
+
+    err = ota_patch_begin(callback, user_data);
+    if (err != OTA_OK) {
+        return err;
+    }
+
+    /*
+     * The parser state is not checkpointed, so a dropped patch download
+     * starts again from the beginning of the patch.
+     */
+    if (net_http_get_stream(url, NULL, patch_http_body, NULL, NULL, config.timeout_ms) != OS_OK) {
+        if (!patch.active) {
+            return patch.error;
+        }
+        return patch_fail(OTA_ERROR_DOWNLOAD_FAILED);
+    }
+
+    return ota_patch_end();
+}
@@ -0,0 +1,353 @@
+/**
+ * @file ota_compress.c
+ * @brief Host-side Image Compressor for TinyOS-RTOS OTA Updates
+ *
+ * Turns a firmware image (starting with an ota_image_header_t) into the
+ * compressed transport described in include/tinyos/ota.h:
+ *
+ *     ota_compress image.bin image.lz
+ *
+ * The header is copied with OTA_IMAGE_FLAG_COMPRESSED set and the payload
+ * follows as one LZ4 block. Size, CRC32 and signature are left as they
+ * are: they describe the image the device ends up with. The output is
+ * decompressed again in memory and compared before it is written.
+ *
+ * Matches are found through a hash chain and chosen greedily with one
+ * step of lazy evaluation. They only reach back into the payload, never
+ * into the header the device rewrites.
+ *
+ * Build with the host compiler: make tools
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Image header fields (ota_image_header_t offsets) */
+#define OTA_IMAGE_FLAGS_OFFSET  116
+#define OTA_IMAGE_HEADER_SIZE   136
+#define OTA_IMAGE_FLAG_COMPRESSED 0x00000001
+
+/* LZ4 block format */
+#define LZ_MIN_MATCH            4
+#define LZ_MAX_OFFSET           65535
+#define LZ_LAST_LITERALS        5           /* The block ends with at least this many literals */
+#define LZ_MATCH_LIMIT          12          /* No match starts closer than this to the end */
+
+/* Compressor tuning */
+#define OTA_COMPRESS_HASH_BITS  16
+#define OTA_COMPRESS_MAX_CHAIN  32          /* Candidates tried per position */
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t length;
+    bool overflow;
+} lz_writer_t;
+
+static void put_byte(lz_writer_t *w, uint8_t byte) {
+    if (w->length < w->size) {
+        w->data[w->length++] = byte;
+    } else {
+        w->overflow = true;
+    }
+}
+
+static void put_length(lz_writer_t *w, size_t length) {
+    for (; length >= 255; length -= 255) {
+        put_byte(w, 255);
+    }
+    put_byte(w, (uint8_t)length);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t lz_hash(const uint8_t *p) {
+    return (get_u32(p) * 2654435761U) >> (32 - OTA_COMPRESS_HASH_BITS);
+}
+
+/**
+ * @brief Write one sequence: literals, then a match unless match_length is 0
+ */
+static void lz_put_sequence(lz_writer_t *w, const uint8_t *literals, size_t literal_length,
+                            size_t offset, size_t match_length) {
+    size_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+
+    put_byte(w, (uint8_t)(((literal_length < 15 ? literal_length : 15) << 4) |
+                          (match_code < 15 ? match_code : 15)));
+    if (literal_length >= 15) {
+        put_length(w, literal_length - 15);
+    }
+    for (size_t i = 0; i < literal_length; i++) {
+        put_byte(w, literals[i]);
+    }
+
+    if (match_length) {
+        put_byte(w, (uint8_t)offset);
+        put_byte(w, (uint8_t)(offset >> 8));
+        if (match_code >= 15) {
+            put_length(w, match_code - 15);
+        }
+    }
+}
+
+/**
+ * @brief Add the positions before end to the hash chains
+ */
+static void lz_insert(const uint8_t *in, int32_t *head, int32_t *chain, size_t *hashed, size_t end) {
+    for (; *hashed < end; (*hashed)++) {
+        uint32_t h = lz_hash(in + *hashed);
+        chain[*hashed] = head[h];
+        head[h] = (int32_t)*hashed;
+    }
+}
+
+/**
+ * @brief Longest match for position i among the hash chain candidates
+ */
+static size_t lz_find(const uint8_t *in, size_t end, size_t i, const int32_t *head,
+                      const int32_t *chain, size_t *offset) {
+    size_t best = 0;
+    int tries = 0;
+
+    for (int32_t c = head[lz_hash(in + i)]; c >= 0 && tries < OTA_COMPRESS_MAX_CHAIN;
+         c = chain[c], tries++) {
+        if (i - (size_t)c > LZ_MAX_OFFSET) {
+            break;
+        }
+        size_t length = 0;
+        while (i + length < end && in[c + length] == in[i + length]) {
+            length++;
+        }
+        if (length > best) {
+            best = length;
+            *offset = i - (size_t)c;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief Compress an image into the OTA transport
+ * @param work Scratch space of OTA_COMPRESS_WORK_SIZE(size) bytes
+ * @return Output length, or 0 if the input is not an uncompressed image or out_size is too small
+ */
+#define OTA_COMPRESS_WORK_SIZE(size) \
+    ((((size_t)1 << OTA_COMPRESS_HASH_BITS) + (size)) * sizeof(int32_t))
+
+size_t ota_compress(const uint8_t *image, size_t size, uint8_t *out, size_t out_size, void *work) {
+    if (size < OTA_IMAGE_HEADER_SIZE || out_size < OTA_IMAGE_HEADER_SIZE ||
+        (get_u32(image + OTA_IMAGE_FLAGS_OFFSET) & OTA_IMAGE_FLAG_COMPRESSED)) {
+        return 0;
+    }
+
+    memcpy(out, image, OTA_IMAGE_HEADER_SIZE);
+    uint32_t flags = get_u32(image + OTA_IMAGE_FLAGS_OFFSET) | OTA_IMAGE_FLAG_COMPRESSED;
+    for (int i = 0; i < 4; i++) {
+        out[OTA_IMAGE_FLAGS_OFFSET + i] = (uint8_t)(flags >> (8 * i));
+    }
+
+    /* The payload alone: matches never reach into the header */
+    const uint8_t *in = image + OTA_IMAGE_HEADER_SIZE;
+    size_t length = size - OTA_IMAGE_HEADER_SIZE;
+    lz_writer_t w = { .data = out, .size = out_size, .length = OTA_IMAGE_HEADER_SIZE };
+
+    int32_t *head = (int32_t *)work;
+    int32_t *chain = head + ((size_t)1 << OTA_COMPRESS_HASH_BITS);
+    for (size_t i = 0; i < ((size_t)1 << OTA_COMPRESS_HASH_BITS); i++) {
+        head[i] = -1;
+    }
+
+    size_t anchor = 0, i = 0, hashed = 0;
+    size_t match_end = (length > LZ_LAST_LITERALS) ? length - LZ_LAST_LITERALS : 0;
+    size_t match_limit = (length > LZ_MATCH_LIMIT) ? length - LZ_MATCH_LIMIT : 0;
+
+    while (i < match_limit) {
+        lz_insert(in, head, chain, &hashed, i);
+
+        size_t offset = 0;
+        size_t best = lz_find(in, match_end, i, head, chain, &offset);
+        if (best < LZ_MIN_MATCH) {
+            i++;
+            continue;
+        }
+
+        /* Lazy step: prefer a longer match starting one byte later */
+        if (i + 1 < match_limit) {
+            size_t next_offset;
+            lz_insert(in, head, chain, &hashed, i + 1);
+            if (lz_find(in, match_end, i + 1, head, chain, &next_offset) > best + 1) {
+                i++;
+                continue;
+            }
+        }
+
+        lz_put_sequence(&w, in + anchor, i - anchor, offset, best);
+        i += best;
+        anchor = i;
+    }
+
+    /* Final literals (a block for an empty payload has no sequence at all) */
+    if (anchor < length) {
+        lz_put_sequence(&w, in + anchor, length - anchor, 0, 0);
+    }
+
+    return w.overflow ? 0 : w.length;
+}
+
+/**
+ * @brief Reference decompressor used to check the output
+ * @return Image length, or 0 if the stream is malformed
+ */
+size_t ota_decompress(const uint8_t *stream, size_t stream_size, uint8_t *out, size_t out_size) {
+    if (stream_size < OTA_IMAGE_HEADER_SIZE) {
+        return 0;
+    }
+
+    size_t size = get_u32(stream + 40);
+    if (size < OTA_IMAGE_HEADER_SIZE || size > out_size) {
+        return 0;
+    }
+
+    memcpy(out, stream, OTA_IMAGE_HEADER_SIZE);
+    uint32_t flags = get_u32(stream + OTA_IMAGE_FLAGS_OFFSET) & ~OTA_IMAGE_FLAG_COMPRESSED;
+    for (int i = 0; i < 4; i++) {
+        out[OTA_IMAGE_FLAGS_OFFSET + i] = (uint8_t)(flags >> (8 * i));
+    }
+
+    size_t p = OTA_IMAGE_HEADER_SIZE, produced = OTA_IMAGE_HEADER_SIZE;
+
+#define GET_LENGTH(v) do { \
+        uint8_t byte_; \
+        do { \
+            if (p >= stream_size) return 0; \
+            byte_ = stream[p++]; \
+            (v) += byte_; \
+        } while (byte_ == 255); \
+    } while (0)
+
+    while (produced < size) {
+        if (p >= stream_size) {
+            return 0;
+        }
+        uint8_t token = stream[p++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15) {
+            GET_LENGTH(literal_length);
+        }
+        if (literal_length > stream_size - p || literal_length > size - produced) {
+            return 0;
+        }
+        memcpy(out + produced, stream + p, literal_length);
+        produced += literal_length;
+        p += literal_length;
+        if (produced == size) {
+            break;
+        }
+
+        if (stream_size - p < 2) {
+            return 0;
+        }
+        size_t offset = stream[p] | ((size_t)stream[p + 1] << 8);
+        p += 2;
+        size_t match_length = (token & 0x0F) + LZ_MIN_MATCH;
+        if ((token & 0x0F) == 15) {
+            GET_LENGTH(match_length);
+        }
+        if (offset == 0 || offset > produced - OTA_IMAGE_HEADER_SIZE || match_length > size - produced) {
+            return 0;
+        }
+        for (size_t i = 0; i < match_length; i++, produced++) {
+            out[produced] = out[produced - offset];
+        }
+    }
+
+#undef GET_LENGTH
+
+    return (p == stream_size) ? produced : 0;
+}
+
+#ifndef OTA_COMPRESS_NO_MAIN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *data = malloc(length > 0 ? (size_t)length : 1);
+    if (data && fread(data, 1, (size_t)length, f) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *size = (size_t)length;
+    return data;
+}
+
+static double elapsed_ms(clock_t start) {
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s image.bin out.lz\n", argv[0]);
+        return 2;
+    }
+
+    size_t size;
+    uint8_t *image = read_file(argv[1], &size);
+    if (image == NULL) {
+        fprintf(stderr, "ota_compress: cannot read %s\n", argv[1]);
+        return 1;
+    }
+
+    size_t out_size = size + size / 255 + 16;     /* Worst case: all literals */
+    uint8_t *out = malloc(out_size);
+    uint8_t *check = malloc(size);
+    void *work = malloc(OTA_COMPRESS_WORK_SIZE(size));
+    if (out == NULL || check == NULL || work == NULL) {
+        fprintf(stderr, "ota_compress: out of memory\n");
+        return 1;
+    }
+
+    clock_t start = clock();
+    size_t length = ota_compress(image, size, out, out_size, work);
+    double compress_ms = elapsed_ms(start);
+    if (length == 0) {
+        fprintf(stderr, "ota_compress: %s is not an uncompressed firmware image\n", argv[1]);
+        return 1;
+    }
+
+    start = clock();
+    size_t rebuilt = ota_decompress(out, length, check, size);
+    double decompress_ms = elapsed_ms(start);
+    if (rebuilt != size || memcmp(check, image, size) != 0) {
+        fprintf(stderr, "ota_compress: output does not reproduce %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[2], "wb");
+    if (f == NULL || fwrite(out, 1, length, f) != length || fclose(f) != 0) {
+        fprintf(stderr, "ota_compress: cannot write %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("image %zu bytes, compressed %zu bytes (%.1f%%)\n", size, length, 100.0 * length / size);
+    printf("compress %.1f ms, decompress %.1f ms (host), verified\n", compress_ms, decompress_ms);
+    return 0;
+}
+
+#endif /* OTA_COMPRESS_NO_MAIN */
@@ -0,0 +1,392 @@
+/**
+ * @file ota_diff.c
+ * @brief Host-side Delta Patch Generator for TinyOS-RTOS OTA Updates
+ *
+ * Produces patches in the format described in include/tinyos/ota_delta.h
+ * from two firmware images (each starting with an ota_image_header_t):
+ *
+ *     ota_diff old.bin new.bin update.patch
+ *
+ * The patch is applied back onto old.bin in memory and compared with
+ * new.bin before it is written, and the sizes and times are printed.
+ *
+ * Matching follows bsdiff: exact seeds of OTA_DIFF_MIN_MATCH bytes are
+ * found through a hash chain over the old image, then extended forward
+ * as long as most bytes still agree. Code that moved keeps matching even
+ * though the addresses inside it changed; those changes become small,
+ * mostly-zero diff bytes, which the diff tokens store compactly.
+ *
+ * Build with the host compiler: make tools
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Patch format (see include/tinyos/ota_delta.h) */
+#define OTA_PATCH_MAGIC         0x44534F54  /* "TOSD" */
+#define OTA_PATCH_HEADER_SIZE   16
+
+/* Image header fields the patch header copies (ota_image_header_t offsets) */
+#define OTA_IMAGE_SIZE_OFFSET   40
+#define OTA_IMAGE_CRC32_OFFSET  44
+#define OTA_IMAGE_HEADER_SIZE   136
+
+/* Generator tuning */
+#define OTA_DIFF_MIN_MATCH      8           /* Exact seed length */
+#define OTA_DIFF_HASH_BITS      16
+#define OTA_DIFF_MAX_CHAIN      64          /* Candidates tried per position */
+#define OTA_DIFF_MAX_MISMATCH   64          /* Extension gives up after this many bytes without gain */
+#define OTA_DIFF_MIN_ZERO_RUN   4           /* Shorter unchanged runs stay inside literal runs */
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t length;
+    bool overflow;
+} patch_writer_t;
+
+static void put_byte(patch_writer_t *w, uint8_t byte) {
+    if (w->length < w->size) {
+        w->data[w->length++] = byte;
+    } else {
+        w->overflow = true;
+    }
+}
+
+static void put_u32(patch_writer_t *w, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        put_byte(w, (uint8_t)(value >> (8 * i)));
+    }
+}
+
+static void put_varint(patch_writer_t *w, uint32_t value) {
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        put_byte(w, byte | (value ? 0x80 : 0));
+    } while (value);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t diff_hash(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return (uint32_t)((v * 0x9E3779B97F4A7C15ULL) >> (64 - OTA_DIFF_HASH_BITS));
+}
+
+/**
+ * @brief Extend a match forward while most bytes agree (bsdiff scoring)
+ */
+static size_t diff_extend(const uint8_t *old, size_t old_size, size_t o,
+                          const uint8_t *new_image, size_t new_size, size_t n) {
+    long score = 0, best = 0;
+    size_t i = 0, best_length = 0;
+
+    while (o + i < old_size && n + i < new_size) {
+        score += (old[o + i] == new_image[n + i]) ? 1 : -1;
+        i++;
+        if (score > best) {
+            best = score;
+            best_length = i;
+        } else if (i - best_length > OTA_DIFF_MAX_MISMATCH) {
+            break;
+        }
+    }
+
+    return best_length;
+}
+
+/**
+ * @brief Encode the diff bytes of one op as copy/add tokens
+ */
+static void diff_encode(patch_writer_t *w, const uint8_t *old, const uint8_t *new_image, size_t length) {
+    size_t k = 0;
+
+    while (k < length) {
+        size_t zeros = 0;
+        while (k + zeros < length && old[k + zeros] == new_image[k + zeros]) {
+            zeros++;
+        }
+        if (zeros >= OTA_DIFF_MIN_ZERO_RUN || (zeros > 0 && k + zeros == length)) {
+            put_varint(w, (uint32_t)zeros << 1);
+            k += zeros;
+            continue;
+        }
+
+        /* Literal run, absorbing short unchanged stretches */
+        size_t j = k;
+        while (j < length) {
+            size_t z = 0;
+            while (j + z < length && old[j + z] == new_image[j + z]) {
+                z++;
+            }
+            if (z == 0) {
+                j++;
+            } else if (z >= OTA_DIFF_MIN_ZERO_RUN || j + z == length) {
+                break;
+            } else {
+                j += z;
+            }
+        }
+
+        put_varint(w, ((uint32_t)(j - k) << 1) | 1);
+        for (size_t i = k; i < j; i++) {
+            put_byte(w, (uint8_t)(new_image[i] - old[i]));
+        }
+        k = j;
+    }
+}
+
+static void diff_put_op(patch_writer_t *w, const uint8_t *old, const uint8_t *new_image,
+                        size_t diff_old, size_t diff_new, size_t diff_length,
+                        size_t extra_end, long seek, size_t *ops) {
+    size_t extra_start = diff_new + diff_length;
+    int32_t s = (int32_t)seek;
+
+    put_varint(w, (uint32_t)diff_length);
+    put_varint(w, (uint32_t)(extra_end - extra_start));
+    put_varint(w, ((uint32_t)s << 1) ^ (uint32_t)(s >> 31));
+    diff_encode(w, old + diff_old, new_image + diff_new, diff_length);
+    for (size_t i = extra_start; i < extra_end; i++) {
+        put_byte(w, new_image[i]);
+    }
+    (*ops)++;
+}
+
+/**
+ * @brief Generate a patch turning old into new_image
+ * @param work Scratch space of OTA_DIFF_WORK_SIZE(old_size) bytes
+ * @param ops Number of ops written (output, can be NULL)
+ * @return Patch length, or 0 if the images are invalid or patch_size is too small
+ */
+#define OTA_DIFF_WORK_SIZE(old_size) \
+    ((((size_t)1 << OTA_DIFF_HASH_BITS) + (old_size)) * sizeof(int32_t))
+
+size_t ota_diff_generate(const uint8_t *old, size_t old_size,
+                         const uint8_t *new_image, size_t new_size,
+                         uint8_t *patch, size_t patch_size, void *work, size_t *ops) {
+    if (old_size < OTA_IMAGE_HEADER_SIZE || new_size < OTA_IMAGE_HEADER_SIZE) {
+        return 0;
+    }
+
+    /* Hash chains over every position of the old image */
+    int32_t *head = (int32_t *)work;
+    int32_t *chain = head + ((size_t)1 << OTA_DIFF_HASH_BITS);
+    for (size_t i = 0; i < ((size_t)1 << OTA_DIFF_HASH_BITS); i++) {
+        head[i] = -1;
+    }
+    for (size_t i = 0; i + OTA_DIFF_MIN_MATCH <= old_size; i++) {
+        uint32_t h = diff_hash(old + i);
+        chain[i] = head[h];
+        head[h] = (int32_t)i;
+    }
+
+    patch_writer_t w = { .data = patch, .size = patch_size };
+    put_u32(&w, OTA_PATCH_MAGIC);
+    put_u32(&w, get_u32(old + OTA_IMAGE_SIZE_OFFSET));
+    put_u32(&w, get_u32(old + OTA_IMAGE_CRC32_OFFSET));
+    put_u32(&w, (uint32_t)new_size);
+
+    size_t op_count = 0;
+    size_t diff_old = 0, diff_new = 0, diff_length = 0;     /* Pending op */
+    size_t n = 0;
+
+    while (n + OTA_DIFF_MIN_MATCH <= new_size) {
+        /* Longest exact seed among the candidates */
+        size_t best_o = 0, best_length = 0;
+        int tries = 0;
+        for (int32_t c = head[diff_hash(new_image + n)]; c >= 0 && tries < OTA_DIFF_MAX_CHAIN;
+             c = chain[c], tries++) {
+            size_t length = 0;
+            while (c + length < old_size && n + length < new_size &&
+                   old[c + length] == new_image[n + length]) {
+                length++;
+            }
+            if (length > best_length) {
+                best_length = length;
+                best_o = (size_t)c;
+            }
+        }
+
+        if (best_length < OTA_DIFF_MIN_MATCH) {
+            n++;
+            continue;
+        }
+
+        /* Pull the match back over equal bytes still in the pending extras */
+        size_t o = best_o;
+        while (n > diff_new + diff_length && o > 0 && old[o - 1] == new_image[n - 1]) {
+            n--;
+            o--;
+        }
+
+        size_t length = diff_extend(old, old_size, o, new_image, new_size, n);
+        diff_put_op(&w, old, new_image, diff_old, diff_new, diff_length, n,
+                    (long)o - (long)(diff_old + diff_length), &op_count);
+
+        diff_old = o;
+        diff_new = n;
+        diff_length = length;
+        n += length;
+    }
+
+    diff_put_op(&w, old, new_image, diff_old, diff_new, diff_length, new_size, 0, &op_count);
+
+    if (ops) {
+        *ops = op_count;
+    }
+    return w.overflow ? 0 : w.length;
+}
+
+/**
+ * @brief Reference applier used to check a generated patch
+ * @return Reconstructed length, or 0 if the patch is malformed
+ */
+size_t ota_diff_apply(const uint8_t *old, size_t old_size, const uint8_t *patch, size_t patch_size,
+                      uint8_t *out, size_t out_size) {
+    size_t p = OTA_PATCH_HEADER_SIZE, produced = 0, old_pos = 0;
+
+    if (patch_size < OTA_PATCH_HEADER_SIZE || get_u32(patch) != OTA_PATCH_MAGIC) {
+        return 0;
+    }
+    size_t new_size = get_u32(patch + 12);
+    if (new_size > out_size) {
+        return 0;
+    }
+
+#define GET_VARINT(v) do { \
+        uint32_t shift_ = 0; (v) = 0; \
+        do { \
+            if (p >= patch_size || shift_ > 28) return 0; \
+            (v) |= (uint32_t)(patch[p] & 0x7F) << shift_; \
+            shift_ += 7; \
+        } while (patch[p++] & 0x80); \
+    } while (0)
+
+    while (produced < new_size) {
+        uint32_t diff_length, extra_length, zz;
+        GET_VARINT(diff_length);
+        GET_VARINT(extra_length);
+        GET_VARINT(zz);
+        long seek = (long)(int32_t)((zz >> 1) ^ -(zz & 1));
+
+        if (diff_length > old_size - old_pos || diff_length + (size_t)extra_length > new_size - produced) {
+            return 0;
+        }
+        for (uint32_t left = diff_length; left > 0;) {
+            uint32_t token;
+            GET_VARINT(token);
+            uint32_t run = token >> 1;
+            if (run == 0 || run > left || ((token & 1) && run > patch_size - p)) {
+                return 0;
+            }
+            for (uint32_t i = 0; i < run; i++) {
+                out[produced++] = old[old_pos++] + ((token & 1) ? patch[p++] : 0);
+            }
+            left -= run;
+        }
+        if (extra_length > patch_size - p) {
+            return 0;
+        }
+        memcpy(out + produced, patch + p, extra_length);
+        produced += extra_length;
+        p += extra_length;
+
+        if ((long)old_pos + seek < 0 || (long)old_pos + seek > (long)old_size) {
+            return 0;
+        }
+        old_pos = (size_t)((long)old_pos + seek);
+    }
+
+#undef GET_VARINT
+
+    return (p == patch_size) ? produced : 0;
+}
+
+#ifndef OTA_DIFF_NO_MAIN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *data = malloc(length > 0 ? (size_t)length : 1);
+    if (data && fread(data, 1, (size_t)length, f) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *size = (size_t)length;
+    return data;
+}
+
+static double elapsed_ms(clock_t start) {
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s old.bin new.bin out.patch\n", argv[0]);
+        return 2;
+    }
+
+    size_t old_size, new_size;
+    uint8_t *old = read_file(argv[1], &old_size);
+    uint8_t *new_image = read_file(argv[2], &new_size);
+    if (old == NULL || new_image == NULL) {
+        fprintf(stderr, "ota_diff: cannot read input images\n");
+        return 1;
+    }
+
+    size_t patch_size = new_size + new_size / 8 + 1024;    /* Worst case: all extras */
+    uint8_t *patch = malloc(patch_size);
+    uint8_t *check = malloc(new_size);
+    void *work = malloc(OTA_DIFF_WORK_SIZE(old_size));
+    if (patch == NULL || check == NULL || work == NULL) {
+        fprintf(stderr, "ota_diff: out of memory\n");
+        return 1;
+    }
+
+    size_t ops;
+    clock_t start = clock();
+    size_t length = ota_diff_generate(old, old_size, new_image, new_size, patch, patch_size, work, &ops);
+    double generate_ms = elapsed_ms(start);
+    if (length == 0) {
+        fprintf(stderr, "ota_diff: inputs are not firmware images\n");
+        return 1;
+    }
+
+    start = clock();
+    size_t rebuilt = ota_diff_apply(old, old_size, patch, length, check, new_size);
+    double apply_ms = elapsed_ms(start);
+    if (rebuilt != new_size || memcmp(check, new_image, new_size) != 0) {
+        fprintf(stderr, "ota_diff: patch does not reproduce %s\n", argv[2]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[3], "wb");
+    if (f == NULL || fwrite(patch, 1, length, f) != length || fclose(f) != 0) {
+        fprintf(stderr, "ota_diff: cannot write %s\n", argv[3]);
+        return 1;
+    }
+
+    printf("old %zu bytes, new %zu bytes, patch %zu bytes (%.1f%% of new), %zu ops\n",
+           old_size, new_size, length, 100.0 * length / new_size, ops);
+    printf("generate %.1f ms, apply %.1f ms (host), verified\n", generate_ms, apply_ms);
+    return 0;
+}
+
+#endif /* OTA_DIFF_NO_MAIN */
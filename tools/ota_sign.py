@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""
+Host-side Image Signing Tool for TinyOS-RTOS OTA Updates
+
+Signs firmware images (starting with an ota_image_header_t) with Ed25519,
+the scheme ota_verify_image() and the bootloader check:
+
+    ota_sign.py keygen signing.key         # new key, prints the public key
+    ota_sign.py pubkey signing.key         # public key as a C initializer
+    ota_sign.py sign signing.key app.bin   # fill in the header signature
+
+The signed message is the image digest: SHA-256 over the header with its
+signature field zeroed, followed by the payload. Sign after the crc32
+and every other header field are final; the delta generator (ota_diff)
+takes signed images, since the signature travels in the new header.
+
+The key file holds the 32-byte Ed25519 seed; keep it off the devices.
+Only the standard library is needed; Ed25519 follows RFC 8032 section 6.
+"""
+
+import hashlib
+import os
+import struct
+import sys
+
+# Image header layout (see include/tinyos/ota.h)
+OTA_MAGIC = 0x544F5346
+OTA_IMAGE_HEADER_SIZE = 136
+OTA_IMAGE_SIZE_OFFSET = 40
+OTA_SIGNATURE_OFFSET = 48
+OTA_SIGNATURE_SIZE = 64
+
+# ============================================================================
+# Ed25519 (RFC 8032)
+# ============================================================================
+
+P = 2**255 - 19
+L = 2**252 + 27742317777372353535851937790883648493
+D = -121665 * pow(121666, P - 2, P) % P
+SQRT_M1 = pow(2, (P - 1) // 4, P)
+
+
+def _add(p, q):
+    a = (p[1] - p[0]) * (q[1] - q[0]) % P
+    b = (p[1] + p[0]) * (q[1] + q[0]) % P
+    c = 2 * p[3] * q[3] * D % P
+    d = 2 * p[2] * q[2] % P
+    e, f, g, h = b - a, d - c, d + c, b + a
+    return (e * f % P, g * h % P, f * g % P, e * h % P)
+
+
+def _mul(s, p):
+    q = (0, 1, 1, 0)
+    while s > 0:
+        if s & 1:
+            q = _add(q, p)
+        p = _add(p, p)
+        s >>= 1
+    return q
+
+
+def _recover_x(y, sign):
+    x2 = (y * y - 1) * pow(D * y * y + 1, P - 2, P)
+    x = pow(x2, (P + 3) // 8, P)
+    if (x * x - x2) % P != 0:
+        x = x * SQRT_M1 % P
+    if (x & 1) != sign:
+        x = P - x
+    return x
+
+
+_BY = 4 * pow(5, P - 2, P) % P
+_BX = _recover_x(_BY, 0)
+BASE = (_BX, _BY, 1, _BX * _BY % P)
+
+
+def _encode(p):
+    zinv = pow(p[2], P - 2, P)
+    x, y = p[0] * zinv % P, p[1] * zinv % P
+    return int.to_bytes(y | ((x & 1) << 255), 32, "little")
+
+
+def _sha512_int(data):
+    return int.from_bytes(hashlib.sha512(data).digest(), "little")
+
+
+def _expand(seed):
+    h = hashlib.sha512(seed).digest()
+    a = int.from_bytes(h[:32], "little")
+    a &= (1 << 254) - 8
+    a |= 1 << 254
+    return a, h[32:]
+
+
+def public_key(seed):
+    a, _ = _expand(seed)
+    return _encode(_mul(a, BASE))
+
+
+def sign(seed, message):
+    a, prefix = _expand(seed)
+    pub = _encode(_mul(a, BASE))
+    r = _sha512_int(prefix + message) % L
+    rs = _encode(_mul(r, BASE))
+    k = _sha512_int(rs + pub + message) % L
+    s = (r + k * a) % L
+    return rs + int.to_bytes(s, 32, "little")
+
+
+# ============================================================================
+# Images
+# ============================================================================
+
+def image_digest(image):
+    header = bytearray(image[:OTA_IMAGE_HEADER_SIZE])
+    header[OTA_SIGNATURE_OFFSET:OTA_SIGNATURE_OFFSET + OTA_SIGNATURE_SIZE] = bytes(OTA_SIGNATURE_SIZE)
+    return hashlib.sha256(bytes(header) + image[OTA_IMAGE_HEADER_SIZE:]).digest()
+
+
+def sign_image(seed, image):
+    if len(image) < OTA_IMAGE_HEADER_SIZE or struct.unpack_from("<I", image, 0)[0] != OTA_MAGIC:
+        raise ValueError("not a firmware image")
+    if struct.unpack_from("<I", image, OTA_IMAGE_SIZE_OFFSET)[0] != len(image):
+        raise ValueError("image_size does not match the file length")
+
+    signed = bytearray(image)
+    signed[OTA_SIGNATURE_OFFSET:OTA_SIGNATURE_OFFSET + OTA_SIGNATURE_SIZE] = sign(seed, image_digest(image))
+    return bytes(signed)
+
+
+def c_array(key):
+    lines = []
+    for i in range(0, len(key), 8):
+        lines.append("    " + ", ".join("0x%02X" % b for b in key[i:i + 8]))
+    return "{\n" + ",\n".join(lines) + "\n}"
+
+
+def read_seed(path):
+    with open(path, "rb") as f:
+        seed = f.read()
+    if len(seed) != 32:
+        raise ValueError("%s is not a 32-byte Ed25519 seed" % path)
+    return seed
+
+
+def main(argv):
+    if len(argv) == 3 and argv[1] == "keygen":
+        seed = os.urandom(32)
+        fd = os.open(argv[2], os.O_WRONLY | os.O_CREAT | os.O_EXCL, 0o600)
+        with os.fdopen(fd, "wb") as f:
+            f.write(seed)
+        print(c_array(public_key(seed)))
+    elif len(argv) == 3 and argv[1] == "pubkey":
+        print(c_array(public_key(read_seed(argv[2]))))
+    elif len(argv) == 4 and argv[1] == "sign":
+        seed = read_seed(argv[2])
+        with open(argv[3], "rb") as f:
+            image = f.read()
+        signed = sign_image(seed, image)
+        with open(argv[3], "wb") as f:
+            f.write(signed)
+        print("signed %s, %d bytes, digest %s" % (argv[3], len(signed), image_digest(signed).hex()))
+    else:
+        sys.stderr.write(__doc__)
+        return 2
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main(sys.argv))
+    except (OSError, ValueError) as e:
+        sys.stderr.write("ota_sign: %s\n" % e)
+        sys.exit(1)